@@ -0,0 +1,360 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+// version of the tuning cache format
+#define TUNING_CACHE_VERSION 1
+
+// seed of the generator the synthetic inputs are drawn from, so tuning
+// leaves rand() alone
+#define AUTOTUNE_SEED 0x6175746f74756e65ull
+
+// settings that are fastest for one network shape on one machine
+typedef struct TunedConfig_ {
+    GemmBlocking blocking; // tiles of the built-in product kernel
+    int numThreads; // threads for chunked evaluation
+    size_t chunkRows; // rows per inference micro-batch
+    double rowsPerSecond; // evaluation throughput measured with these settings
+} TunedConfig;
+
+// times the built-in product kernel under candidate tile sizes on the
+// products of a forward pass of $network (skipped when a BLAS backend
+// does the products), then chunked evaluation under candidate micro-batch
+// sizes and thread counts of up to $maxThreads, and returns the fastest
+// settings found, which are left applied
+// verbose prints every candidate's time
+static TunedConfig autotuneNetwork(Network* network, int maxThreads, int verbose);
+
+// makes the settings current: the product kernel's tiles, and the chunk
+// rows and thread count as the evaluation defaults
+static void applyTunedConfig(TunedConfig* config);
+
+// writes the path of this host's tuning cache into $path: the value of
+// CRANIUM_TUNING_CACHE if set, and otherwise cranium-<host>.tune in
+// $XDG_CACHE_HOME or ~/.cache (created with CRANIUM_USE_POSIX), or the
+// working directory if neither is set
+static void tuningCachePath(char* path, size_t size);
+
+// looks up the settings stored at $path for the shape of $network and the
+// current BLAS backend, returning 0 if found and -1 otherwise, including
+// when the file was written on another host
+static int loadTunedConfig(const char* path, Network* network, TunedConfig* config);
+
+// stores $config at $path for the shape of $network and the current BLAS
+// backend, replacing any earlier entry for them; a cache from another host
+// is started afresh
+// returns 0 on success, and -1 if the file cannot be written
+static int saveTunedConfig(const char* path, Network* network, TunedConfig* config);
+
+// returns the settings cached at $path for $network if there are any, and
+// otherwise tunes and caches them; either way they are applied
+static TunedConfig tuneNetwork(Network* network, const char* path, int maxThreads, int verbose);
+
+
+/*
+    Begin functions.
+*/
+
+// best time of the forward products through every connection, the work
+// the tiles are tuned for
+static double timeProducts(Network* network, Matrix** activations){
+    int i;
+    double best = 1e30;
+    int repeat;
+    for (repeat = 0; repeat < 3; repeat++){
+        double start = monotonicSeconds();
+        for (i = 0; i < network->numConnections; i++){
+            multiplyInto(activations[i], network->connections[i]->weights, activations[i + 1]);
+        }
+        double seconds = monotonicSeconds() - start;
+        best = seconds < best ? seconds : best;
+    }
+    return best;
+}
+
+// a synthetic input in [-.5, .5) from the top 24 bits of a draw
+static float uniformInput(uint64_t* random){
+    return (randomBits(random) >> 40) * (1.0f / 16777216) - .5f;
+}
+
+TunedConfig autotuneNetwork(Network* network, int maxThreads, int verbose){
+    assert(maxThreads >= 1);
+    TunedConfig config;
+    memset(&config, 0, sizeof(config));
+    config.blocking = currentGemmBlocking();
+    size_t inputs = network->layers[0]->size, outputs = network->layers[network->numLayers - 1]->size;
+    size_t i, j;
+    int l;
+    uint64_t random = AUTOTUNE_SEED;
+
+    // tiles only matter while the built-in kernel does the products
+    if (currentBlasBackend()->sgemm == NULL){
+        size_t rows = 128;
+        Matrix* activations[network->numLayers];
+        for (l = 0; l < network->numLayers; l++){
+            activations[l] = createMatrixZeroes(rows, network->layers[l]->size);
+        }
+        for (j = 0; j < rows * inputs; j++){
+            activations[0]->data[j] = uniformInput(&random);
+        }
+        size_t rowBlocks[] = {8, 32, 128}, depthBlocks[] = {64, 256}, colBlocks[] = {64, 256, 1024};
+        double best = 1e30;
+        size_t r, d, c;
+        for (r = 0; r < 3; r++){
+            for (d = 0; d < 2; d++){
+                for (c = 0; c < 3; c++){
+                    GemmBlocking candidate = {rowBlocks[r], depthBlocks[d], colBlocks[c]};
+                    setGemmBlocking(candidate);
+                    double seconds = timeProducts(network, activations);
+                    if (verbose){
+                        printf("tiles %zu x %zu x %zu: %.3f ms\n", candidate.rowBlock, candidate.depthBlock, candidate.colBlock, seconds * 1e3);
+                    }
+                    if (seconds < best){
+                        best = seconds;
+                        config.blocking = candidate;
+                    }
+                }
+            }
+        }
+        for (l = 0; l < network->numLayers; l++){
+            destroyMatrix(activations[l]);
+        }
+    }
+    setGemmBlocking(config.blocking);
+
+    // synthetic rows, enough to give the largest micro-batch to every thread
+    size_t chunkSizes[] = {16, 32, 64, 128, 256, 512};
+    size_t numRows = 512 * (size_t)MAX(maxThreads, 4);
+    DataSet* data = createDataSetContiguous(numRows, inputs);
+    DataSet* classes = createDataSetContiguous(numRows, outputs);
+    for (i = 0; i < numRows; i++){
+        for (j = 0; j < inputs; j++){
+            data->data[i][j] = uniformInput(&random);
+        }
+        classes->data[i][randomBelow(&random, outputs)] = 1;
+    }
+    int threadCounts[32], numThreadCounts = 0, t;
+#ifdef CRANIUM_USE_POSIX
+    for (t = 1; t < maxThreads && numThreadCounts < 31; t *= 2){
+        threadCounts[numThreadCounts++] = t;
+    }
+    threadCounts[numThreadCounts++] = maxThreads;
+#else
+    threadCounts[numThreadCounts++] = 1;
+#endif
+    double bestSeconds = 1e30;
+    for (i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++){
+        for (t = 0; t < numThreadCounts; t++){
+            double best = 1e30;
+            int repeat;
+            for (repeat = 0; repeat < 2; repeat++){
+                double start = monotonicSeconds();
+                evaluateNetwork(network, data, classes, chunkSizes[i], threadCounts[t]);
+                double seconds = monotonicSeconds() - start;
+                best = seconds < best ? seconds : best;
+            }
+            if (verbose){
+                printf("%zu rows per micro-batch on %d threads: %.0f rows/s\n", chunkSizes[i], threadCounts[t], numRows / best);
+            }
+            if (best < bestSeconds){
+                bestSeconds = best;
+                config.chunkRows = chunkSizes[i];
+                config.numThreads = threadCounts[t];
+            }
+        }
+    }
+    config.rowsPerSecond = numRows / bestSeconds;
+    applyTunedConfig(&config);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    if (verbose){
+        printf("fastest: tiles %zu x %zu x %zu, %zu rows per micro-batch on %d threads, %.0f rows/s\n", config.blocking.rowBlock, config.blocking.depthBlock, config.blocking.colBlock, config.chunkRows, config.numThreads, config.rowsPerSecond);
+    }
+    return config;
+}
+
+void applyTunedConfig(TunedConfig* config){
+    setGemmBlocking(config->blocking);
+    EvaluationDefaults defaults = {config->chunkRows, config->numThreads};
+    setEvaluationDefaults(defaults);
+}
+
+void tuningCachePath(char* path, size_t size){
+    const char* explicitPath = getenv("CRANIUM_TUNING_CACHE");
+    if (explicitPath != NULL && explicitPath[0] != '\0'){
+        snprintf(path, size, "%s", explicitPath);
+        return;
+    }
+    char host[256] = "localhost";
+#ifdef CRANIUM_USE_POSIX
+    if (gethostname(host, sizeof(host)) != 0){
+        snprintf(host, sizeof(host), "localhost");
+    }
+    host[sizeof(host) - 1] = '\0';
+#endif
+    char directory[1024] = "";
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (cache != NULL && cache[0] != '\0'){
+        snprintf(directory, sizeof(directory), "%s/", cache);
+    }
+    else if (home != NULL && home[0] != '\0'){
+        snprintf(directory, sizeof(directory), "%s/.cache/", home);
+    }
+#ifdef CRANIUM_USE_POSIX
+    if (directory[0] != '\0'){
+        mkdir(directory, 0755);
+    }
+#endif
+    snprintf(path, size, "%scranium-%s.tune", directory, host);
+}
+
+// identifies the machine: its host name and CPU model, without spaces
+static void tuningHost(char* host, size_t size){
+    char name[256] = "localhost", model[256] = "unknown";
+#ifdef CRANIUM_USE_POSIX
+    if (gethostname(name, sizeof(name)) != 0){
+        snprintf(name, sizeof(name), "localhost");
+    }
+    name[sizeof(name) - 1] = '\0';
+#endif
+    FILE* fp = fopen("/proc/cpuinfo", "r");
+    if (fp != NULL){
+        char line[512];
+        while (fgets(line, sizeof(line), fp) != NULL){
+            char* colon = strchr(line, ':');
+            if (strncmp(line, "model name", 10) == 0 && colon != NULL){
+                snprintf(model, sizeof(model), "%s", colon + 1 + (colon[1] == ' '));
+                model[strcspn(model, "\n")] = '\0';
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    snprintf(host, size, "%s|%s", name, model);
+    char* c;
+    for (c = host; *c != '\0'; c++){
+        if (*c == ' ' || *c == '\n' || *c == '\t'){
+            *c = '_';
+        }
+    }
+}
+
+// the shape of $network and the current backend, without spaces
+static void tuningKey(Network* network, char* key, size_t size){
+    size_t length = 0;
+    int l;
+    for (l = 0; l < network->numLayers && length < size; l++){
+        length += snprintf(key + length, size - length, l == 0 ? "%zu" : "-%zu", network->layers[l]->size);
+    }
+    if (length < size){
+        snprintf(key + length, size - length, "@%s", currentBlasBackend()->name);
+    }
+    char* c;
+    for (c = key; *c != '\0'; c++){
+        if (*c == ' ' || *c == '\n' || *c == '\t'){
+            *c = '_';
+        }
+    }
+}
+
+// reads the entry lines of the cache at $path if it was written on this
+// host, returning their number and the lines in $lines, or -1
+static int readTuningCache(const char* path, char*** lines){
+    *lines = NULL;
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL){
+        return -1;
+    }
+    char line[2048], host[600], expected[600];
+    int version, numLines = 0;
+    tuningHost(expected, sizeof(expected));
+    if (fgets(line, sizeof(line), fp) == NULL || sscanf(line, "cranium-tuning %d", &version) != 1 || version != TUNING_CACHE_VERSION
+        || fgets(line, sizeof(line), fp) == NULL || sscanf(line, "host %599s", host) != 1 || strcmp(host, expected) != 0){
+        fclose(fp);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL){
+        *lines = (char**)realloc(*lines, sizeof(char*) * (numLines + 1));
+        (*lines)[numLines] = (char*)malloc(strlen(line) + 1);
+        strcpy((*lines)[numLines++], line);
+    }
+    fclose(fp);
+    return numLines;
+}
+
+static void freeTuningLines(char** lines, int numLines){
+    int i;
+    for (i = 0; i < numLines; i++){
+        free(lines[i]);
+    }
+    free(lines);
+}
+
+int loadTunedConfig(const char* path, Network* network, TunedConfig* config){
+    char key[1024], entryKey[1024];
+    tuningKey(network, key, sizeof(key));
+    char** lines;
+    int numLines = readTuningCache(path, &lines), i, found = -1;
+    for (i = 0; i < numLines && found != 0; i++){
+        TunedConfig entry;
+        if (sscanf(lines[i], "%1023s %zu %zu %zu %d %zu %lf", entryKey, &entry.blocking.rowBlock, &entry.blocking.depthBlock, &entry.blocking.colBlock, &entry.numThreads, &entry.chunkRows, &entry.rowsPerSecond) == 7
+            && strcmp(entryKey, key) == 0 && entry.blocking.rowBlock > 0 && entry.blocking.depthBlock > 0 && entry.blocking.colBlock > 0
+            && entry.numThreads >= 1 && entry.chunkRows > 0){
+            *config = entry;
+            found = 0;
+        }
+    }
+    freeTuningLines(lines, numLines);
+    return found;
+}
+
+int saveTunedConfig(const char* path, Network* network, TunedConfig* config){
+    char key[1024], entryKey[1024], host[600];
+    tuningKey(network, key, sizeof(key));
+    tuningHost(host, sizeof(host));
+    char** lines;
+    int numLines = readTuningCache(path, &lines), i;
+
+    // written beside the cache and renamed over it, so readers see either
+    // the old file or the new one
+    char temporary[1100];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE* fp = fopen(temporary, "w");
+    if (fp == NULL){
+        freeTuningLines(lines, MAX(numLines, 0));
+        return -1;
+    }
+    fprintf(fp, "cranium-tuning %d\nhost %s\n", TUNING_CACHE_VERSION, host);
+    for (i = 0; i < numLines; i++){
+        if (sscanf(lines[i], "%1023s", entryKey) == 1 && strcmp(entryKey, key) != 0){
+            fputs(lines[i], fp);
+        }
+    }
+    fprintf(fp, "%s %zu %zu %zu %d %zu %.1f\n", key, config->blocking.rowBlock, config->blocking.depthBlock, config->blocking.colBlock, config->numThreads, config->chunkRows, config->rowsPerSecond);
+    freeTuningLines(lines, MAX(numLines, 0));
+    int failed = fclose(fp) != 0;
+    if (failed || rename(temporary, path) != 0){
+        remove(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+TunedConfig tuneNetwork(Network* network, const char* path, int maxThreads, int verbose){
+    TunedConfig config;
+    if (loadTunedConfig(path, network, &config) == 0){
+        applyTunedConfig(&config);
+        return config;
+    }
+    config = autotuneNetwork(network, maxThreads, verbose);
+    saveTunedConfig(path, network, &config);
+    return config;
+}
+
+#endif
\ No newline at end of file
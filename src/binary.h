@@ -0,0 +1,389 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "half.h"
+#include "layer.h"
+#include "network.h"
+
+#ifndef BINARY_H
+#define BINARY_H
+
+#define BINARY_MAGIC "CRANIUM"
+#define BINARY_VERSION 2
+#define BINARY_ENDIANNESS 0x01020304u
+#define BINARY_ALIGNMENT 64
+
+// connection flags stored in the binary format
+#define BINARY_PRUNED 1u
+#define BINARY_FACTORIZED 2u
+
+// fixed-size header at the start of a binary network file
+// all integers and floats are stored in the byte order of the saving machine,
+// which $endianness (BINARY_ENDIANNESS as written) identifies
+typedef struct BinaryHeader_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianness;
+    uint64_t numLayers;
+    uint64_t tableSize; // bytes of layer and connection records after the header
+    uint64_t dataOffset; // start of the weight and bias blobs
+    uint64_t dataSize;
+    uint64_t dataChecksum; // checksum of the blobs
+    uint64_t headerChecksum; // checksum of the header (with this field 0) and records
+} BinaryHeader;
+
+// describes one layer
+typedef struct BinaryLayer_ {
+    uint64_t size;
+    char activation[24];
+} BinaryLayer;
+
+// describes one connection; offsets are from the start of the file and
+// are multiples of BINARY_ALIGNMENT, and the factor offsets are 0 unless
+// the connection is factorized
+typedef struct BinaryConnection_ {
+    uint32_t precision;
+    uint32_t flags;
+    uint64_t rank;
+    uint64_t weightsOffset;
+    uint64_t biasOffset;
+    uint64_t factorUOffset; // (from_size x rank) factor
+    uint64_t factorVOffset; // (rank x to_size) factor
+} BinaryConnection;
+
+// returns a 64 bit checksum of $size bytes at $data
+static uint64_t checksumBytes(const void* data, size_t size);
+
+// writes network to a binary file with aligned weight blobs
+// input stats are not stored, so they must be folded into the weights
+// returns 0 on success, -1 on failure
+static int saveNetworkBinary(Network* network, const char* path);
+
+// reads a network from a binary file into newly allocated weights,
+// verifying both checksums; returns NULL if the file is invalid
+static Network* readNetworkBinary(const char* path);
+
+// maps a binary file into memory and points the connection weights and
+// biases straight at it, so the weights are not read until used and pages
+// are shared by every process mapping the file; only the header checksum
+// is verified, since checking the data would touch every page
+// the mapping is private, so writing to the weights (e.g. training) copies
+// the touched pages instead of changing the file
+// without CRANIUM_USE_POSIX this is the same as readNetworkBinary
+static Network* mapNetwork(const char* path);
+
+
+/*
+    Begin functions.
+*/
+
+// FNV-1a over 8 byte words, then over the remaining bytes
+uint64_t checksumBytes(const void* data, size_t size){
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = 14695981039346656037ull;
+    size_t i;
+    for (i = 0; i + 8 <= size; i += 8){
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < size; i++){
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static size_t alignBinary(size_t offset){
+    return (offset + BINARY_ALIGNMENT - 1) / BINARY_ALIGNMENT * BINARY_ALIGNMENT;
+}
+
+static uint64_t checksumHeader(BinaryHeader* header, const unsigned char* tables){
+    BinaryHeader copy = *header;
+    copy.headerChecksum = 0;
+    uint64_t hash = checksumBytes(&copy, sizeof(BinaryHeader));
+    return hash ^ checksumBytes(tables, header->tableSize);
+}
+
+// blobs are laid out as all weights in connection order, then all biases,
+// then the U and V factors of each factorized connection
+int saveNetworkBinary(Network* network, const char* path){
+    if (network->featureMean != NULL && !network->normalizationFolded){
+        return -1;
+    }
+    size_t tableSize = sizeof(BinaryLayer) * network->numLayers + sizeof(BinaryConnection) * network->numConnections;
+    unsigned char* tables = (unsigned char*)calloc(1, tableSize);
+    BinaryLayer* layers = (BinaryLayer*)tables;
+    BinaryConnection* connections = (BinaryConnection*)(tables + sizeof(BinaryLayer) * network->numLayers);
+    int i;
+    for (i = 0; i < network->numLayers; i++){
+        layers[i].size = network->layers[i]->size;
+        strncpy(layers[i].activation, getFunctionName(network->layers[i]->activation), sizeof(layers[i].activation) - 1);
+    }
+    size_t offset = alignBinary(sizeof(BinaryHeader) + tableSize);
+    size_t dataOffset = offset;
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        connections[i].precision = con->precision;
+        connections[i].flags = (con->sparseWeights != NULL ? BINARY_PRUNED : 0) | (con->factorU != NULL ? BINARY_FACTORIZED : 0);
+        connections[i].rank = con->factorU != NULL ? con->factorU->cols : 0;
+        connections[i].weightsOffset = offset;
+        offset = alignBinary(offset + sizeof(float) * con->weights->rows * con->weights->cols);
+    }
+    for (i = 0; i < network->numConnections; i++){
+        connections[i].biasOffset = offset;
+        offset = alignBinary(offset + sizeof(float) * network->connections[i]->bias->cols);
+    }
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        if (con->factorU != NULL){
+            connections[i].factorUOffset = offset;
+            offset = alignBinary(offset + sizeof(float) * con->factorU->rows * con->factorU->cols);
+            connections[i].factorVOffset = offset;
+            offset = alignBinary(offset + sizeof(float) * con->factorV->rows * con->factorV->cols);
+        }
+    }
+
+    // assemble the blobs so they can be checksummed and written at once
+    size_t dataSize = offset - dataOffset;
+    unsigned char* data = (unsigned char*)calloc(1, dataSize);
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        memcpy(data + connections[i].weightsOffset - dataOffset, con->weights->data, sizeof(float) * con->weights->rows * con->weights->cols);
+        memcpy(data + connections[i].biasOffset - dataOffset, con->bias->data, sizeof(float) * con->bias->cols);
+        if (con->factorU != NULL){
+            memcpy(data + connections[i].factorUOffset - dataOffset, con->factorU->data, sizeof(float) * con->factorU->rows * con->factorU->cols);
+            memcpy(data + connections[i].factorVOffset - dataOffset, con->factorV->data, sizeof(float) * con->factorV->rows * con->factorV->cols);
+        }
+    }
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.endianness = BINARY_ENDIANNESS;
+    header.numLayers = network->numLayers;
+    header.tableSize = tableSize;
+    header.dataOffset = dataOffset;
+    header.dataSize = dataSize;
+    header.dataChecksum = checksumBytes(data, dataSize);
+    header.headerChecksum = checksumHeader(&header, tables);
+
+    int result = -1;
+    FILE* fp = fopen(path, "wb");
+    if (fp != NULL){
+        unsigned char padding[BINARY_ALIGNMENT] = {0};
+        size_t paddingSize = dataOffset - sizeof(BinaryHeader) - tableSize;
+        if (fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(tables, tableSize, 1, fp) == 1
+            && fwrite(padding, 1, paddingSize, fp) == paddingSize && fwrite(data, dataSize, 1, fp) == 1){
+            result = 0;
+        }
+        if (fclose(fp) != 0){
+            result = -1;
+        }
+    }
+    free(tables);
+    free(data);
+    return result;
+}
+
+// places $a * $b * $c into $product, returning 0 if it overflows
+static int multiplyChecked(uint64_t a, uint64_t b, uint64_t c, uint64_t* product){
+    if ((b != 0 && a > UINT64_MAX / b) || (c != 0 && a * b > UINT64_MAX / c)){
+        return 0;
+    }
+    *product = a * b * c;
+    return 1;
+}
+
+// returns whether the $length bytes at $offset are aligned and lie within
+// the $dataSize bytes at $dataOffset, which must themselves be in the file
+static int blobInside(uint64_t offset, uint64_t length, BinaryHeader* header){
+    return offset % BINARY_ALIGNMENT == 0 && offset >= header->dataOffset
+        && offset - header->dataOffset <= header->dataSize && length <= header->dataSize - (offset - header->dataOffset);
+}
+
+// checks the header and records of a file of $fileSize bytes, returning a
+// pointer to the records or NULL if anything is inconsistent; every size
+// and offset is checked without overflow, so the records can be trusted
+static const unsigned char* validateBinary(BinaryHeader* header, const unsigned char* file, size_t fileSize){
+    if (fileSize < sizeof(BinaryHeader)){
+        return NULL;
+    }
+    memcpy(header, file, sizeof(BinaryHeader));
+    if (memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 || header->version != BINARY_VERSION){
+        return NULL;
+    }
+    if (header->endianness != BINARY_ENDIANNESS || header->numLayers < 2){
+        return NULL;
+    }
+
+    // bounding the layer count by the file keeps the table size from overflowing
+    uint64_t recordSize = sizeof(BinaryLayer) + sizeof(BinaryConnection);
+    if (header->numLayers > fileSize / recordSize + 1){
+        return NULL;
+    }
+    uint64_t expectedTable = recordSize * header->numLayers - sizeof(BinaryConnection);
+    if (header->tableSize != expectedTable || header->tableSize > fileSize - sizeof(BinaryHeader)){
+        return NULL;
+    }
+    if (header->dataOffset % BINARY_ALIGNMENT != 0 || header->dataOffset > fileSize || header->dataSize > fileSize - header->dataOffset){
+        return NULL;
+    }
+    const unsigned char* tables = file + sizeof(BinaryHeader);
+    if (checksumHeader(header, tables) != header->headerChecksum){
+        return NULL;
+    }
+
+    // every layer must be non-empty and every blob must lie inside the data section
+    const BinaryLayer* layers = (const BinaryLayer*)tables;
+    const BinaryConnection* connections = (const BinaryConnection*)(tables + sizeof(BinaryLayer) * header->numLayers);
+    size_t i;
+    for (i = 0; i < header->numLayers; i++){
+        if (layers[i].size == 0){
+            return NULL;
+        }
+    }
+    for (i = 0; i < header->numLayers - 1; i++){
+        const BinaryConnection* record = &connections[i];
+        uint64_t weightsSize, biasSize;
+        if (record->precision > BFLOAT16 || (record->flags & ~(BINARY_PRUNED | BINARY_FACTORIZED)) != 0){
+            return NULL;
+        }
+        if (!multiplyChecked(sizeof(float), layers[i].size, layers[i + 1].size, &weightsSize) || !multiplyChecked(sizeof(float), layers[i + 1].size, 1, &biasSize)){
+            return NULL;
+        }
+        if (!blobInside(record->weightsOffset, weightsSize, header) || !blobInside(record->biasOffset, biasSize, header)){
+            return NULL;
+        }
+        if (!(record->flags & BINARY_FACTORIZED)){
+            continue;
+        }
+        uint64_t factorUSize, factorVSize;
+        if (record->rank == 0 || record->rank > layers[i].size || record->rank > layers[i + 1].size){
+            return NULL;
+        }
+        if (!multiplyChecked(sizeof(float), layers[i].size, record->rank, &factorUSize) || !multiplyChecked(sizeof(float), record->rank, layers[i + 1].size, &factorVSize)){
+            return NULL;
+        }
+        if (!blobInside(record->factorUOffset, factorUSize, header) || !blobInside(record->factorVOffset, factorVSize, header)){
+            return NULL;
+        }
+    }
+    return tables;
+}
+
+// builds the network described by validated records; weights and biases
+// point into $file if $external is non-zero, and are copied otherwise
+// factors are always copied, being small and rewritten by training
+static Network* networkFromBinary(BinaryHeader* header, const unsigned char* tables, unsigned char* file, int external){
+    const BinaryLayer* layers = (const BinaryLayer*)tables;
+    const BinaryConnection* records = (const BinaryConnection*)(tables + sizeof(BinaryLayer) * header->numLayers);
+    size_t numLayers = header->numLayers;
+    size_t* layerSizes = (size_t*)malloc(sizeof(size_t) * numLayers);
+    Activation* funcs = (Activation*)malloc(sizeof(Activation) * (numLayers - 1));
+    char name[sizeof(layers[0].activation) + 1];
+    size_t i;
+    for (i = 0; i < numLayers; i++){
+        layerSizes[i] = layers[i].size;
+        if (i > 0){
+            memcpy(name, layers[i].activation, sizeof(layers[i].activation));
+            name[sizeof(layers[i].activation)] = '\0';
+            funcs[i - 1] = getFunctionByName(name);
+        }
+    }
+    Network* network = allocateNetwork(numLayers, layerSizes, funcs);
+    free(layerSizes);
+    free(funcs);
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        float* weights = (float*)(file + records[i].weightsOffset);
+        float* bias = (float*)(file + records[i].biasOffset);
+        if (external){
+            con->weights->data = weights;
+            con->bias->data = bias;
+            con->external = 1;
+        }
+        else{
+            memcpy(con->weights->data, weights, sizeof(float) * con->weights->rows * con->weights->cols);
+            memcpy(con->bias->data, bias, sizeof(float) * con->bias->cols);
+        }
+        Matrix* factorU = NULL;
+        Matrix* factorV = NULL;
+        if (records[i].flags & BINARY_FACTORIZED){
+            factorU = createMatrixZeroes(con->weights->rows, records[i].rank);
+            factorV = createMatrixZeroes(records[i].rank, con->weights->cols);
+            memcpy(factorU->data, file + records[i].factorUOffset, sizeof(float) * factorU->rows * factorU->cols);
+            memcpy(factorV->data, file + records[i].factorVOffset, sizeof(float) * factorV->rows * factorV->cols);
+        }
+        restoreConnection(con, (PRECISION)records[i].precision, records[i].flags & BINARY_PRUNED, factorU, factorV);
+    }
+
+    // mapped weights leave the arena unused
+    if (external){
+        free(network->parameterBlock);
+        network->parameterBlock = NULL;
+        network->parameters = NULL;
+        network->numParameters = 0;
+    }
+    return network;
+}
+
+Network* readNetworkBinary(const char* path){
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL){
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (fileSize <= 0){
+        fclose(fp);
+        return NULL;
+    }
+    unsigned char* file = (unsigned char*)malloc(fileSize);
+    size_t read = fread(file, 1, fileSize, fp);
+    fclose(fp);
+
+    Network* network = NULL;
+    BinaryHeader header;
+    const unsigned char* tables = validateBinary(&header, file, read);
+    if (tables != NULL && checksumBytes(file + header.dataOffset, header.dataSize) == header.dataChecksum){
+        network = networkFromBinary(&header, tables, file, 0);
+    }
+    free(file);
+    return network;
+}
+
+Network* mapNetwork(const char* path){
+#ifdef CRANIUM_USE_POSIX
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0){
+        close(fd);
+        return NULL;
+    }
+    size_t fileSize = info.st_size;
+    void* mapping = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED){
+        return NULL;
+    }
+    BinaryHeader header;
+    const unsigned char* tables = validateBinary(&header, (unsigned char*)mapping, fileSize);
+    if (tables == NULL){
+        munmap(mapping, fileSize);
+        return NULL;
+    }
+    Network* network = networkFromBinary(&header, tables, (unsigned char*)mapping, 1);
+    network->mapping = mapping;
+    network->mappingSize = fileSize;
+    return network;
+#else
+    return readNetworkBinary(path);
+#endif
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+#include "binary.h"
+#include "optimizer.h"
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#define CHECKPOINT_MAGIC "CRANCKPT"
+#define CHECKPOINT_VERSION 4
+
+// header of a checkpoint file, followed by the shape of every connection
+// (rows, columns and rank as uint64s, rank 0 if not factorized), then the
+// network's parameter arena and the matching momentum arena as floats, then
+// U, V and their momentum for each factorized connection as floats, then the
+// shuffled row order as uint64s
+// parameters are always stored with the input stats unfolded, which is how
+// training steps them
+typedef struct CheckpointHeader_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianness;
+    uint32_t numConnections;
+    uint32_t normalizationFolded; // if non-zero, the stats are folded outside training
+    uint64_t epoch;
+    uint64_t batch;
+    uint64_t random;
+    uint64_t numRows;
+    uint64_t checksum; // of everything after the header
+} CheckpointHeader;
+
+// writes snapshots of a training state to disk
+// snapshots are taken into whichever of two buffers is not being written,
+// and written out on a background thread with CRANIUM_USE_POSIX
+typedef struct Checkpointer_ {
+    char* path;
+    int interval;
+    size_t size;
+    unsigned char* buffers[2];
+    int pending; // buffer waiting to be written, or -1
+    int writing; // buffer being written, or -1
+    int failures;
+#ifdef CRANIUM_USE_POSIX
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int stopping;
+#endif
+} Checkpointer;
+
+// writes the network and optimizer state of $state to $path
+// the file is written to $path.tmp and then renamed, so $path always holds
+// a complete checkpoint
+// returns 0 on success, -1 on failure
+static int saveCheckpoint(TrainingState* state, const char* path);
+
+// restores the network and optimizer state saved at $path into $state,
+// whose network must have the same shape
+// a network saved with its input stats folded must have stats; it is
+// restored unfolded and folded again when the next run (or $state) ends
+// returns 0 on success, 1 if there is no file to open at $path, and -1 if
+// the file is corrupt, truncated or of another shape, leaving $state as is
+static int loadCheckpoint(TrainingState* state, const char* path);
+
+// checkpoints $state to $path after every $interval steps without waiting
+// for the write
+static void enableCheckpoints(TrainingState* state, const char* path, int interval);
+
+// waits for outstanding checkpoint writes and stops checkpointing
+// returns the number of writes that failed
+static int disableCheckpoints(TrainingState* state);
+
+// optimizes given parameters, first resuming from the checkpoint at $path
+// if there is one, then checkpointing every $interval steps and at the end
+// a job rerun after being stopped continues exactly where it was saved
+// returns 0 on success, -1 without training or touching the file if the
+// checkpoint at $path is invalid, and -1 if any checkpoint failed to write
+static int optimizeWithCheckpoints(ParameterSet params, const char* path, int interval);
+
+
+/*
+    Begin functions.
+*/
+
+// bytes of a checkpoint of $state after the header
+static size_t checkpointPayloadSize(TrainingState* state){
+    Network* network = state->network;
+    size_t size = sizeof(uint64_t) * 3 * network->numConnections;
+    size += sizeof(float) * 2 * network->numParameters;
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        if (con->factorU != NULL){
+            size += sizeof(float) * 2 * (con->factorU->rows * con->factorU->cols + con->factorV->rows * con->factorV->cols);
+        }
+    }
+    return size + sizeof(uint64_t) * state->numRows;
+}
+
+// copies $count floats of $values to $out, or zeroes if $values is NULL,
+// returning the end of what was written
+static unsigned char* snapshotValues(unsigned char* out, const float* values, size_t count){
+    if (values != NULL){
+        memcpy(out, values, sizeof(float) * count);
+    }
+    else{
+        memset(out, 0, sizeof(float) * count);
+    }
+    return out + sizeof(float) * count;
+}
+
+// copies $state into $buffer in the checkpoint layout
+static void snapshotTrainingState(TrainingState* state, unsigned char* buffer){
+    Network* network = state->network;
+    CheckpointHeader* header = (CheckpointHeader*)buffer;
+    memset(header, 0, sizeof(CheckpointHeader));
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->endianness = BINARY_ENDIANNESS;
+    header->numConnections = network->numConnections;
+    header->normalizationFolded = network->normalizationFolded || state->refold;
+    header->epoch = state->epoch;
+    header->batch = state->batch;
+    header->random = state->random;
+    header->numRows = state->numRows;
+
+    unsigned char* out = buffer + sizeof(CheckpointHeader);
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        uint64_t shape[3] = {con->weights->rows, con->weights->cols, con->factorU != NULL ? con->factorU->cols : 0};
+        memcpy(out, shape, sizeof(shape));
+        out += sizeof(shape);
+    }
+    assert(isNetworkFlat(network));
+    float* parameters = (float*)out;
+    out = snapshotValues(out, network->parameters, network->numParameters);
+    out = snapshotValues(out, state->velocity, network->numParameters);
+    float* firstFactor = network->connections[0]->factorU != NULL ? (float*)out : NULL;
+
+    // factors have no momentum until their first step
+    for (i = 0; i < network->numConnections; i++){
+        Matrix* U = network->connections[i]->factorU;
+        Matrix* V = network->connections[i]->factorV;
+        if (U != NULL){
+            int stepped = state->dUi[i] != NULL && state->dUi[i]->rows == U->rows && state->dUi[i]->cols == U->cols && state->dVi[i]->cols == V->cols;
+            out = snapshotValues(out, U->data, U->rows * U->cols);
+            out = snapshotValues(out, V->data, V->rows * V->cols);
+            out = snapshotValues(out, stepped ? state->dUi_last[i]->data : NULL, U->rows * U->cols);
+            out = snapshotValues(out, stepped ? state->dVi_last[i]->data : NULL, V->rows * V->cols);
+        }
+    }
+    if (network->normalizationFolded){
+        Connection* first = network->connections[0];
+        unfoldValues(network, parameters + (first->weights->data - network->parameters), parameters + (first->bias->data - network->parameters), firstFactor);
+    }
+    size_t j;
+    for (j = 0; j < state->numRows; j++){
+        uint64_t row = state->order[j];
+        memcpy(out, &row, sizeof(row));
+        out += sizeof(row);
+    }
+    header->checksum = checksumBytes(buffer + sizeof(CheckpointHeader), out - buffer - sizeof(CheckpointHeader));
+}
+
+// writes a snapshot to $path through a temporary file
+static int writeSnapshot(const unsigned char* buffer, size_t size, const char* path){
+    char* temporary = (char*)malloc(strlen(path) + 5);
+    sprintf(temporary, "%s.tmp", path);
+    FILE* fp = fopen(temporary, "wb");
+    if (fp == NULL){
+        free(temporary);
+        return -1;
+    }
+    int ok = fwrite(buffer, 1, size, fp) == size;
+    ok = ok && fflush(fp) == 0;
+#ifdef CRANIUM_USE_POSIX
+    ok = ok && fsync(fileno(fp)) == 0;
+#endif
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(temporary, path) != 0){
+        remove(temporary);
+        free(temporary);
+        return -1;
+    }
+    free(temporary);
+    return 0;
+}
+
+int saveCheckpoint(TrainingState* state, const char* path){
+    size_t size = sizeof(CheckpointHeader) + checkpointPayloadSize(state);
+    unsigned char* buffer = (unsigned char*)malloc(size);
+    snapshotTrainingState(state, buffer);
+    int result = writeSnapshot(buffer, size, path);
+    free(buffer);
+    return result;
+}
+
+int loadCheckpoint(TrainingState* state, const char* path){
+    Network* network = state->network;
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL){
+        return 1;
+    }
+    CheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CHECKPOINT_VERSION || header.endianness != BINARY_ENDIANNESS
+        || header.numConnections != network->numConnections || header.numRows > ((uint64_t)1 << 40)
+        || (header.normalizationFolded && network->featureMean == NULL)){
+        fclose(fp);
+        return -1;
+    }
+
+    // read the payload as a state with this many rows would lay it out
+    size_t savedRows = state->numRows;
+    state->numRows = header.numRows;
+    size_t size = checkpointPayloadSize(state);
+    state->numRows = savedRows;
+    unsigned char* payload = (unsigned char*)malloc(size > 0 ? size : 1);
+    int valid = fread(payload, 1, size, fp) == size && fgetc(fp) == EOF && checksumBytes(payload, size) == header.checksum;
+    fclose(fp);
+    const unsigned char* in = payload;
+    int i;
+    for (i = 0; valid && i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        uint64_t shape[3];
+        memcpy(shape, in, sizeof(shape));
+        in += sizeof(shape);
+        valid = shape[0] == con->weights->rows && shape[1] == con->weights->cols && shape[2] == (con->factorU != NULL ? con->factorU->cols : 0);
+    }
+    if (!valid){
+        free(payload);
+        return -1;
+    }
+
+    // the shapes match, so the arenas have the same layout
+    network->normalizationFolded = 0;
+    state->refold = header.normalizationFolded != 0;
+    memcpy(network->parameters, in, sizeof(float) * network->numParameters);
+    in += sizeof(float) * network->numParameters;
+    memcpy(state->velocity, in, sizeof(float) * network->numParameters);
+    in += sizeof(float) * network->numParameters;
+    for (i = 0; i < network->numConnections; i++){
+        Matrix* U = network->connections[i]->factorU;
+        Matrix* V = network->connections[i]->factorV;
+        if (U != NULL){
+            prepareFactorBuffers(state, i);
+            Matrix* values[4] = {U, V, state->dUi_last[i], state->dVi_last[i]};
+            int k;
+            for (k = 0; k < 4; k++){
+                memcpy(values[k]->data, in, sizeof(float) * values[k]->rows * values[k]->cols);
+                in += sizeof(float) * values[k]->rows * values[k]->cols;
+            }
+        }
+        refreshConnection(network->connections[i]);
+    }
+    free(state->order);
+    state->numRows = header.numRows;
+    state->order = header.numRows > 0 ? (size_t*)malloc(sizeof(size_t) * header.numRows) : NULL;
+    size_t j;
+    for (j = 0; j < header.numRows; j++){
+        uint64_t row;
+        memcpy(&row, in, sizeof(row));
+        in += sizeof(row);
+        state->order[j] = row;
+    }
+    state->epoch = header.epoch;
+    state->batch = header.batch;
+    state->random = header.random;
+    free(payload);
+    return 0;
+}
+
+#ifdef CRANIUM_USE_POSIX
+// writes whichever snapshot is pending until asked to stop
+static void* runCheckpointWriter(void* arg){
+    Checkpointer* checkpointer = (Checkpointer*)arg;
+    pthread_mutex_lock(&checkpointer->lock);
+    while (1){
+        while (checkpointer->pending < 0 && !checkpointer->stopping){
+            pthread_cond_wait(&checkpointer->changed, &checkpointer->lock);
+        }
+        if (checkpointer->pending < 0){
+            break;
+        }
+        int buffer = checkpointer->pending;
+        checkpointer->pending = -1;
+        checkpointer->writing = buffer;
+        pthread_mutex_unlock(&checkpointer->lock);
+        int result = writeSnapshot(checkpointer->buffers[buffer], checkpointer->size, checkpointer->path);
+        pthread_mutex_lock(&checkpointer->lock);
+        checkpointer->writing = -1;
+        checkpointer->failures += result != 0;
+        pthread_cond_broadcast(&checkpointer->changed);
+    }
+    pthread_mutex_unlock(&checkpointer->lock);
+    return NULL;
+}
+#endif
+
+// step callback that snapshots every interval steps
+static void checkpointStep(TrainingState* state, void* context){
+    Checkpointer* checkpointer = (Checkpointer*)context;
+    if ((state->epoch - 1) % checkpointer->interval != 0){
+        return;
+    }
+    if (checkpointer->size == 0){
+        // the row order exists once training has started
+        checkpointer->size = sizeof(CheckpointHeader) + checkpointPayloadSize(state);
+        checkpointer->buffers[0] = (unsigned char*)malloc(checkpointer->size);
+        checkpointer->buffers[1] = (unsigned char*)malloc(checkpointer->size);
+    }
+#ifdef CRANIUM_USE_POSIX
+    // a newer snapshot replaces one still waiting, never one being written
+    pthread_mutex_lock(&checkpointer->lock);
+    int buffer = checkpointer->writing == 0 ? 1 : 0;
+    if (checkpointer->pending == buffer){
+        checkpointer->pending = -1;
+    }
+    pthread_mutex_unlock(&checkpointer->lock);
+    snapshotTrainingState(state, checkpointer->buffers[buffer]);
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpointer->pending = buffer;
+    pthread_cond_broadcast(&checkpointer->changed);
+    pthread_mutex_unlock(&checkpointer->lock);
+#else
+    snapshotTrainingState(state, checkpointer->buffers[0]);
+    checkpointer->failures += writeSnapshot(checkpointer->buffers[0], checkpointer->size, checkpointer->path) != 0;
+#endif
+}
+
+void enableCheckpoints(TrainingState* state, const char* path, int interval){
+    assert(interval >= 1 && state->stepCallback == NULL);
+    Checkpointer* checkpointer = (Checkpointer*)malloc(sizeof(Checkpointer));
+    checkpointer->path = (char*)malloc(strlen(path) + 1);
+    strcpy(checkpointer->path, path);
+    checkpointer->interval = interval;
+    checkpointer->size = 0;
+    checkpointer->buffers[0] = NULL;
+    checkpointer->buffers[1] = NULL;
+    checkpointer->pending = -1;
+    checkpointer->writing = -1;
+    checkpointer->failures = 0;
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_init(&checkpointer->lock, NULL);
+    pthread_cond_init(&checkpointer->changed, NULL);
+    checkpointer->stopping = 0;
+    pthread_create(&checkpointer->writer, NULL, runCheckpointWriter, checkpointer);
+#endif
+    state->stepCallback = checkpointStep;
+    state->stepContext = checkpointer;
+}
+
+int disableCheckpoints(TrainingState* state){
+    Checkpointer* checkpointer = (Checkpointer*)state->stepContext;
+    if (state->stepCallback != checkpointStep){
+        return 0;
+    }
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpointer->stopping = 1;
+    pthread_cond_broadcast(&checkpointer->changed);
+    pthread_mutex_unlock(&checkpointer->lock);
+    pthread_join(checkpointer->writer, NULL);
+    pthread_mutex_destroy(&checkpointer->lock);
+    pthread_cond_destroy(&checkpointer->changed);
+#endif
+    int failures = checkpointer->failures;
+    free(checkpointer->buffers[0]);
+    free(checkpointer->buffers[1]);
+    free(checkpointer->path);
+    free(checkpointer);
+    state->stepCallback = NULL;
+    state->stepContext = NULL;
+    return failures;
+}
+
+// an invalid checkpoint is kept for inspection rather than overwritten by
+// a run started from scratch
+int optimizeWithCheckpoints(ParameterSet params, const char* path, int interval){
+    TrainingState* state = createTrainingState(params.network, params.lossFunction);
+    if (loadCheckpoint(state, path) < 0){
+        destroyTrainingState(state);
+        return -1;
+    }
+    enableCheckpoints(state, path, interval);
+    trainGradientDescent(state, params.data, params.classes, params.batchSize, params.learningRate, params.searchTime, params.regularizationStrength, params.momentumFactor, params.maxIters, params.shuffle, params.verbose);
+    int failures = disableCheckpoints(state);
+    failures += saveCheckpoint(state, path) != 0;
+    destroyTrainingState(state);
+    return failures == 0 ? 0 : -1;
+}
+
+#endif
\ No newline at end of file
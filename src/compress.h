@@ -0,0 +1,550 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "half.h"
+#include "layer.h"
+#include "network.h"
+#include "binary.h"
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#define COMPRESSED_MAGIC "CRANLZ"
+#define COMPRESSED_VERSION 3
+
+// bits of the match finder's hash table
+#define LZ_HASH_BITS 14
+
+// shortest match the compressor emits
+#define LZ_MIN_MATCH 4
+
+// farthest back a match may refer
+#define LZ_MAX_OFFSET 65535
+
+// how weights are encoded before compression
+// FLOAT16, BFLOAT16 and INT8 are lossy; biases are always stored as floats
+typedef enum WEIGHT_ENCODING_ {
+    ENCODE_FLOAT32,
+    ENCODE_FLOAT16,
+    ENCODE_BFLOAT16,
+    ENCODE_INT8 // symmetric, with one scale per connection
+} WEIGHT_ENCODING;
+
+// describes one compressed block of values
+typedef struct CompressedBlock_ {
+    uint32_t encoding;
+    float scale; // value of one step, for ENCODE_INT8
+    uint64_t count; // number of values
+    uint64_t compressedSize;
+    uint64_t checksum; // of the compressed bytes
+} CompressedBlock;
+
+// returns the largest size lzCompress can produce for $size bytes
+static size_t lzBound(size_t size);
+
+// compresses $size bytes of $src into $dst, which must hold lzBound(size)
+// bytes, and returns the compressed size
+static size_t lzCompress(const unsigned char* src, size_t size, unsigned char* dst);
+
+// decompresses $size bytes of $src into exactly $expected bytes of $dst
+// returns 0 on success, -1 if the input is malformed
+static int lzDecompress(const unsigned char* src, size_t size, unsigned char* dst, size_t expected);
+
+// groups byte k of every $width byte element of $src into plane k of $dst
+static void shuffleBytes(const unsigned char* src, size_t count, size_t width, unsigned char* dst);
+
+// reverses shuffleBytes
+static void unshuffleBytes(const unsigned char* src, size_t count, size_t width, unsigned char* dst);
+
+// writes network to a compressed file, encoding weights with $encoding
+// input stats are not stored, so they must be folded into the weights
+// returns 0 on success, -1 on failure
+static int saveNetworkCompressed(Network* network, const char* path, WEIGHT_ENCODING encoding);
+
+// reads a network from a compressed file, streaming the blocks from disk
+// and decompressing connections on up to $numThreads threads (with
+// CRANIUM_USE_POSIX) while later blocks are still being read
+// returns NULL if the file is invalid
+static Network* readNetworkCompressed(const char* path, int numThreads);
+
+
+/*
+    Begin functions.
+*/
+
+size_t lzBound(size_t size){
+    return size + size / 255 + 16;
+}
+
+// writes a length continuation: runs of 255 then the remainder
+static size_t lzWriteLength(unsigned char* dst, size_t length){
+    size_t out = 0;
+    while (length >= 255){
+        dst[out++] = 255;
+        length -= 255;
+    }
+    dst[out++] = (unsigned char)length;
+    return out;
+}
+
+// writes one sequence of literals followed by a match, or only literals
+// if $matchLength is 0
+static size_t lzWriteSequence(unsigned char* dst, const unsigned char* literals, size_t numLiterals, size_t offset, size_t matchLength){
+    size_t out = 1;
+    size_t extraMatch = matchLength >= LZ_MIN_MATCH ? matchLength - LZ_MIN_MATCH : 0;
+    dst[0] = (unsigned char)(((numLiterals < 15 ? numLiterals : 15) << 4) | (extraMatch < 15 ? extraMatch : 15));
+    if (numLiterals >= 15){
+        out += lzWriteLength(dst + out, numLiterals - 15);
+    }
+    memcpy(dst + out, literals, numLiterals);
+    out += numLiterals;
+    if (matchLength == 0){
+        return out;
+    }
+    dst[out++] = offset & 0xff;
+    dst[out++] = offset >> 8;
+    if (extraMatch >= 15){
+        out += lzWriteLength(dst + out, extraMatch - 15);
+    }
+    return out;
+}
+
+size_t lzCompress(const unsigned char* src, size_t size, unsigned char* dst){
+    size_t* table = (size_t*)calloc(1 << LZ_HASH_BITS, sizeof(size_t));
+    size_t i = 0, anchor = 0, out = 0;
+    while (i + LZ_MIN_MATCH <= size){
+        uint32_t sequence;
+        memcpy(&sequence, src + i, 4);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = i + 1;
+        if (candidate != 0 && i - (candidate - 1) <= LZ_MAX_OFFSET && memcmp(src + candidate - 1, src + i, 4) == 0){
+            size_t reference = candidate - 1;
+            size_t length = LZ_MIN_MATCH;
+            while (i + length < size && src[reference + length] == src[i + length]){
+                length++;
+            }
+            out += lzWriteSequence(dst + out, src + anchor, i - anchor, i - reference, length);
+            i += length;
+            anchor = i;
+        }
+        else{
+            i++;
+        }
+    }
+    out += lzWriteSequence(dst + out, src + anchor, size - anchor, 0, 0);
+    free(table);
+    return out;
+}
+
+// reads a length continuation, returning -1 if it runs off the input
+static int lzReadLength(const unsigned char* src, size_t size, size_t* in, size_t* length){
+    unsigned char byte;
+    do{
+        if (*in >= size){
+            return -1;
+        }
+        byte = src[(*in)++];
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+int lzDecompress(const unsigned char* src, size_t size, unsigned char* dst, size_t expected){
+    size_t in = 0, out = 0;
+    while (in < size){
+        unsigned char token = src[in++];
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 && lzReadLength(src, size, &in, &numLiterals) != 0){
+            return -1;
+        }
+        if (numLiterals > size - in || numLiterals > expected - out){
+            return -1;
+        }
+        memcpy(dst + out, src + in, numLiterals);
+        in += numLiterals;
+        out += numLiterals;
+        if (in == size){
+            break;
+        }
+        if (size - in < 2){
+            return -1;
+        }
+        size_t offset = src[in] | ((size_t)src[in + 1] << 8);
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && lzReadLength(src, size, &in, &length) != 0){
+            return -1;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || length > expected - out){
+            return -1;
+        }
+        // matches may overlap their own output, so copy forwards
+        size_t i;
+        for (i = 0; i < length; i++){
+            dst[out + i] = dst[out - offset + i];
+        }
+        out += length;
+    }
+    return out == expected ? 0 : -1;
+}
+
+void shuffleBytes(const unsigned char* src, size_t count, size_t width, unsigned char* dst){
+    size_t i, k;
+    for (i = 0; i < count; i++){
+        for (k = 0; k < width; k++){
+            dst[k * count + i] = src[i * width + k];
+        }
+    }
+}
+
+void unshuffleBytes(const unsigned char* src, size_t count, size_t width, unsigned char* dst){
+    size_t i, k;
+    for (k = 0; k < width; k++){
+        for (i = 0; i < count; i++){
+            dst[i * width + k] = src[k * count + i];
+        }
+    }
+}
+
+static size_t encodingWidth(WEIGHT_ENCODING encoding){
+    if (encoding == ENCODE_FLOAT32){
+        return 4;
+    }
+    return encoding == ENCODE_INT8 ? 1 : 2;
+}
+
+// encodes, shuffles and compresses $count values, returning the compressed
+// bytes (to be freed) and filling in $block
+static unsigned char* compressValues(const float* values, size_t count, WEIGHT_ENCODING encoding, CompressedBlock* block){
+    size_t width = encodingWidth(encoding);
+    size_t size = count * width, i;
+    unsigned char* encoded = (unsigned char*)malloc(size > 0 ? size : 1);
+    block->encoding = encoding;
+    block->scale = 0;
+    block->count = count;
+    if (encoding == ENCODE_FLOAT32){
+        memcpy(encoded, values, size);
+    }
+    else if (encoding == ENCODE_INT8){
+        float maxAbs = 0;
+        for (i = 0; i < count; i++){
+            maxAbs = MAX(maxAbs, fabsf(values[i]));
+        }
+        block->scale = maxAbs > 0 ? maxAbs / 127 : 1;
+        for (i = 0; i < count; i++){
+            int8_t step = (int8_t)lrintf(values[i] / block->scale);
+            memcpy(encoded + i, &step, 1);
+        }
+    }
+    else{
+        PRECISION precision = encoding == ENCODE_FLOAT16 ? FLOAT16 : BFLOAT16;
+        for (i = 0; i < count; i++){
+            uint16_t half = encodeHalf(values[i], precision);
+            memcpy(encoded + 2 * i, &half, 2);
+        }
+    }
+    unsigned char* shuffled = (unsigned char*)malloc(size > 0 ? size : 1);
+    shuffleBytes(encoded, count, width, shuffled);
+    unsigned char* compressed = (unsigned char*)malloc(lzBound(size));
+    block->compressedSize = lzCompress(shuffled, size, compressed);
+    block->checksum = checksumBytes(compressed, block->compressedSize);
+    free(encoded);
+    free(shuffled);
+    return compressed;
+}
+
+// reverses compressValues into $values, returning 0 on success
+static int decompressValues(const unsigned char* compressed, CompressedBlock* block, float* values){
+    if (block->encoding > ENCODE_INT8 || checksumBytes(compressed, block->compressedSize) != block->checksum){
+        return -1;
+    }
+    WEIGHT_ENCODING encoding = (WEIGHT_ENCODING)block->encoding;
+    size_t width = encodingWidth(encoding);
+    size_t count = block->count, size = count * width, i;
+    unsigned char* shuffled = (unsigned char*)malloc(size > 0 ? size : 1);
+    if (lzDecompress(compressed, block->compressedSize, shuffled, size) != 0){
+        free(shuffled);
+        return -1;
+    }
+    if (encoding == ENCODE_FLOAT32){
+        unshuffleBytes(shuffled, count, width, (unsigned char*)values);
+    }
+    else{
+        unsigned char* encoded = (unsigned char*)malloc(size > 0 ? size : 1);
+        unshuffleBytes(shuffled, count, width, encoded);
+        if (encoding == ENCODE_INT8){
+            for (i = 0; i < count; i++){
+                int8_t step;
+                memcpy(&step, encoded + i, 1);
+                values[i] = step * block->scale;
+            }
+        }
+        else{
+            PRECISION precision = encoding == ENCODE_FLOAT16 ? FLOAT16 : BFLOAT16;
+            for (i = 0; i < count; i++){
+                uint16_t half;
+                memcpy(&half, encoded + 2 * i, 2);
+                values[i] = decodeHalf(half, precision);
+            }
+        }
+        free(encoded);
+    }
+    free(shuffled);
+    return 0;
+}
+
+// file layout: magic, version, endianness, numLayers, BinaryLayer records,
+// BinaryConnection records (offsets unused), then for each connection a
+// CompressedBlock and its bytes for the weights, followed by the same for the
+// bias and, if factorized, for the U and V factors
+// factors are always stored as floats, since the forward pass reads them
+// in place of the weights, and the weights of a factorized connection are
+// left out, being U * V, unless it is also pruned
+int saveNetworkCompressed(Network* network, const char* path, WEIGHT_ENCODING encoding){
+    if (network->featureMean != NULL && !network->normalizationFolded){
+        return -1;
+    }
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL){
+        return -1;
+    }
+    int ok = 1;
+    char magic[8] = {0};
+    memcpy(magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC));
+    uint32_t version = COMPRESSED_VERSION, endianness = BINARY_ENDIANNESS;
+    uint64_t numLayers = network->numLayers;
+    ok &= fwrite(magic, sizeof(magic), 1, fp) == 1;
+    ok &= fwrite(&version, sizeof(version), 1, fp) == 1;
+    ok &= fwrite(&endianness, sizeof(endianness), 1, fp) == 1;
+    ok &= fwrite(&numLayers, sizeof(numLayers), 1, fp) == 1;
+    int i;
+    for (i = 0; i < network->numLayers; i++){
+        BinaryLayer layer;
+        memset(&layer, 0, sizeof(layer));
+        layer.size = network->layers[i]->size;
+        strncpy(layer.activation, getFunctionName(network->layers[i]->activation), sizeof(layer.activation) - 1);
+        ok &= fwrite(&layer, sizeof(layer), 1, fp) == 1;
+    }
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        BinaryConnection record;
+        memset(&record, 0, sizeof(record));
+        record.precision = con->precision;
+        record.flags = (con->sparseWeights != NULL ? BINARY_PRUNED : 0) | (con->factorU != NULL ? BINARY_FACTORIZED : 0);
+        record.rank = con->factorU != NULL ? con->factorU->cols : 0;
+        ok &= fwrite(&record, sizeof(record), 1, fp) == 1;
+    }
+    for (i = 0; i < network->numConnections && ok; i++){
+        Connection* con = network->connections[i];
+        CompressedBlock block;
+        unsigned char* compressed;
+        if (con->factorU == NULL || con->sparseWeights != NULL){
+            compressed = compressValues(con->weights->data, con->weights->rows * con->weights->cols, encoding, &block);
+            ok &= fwrite(&block, sizeof(block), 1, fp) == 1;
+            ok &= fwrite(compressed, 1, block.compressedSize, fp) == block.compressedSize;
+            free(compressed);
+        }
+        compressed = compressValues(con->bias->data, con->bias->cols, ENCODE_FLOAT32, &block);
+        ok &= fwrite(&block, sizeof(block), 1, fp) == 1;
+        ok &= fwrite(compressed, 1, block.compressedSize, fp) == block.compressedSize;
+        free(compressed);
+        if (con->factorU == NULL){
+            continue;
+        }
+        Matrix* factors[] = {con->factorU, con->factorV};
+        int f;
+        for (f = 0; f < 2; f++){
+            compressed = compressValues(factors[f]->data, factors[f]->rows * factors[f]->cols, ENCODE_FLOAT32, &block);
+            ok &= fwrite(&block, sizeof(block), 1, fp) == 1;
+            ok &= fwrite(compressed, 1, block.compressedSize, fp) == block.compressedSize;
+            free(compressed);
+        }
+    }
+    ok &= fclose(fp) == 0;
+    return ok ? 0 : -1;
+}
+
+// decompression of one connection's stored blocks into $targets: its
+// weights unless they are left out, its bias and, if factorized, factors
+typedef struct DecompressJob_ {
+    Connection* connection;
+    Matrix* factors[2];
+    Matrix* targets[4];
+    int numBlocks;
+    CompressedBlock blocks[4];
+    unsigned char* compressed[4];
+    int status;
+#ifdef CRANIUM_USE_POSIX
+    pthread_t thread;
+    int started;
+#endif
+} DecompressJob;
+
+static void* runDecompressJob(void* arg){
+    DecompressJob* job = (DecompressJob*)arg;
+    Matrix** targets = job->targets;
+    int b;
+    job->status = 0;
+    for (b = 0; b < job->numBlocks && job->status == 0; b++){
+        if (job->blocks[b].count != targets[b]->rows * targets[b]->cols || decompressValues(job->compressed[b], &job->blocks[b], targets[b]->data) != 0){
+            job->status = -1;
+        }
+    }
+    for (b = 0; b < 4; b++){
+        free(job->compressed[b]);
+        job->compressed[b] = NULL;
+    }
+    return NULL;
+}
+
+// reads a block header and its bytes, returning 0 on success
+static int readCompressedBlock(FILE* fp, CompressedBlock* block, unsigned char** compressed){
+    *compressed = NULL;
+    if (fread(block, sizeof(CompressedBlock), 1, fp) != 1 || block->compressedSize > ((uint64_t)1 << 40)){
+        return -1;
+    }
+    *compressed = (unsigned char*)malloc(block->compressedSize > 0 ? block->compressedSize : 1);
+    return fread(*compressed, 1, block->compressedSize, fp) == block->compressedSize ? 0 : -1;
+}
+
+Network* readNetworkCompressed(const char* path, int numThreads){
+    assert(numThreads >= 1);
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL){
+        return NULL;
+    }
+    char magic[8];
+    uint32_t version, endianness;
+    uint64_t numLayers;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || fread(&version, sizeof(version), 1, fp) != 1
+        || fread(&endianness, sizeof(endianness), 1, fp) != 1 || fread(&numLayers, sizeof(numLayers), 1, fp) != 1
+        || memcmp(magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) != 0 || version != COMPRESSED_VERSION
+        || endianness != BINARY_ENDIANNESS || numLayers < 2){
+        fclose(fp);
+        return NULL;
+    }
+
+    // every layer needs a record in the file, which bounds the layer count
+    // before anything is allocated from it; likewise a byte of compressed
+    // input decompresses to fewer than 256 bytes and int8 weights widen 4
+    // times, which bounds the stored weights or factors of each connection
+    long recordsStart = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    long fileEnd = ftell(fp);
+    fseek(fp, recordsStart, SEEK_SET);
+    if (recordsStart < 0 || fileEnd < recordsStart || numLayers > (uint64_t)(fileEnd - recordsStart) / (sizeof(BinaryLayer) + sizeof(BinaryConnection)) + 1){
+        fclose(fp);
+        return NULL;
+    }
+    BinaryLayer* layers = (BinaryLayer*)malloc(sizeof(BinaryLayer) * numLayers);
+    BinaryConnection* records = (BinaryConnection*)malloc(sizeof(BinaryConnection) * (numLayers - 1));
+    size_t* layerSizes = (size_t*)malloc(sizeof(size_t) * numLayers);
+    Activation* funcs = (Activation*)malloc(sizeof(Activation) * (numLayers - 1));
+    int valid = fread(layers, sizeof(BinaryLayer), numLayers, fp) == numLayers && fread(records, sizeof(BinaryConnection), numLayers - 1, fp) == numLayers - 1;
+    uint64_t payload = fileEnd - recordsStart, weightsSize = 0;
+    char name[sizeof(layers[0].activation) + 1];
+    size_t i;
+    for (i = 0; i < numLayers && valid; i++){
+        layerSizes[i] = layers[i].size;
+        valid = layerSizes[i] > 0 && (i == 0 || multiplyChecked(sizeof(float), layerSizes[i - 1], layerSizes[i], &weightsSize));
+        if (valid && i > 0){
+            memcpy(name, layers[i].activation, sizeof(layers[i].activation));
+            name[sizeof(layers[i].activation)] = '\0';
+            funcs[i - 1] = getFunctionByName(name);
+        }
+    }
+    for (i = 0; i < numLayers - 1 && valid; i++){
+        uint64_t rank = records[i].rank;
+        valid = records[i].precision <= BFLOAT16 && (records[i].flags & ~(BINARY_PRUNED | BINARY_FACTORIZED)) == 0;
+        valid &= !(records[i].flags & BINARY_FACTORIZED) || (rank > 0 && rank <= layerSizes[i] && rank <= layerSizes[i + 1]);
+        if (valid && (records[i].flags & BINARY_FACTORIZED) && !(records[i].flags & BINARY_PRUNED)){
+            valid = multiplyChecked(sizeof(float), layerSizes[i] + layerSizes[i + 1], rank, &weightsSize);
+        }
+        else if (valid){
+            multiplyChecked(sizeof(float), layerSizes[i], layerSizes[i + 1], &weightsSize);
+        }
+        valid &= weightsSize / 1024 <= payload;
+    }
+    Network* network = valid ? allocateNetwork(numLayers, layerSizes, funcs) : NULL;
+    free(layers);
+    free(layerSizes);
+    free(funcs);
+    if (network == NULL){
+        free(records);
+        fclose(fp);
+        return NULL;
+    }
+
+    // stream blocks in order, keeping at most numThreads decompressions in flight
+    DecompressJob* jobs = (DecompressJob*)calloc(network->numConnections, sizeof(DecompressJob));
+    int failed = 0;
+    for (i = 0; i < network->numConnections && !failed; i++){
+        Connection* con = network->connections[i];
+        jobs[i].connection = con;
+        int numBlocks = 0, b;
+        if (!(records[i].flags & BINARY_FACTORIZED) || (records[i].flags & BINARY_PRUNED)){
+            jobs[i].targets[numBlocks++] = con->weights;
+        }
+        jobs[i].targets[numBlocks++] = con->bias;
+        if (records[i].flags & BINARY_FACTORIZED){
+            jobs[i].factors[0] = createMatrixZeroes(con->weights->rows, records[i].rank);
+            jobs[i].factors[1] = createMatrixZeroes(records[i].rank, con->weights->cols);
+            jobs[i].targets[numBlocks++] = jobs[i].factors[0];
+            jobs[i].targets[numBlocks++] = jobs[i].factors[1];
+        }
+        jobs[i].numBlocks = numBlocks;
+        for (b = 0; b < numBlocks && !failed; b++){
+            failed = readCompressedBlock(fp, &jobs[i].blocks[b], &jobs[i].compressed[b]) != 0;
+        }
+        if (failed){
+            for (b = 0; b < numBlocks; b++){
+                free(jobs[i].compressed[b]);
+            }
+            break;
+        }
+#ifdef CRANIUM_USE_POSIX
+        if (i >= numThreads && jobs[i - numThreads].started){
+            pthread_join(jobs[i - numThreads].thread, NULL);
+            jobs[i - numThreads].started = 0;
+        }
+        if (numThreads > 1 && pthread_create(&jobs[i].thread, NULL, runDecompressJob, &jobs[i]) == 0){
+            jobs[i].started = 1;
+            continue;
+        }
+#endif
+        runDecompressJob(&jobs[i]);
+    }
+#ifdef CRANIUM_USE_POSIX
+    for (i = 0; i < network->numConnections; i++){
+        if (jobs[i].started){
+            pthread_join(jobs[i].thread, NULL);
+        }
+    }
+#endif
+    fclose(fp);
+    for (i = 0; i < network->numConnections; i++){
+        failed |= jobs[i].status != 0 || jobs[i].connection == NULL;
+    }
+    if (failed){
+        for (i = 0; i < network->numConnections; i++){
+            if (jobs[i].factors[0] != NULL){
+                destroyMatrix(jobs[i].factors[0]);
+                destroyMatrix(jobs[i].factors[1]);
+            }
+        }
+        free(jobs);
+        free(records);
+        destroyNetwork(network);
+        return NULL;
+    }
+    for (i = 0; i < network->numConnections; i++){
+        restoreConnection(network->connections[i], (PRECISION)records[i].precision, records[i].flags & BINARY_PRUNED, jobs[i].factors[0], jobs[i].factors[1]);
+    }
+    free(jobs);
+    free(records);
+    return network;
+}
+
+#endif
\ No newline at end of file
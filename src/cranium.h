@@ -1,6 +1,23 @@
 #include "std_includes.h"
+#include "profile.h"
 #include "matrix.h"
 #include "function.h"
+#include "half.h"
+#include "sparse.h"
 #include "layer.h"
 #include "network.h"
-#include "optimizer.h"
\ No newline at end of file
+#include "binary.h"
+#include "compress.h"
+#include "serving.h"
+#include "optimizer.h"
+#include "checkpoint.h"
+#include "stream.h"
+#include "ingest.h"
+#include "prune.h"
+#include "lowrank.h"
+#include "export.h"
+#include "distributed.h"
+#include "placement.h"
+#include "autotune.h"
+#include "search.h"
+#include "pipeline.h"
\ No newline at end of file
@@ -0,0 +1,487 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+#include "optimizer.h"
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+// data-parallel training over TCP needs sockets and threads, so this header
+// is empty without CRANIUM_USE_POSIX
+#ifdef CRANIUM_USE_POSIX
+
+// pause between attempts to reach a neighbour that is not listening yet
+#define RING_RETRY_NANOSECONDS 10000000
+
+// default seconds an exchange waits on a neighbour that makes no progress
+// before treating it as lost
+#define RING_EXCHANGE_TIMEOUT 60
+
+// one process's place in a ring of processes training the same network on
+// different shards of the data; each rank sends to the next rank and
+// receives from the previous one over its own TCP connection
+// values travel in native byte order, so all ranks share one architecture
+typedef struct RingGroup_ {
+    int rank;
+    int size;
+    int sendSocket; // to rank + 1
+    int receiveSocket; // from rank - 1
+    float* scratch; // one incoming chunk
+    size_t scratchSize;
+    uint64_t bytesSent;
+    float exchangeTimeout; // seconds without progress before a neighbour
+                           // counts as lost, RING_EXCHANGE_TIMEOUT at first
+} RingGroup;
+
+// joins a ring of $size processes as $rank, where rank r listens on port
+// $basePort + r of $hosts[r] ($hosts may be NULL when every rank runs on
+// this machine)
+// returns NULL if the ring is not formed within $timeout seconds
+static RingGroup* createRingGroup(int rank, int size, const char** hosts, int basePort, float timeout);
+
+// opens the listening socket a rank joins a ring with, on $port of every
+// interface, or on a free port chosen by the system if $port is 0, and
+// places the port bound into $bound
+// returns the socket, or -1 on failure
+static int ringListen(int port, int* bound);
+
+// same as createRingGroup, with rank r listening on $ports[r] and this
+// rank's socket from ringListen passed as $listener, which is closed; lets
+// ranks bind port 0 and share the ports they were given
+static RingGroup* joinRingGroup(int rank, int size, const char** hosts, const int* ports, int listener, float timeout);
+
+// replaces $data on every rank by its elementwise sum over all ranks, as a
+// reduce-scatter then an all-gather around the ring, so each rank sends
+// 2 * (size - 1) / size of the buffer however many ranks there are
+// each sum is made once and copied, so all ranks end with the same bits
+// returns 0, or -1 if a neighbour was lost
+static int ringAllReduce(RingGroup* group, float* data, size_t count);
+
+// replaces $data on every rank by the copy on rank $root
+static int ringBroadcast(RingGroup* group, float* data, size_t count, int root);
+
+// replaces $value on every rank by its sum over all ranks
+static int ringSum(RingGroup* group, uint64_t* value);
+
+// closes the connections of a ring
+static void destroyRingGroup(RingGroup* group);
+
+// trains the network of $state on this rank's $shard in lockstep with the
+// other ranks: parameters, input stats and factors start as rank 0's, and
+// every step sums the gradient over all ranks and divides it by the rows of
+// all shards, so replicas stay identical and a step is the step a single
+// process would take on the union of the ranks' batches
+// a background thread reduces each connection's gradient as soon as the
+// step's last example has finished it, so the later layers travel while the
+// earlier ones are still being backpropagated
+// every rank must run the same $maxIters; other parameters are as in
+// trainGradientDescent, and only rank 0 prints
+// returns 0, or -1 if a neighbour was lost, in which case training stops
+// before the step it was lost in, leaving the parameters and momentum as
+// the last completed step left them
+static int distributedGradientDescent(RingGroup* group, TrainingState* state, DataSet* shard, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose);
+
+
+/*
+    Begin functions.
+*/
+
+int ringListen(int port, int* bound){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0){
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 1) != 0
+        || getsockname(fd, (struct sockaddr*)&address, &length) != 0){
+        close(fd);
+        return -1;
+    }
+    *bound = ntohs(address.sin_port);
+    return fd;
+}
+
+// connects to $port of $host, retrying while the peer is not yet listening
+static int connectTo(const char* host, int port, double start, float timeout){
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, service, &hints, &found) != 0){
+        return -1;
+    }
+    struct timespec pause = {0, RING_RETRY_NANOSECONDS};
+    int fd = -1;
+    while (monotonicSeconds() - start < timeout){
+        fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+        if (fd >= 0 && connect(fd, found->ai_addr, found->ai_addrlen) == 0){
+            break;
+        }
+        if (fd >= 0){
+            close(fd);
+            fd = -1;
+        }
+        nanosleep(&pause, NULL);
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+// reads or writes exactly $bytes on a blocking socket
+static int transferAll(int fd, void* buffer, size_t bytes, int sending){
+    char* p = (char*)buffer;
+    while (bytes > 0){
+        ssize_t done = sending ? send(fd, p, bytes, MSG_NOSIGNAL) : recv(fd, p, bytes, 0);
+        if (done <= 0){
+            if (done < 0 && errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        p += done;
+        bytes -= done;
+    }
+    return 0;
+}
+
+RingGroup* createRingGroup(int rank, int size, const char** hosts, int basePort, float timeout){
+    assert(size >= 1 && rank >= 0 && rank < size);
+    int* ports = (int*)malloc(sizeof(int) * size);
+    int r, bound;
+    for (r = 0; r < size; r++){
+        ports[r] = basePort + r;
+    }
+    int listener = size > 1 ? ringListen(ports[rank], &bound) : -1;
+    RingGroup* group = size == 1 || listener >= 0 ? joinRingGroup(rank, size, hosts, ports, listener, timeout) : NULL;
+    free(ports);
+    return group;
+}
+
+RingGroup* joinRingGroup(int rank, int size, const char** hosts, const int* ports, int listener, float timeout){
+    assert(size >= 1 && rank >= 0 && rank < size);
+    RingGroup* group = (RingGroup*)malloc(sizeof(RingGroup));
+    group->rank = rank;
+    group->size = size;
+    group->sendSocket = -1;
+    group->receiveSocket = -1;
+    group->scratch = NULL;
+    group->scratchSize = 0;
+    group->bytesSent = 0;
+    group->exchangeTimeout = RING_EXCHANGE_TIMEOUT;
+    if (size == 1){
+        if (listener >= 0){
+            close(listener);
+        }
+        return group;
+    }
+
+    // every rank listens before connecting, and a connection completes in
+    // the peer's backlog before it is accepted, so no order of start deadlocks
+    double start = monotonicSeconds();
+    int next = (rank + 1) % size;
+    int previous = (rank + size - 1) % size;
+    group->sendSocket = connectTo(hosts != NULL ? hosts[next] : "127.0.0.1", ports[next], start, timeout);
+    int32_t sender = -1;
+    if (group->sendSocket >= 0){
+        int32_t me = rank;
+        struct pollfd waiting = {listener, POLLIN, 0};
+        int remaining = (int)(1000 * (timeout - (monotonicSeconds() - start)));
+        if (transferAll(group->sendSocket, &me, sizeof(int32_t), 1) == 0 && poll(&waiting, 1, MAX(remaining, 0)) == 1){
+            group->receiveSocket = accept(listener, NULL, NULL);
+        }
+        if (group->receiveSocket >= 0){
+            transferAll(group->receiveSocket, &sender, sizeof(int32_t), 0);
+        }
+    }
+    close(listener);
+    if (sender != previous){
+        destroyRingGroup(group);
+        return NULL;
+    }
+
+    // steps exchange one chunk at a time, which should not wait on Nagle
+    int yes = 1;
+    setsockopt(group->sendSocket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+    setsockopt(group->receiveSocket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+    fcntl(group->sendSocket, F_SETFL, fcntl(group->sendSocket, F_GETFL) | O_NONBLOCK);
+    fcntl(group->receiveSocket, F_SETFL, fcntl(group->receiveSocket, F_GETFL) | O_NONBLOCK);
+    return group;
+}
+
+// sends $sendBytes to the next rank while receiving $receiveBytes from the
+// previous one; both sides move at once, since every rank sends before it
+// would otherwise receive and large chunks would fill the socket buffers
+// fails if neither side moves for the group's exchange timeout
+static int ringExchange(RingGroup* group, const void* outgoing, size_t sendBytes, void* incoming, size_t receiveBytes){
+    const char* out = (const char*)outgoing;
+    char* in = (char*)incoming;
+    group->bytesSent += sendBytes;
+    while (sendBytes > 0 || receiveBytes > 0){
+        struct pollfd fds[2] = {{group->sendSocket, sendBytes > 0 ? POLLOUT : 0, 0}, {group->receiveSocket, receiveBytes > 0 ? POLLIN : 0, 0}};
+        int ready = poll(fds, 2, (int)(1000 * group->exchangeTimeout));
+        if (ready == 0){
+            return -1;
+        }
+        if (ready < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        if (sendBytes > 0 && fds[0].revents != 0){
+            ssize_t done = send(group->sendSocket, out, sendBytes, MSG_NOSIGNAL);
+            if (done < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                return -1;
+            }
+            if (done > 0){
+                out += done;
+                sendBytes -= done;
+            }
+        }
+        if (receiveBytes > 0 && fds[1].revents != 0){
+            ssize_t done = recv(group->receiveSocket, in, receiveBytes, 0);
+            if (done == 0 || (done < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)){
+                return -1;
+            }
+            if (done > 0){
+                in += done;
+                receiveBytes -= done;
+            }
+        }
+    }
+    return 0;
+}
+
+// first element of chunk $chunk when $count elements are cut into $size chunks
+static size_t chunkStart(size_t count, int size, int chunk){
+    return count / size * chunk + MIN(count % size, (size_t)chunk);
+}
+
+int ringAllReduce(RingGroup* group, float* data, size_t count){
+    int size = group->size, rank = group->rank;
+    if (size == 1 || count == 0){
+        return 0;
+    }
+    PROFILE_BEGIN(allReduce);
+    size_t largest = chunkStart(count, size, 1);
+    if (group->scratchSize < largest){
+        free(group->scratch);
+        group->scratch = (float*)malloc(sizeof(float) * largest);
+        group->scratchSize = largest;
+    }
+    int step;
+    size_t j;
+
+    // reduce-scatter: after it, rank r holds the full sum of chunk r + 1
+    for (step = 0; step < size - 1; step++){
+        int sendChunk = (rank - step + size) % size;
+        int receiveChunk = (rank - step - 1 + 2 * size) % size;
+        size_t sendFirst = chunkStart(count, size, sendChunk);
+        size_t receiveFirst = chunkStart(count, size, receiveChunk);
+        size_t sendCount = chunkStart(count, size, sendChunk + 1) - sendFirst;
+        size_t receiveCount = chunkStart(count, size, receiveChunk + 1) - receiveFirst;
+        if (ringExchange(group, data + sendFirst, sizeof(float) * sendCount, group->scratch, sizeof(float) * receiveCount) != 0){
+            return -1;
+        }
+        for (j = 0; j < receiveCount; j++){
+            data[receiveFirst + j] += group->scratch[j];
+        }
+    }
+
+    // all-gather: pass the finished sums on around the ring
+    for (step = 0; step < size - 1; step++){
+        int sendChunk = (rank + 1 - step + size) % size;
+        int receiveChunk = (rank - step + size) % size;
+        size_t sendFirst = chunkStart(count, size, sendChunk);
+        size_t receiveFirst = chunkStart(count, size, receiveChunk);
+        size_t sendCount = chunkStart(count, size, sendChunk + 1) - sendFirst;
+        size_t receiveCount = chunkStart(count, size, receiveChunk + 1) - receiveFirst;
+        if (ringExchange(group, data + sendFirst, sizeof(float) * sendCount, data + receiveFirst, sizeof(float) * receiveCount) != 0){
+            return -1;
+        }
+    }
+
+    // every rank sends and receives (size - 1) / size of the data twice
+    PROFILE_END(allReduce, "ringAllReduce", -1, (double)count * (size - 1) / size, 16.0 * count * (size - 1) / size);
+    return 0;
+}
+
+int ringBroadcast(RingGroup* group, float* data, size_t count, int root){
+    // a sum in which only the root contributes is the root's copy
+    if (group->rank != root){
+        memset(data, 0, sizeof(float) * count);
+    }
+    return ringAllReduce(group, data, count);
+}
+
+int ringSum(RingGroup* group, uint64_t* value){
+    uint64_t passing = *value, incoming, total = *value;
+    int step;
+    for (step = 0; step < group->size - 1; step++){
+        if (ringExchange(group, &passing, sizeof(uint64_t), &incoming, sizeof(uint64_t)) != 0){
+            return -1;
+        }
+        total += incoming;
+        passing = incoming;
+    }
+    *value = total;
+    return 0;
+}
+
+void destroyRingGroup(RingGroup* group){
+    if (group->sendSocket >= 0){
+        close(group->sendSocket);
+    }
+    if (group->receiveSocket >= 0){
+        close(group->receiveSocket);
+    }
+    free(group->scratch);
+    free(group);
+}
+
+// hands connections finished by backpropagation to a thread that reduces
+// them in the order they finish, last connection first
+typedef struct GradientReducer_ {
+    RingGroup* group;
+    TrainingState* state;
+    size_t* weightsOffset;
+    size_t* biasOffset;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int ready; // connections finished this step
+    int reduced; // connections reduced this step
+    int stop;
+    int failed;
+} GradientReducer;
+
+static void* reduceGradients(void* argument){
+    GradientReducer* reducer = (GradientReducer*)argument;
+    Network* network = reducer->state->network;
+    pthread_mutex_lock(&reducer->lock);
+    while (1){
+        while (reducer->reduced == reducer->ready && !reducer->stop){
+            pthread_cond_wait(&reducer->changed, &reducer->lock);
+        }
+        if (reducer->reduced == reducer->ready){
+            break;
+        }
+        int i = network->numConnections - 1 - reducer->reduced;
+        pthread_mutex_unlock(&reducer->lock);
+
+        Matrix* weights = network->connections[i]->weights;
+        float* gradient = reducer->state->gradient;
+        int failed = reducer->failed;
+        if (!failed){
+            failed = ringAllReduce(reducer->group, gradient + reducer->weightsOffset[i], weights->rows * weights->cols) != 0
+                || ringAllReduce(reducer->group, gradient + reducer->biasOffset[i], weights->cols) != 0;
+        }
+
+        pthread_mutex_lock(&reducer->lock);
+        reducer->failed = failed;
+        reducer->reduced++;
+        pthread_cond_broadcast(&reducer->changed);
+    }
+    pthread_mutex_unlock(&reducer->lock);
+    return NULL;
+}
+
+static void gradientReady(TrainingState* state, int connection, void* context){
+    GradientReducer* reducer = (GradientReducer*)context;
+    // sparse steps update only their own touched rows, which differ by rank
+    assert(!state->sparseStep);
+    pthread_mutex_lock(&reducer->lock);
+    assert(connection == state->network->numConnections - 1 - reducer->ready);
+    reducer->ready++;
+    pthread_cond_broadcast(&reducer->changed);
+    pthread_mutex_unlock(&reducer->lock);
+}
+
+// a partial sum is not the step, so a failure drops it and ends the run
+static int gradientWait(TrainingState* state, void* context){
+    GradientReducer* reducer = (GradientReducer*)context;
+    pthread_mutex_lock(&reducer->lock);
+    while (reducer->reduced < state->network->numConnections){
+        pthread_cond_wait(&reducer->changed, &reducer->lock);
+    }
+    reducer->ready = 0;
+    reducer->reduced = 0;
+    int failed = reducer->failed;
+    pthread_mutex_unlock(&reducer->lock);
+    return failed;
+}
+
+int distributedGradientDescent(RingGroup* group, TrainingState* state, DataSet* shard, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose){
+    Network* network = state->network;
+    assert(isNetworkFlat(network));
+
+    // replicas start from rank 0, and steps are divided by the rows of all shards
+    uint64_t totalRows = classes->rows;
+    if (ringSum(group, &totalRows) != 0 || ringBroadcast(group, network->parameters, network->numParameters, 0) != 0){
+        return -1;
+    }
+    if (network->featureMean != NULL){
+        size_t inputs = network->layers[0]->size;
+        if (ringBroadcast(group, network->featureMean, inputs, 0) != 0 || ringBroadcast(group, network->featureScale, inputs, 0) != 0){
+            return -1;
+        }
+    }
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        if (con->factorU != NULL && (ringBroadcast(group, con->factorU->data, con->factorU->rows * con->factorU->cols, 0) != 0
+            || ringBroadcast(group, con->factorV->data, con->factorV->rows * con->factorV->cols, 0) != 0)){
+            return -1;
+        }
+        refreshConnection(con);
+    }
+
+    size_t weightsOffset[network->numConnections], biasOffset[network->numConnections];
+    parameterLayout(network, weightsOffset, biasOffset);
+    GradientReducer reducer;
+    reducer.group = group;
+    reducer.state = state;
+    reducer.weightsOffset = weightsOffset;
+    reducer.biasOffset = biasOffset;
+    reducer.ready = 0;
+    reducer.reduced = 0;
+    reducer.stop = 0;
+    reducer.failed = 0;
+    pthread_mutex_init(&reducer.lock, NULL);
+    pthread_cond_init(&reducer.changed, NULL);
+    pthread_create(&reducer.thread, NULL, reduceGradients, &reducer);
+
+    state->gradientReady = gradientReady;
+    state->gradientWait = gradientWait;
+    state->gradientContext = &reducer;
+    state->normalizer = totalRows;
+    trainGradientDescent(state, shard, classes, batchSize, learningRate, searchTime, regularizationStrength, momentumFactor, maxIters, shuffle, group->rank == 0 ? verbose : 0);
+    state->gradientReady = NULL;
+    state->gradientWait = NULL;
+    state->gradientContext = NULL;
+    state->normalizer = 0;
+
+    pthread_mutex_lock(&reducer.lock);
+    reducer.stop = 1;
+    pthread_cond_broadcast(&reducer.changed);
+    pthread_mutex_unlock(&reducer.lock);
+    pthread_join(reducer.thread, NULL);
+    pthread_mutex_destroy(&reducer.lock);
+    pthread_cond_destroy(&reducer.changed);
+    return reducer.failed ? -1 : 0;
+}
+
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+// writes a self-contained C implementation of the network's forward pass
+// to $path.h and $path.c, with every symbol prefixed by $name
+// the generated code has the weights as static const arrays and the layer
+// sizes as constants, needs only <math.h>, and allocates nothing
+// the declared function is: void $name_forward(const float* input, float* output)
+// weights are taken from the float matrices of each connection, which
+// already hold any rounding, pruning, or factorization applied to them,
+// and any folded input stats (unfolded stats must be folded first)
+// returns 0 on success, -1 if a file could not be written or stats are unfolded
+static int exportNetworkC(Network* network, const char* path, const char* name);
+
+
+/*
+    Begin functions.
+*/
+
+// writes $name in upper case
+static void printUpper(FILE* fp, const char* name){
+    for (; *name != '\0'; name++){
+        fputc(*name >= 'a' && *name <= 'z' ? *name - 'a' + 'A' : *name, fp);
+    }
+}
+
+// writes the statements applying $func in place to $array of $size entries
+static void printActivation(FILE* fp, Activation func, const char* array, const char* size){
+    if (func == sigmoid){
+        fprintf(fp, "    for (j = 0; j < %s; j++){\n        %s[j] = 1 / (1 + expf(-1 * %s[j]));\n    }\n", size, array, array);
+    }
+    else if (func == relu){
+        fprintf(fp, "    for (j = 0; j < %s; j++){\n        %s[j] = %s[j] > 0 ? %s[j] : 0;\n    }\n", size, array, array, array);
+    }
+    else if (func == tanH){
+        fprintf(fp, "    for (j = 0; j < %s; j++){\n        %s[j] = tanh(%s[j]);\n    }\n", size, array, array);
+    }
+    else if (func == softmax){
+        fprintf(fp, "    summed = 0;\n");
+        fprintf(fp, "    for (j = 0; j < %s; j++){\n        summed += expf(%s[j]);\n    }\n", size, array);
+        fprintf(fp, "    for (j = 0; j < %s; j++){\n        %s[j] = expf(%s[j]) / summed;\n    }\n", size, array, array);
+    }
+}
+
+static void printArray(FILE* fp, const char* name, const char* kind, int index, float* data, size_t size){
+    fprintf(fp, "static const float %s_%s%d[%zu] CRANIUM_EXPORT_ALIGN = {", name, kind, index, size);
+    size_t i;
+    for (i = 0; i < size; i++){
+        fprintf(fp, "%s%a", i % 4 == 0 ? "\n    " : " ", data[i]);
+        fprintf(fp, i == size - 1 ? "f" : "f,");
+    }
+    fprintf(fp, "\n};\n\n");
+}
+
+int exportNetworkC(Network* network, const char* path, const char* name){
+    if (network->featureMean != NULL && !network->normalizationFolded){
+        return -1;
+    }
+    size_t pathLength = strlen(path);
+    char fileName[pathLength + 3];
+    const char* base = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    int i;
+
+    // header with sizes and the forward declaration
+    sprintf(fileName, "%s.h", path);
+    FILE* fp = fopen(fileName, "w");
+    if (fp == NULL){
+        return -1;
+    }
+    fprintf(fp, "#ifndef ");
+    printUpper(fp, name);
+    fprintf(fp, "_H\n#define ");
+    printUpper(fp, name);
+    fprintf(fp, "_H\n\n");
+    for (i = 0; i < network->numLayers; i++){
+        fprintf(fp, "#define ");
+        printUpper(fp, name);
+        fprintf(fp, "_LAYER%d %zu\n", i, network->layers[i]->size);
+    }
+    fprintf(fp, "#define ");
+    printUpper(fp, name);
+    fprintf(fp, "_INPUTS %zu\n#define ", network->layers[0]->size);
+    printUpper(fp, name);
+    fprintf(fp, "_OUTPUTS %zu\n\n", network->layers[network->numLayers - 1]->size);
+    fprintf(fp, "// propagates one example through the network\n");
+    fprintf(fp, "void %s_forward(const float* input, float* output);\n\n#endif\n", name);
+    fclose(fp);
+
+    // source with the weights and the unrolled layers
+    sprintf(fileName, "%s.c", path);
+    fp = fopen(fileName, "w");
+    if (fp == NULL){
+        return -1;
+    }
+    fprintf(fp, "#include <math.h>\n#include \"%s.h\"\n\n", base);
+    fprintf(fp, "#ifndef CRANIUM_EXPORT_ALIGN\n#if defined(__GNUC__)\n#define CRANIUM_EXPORT_ALIGN __attribute__((aligned(64)))\n");
+    fprintf(fp, "#else\n#define CRANIUM_EXPORT_ALIGN\n#endif\n#endif\n\n");
+    for (i = 0; i < network->numConnections; i++){
+        Matrix* weights = network->connections[i]->weights;
+        printArray(fp, name, "weights", i, weights->data, weights->rows * weights->cols);
+        printArray(fp, name, "bias", i, network->connections[i]->bias->data, weights->cols);
+    }
+    fprintf(fp, "void %s_forward(const float* input, float* output){\n", name);
+    fprintf(fp, "    int i, j;\n    float x, summed;\n");
+    for (i = 1; i < network->numLayers - 1; i++){
+        fprintf(fp, "    float layer%d[", i);
+        printUpper(fp, name);
+        fprintf(fp, "_LAYER%d];\n", i);
+    }
+    for (i = 0; i < network->numConnections; i++){
+        char from[64], to[64], fromSize[256], toSize[256];
+        if (i == 0){
+            sprintf(from, "input");
+        }
+        else{
+            sprintf(from, "layer%d", i);
+        }
+        if (i == network->numConnections - 1){
+            sprintf(to, "output");
+        }
+        else{
+            sprintf(to, "layer%d", i + 1);
+        }
+        sprintf(fromSize, "%zu", network->layers[i]->size);
+        sprintf(toSize, "%zu", network->layers[i + 1]->size);
+
+        // same accumulation order as multiplyInto followed by the bias
+        fprintf(fp, "\n    // connection %d\n", i);
+        fprintf(fp, "    for (j = 0; j < %s; j++){\n        %s[j] = 0;\n    }\n", toSize, to);
+        fprintf(fp, "    for (i = 0; i < %s; i++){\n        x = %s[i];\n", fromSize, from);
+        fprintf(fp, "        for (j = 0; j < %s; j++){\n            %s[j] += x * %s_weights%d[i * %s + j];\n        }\n    }\n", toSize, to, name, i, toSize);
+        fprintf(fp, "    for (j = 0; j < %s; j++){\n        %s[j] += %s_bias%d[j];\n    }\n", toSize, to, name, i);
+        printActivation(fp, network->layers[i + 1]->activation, to, toSize);
+    }
+    fprintf(fp, "    (void)summed;\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+#endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 typedef void (*Activation)(Matrix*);
 
 #define MAX(a,b) (((a)>(b))?(a):(b))
+#define MIN(a,b) (((a)<(b))?(a):(b))
 
 // raw sigmoid function
 static float sigmoidFunc(float input);
@@ -47,6 +48,16 @@ static float linearDeriv(float linearInput);
 // sample from the unit guassian distribution (mean = 0, variance = 1)
 static float box_muller();
 
+// advances $state and returns 64 uniformly random bits, for randomness
+// whose state can be saved and restored
+static uint64_t randomBits(uint64_t* state);
+
+// returns a uniformly random integer in [0, $bound) drawn from $state
+static size_t randomBelow(uint64_t* state, size_t bound);
+
+// returns a sample of the unit gaussian drawn from $state
+static float randomGaussian(uint64_t* state);
+
 // return the string representation of activation function
 static const char* getFunctionName(Activation func);
 
@@ -79,12 +90,14 @@ float reluDeriv(float reluInput){
 
 // operates on each row
 void sigmoid(Matrix* input){
+    PROFILE_BEGIN(sigmoid);
     int i, j;
     for (i = 0; i < input->rows; i++){
         for (j = 0; j < input->cols; j++){
             setMatrix(input, i, j, sigmoidFunc(getMatrix(input, i, j)));
         }
     }
+    PROFILE_END(sigmoid, "sigmoid", -1, 3.0 * input->rows * input->cols, 8.0 * input->rows * input->cols);
 }
 
 float tanHFunc(float input){
@@ -97,26 +110,31 @@ float tanHDeriv(float tanhInput){
 
 // operates on each row
 void relu(Matrix* input){
+    PROFILE_BEGIN(relu);
     int i, j;
     for (i = 0; i < input->rows; i++){
         for (j = 0; j < input->cols; j++){
             setMatrix(input, i, j, reluFunc(getMatrix(input, i, j)));
         }
     }
+    PROFILE_END(relu, "relu", -1, input->rows * input->cols, 8.0 * input->rows * input->cols);
 }
 
 // operates on each row
 void tanH(Matrix* input){
+    PROFILE_BEGIN(tanH);
     int i, j;
     for (i = 0; i < input->rows; i++){
         for (j = 0; j < input->cols; j++){
             setMatrix(input, i, j, tanHFunc(getMatrix(input, i, j)));
         }
     }
+    PROFILE_END(tanH, "tanH", -1, input->rows * input->cols, 8.0 * input->rows * input->cols);
 }
 
 // operates on each row
 void softmax(Matrix* input){
+    PROFILE_BEGIN(softmax);
     int i;
     for (i = 0; i < input->rows; i++){
         float summed = 0;
@@ -128,6 +146,7 @@ void softmax(Matrix* input){
             setMatrix(input, i, j, expf(getMatrix(input, i, j)) / summed);
         }
     }
+    PROFILE_END(softmax, "softmax", -1, 4.0 * input->rows * input->cols, 12.0 * input->rows * input->cols);
 }
 
 // operates on each row
@@ -157,6 +176,32 @@ float box_muller(){
     return z0;
 }
 
+// splitmix64
+uint64_t randomBits(uint64_t* state){
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// rejects the top sliver of values so every result is equally likely
+size_t randomBelow(uint64_t* state, size_t bound){
+    assert(bound > 0);
+    uint64_t limit = UINT64_MAX - UINT64_MAX % bound;
+    uint64_t bits;
+    do{
+        bits = randomBits(state);
+    } while (bits >= limit);
+    return bits % bound;
+}
+
+// Box-Muller on the top 53 bits of two draws, the first in (0, 1]
+float randomGaussian(uint64_t* state){
+    double u1 = ((randomBits(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double u2 = (randomBits(state) >> 11) * (1.0 / 9007199254740992.0);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * 3.14159265358979323846 * u2);
+}
+
 const char* getFunctionName(Activation func){
     if (func == sigmoid){
         return "sigmoid";
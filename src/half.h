@@ -0,0 +1,291 @@
+#include "std_includes.h"
+#include "matrix.h"
+
+#ifndef HALF_H
+#define HALF_H
+
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// storage formats available for connection weights
+typedef enum PRECISION_ {
+    FLOAT32,
+    FLOAT16,
+    BFLOAT16
+} PRECISION;
+
+// represents a matrix of 16 bit floats in row-major order
+typedef struct HalfMatrix_ {
+    size_t rows;
+    size_t cols;
+    PRECISION precision;
+    uint16_t* data;
+} HalfMatrix;
+
+// converts a float to IEEE half precision (round to nearest even)
+static uint16_t floatToHalf(float input);
+
+// converts an IEEE half precision value to a float
+static float halfToFloat(uint16_t input);
+
+// converts a float to bfloat16 (round to nearest even)
+static uint16_t floatToBFloat16(float input);
+
+// converts a bfloat16 value to a float
+static float bfloat16ToFloat(uint16_t input);
+
+// converts a float to the given 16 bit precision
+static uint16_t encodeHalf(float input, PRECISION precision);
+
+// converts a value of the given 16 bit precision to a float
+static float decodeHalf(uint16_t input, PRECISION precision);
+
+// returns $input rounded to the nearest value representable in $precision
+static float roundToPrecision(float input, PRECISION precision);
+
+// creates a 16 bit copy of $orig in the given precision
+static HalfMatrix* createHalfMatrix(Matrix* orig, PRECISION precision);
+
+// re-encodes the values of $from into an existing half matrix
+static void encodeHalfInto(Matrix* from, HalfMatrix* to);
+
+// widens the values of $from into an existing float matrix
+static void decodeHalfInto(HalfMatrix* from, Matrix* to);
+
+// adds $a times the widened values of $x to $y ($n entries)
+static void halfAxpy(float a, const uint16_t* x, float* y, size_t n, PRECISION precision);
+
+// multiplies $A and $B (ordering: AB) and places values into $into
+// $B is widened on the fly, accumulation is done in 32 bit floats
+static void multiplyHalfInto(Matrix* A, HalfMatrix* B, Matrix* into);
+
+// return the string representation of a precision
+static const char* getPrecisionName(PRECISION precision);
+
+// return the precision corresponding to a name
+static PRECISION getPrecisionByName(const char* name);
+
+// frees a half matrix and its data
+static void destroyHalfMatrix(HalfMatrix* matrix);
+
+
+/*
+    Begin functions.
+*/
+
+static uint32_t floatBits(float input){
+    uint32_t bits;
+    memcpy(&bits, &input, sizeof(bits));
+    return bits;
+}
+
+static float bitsToFloat(uint32_t bits){
+    float output;
+    memcpy(&output, &bits, sizeof(output));
+    return output;
+}
+
+uint16_t floatToHalf(float input){
+    uint32_t bits = floatBits(input);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // infinity and NaN (keep NaN quiet)
+    if (exponent == 0xff){
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+    }
+
+    int halfExponent = (int)exponent - 127 + 15;
+    // overflow to infinity
+    if (halfExponent >= 0x1f){
+        return sign | 0x7c00;
+    }
+
+    // subnormal or zero
+    if (halfExponent <= 0){
+        if (halfExponent < -10){
+            return sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - halfExponent;
+        uint32_t halfMantissa = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (halfMantissa & 1))){
+            halfMantissa++;
+        }
+        return sign | halfMantissa;
+    }
+
+    // normal, rounding may carry into the exponent which is still correct
+    uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))){
+        half++;
+    }
+    return sign | half;
+}
+
+float halfToFloat(uint16_t input){
+    uint32_t sign = (uint32_t)(input & 0x8000) << 16;
+    uint32_t exponent = (input >> 10) & 0x1f;
+    uint32_t mantissa = input & 0x3ff;
+    if (exponent == 0x1f){
+        return bitsToFloat(sign | 0x7f800000 | (mantissa << 13));
+    }
+    if (exponent == 0){
+        if (mantissa == 0){
+            return bitsToFloat(sign);
+        }
+        // normalize subnormal
+        exponent = 127 - 15 + 1;
+        while ((mantissa & 0x400) == 0){
+            mantissa <<= 1;
+            exponent--;
+        }
+        mantissa &= 0x3ff;
+        return bitsToFloat(sign | (exponent << 23) | (mantissa << 13));
+    }
+    return bitsToFloat(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+uint16_t floatToBFloat16(float input){
+    uint32_t bits = floatBits(input);
+    if ((bits & 0x7f800000) == 0x7f800000 && (bits & 0x7fffff) != 0){
+        return (bits >> 16) | 0x40;
+    }
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+float bfloat16ToFloat(uint16_t input){
+    return bitsToFloat((uint32_t)input << 16);
+}
+
+uint16_t encodeHalf(float input, PRECISION precision){
+    assert(precision == FLOAT16 || precision == BFLOAT16);
+    return precision == FLOAT16 ? floatToHalf(input) : floatToBFloat16(input);
+}
+
+float decodeHalf(uint16_t input, PRECISION precision){
+    assert(precision == FLOAT16 || precision == BFLOAT16);
+    return precision == FLOAT16 ? halfToFloat(input) : bfloat16ToFloat(input);
+}
+
+float roundToPrecision(float input, PRECISION precision){
+    if (precision == FLOAT32){
+        return input;
+    }
+    return decodeHalf(encodeHalf(input, precision), precision);
+}
+
+HalfMatrix* createHalfMatrix(Matrix* orig, PRECISION precision){
+    assert(precision == FLOAT16 || precision == BFLOAT16);
+    HalfMatrix* matrix = (HalfMatrix*)malloc(sizeof(HalfMatrix));
+    matrix->rows = orig->rows;
+    matrix->cols = orig->cols;
+    matrix->precision = precision;
+    matrix->data = (uint16_t*)malloc(sizeof(uint16_t) * orig->rows * orig->cols);
+    encodeHalfInto(orig, matrix);
+    return matrix;
+}
+
+void encodeHalfInto(Matrix* from, HalfMatrix* to){
+    assert(from->rows == to->rows && from->cols == to->cols);
+    size_t i;
+    for (i = 0; i < from->rows * from->cols; i++){
+        to->data[i] = encodeHalf(from->data[i], to->precision);
+    }
+}
+
+void decodeHalfInto(HalfMatrix* from, Matrix* to){
+    assert(from->rows == to->rows && from->cols == to->cols);
+    size_t i;
+    for (i = 0; i < from->rows * from->cols; i++){
+        to->data[i] = decodeHalf(from->data[i], from->precision);
+    }
+}
+
+// the 8-wide paths widen in registers; anything left over goes through
+// the scalar conversion
+void halfAxpy(float a, const uint16_t* x, float* y, size_t n, PRECISION precision){
+    size_t i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+    if (precision == FLOAT16){
+        __m256 va = _mm256_set1_ps(a);
+        for (; i + 8 <= n; i += 8){
+            __m256 vx = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(x + i)));
+            _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(va, vx)));
+        }
+    }
+#endif
+#if defined(__AVX2__)
+    if (precision == BFLOAT16){
+        __m256 va = _mm256_set1_ps(a);
+        for (; i + 8 <= n; i += 8){
+            __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(x + i)));
+            __m256 vx = _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+            _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(va, vx)));
+        }
+    }
+#endif
+    if (precision == FLOAT16){
+        for (; i < n; i++){
+            y[i] += a * halfToFloat(x[i]);
+        }
+    }
+    else{
+        for (; i < n; i++){
+            y[i] += a * bfloat16ToFloat(x[i]);
+        }
+    }
+}
+
+void multiplyHalfInto(Matrix* A, HalfMatrix* B, Matrix* into){
+    assert(A->cols == B->rows);
+    assert(A->rows == into->rows && B->cols == into->cols);
+    size_t i, k;
+    for (i = 0; i < A->rows; i++){
+        float* row = into->data + i * into->cols;
+        memset(row, 0, sizeof(float) * into->cols);
+        for (k = 0; k < A->cols; k++){
+            float a = getMatrix(A, i, k);
+            if (a != 0){
+                halfAxpy(a, B->data + k * B->cols, row, B->cols, B->precision);
+            }
+        }
+    }
+}
+
+const char* getPrecisionName(PRECISION precision){
+    if (precision == FLOAT16){
+        return "float16";
+    }
+    else if (precision == BFLOAT16){
+        return "bfloat16";
+    }
+    else{
+        return "float32";
+    }
+}
+
+PRECISION getPrecisionByName(const char* name){
+    if (strcmp(name, "float16") == 0){
+        return FLOAT16;
+    }
+    else if (strcmp(name, "bfloat16") == 0){
+        return BFLOAT16;
+    }
+    else{
+        return FLOAT32;
+    }
+}
+
+void destroyHalfMatrix(HalfMatrix* matrix){
+    free(matrix->data);
+    free(matrix);
+}
+
+#endif
\ No newline at end of file
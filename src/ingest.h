@@ -0,0 +1,485 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+
+#ifndef INGEST_H
+#define INGEST_H
+
+// longest number handed to strtof when the fast parser cannot be exact;
+// longer numbers are rejected rather than cut short
+#define INGEST_MAX_TOKEN 64
+
+// parses the number at *$cursor (before $end) into $value and advances
+// past it; correctly rounded for every input, with a fast path for up to
+// 15 significant digits
+// the decimal point is always '.', whatever the locale
+// returns 0 on success, -1 if no number is present or it is longer than
+// INGEST_MAX_TOKEN - 1 characters and needs the slow path
+static int parseFloat(const char** cursor, const char* end, float* value);
+
+// loads a CSV file of numbers into contiguous $data and $classes datasets
+// column $targetColumn (counted from the end if negative) holds the target;
+// if $numClasses is positive it is a class index expanded to $numClasses
+// one-hot columns, otherwise it is a single float target
+// every other column becomes a feature; empty fields are read as NAN
+// if $hasHeader is non-zero the first line is skipped
+// the file is split into byte ranges parsed on $numThreads threads (with
+// CRANIUM_USE_POSIX)
+// returns 0 on success, -1 if the file is missing or malformed
+static int loadCSV(const char* path, int targetColumn, int numClasses, int hasHeader, int numThreads, DataSet** data, DataSet** classes);
+
+// loads a LIBSVM file ("label index:value ...", indices from 1) into
+// contiguous $data and $classes datasets
+// $numFeatures of 0 takes the largest index in the file
+// labels are as for loadCSV's target, except that a class label of -1 is
+// read as class 0 so binary files with -1/+1 labels load directly
+// returns 0 on success, -1 if the file is missing or malformed
+static int loadLIBSVM(const char* path, size_t numFeatures, int numClasses, int numThreads, DataSet** data, DataSet** classes);
+
+
+/*
+    Begin functions.
+*/
+
+// powers of ten that are exact, so that one multiply or divide rounds correctly
+static const double exactPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const float exactPowersOfTenFloat[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+int parseFloat(const char** cursor, const char* end, float* value){
+    const char* s = *cursor;
+    int negative = 0;
+    if (s < end && (*s == '-' || *s == '+')){
+        negative = *s == '-';
+        s++;
+    }
+    uint64_t mantissa = 0;
+    int significant = 0, exponent = 0, numDigits = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; s++, numDigits++){
+        if (mantissa != 0 || *s != '0'){
+            mantissa = mantissa * 10 + (*s - '0');
+            significant++;
+        }
+    }
+    if (s < end && *s == '.'){
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, numDigits++){
+            if (mantissa != 0 || *s != '0'){
+                mantissa = mantissa * 10 + (*s - '0');
+                significant++;
+            }
+            exponent--;
+        }
+    }
+    if (numDigits > 0 && s < end && (*s == 'e' || *s == 'E')){
+        const char* e = s + 1;
+        int exponentSign = 1, power = 0;
+        if (e < end && (*e == '-' || *e == '+')){
+            exponentSign = *e == '-' ? -1 : 1;
+            e++;
+        }
+        if (e < end && *e >= '0' && *e <= '9'){
+            for (; e < end && *e >= '0' && *e <= '9'; e++){
+                power = power < 100000 ? power * 10 + (*e - '0') : power;
+            }
+            exponent += exponentSign * power;
+            s = e;
+        }
+    }
+
+    // a single float operation on exact operands rounds correctly
+    if (numDigits > 0 && significant <= 7 && exponent >= -10 && exponent <= 10){
+        float result = exponent < 0 ? (float)mantissa / exactPowersOfTenFloat[-exponent] : (float)mantissa * exactPowersOfTenFloat[exponent];
+        *value = negative ? -result : result;
+        *cursor = s;
+        return 0;
+    }
+
+    // the double is correctly rounded when both the digits and the power of
+    // ten are exact doubles, and rounding it again to a float is only wrong
+    // when it lies exactly halfway between two normal floats, which shows in
+    // the 29 mantissa bits a float drops
+    if (numDigits > 0 && significant <= 15 && exponent >= -22 && exponent <= 22){
+        double result = exponent < 0 ? mantissa / exactPowersOfTen[-exponent] : mantissa * exactPowersOfTen[exponent];
+        uint64_t bits;
+        memcpy(&bits, &result, sizeof(bits));
+        if (result == 0 || (result >= FLT_MIN && result <= FLT_MAX && (bits & 0x1fffffff) != 0x10000000)){
+            float rounded = (float)result;
+            *value = negative ? -rounded : rounded;
+            *cursor = s;
+            return 0;
+        }
+    }
+
+    // long numbers, extreme exponents, inf and nan; strtof reads the
+    // locale's decimal point, so the token's '.' is swapped for it, and a
+    // character that is only a decimal point in the locale ends the token
+    char token[INGEST_MAX_TOKEN];
+    char point = localeconv()->decimal_point[0];
+    size_t length = 0;
+    const char* t = *cursor;
+    while (t < end && *t != ',' && *t != ' ' && *t != '\t' && *t != '\n' && *t != '\r' && (*t == '.' || *t != point)){
+        if (length == INGEST_MAX_TOKEN - 1){
+            return -1;
+        }
+        token[length++] = *t == '.' ? point : *t;
+        t++;
+    }
+    token[length] = '\0';
+    char* parsedEnd;
+    *value = strtof(token, &parsedEnd);
+    if (parsedEnd == token){
+        return -1;
+    }
+    *cursor += parsedEnd - token;
+    return 0;
+}
+
+// what one thread parses: whole lines in [start, end)
+typedef struct IngestRange_ {
+    const char* start;
+    const char* end;
+    size_t rows;
+    size_t firstRow;
+    size_t maxIndex;
+    int status;
+
+    // shared by every range
+    int libsvm;
+    size_t cols;
+    int targetColumn;
+    int numClasses;
+    DataSet* data;
+    DataSet* classes;
+} IngestRange;
+
+static int isBlankLine(const char* line, const char* end){
+    for (; line < end; line++){
+        if (*line != ' ' && *line != '\t' && *line != '\r'){
+            return *line == '#';
+        }
+    }
+    return 1;
+}
+
+static const char* lineEnd(const char* line, const char* end){
+    const char* newline = (const char*)memchr(line, '\n', end - line);
+    return newline != NULL ? newline : end;
+}
+
+static const char* skipSpaces(const char* s, const char* end){
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r')){
+        s++;
+    }
+    return s;
+}
+
+// places a parsed target into row $row of $classes
+static int storeTarget(IngestRange* range, size_t row, float target){
+    if (range->numClasses <= 0){
+        range->classes->data[row][0] = target;
+        return 0;
+    }
+    float label = target == -1 && range->libsvm ? 0 : target;
+    if (!(label >= 0 && label < range->numClasses) || label != floorf(label)){
+        return -1;
+    }
+    range->classes->data[row][(int)label] = 1;
+    return 0;
+}
+
+// first pass: counts rows, and for LIBSVM finds the largest feature index
+static void* countIngestRange(void* arg){
+    IngestRange* range = (IngestRange*)arg;
+    const char* line = range->start;
+    range->rows = 0;
+    range->maxIndex = 0;
+    range->status = 0;
+    while (line < range->end){
+        const char* stop = lineEnd(line, range->end);
+        if (!isBlankLine(line, stop)){
+            range->rows++;
+            if (range->libsvm){
+                const char* s = line;
+                while ((s = (const char*)memchr(s, ':', stop - s)) != NULL){
+                    const char* digit = s;
+                    size_t index = 0, scale = 1;
+                    while (digit > line && digit[-1] >= '0' && digit[-1] <= '9'){
+                        digit--;
+                        index += (*digit - '0') * scale;
+                        scale *= 10;
+                    }
+                    range->maxIndex = MAX(range->maxIndex, index);
+                    s++;
+                }
+            }
+        }
+        line = stop + 1;
+    }
+    return NULL;
+}
+
+static int parseCSVLine(IngestRange* range, const char* s, const char* stop, size_t row){
+    float* features = range->data->data[row];
+    size_t col, feature = 0;
+    for (col = 0; col < range->cols; col++){
+        float value = NAN;
+        s = skipSpaces(s, stop);
+        if (s < stop && *s != ','){
+            if (parseFloat(&s, stop, &value) != 0){
+                return -1;
+            }
+            s = skipSpaces(s, stop);
+        }
+        if (col == range->targetColumn){
+            if (storeTarget(range, row, value) != 0){
+                return -1;
+            }
+        }
+        else{
+            features[feature++] = value;
+        }
+        if (col < range->cols - 1){
+            if (s >= stop || *s != ','){
+                return -1;
+            }
+            s++;
+        }
+    }
+    return s == stop ? 0 : -1;
+}
+
+static int parseLIBSVMLine(IngestRange* range, const char* s, const char* stop, size_t row){
+    float* features = range->data->data[row];
+    float target;
+    s = skipSpaces(s, stop);
+    if (parseFloat(&s, stop, &target) != 0 || storeTarget(range, row, target) != 0){
+        return -1;
+    }
+    while ((s = skipSpaces(s, stop)) < stop){
+        if (*s == '#'){
+            return 0;
+        }
+        size_t index = 0;
+        const char* digits = s;
+        for (; s < stop && *s >= '0' && *s <= '9'; s++){
+            index = index * 10 + (*s - '0');
+        }
+        if (s == digits || s >= stop || *s != ':'){
+            // skip other annotations such as qid:
+            while (s < stop && *s != ' ' && *s != '\t'){
+                s++;
+            }
+            continue;
+        }
+        s++;
+        float value;
+        if (parseFloat(&s, stop, &value) != 0 || index == 0){
+            return -1;
+        }
+        if (index <= range->data->cols){
+            features[index - 1] = value;
+        }
+    }
+    return 0;
+}
+
+// second pass: parses every row into its slot
+static void* parseIngestRange(void* arg){
+    IngestRange* range = (IngestRange*)arg;
+    const char* line = range->start;
+    size_t row = range->firstRow;
+    range->status = 0;
+    while (line < range->end && range->status == 0){
+        const char* stop = lineEnd(line, range->end);
+        if (!isBlankLine(line, stop)){
+            const char* trimmed = stop;
+            while (trimmed > line && trimmed[-1] == '\r'){
+                trimmed--;
+            }
+            if (range->libsvm){
+                range->status = parseLIBSVMLine(range, line, trimmed, row);
+            }
+            else{
+                range->status = parseCSVLine(range, line, trimmed, row);
+            }
+            row++;
+        }
+        line = stop + 1;
+    }
+    return NULL;
+}
+
+// runs $pass over every range, on threads if available
+static void runIngestPass(IngestRange* ranges, int numRanges, void* (*pass)(void*)){
+    int i;
+#ifdef CRANIUM_USE_POSIX
+    pthread_t threads[numRanges];
+    int started[numRanges];
+    for (i = 1; i < numRanges; i++){
+        started[i] = pthread_create(&threads[i], NULL, pass, &ranges[i]) == 0;
+        if (!started[i]){
+            pass(&ranges[i]);
+        }
+    }
+    pass(&ranges[0]);
+    for (i = 1; i < numRanges; i++){
+        if (started[i]){
+            pthread_join(threads[i], NULL);
+        }
+    }
+#else
+    for (i = 0; i < numRanges; i++){
+        pass(&ranges[i]);
+    }
+#endif
+}
+
+// reads the whole file into memory, mapping it with CRANIUM_USE_POSIX
+static char* readWholeFile(const char* path, size_t* size, int* mapped){
+    *mapped = 0;
+#ifdef CRANIUM_USE_POSIX
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0){
+        void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED){
+            close(fd);
+            *size = info.st_size;
+            *mapped = 1;
+            return (char*)mapping;
+        }
+    }
+    close(fd);
+#endif
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL){
+        return NULL;
+    }
+    size_t capacity = 1 << 16, length = 0, got;
+    char* contents = (char*)malloc(capacity);
+    while ((got = fread(contents + length, 1, capacity - length, fp)) > 0){
+        length += got;
+        if (length == capacity){
+            capacity *= 2;
+            contents = (char*)realloc(contents, capacity);
+        }
+    }
+    fclose(fp);
+    *size = length;
+    return contents;
+}
+
+static void releaseWholeFile(char* contents, size_t size, int mapped){
+#ifdef CRANIUM_USE_POSIX
+    if (mapped){
+        munmap(contents, size);
+        return;
+    }
+#endif
+    free(contents);
+}
+
+// shared driver for both formats
+static int loadText(const char* path, int libsvm, int targetColumn, size_t numFeatures, int numClasses, int hasHeader, int numThreads, DataSet** data, DataSet** classes){
+    assert(numThreads >= 1);
+    size_t size;
+    int mapped;
+    char* contents = readWholeFile(path, &size, &mapped);
+    if (contents == NULL){
+        return -1;
+    }
+    const char* start = contents,* end = contents + size;
+    while (start < end && isBlankLine(start, lineEnd(start, end))){
+        start = lineEnd(start, end) + 1;
+    }
+    if (hasHeader && start < end){
+        start = lineEnd(start, end) + 1;
+    }
+
+    // CSV columns come from the first row
+    size_t cols = 0;
+    if (!libsvm && start < end){
+        const char* stop = lineEnd(start, end);
+        const char* s;
+        for (cols = 1, s = start; s < stop; s++){
+            cols += *s == ',';
+        }
+        if (targetColumn < 0){
+            targetColumn += cols;
+        }
+        if (targetColumn < 0 || targetColumn >= cols || cols < 2){
+            releaseWholeFile(contents, size, mapped);
+            return -1;
+        }
+    }
+
+    // split into byte ranges that end on line boundaries
+    int numRanges = MAX(1, MIN(numThreads, (int)((end - start) / 4096) + 1));
+    IngestRange ranges[numRanges];
+    int i;
+    for (i = 0; i < numRanges; i++){
+        const char* cut = i == numRanges - 1 ? end : start + (end - start) * (i + 1) / numRanges;
+        ranges[i].start = i == 0 ? start : ranges[i - 1].end;
+        if (cut < ranges[i].start){
+            cut = ranges[i].start;
+        }
+        if (cut < end){
+            cut = lineEnd(cut, end) + (lineEnd(cut, end) < end);
+        }
+        ranges[i].end = cut;
+        ranges[i].libsvm = libsvm;
+        ranges[i].cols = cols;
+        ranges[i].targetColumn = targetColumn;
+        ranges[i].numClasses = numClasses;
+    }
+    runIngestPass(ranges, numRanges, countIngestRange);
+
+    size_t rows = 0, maxIndex = 0;
+    for (i = 0; i < numRanges; i++){
+        ranges[i].firstRow = rows;
+        rows += ranges[i].rows;
+        maxIndex = MAX(maxIndex, ranges[i].maxIndex);
+    }
+    size_t featureCols = libsvm ? (numFeatures > 0 ? numFeatures : maxIndex) : cols - 1;
+    if (rows == 0 || featureCols == 0){
+        releaseWholeFile(contents, size, mapped);
+        return -1;
+    }
+    *data = createDataSetContiguous(rows, featureCols);
+    *classes = createDataSetContiguous(rows, numClasses > 0 ? numClasses : 1);
+    for (i = 0; i < numRanges; i++){
+        ranges[i].data = *data;
+        ranges[i].classes = *classes;
+    }
+    runIngestPass(ranges, numRanges, parseIngestRange);
+    releaseWholeFile(contents, size, mapped);
+
+    for (i = 0; i < numRanges; i++){
+        if (ranges[i].status != 0){
+            destroyDataSet(*data);
+            destroyDataSet(*classes);
+            *data = NULL;
+            *classes = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int loadCSV(const char* path, int targetColumn, int numClasses, int hasHeader, int numThreads, DataSet** data, DataSet** classes){
+    return loadText(path, 0, targetColumn, 0, numClasses, hasHeader, numThreads, data, classes);
+}
+
+int loadLIBSVM(const char* path, size_t numFeatures, int numClasses, int numThreads, DataSet** data, DataSet** classes){
+    return loadText(path, 1, 0, numFeatures, numClasses, 0, numThreads, data, classes);
+}
+
+#endif
\ No newline at end of file
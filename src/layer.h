@@ -1,6 +1,8 @@
 #include "std_includes.h"
 #include "matrix.h"
 #include "function.h"
+#include "half.h"
+#include "sparse.h"
 
 #ifndef LAYER_H
 #define LAYER_H
@@ -29,6 +31,14 @@ typedef struct Connection_ {
     Layer* to;
     Matrix* weights; // (from_size x to_size)
     Matrix* bias; // (1 x to_size)
+    PRECISION precision; // storage used by the forward pass
+    HalfMatrix* halfWeights; // 16 bit copy of weights, if precision is not FLOAT32
+    HalfMatrix* halfBias; // 16 bit copy of bias, if precision is not FLOAT32
+    SparseMatrix* sparseWeights; // non-zero pattern of weights, if pruned
+    Matrix* factorU; // (from_size x rank), if factorized; trained in place of
+                     // the weights, which then hold factorU * factorV
+    Matrix* factorV; // (rank x to_size), if factorized
+    int external; // if non-zero, weights and bias data are owned elsewhere
 } Connection;
 
 // returns layer given metadata and configuration
@@ -40,6 +50,57 @@ static Connection* createConnection(Layer* from, Layer* to);
 // initializes weights and biases within connection
 static void initializeConnection(Connection* connection);
 
+// replaces the weights and bias of a connection, freeing the old ones
+// (but not their data if it is owned elsewhere); the connection owns the new ones
+static void setConnectionMatrices(Connection* connection, Matrix* weights, Matrix* bias);
+
+// sets the storage precision the forward pass reads weights and bias in
+// the float weights are rounded to that precision so both copies agree
+static void setConnectionPrecision(Connection* connection, PRECISION precision);
+
+// fixes the pattern of non-zero weights, so weights that are zero now
+// stay zero through training, and stores them sparsely for the forward pass
+static void sparsifyConnection(Connection* connection);
+
+// drops the sparse pattern so every weight can be trained again
+static void densifyConnection(Connection* connection);
+
+// drops the factorization so the forward pass uses the full weights again
+static void unfactorizeConnection(Connection* connection);
+
+// rebuilds any derived weight storage after the float weights have changed
+// the weights of a factorized connection are first set to U * V, since its
+// factors are what holds its values, and the weights and bias of a 16 bit
+// connection are rounded to its precision
+static void refreshConnection(Connection* connection);
+
+// recreates derived weight storage after the shape of the weights changed
+// the factors of a factorized connection must already have the new shape
+static void rebuildConnection(Connection* connection);
+
+// recreates derived storage for weights that already hold their rounded,
+// pruned or factorized values (e.g. just loaded), without writing to them
+// $factorU and $factorV, if not NULL, are the stored factors of the weights
+// and are owned by the connection from then on; unless it is also pruned,
+// its weights are then rebuilt from them, so a format need not store both
+static void restoreConnection(Connection* connection, PRECISION precision, int pruned, Matrix* factorU, Matrix* factorV);
+
+// places $input * weights + bias into $output, reading the weights from
+// factorized, sparse or 16 bit storage when the connection has them
+// a factorized connection keeps $input * U in $scratch, which holds
+// connectionScratchSize floats, or is allocated for the call if NULL
+static void connectionForwardInto(Connection* connection, Matrix* input, Matrix* output, float* scratch);
+
+// places sparse $input * weights + bias into $output, in time proportional
+// to the stored entries of $input rather than its width; reads the float
+// weights, or the factors of a factorized connection, using $scratch as
+// connectionForwardInto does
+static void connectionForwardSparseInto(Connection* connection, SparseMatrix* input, Matrix* output, float* scratch);
+
+// floats of scratch a pass of $rows rows through $connection needs, which
+// is 0 unless it is factorized
+static size_t connectionScratchSize(Connection* connection, size_t rows);
+
 // applies activation function to each input in layer
 static void activateLayer(Layer* layer);
 
@@ -49,6 +110,11 @@ static void destroyLayer(Layer* layer);
 // frees connection, its weights, and biases, but not its layers
 static void destroyConnection(Connection* connection);
 
+// floating-point operations and bytes of a dense pass of $rows rows through
+// $connection, as the profiler counts them
+static double connectionFlops(Connection* connection, size_t rows);
+static double connectionBytes(Connection* connection, size_t rows);
+
 
 /*
     Begin functions.
@@ -72,6 +138,13 @@ Connection* createConnection(Layer* from, Layer* to){
     connection->weights = createMatrix(from->size, to->size, weights_data);
     float* bias_data = (float*)malloc(sizeof(float) * to->size);
     connection->bias = createMatrix(1, to->size, bias_data);
+    connection->precision = FLOAT32;
+    connection->halfWeights = NULL;
+    connection->halfBias = NULL;
+    connection->sparseWeights = NULL;
+    connection->factorU = NULL;
+    connection->factorV = NULL;
+    connection->external = 0;
     return connection;
 }
 
@@ -90,6 +163,185 @@ void initializeConnection(Connection* connection){
     }
 }
 
+void setConnectionMatrices(Connection* connection, Matrix* weights, Matrix* bias){
+    if (connection->external){
+        free(connection->weights);
+        free(connection->bias);
+    }
+    else{
+        destroyMatrix(connection->weights);
+        destroyMatrix(connection->bias);
+    }
+    connection->weights = weights;
+    connection->bias = bias;
+    connection->external = 0;
+}
+
+void setConnectionPrecision(Connection* connection, PRECISION precision){
+    if (connection->halfWeights != NULL){
+        destroyHalfMatrix(connection->halfWeights);
+        destroyHalfMatrix(connection->halfBias);
+        connection->halfWeights = NULL;
+        connection->halfBias = NULL;
+    }
+    connection->precision = precision;
+    if (precision == FLOAT32){
+        return;
+    }
+    size_t i;
+    for (i = 0; i < connection->weights->rows * connection->weights->cols; i++){
+        connection->weights->data[i] = roundToPrecision(connection->weights->data[i], precision);
+    }
+    for (i = 0; i < connection->bias->cols; i++){
+        connection->bias->data[i] = roundToPrecision(connection->bias->data[i], precision);
+    }
+    connection->halfWeights = createHalfMatrix(connection->weights, precision);
+    connection->halfBias = createHalfMatrix(connection->bias, precision);
+}
+
+void sparsifyConnection(Connection* connection){
+    densifyConnection(connection);
+    connection->sparseWeights = createSparseMatrix(connection->weights);
+}
+
+void densifyConnection(Connection* connection){
+    if (connection->sparseWeights != NULL){
+        destroySparseMatrix(connection->sparseWeights);
+        connection->sparseWeights = NULL;
+    }
+}
+
+void unfactorizeConnection(Connection* connection){
+    if (connection->factorU != NULL){
+        destroyMatrix(connection->factorU);
+        destroyMatrix(connection->factorV);
+        connection->factorU = NULL;
+        connection->factorV = NULL;
+    }
+}
+
+// sparse weights are refreshed before encoding, since doing so re-zeroes
+// pruned weights
+void refreshConnection(Connection* connection){
+    if (connection->factorU != NULL){
+        multiplyInto(connection->factorU, connection->factorV, connection->weights);
+    }
+    if (connection->precision != FLOAT32){
+        size_t i;
+        for (i = 0; i < connection->weights->rows * connection->weights->cols; i++){
+            connection->weights->data[i] = roundToPrecision(connection->weights->data[i], connection->precision);
+        }
+        for (i = 0; i < connection->bias->cols; i++){
+            connection->bias->data[i] = roundToPrecision(connection->bias->data[i], connection->precision);
+        }
+    }
+    if (connection->sparseWeights != NULL){
+        refreshSparseFrom(connection->weights, connection->sparseWeights);
+    }
+    if (connection->halfWeights != NULL){
+        encodeHalfInto(connection->weights, connection->halfWeights);
+        encodeHalfInto(connection->bias, connection->halfBias);
+    }
+}
+
+void rebuildConnection(Connection* connection){
+    if (connection->factorU != NULL){
+        assert(connection->factorU->rows == connection->weights->rows && connection->factorV->cols == connection->weights->cols);
+        multiplyInto(connection->factorU, connection->factorV, connection->weights);
+    }
+    if (connection->sparseWeights != NULL){
+        sparsifyConnection(connection);
+    }
+    setConnectionPrecision(connection, connection->precision);
+}
+
+void restoreConnection(Connection* connection, PRECISION precision, int pruned, Matrix* factorU, Matrix* factorV){
+    if (factorU != NULL){
+        assert(factorU->rows == connection->weights->rows && factorV->cols == connection->weights->cols && factorU->cols == factorV->rows);
+        connection->factorU = factorU;
+        connection->factorV = factorV;
+    }
+    if (factorU != NULL && !pruned){
+        multiplyInto(factorU, factorV, connection->weights);
+        size_t i;
+        for (i = 0; precision != FLOAT32 && i < connection->weights->rows * connection->weights->cols; i++){
+            connection->weights->data[i] = roundToPrecision(connection->weights->data[i], precision);
+        }
+    }
+    if (precision == FLOAT16 || precision == BFLOAT16){
+        connection->precision = precision;
+        connection->halfWeights = createHalfMatrix(connection->weights, precision);
+        connection->halfBias = createHalfMatrix(connection->bias, precision);
+    }
+    if (pruned){
+        sparsifyConnection(connection);
+    }
+}
+
+size_t connectionScratchSize(Connection* connection, size_t rows){
+    return connection->factorU != NULL ? rows * connection->factorU->cols : 0;
+}
+
+void connectionForwardInto(Connection* connection, Matrix* input, Matrix* output, float* scratch){
+    assert(input->cols == connection->weights->rows);
+    assert(output->rows == input->rows && output->cols == connection->weights->cols);
+    size_t i, j;
+    int halfBias = 0;
+    if (connection->factorU != NULL){
+        Matrix product = {input->rows, connection->factorU->cols, scratch};
+        if (scratch == NULL){
+            product.data = (float*)malloc(sizeof(float) * connectionScratchSize(connection, input->rows));
+        }
+        multiplyInto(input, connection->factorU, &product);
+        multiplyInto(&product, connection->factorV, output);
+        if (scratch == NULL){
+            free(product.data);
+        }
+    }
+    else if (connection->sparseWeights != NULL && sparseDensity(connection->sparseWeights) <= CRANIUM_SPARSE_MAX_DENSITY){
+        multiplyDenseSparseInto(input, connection->sparseWeights, output);
+    }
+    else if (connection->halfWeights != NULL){
+        multiplyHalfInto(input, connection->halfWeights, output);
+        halfBias = 1;
+    }
+    else{
+        multiplyInto(input, connection->weights, output);
+    }
+    for (i = 0; i < output->rows; i++){
+        for (j = 0; j < output->cols; j++){
+            output->data[i * output->cols + j] += halfBias ? decodeHalf(connection->halfBias->data[j], connection->precision) : connection->bias->data[j];
+        }
+    }
+}
+
+// the float weights always hold the rounded and pruned values, so they give
+// the same outputs as the 16 bit and sparse copies
+void connectionForwardSparseInto(Connection* connection, SparseMatrix* input, Matrix* output, float* scratch){
+    assert(input->cols == connection->weights->rows);
+    assert(output->rows == input->rows && output->cols == connection->weights->cols);
+    size_t i, j;
+    if (connection->factorU != NULL){
+        Matrix product = {input->rows, connection->factorU->cols, scratch};
+        if (scratch == NULL){
+            product.data = (float*)malloc(sizeof(float) * connectionScratchSize(connection, input->rows));
+        }
+        multiplySparseDenseInto(input, connection->factorU, &product);
+        multiplyInto(&product, connection->factorV, output);
+        if (scratch == NULL){
+            free(product.data);
+        }
+    }
+    else{
+        multiplySparseDenseInto(input, connection->weights, output);
+    }
+    for (i = 0; i < output->rows; i++){
+        for (j = 0; j < output->cols; j++){
+            output->data[i * output->cols + j] += connection->bias->data[j];
+        }
+    }
+}
+
 // assuming input of layer is filled with raw input,
 // calls activation function on each of them, and
 // modifies in-place
@@ -105,9 +357,30 @@ void destroyLayer(Layer* layer){
 }
 
 void destroyConnection(Connection* connection){
-    destroyMatrix(connection->weights);
-    destroyMatrix(connection->bias);
+    if (connection->external){
+        free(connection->weights);
+        free(connection->bias);
+    }
+    else{
+        destroyMatrix(connection->weights);
+        destroyMatrix(connection->bias);
+    }
+    if (connection->halfWeights != NULL){
+        destroyHalfMatrix(connection->halfWeights);
+        destroyHalfMatrix(connection->halfBias);
+    }
+    densifyConnection(connection);
+    unfactorizeConnection(connection);
     free(connection);
 }
 
+double connectionFlops(Connection* connection, size_t rows){
+    return 2.0 * rows * connection->weights->rows * connection->weights->cols;
+}
+
+double connectionBytes(Connection* connection, size_t rows){
+    Matrix* weights = connection->weights;
+    return 4.0 * (rows * weights->rows + weights->rows * weights->cols + weights->cols + rows * weights->cols);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+
+#ifndef LOWRANK_H
+#define LOWRANK_H
+
+// extra random directions sampled beyond the requested rank
+#define LOWRANK_OVERSAMPLING 10
+
+// power iterations used to sharpen the sampled range
+#define LOWRANK_POWER_ITERATIONS 2
+
+// seed of the generator the sampling directions are drawn from, so that a
+// factorization is reproducible and leaves rand() alone
+#define LOWRANK_SEED 0x6c6f7772616e6bull
+
+// summary of replacing a connection's weights with a low-rank factorization
+typedef struct FactorizationReport_ {
+    size_t connection;
+    size_t rank; // 0 if no rank met the targets and nothing was changed
+    size_t flopsBefore; // multiply-adds per example through the connection
+    size_t flopsAfter;
+    double secondsBefore; // forward pass time over the evaluation data
+    double secondsAfter;
+    float accuracyBefore;
+    float accuracyAfter;
+} FactorizationReport;
+
+// computes a rank-$rank truncated SVD of $orig (m x n) by randomized range
+// finding, placing the left singular vectors into $left (m x rank), the
+// singular values in decreasing order into $singular, and the right
+// singular vectors into $right (rank x n)
+static void randomizedSVD(Matrix* orig, size_t rank, Matrix** left, float* singular, Matrix** right);
+
+// computes $U (m x rank) and $V (rank x n) such that $U * $V approximates $orig
+static void lowRankFactorize(Matrix* orig, size_t rank, Matrix** U, Matrix** V);
+
+// returns the largest rank at which a factorization of an (m x n) matrix
+// needs at most 1 / $minSpeedup of the multiplications of the matrix itself
+static size_t maxUsefulRank(size_t m, size_t n, float minSpeedup);
+
+// returns the smallest rank whose truncated SVD has relative Frobenius
+// error at most $tolerance and that is within maxUsefulRank, or 0 if none is
+static size_t chooseRank(Matrix* orig, float tolerance, float minSpeedup);
+
+// multiplies $A by the factorization $U * $V (ordering: AUV) and places
+// values into $into, using $scratch (A rows x rank) for the intermediate
+static void multiplyFactorizedInto(Matrix* A, Matrix* U, Matrix* V, Matrix* scratch, Matrix* into);
+
+// replaces the weights with a rank-$rank factorization U * V, which the
+// forward pass multiplies through as two smaller matrices, and which
+// training updates from then on
+static void factorizeConnection(Connection* connection, size_t rank);
+
+// factorizes connection $index at the smallest rank with relative error at
+// most $tolerance that multiplies at least $minSpeedup times fewer values,
+// timing forward passes over $data and measuring accuracy on $classes
+// (if not NULL) before and after
+static FactorizationReport factorizeNetworkConnection(Network* network, size_t index, float tolerance, float minSpeedup, DataSet* data, DataSet* classes);
+
+// prints a factorization report
+static void printFactorizationReport(FactorizationReport report);
+
+
+/*
+    Begin functions.
+*/
+
+// modified Gram-Schmidt, run twice for stability, on the columns of $Q
+// columns that are linearly dependent on earlier ones are zeroed
+static void orthonormalizeColumns(Matrix* Q){
+    size_t i, j, k;
+    int pass;
+    for (j = 0; j < Q->cols; j++){
+        for (pass = 0; pass < 2; pass++){
+            for (k = 0; k < j; k++){
+                double dot = 0;
+                for (i = 0; i < Q->rows; i++){
+                    dot += getMatrix(Q, i, j) * getMatrix(Q, i, k);
+                }
+                for (i = 0; i < Q->rows; i++){
+                    setMatrix(Q, i, j, getMatrix(Q, i, j) - dot * getMatrix(Q, i, k));
+                }
+            }
+        }
+        double norm = 0;
+        for (i = 0; i < Q->rows; i++){
+            norm += getMatrix(Q, i, j) * getMatrix(Q, i, j);
+        }
+        norm = sqrt(norm);
+        for (i = 0; i < Q->rows; i++){
+            setMatrix(Q, i, j, norm > 1e-20 ? getMatrix(Q, i, j) / norm : 0);
+        }
+    }
+}
+
+// one-sided Jacobi: rotates column pairs of $M (n x l) until they are
+// orthogonal, accumulating the rotations into $V (l x l)
+// afterwards M = U * diag(column norms) and original M = M * V^T
+static void jacobiOrthogonalize(Matrix* M, Matrix* V){
+    size_t i, j, k;
+    int sweep;
+    zeroMatrix(V);
+    for (j = 0; j < V->cols; j++){
+        setMatrix(V, j, j, 1);
+    }
+    for (sweep = 0; sweep < 40; sweep++){
+        int rotated = 0;
+        for (j = 0; j < M->cols; j++){
+            for (k = j + 1; k < M->cols; k++){
+                double alpha = 0, beta = 0, gamma = 0;
+                for (i = 0; i < M->rows; i++){
+                    double a = getMatrix(M, i, j), b = getMatrix(M, i, k);
+                    alpha += a * a;
+                    beta += b * b;
+                    gamma += a * b;
+                }
+                if (fabs(gamma) <= 1e-7 * sqrt(alpha * beta) || gamma == 0){
+                    continue;
+                }
+                rotated = 1;
+                double zeta = (beta - alpha) / (2 * gamma);
+                double t = (zeta >= 0 ? 1 : -1) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+                double c = 1 / sqrt(1 + t * t), s = c * t;
+                for (i = 0; i < M->rows; i++){
+                    double a = getMatrix(M, i, j), b = getMatrix(M, i, k);
+                    setMatrix(M, i, j, c * a - s * b);
+                    setMatrix(M, i, k, s * a + c * b);
+                }
+                for (i = 0; i < V->rows; i++){
+                    double a = getMatrix(V, i, j), b = getMatrix(V, i, k);
+                    setMatrix(V, i, j, c * a - s * b);
+                    setMatrix(V, i, k, s * a + c * b);
+                }
+            }
+        }
+        if (!rotated){
+            break;
+        }
+    }
+}
+
+void randomizedSVD(Matrix* orig, size_t rank, Matrix** left, float* singular, Matrix** right){
+    size_t m = orig->rows, n = orig->cols;
+    size_t limit = m < n ? m : n;
+    assert(rank > 0 && rank <= limit);
+    size_t l = rank + LOWRANK_OVERSAMPLING < limit ? rank + LOWRANK_OVERSAMPLING : limit;
+    size_t i, j;
+    int iter;
+
+    // sample the range of orig and sharpen it with power iterations
+    Matrix* omega = createMatrixZeroes(n, l);
+    uint64_t random = LOWRANK_SEED;
+    for (i = 0; i < n * l; i++){
+        omega->data[i] = randomGaussian(&random);
+    }
+    Matrix* Q = multiply(orig, omega);
+    orthonormalizeColumns(Q);
+    Matrix* origT = transpose(orig);
+    for (iter = 0; iter < LOWRANK_POWER_ITERATIONS; iter++){
+        multiplyInto(origT, Q, omega);
+        orthonormalizeColumns(omega);
+        multiplyInto(orig, omega, Q);
+        orthonormalizeColumns(Q);
+    }
+
+    // project onto the sampled range: orig ~ Q * B, so B^T = orig^T * Q
+    Matrix* BT = multiply(origT, Q);
+    Matrix* W = createMatrixZeroes(l, l);
+    jacobiOrthogonalize(BT, W);
+
+    // singular values are the column norms of the rotated B^T
+    float norms[l];
+    size_t order[l];
+    for (j = 0; j < l; j++){
+        double norm = 0;
+        for (i = 0; i < n; i++){
+            norm += getMatrix(BT, i, j) * getMatrix(BT, i, j);
+        }
+        norms[j] = sqrt(norm);
+        order[j] = j;
+    }
+    for (i = 1; i < l; i++){
+        size_t cur = order[i];
+        for (j = i; j > 0 && norms[order[j - 1]] < norms[cur]; j--){
+            order[j] = order[j - 1];
+        }
+        order[j] = cur;
+    }
+
+    // B = W * diag(norms) * normalized(BT)^T, so orig ~ (Q * W) * diag * normalized(BT)^T
+    Matrix* QW = multiply(Q, W);
+    *left = createMatrixZeroes(m, rank);
+    *right = createMatrixZeroes(rank, n);
+    for (j = 0; j < rank; j++){
+        size_t col = order[j];
+        singular[j] = norms[col];
+        for (i = 0; i < m; i++){
+            setMatrix(*left, i, j, getMatrix(QW, i, col));
+        }
+        for (i = 0; i < n; i++){
+            setMatrix(*right, j, i, norms[col] > 0 ? getMatrix(BT, i, col) / norms[col] : 0);
+        }
+    }
+
+    destroyMatrix(omega);
+    destroyMatrix(Q);
+    destroyMatrix(origT);
+    destroyMatrix(BT);
+    destroyMatrix(W);
+    destroyMatrix(QW);
+}
+
+void lowRankFactorize(Matrix* orig, size_t rank, Matrix** U, Matrix** V){
+    float singular[rank];
+    randomizedSVD(orig, rank, U, singular, V);
+    size_t i, j;
+    for (i = 0; i < (*U)->rows; i++){
+        for (j = 0; j < rank; j++){
+            setMatrix(*U, i, j, getMatrix(*U, i, j) * singular[j]);
+        }
+    }
+}
+
+size_t maxUsefulRank(size_t m, size_t n, float minSpeedup){
+    assert(minSpeedup > 0);
+    size_t rank = (size_t)((double)m * n / (minSpeedup * (m + n)));
+    size_t limit = m < n ? m : n;
+    return rank < limit ? rank : limit;
+}
+
+// the error of a truncation follows from the singular values kept, since
+// the squared Frobenius norm is the sum of all squared singular values
+size_t chooseRank(Matrix* orig, float tolerance, float minSpeedup){
+    size_t maxRank = maxUsefulRank(orig->rows, orig->cols, minSpeedup);
+    if (maxRank == 0){
+        return 0;
+    }
+    double total = 0;
+    size_t i;
+    for (i = 0; i < orig->rows * orig->cols; i++){
+        total += orig->data[i] * orig->data[i];
+    }
+    if (total == 0){
+        return 1;
+    }
+    Matrix* left,* right;
+    float singular[maxRank];
+    randomizedSVD(orig, maxRank, &left, singular, &right);
+    destroyMatrix(left);
+    destroyMatrix(right);
+    double kept = 0;
+    for (i = 0; i < maxRank; i++){
+        kept += (double)singular[i] * singular[i];
+        if (sqrt(MAX(0, total - kept) / total) <= tolerance){
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+void multiplyFactorizedInto(Matrix* A, Matrix* U, Matrix* V, Matrix* scratch, Matrix* into){
+    assert(A->cols == U->rows && U->cols == V->rows);
+    assert(scratch->rows == A->rows && scratch->cols == U->cols);
+    multiplyInto(A, U, scratch);
+    multiplyInto(scratch, V, into);
+}
+
+void factorizeConnection(Connection* connection, size_t rank){
+    unfactorizeConnection(connection);
+    lowRankFactorize(connection->weights, rank, &connection->factorU, &connection->factorV);
+    multiplyInto(connection->factorU, connection->factorV, connection->weights);
+}
+
+// wall-clock time, since a threaded BLAS sums processor time over threads
+static double timeForwardPassDataSet(Network* network, DataSet* data){
+    double start = monotonicSeconds();
+    forwardPassDataSet(network, data);
+    return monotonicSeconds() - start;
+}
+
+FactorizationReport factorizeNetworkConnection(Network* network, size_t index, float tolerance, float minSpeedup, DataSet* data, DataSet* classes){
+    assert(index < network->numConnections);
+    Connection* con = network->connections[index];
+    FactorizationReport report;
+    report.connection = index;
+    report.flopsBefore = con->weights->rows * con->weights->cols;
+    report.secondsBefore = timeForwardPassDataSet(network, data);
+    report.accuracyBefore = classes != NULL ? accuracy(network, data, classes) : 0;
+    report.rank = chooseRank(con->weights, tolerance, minSpeedup);
+    if (report.rank > 0){
+        factorizeConnection(con, report.rank);
+        report.flopsAfter = report.rank * (con->weights->rows + con->weights->cols);
+        report.secondsAfter = timeForwardPassDataSet(network, data);
+        report.accuracyAfter = classes != NULL ? accuracy(network, data, classes) : 0;
+    }
+    else{
+        report.flopsAfter = report.flopsBefore;
+        report.secondsAfter = report.secondsBefore;
+        report.accuracyAfter = report.accuracyBefore;
+    }
+    return report;
+}
+
+void printFactorizationReport(FactorizationReport report){
+    if (report.rank == 0){
+        printf("connection %zu: no rank meets the error and speed targets\n", report.connection);
+        return;
+    }
+    printf("connection %zu: rank %zu\n", report.connection, report.rank);
+    printf("  multiply-adds per example: %zu -> %zu (%.2fx fewer)\n", report.flopsBefore, report.flopsAfter, (double)report.flopsBefore / report.flopsAfter);
+    printf("  forward pass time: %fs -> %fs (%.2fx speedup)\n", report.secondsBefore, report.secondsAfter, report.secondsAfter > 0 ? report.secondsBefore / report.secondsAfter : 0);
+    printf("  accuracy: %f -> %f\n", report.accuracyBefore, report.accuracyAfter);
+}
+
+#endif
\ No newline at end of file
@@ -1,19 +1,55 @@
 #include "std_includes.h"
+#include "profile.h"
 
 #ifndef MATRIX_H
 #define MATRIX_H
 
-/* Uncomment the below line to use CBLAS */
+/* Uncomment the below line to link CBLAS in as the starting BLAS backend */
 // #define CRANIUM_USE_CBLAS
 #ifdef CRANIUM_USE_CBLAS
 #include <cblas.h>
 #endif
+#ifdef CRANIUM_USE_POSIX
+#include <dlfcn.h>
+#endif
+
+// CBLAS constants, passed as int by the backend entries
+#define CRANIUM_BLAS_ROW_MAJOR 101
+#define CRANIUM_BLAS_NO_TRANS 111
+#define CRANIUM_BLAS_TRANS 112
+
+typedef void (*BlasGemm)(int order, int transA, int transB, int m, int n, int k, float alpha, const float* A, int lda, const float* B, int ldb, float beta, float* C, int ldc);
+typedef void (*BlasGemv)(int order, int trans, int m, int n, float alpha, const float* A, int lda, const float* x, int incx, float beta, float* y, int incy);
+typedef void (*BlasAxpy)(int n, float alpha, const float* x, int incx, float* y, int incy);
+typedef void (*BlasScal)(int n, float alpha, float* x, int incx);
+
+// tile sizes of the built-in product kernel, in rows of the left factor,
+// shared (inner) dimension and columns of the result; any tiling gives
+// the same bits, since every entry still sums its terms in order
+typedef struct GemmBlocking_ {
+    size_t rowBlock;
+    size_t depthBlock;
+    size_t colBlock;
+} GemmBlocking;
+
+// a BLAS implementation for the matrix operations, with entries following
+// the CBLAS calling convention (cblas_sgemm, cblas_sgemv, ...); any entry
+// left NULL falls back to the built-in kernel for that operation
+typedef struct BlasBackend_ {
+    char name[256];
+    void* library; // handle from dlopen, closed when the backend is replaced
+    BlasGemm sgemm;
+    BlasGemv sgemv;
+    BlasAxpy saxpy;
+    BlasScal sscal;
+} BlasBackend;
 
 // represents user-supplied training data
 typedef struct DataSet_ {
     size_t rows;
     size_t cols;
     float** data;
+    float* block; // if not NULL, the single allocation holding every row
 } DataSet;
 
 // represents a matrix of data in row-major order
@@ -26,9 +62,19 @@ typedef struct Matrix_ {
 // create dataset given user data
 static DataSet* createDataSet(size_t rows, size_t cols, float** data);
 
+// create dataset whose rows share one contiguous, zeroed allocation
+static DataSet* createDataSetContiguous(size_t rows, size_t cols);
+
 // uses memory of the original data to split dataset into batches
 static DataSet** createBatches(DataSet* allData, int numBatches);
 
+// creates a dataset of the rows of $source at $indices, in that order, sharing
+// their memory; free it with destroyDataSetView
+static DataSet* createDataSetView(DataSet* source, size_t* indices, size_t numRows);
+
+// frees a view made by createDataSetView, leaving the rows it shares
+static void destroyDataSetView(DataSet* view);
+
 // split a dataset into row matrices
 static Matrix** splitRows(DataSet* dataset);
 
@@ -86,6 +132,12 @@ static Matrix* multiply(Matrix* A, Matrix* B);
 // multiplies $A and $B (ordering: AB) and places values into $into
 static void multiplyInto(Matrix* A, Matrix* B, Matrix* into);
 
+// multiplies $A and $B transposed (ordering: AB^T) and places values into $into
+static void multiplyTransposedInto(Matrix* A, Matrix* B, Matrix* into);
+
+// adds the product of $A transposed and $B (ordering: A^TB) to $into
+static void addTransposeMultiply(Matrix* A, Matrix* B, Matrix* into);
+
 // element-wise multiplcation
 static Matrix* hadamard(Matrix* A, Matrix* B);
 
@@ -101,16 +153,177 @@ static int equals(Matrix* A, Matrix* B);
 // frees a matrix and its data
 static void destroyMatrix(Matrix* matrix);
 
+// loads cblas_sgemm, cblas_sgemv, cblas_saxpy and cblas_sscal from the shared
+// library at $path with dlopen and runs matrix operations on them; a NULL
+// $path tries the library named by the CRANIUM_BLAS environment variable,
+// then OpenBLAS, BLIS, MKL, Accelerate and the system libblas, in that order
+// returns 0 on success, and -1 if no library loads (or without
+// CRANIUM_USE_POSIX), keeping the current backend
+// backends should only change while no other thread is using matrices
+static int loadBlasBackend(const char* path);
+
+// runs matrix operations on the entries of $backend, such as functions of a
+// statically linked BLAS
+static void setBlasBackend(BlasBackend backend);
+
+// goes back to the built-in kernels, closing any loaded library
+static void useBuiltinBlas();
+
+// returns the backend matrix operations run on
+static const BlasBackend* currentBlasBackend();
+
+// sets the tile sizes the built-in product kernel uses from now on
+static void setGemmBlocking(GemmBlocking blocking);
+
+// returns the tile sizes of the built-in product kernel
+static GemmBlocking currentGemmBlocking();
+
 
 /*
     Begin functions.
 */
 
+#ifdef CRANIUM_USE_CBLAS
+// the linked library, with the enums passed through as the ints they are
+static void linkedSgemm(int order, int transA, int transB, int m, int n, int k, float alpha, const float* A, int lda, const float* B, int ldb, float beta, float* C, int ldc){
+    cblas_sgemm((enum CBLAS_ORDER)order, (enum CBLAS_TRANSPOSE)transA, (enum CBLAS_TRANSPOSE)transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+static void linkedSgemv(int order, int trans, int m, int n, float alpha, const float* A, int lda, const float* x, int incx, float beta, float* y, int incy){
+    cblas_sgemv((enum CBLAS_ORDER)order, (enum CBLAS_TRANSPOSE)trans, m, n, alpha, A, lda, x, incx, beta, y, incy);
+}
+
+static BlasBackend activeBlas = {"CBLAS (linked)", NULL, linkedSgemm, linkedSgemv, (BlasAxpy)cblas_saxpy, (BlasScal)cblas_sscal};
+#else
+static BlasBackend activeBlas = {"built-in", NULL, NULL, NULL, NULL, NULL};
+#endif
+
+// returns 1 if a product of these sizes can go to the backend, whose
+// leading dimensions must be positive ints
+static int blasFits(size_t m, size_t n, size_t k){
+    return m > 0 && n > 0 && k > 0 && m <= INT32_MAX && n <= INT32_MAX && k <= INT32_MAX;
+}
+
+// returns 1 if a whole matrix of these sizes can go to the backend as one
+// vector, whose length must be a positive int
+static int blasFitsVector(size_t rows, size_t cols){
+    return rows > 0 && cols > 0 && rows <= INT32_MAX / cols;
+}
+
+int loadBlasBackend(const char* path){
+#ifdef CRANIUM_USE_POSIX
+    if (path == NULL){
+        const char* candidates[] = {getenv("CRANIUM_BLAS"), "libopenblas.so.0", "libopenblas.so", "libblis.so.4", "libblis.so", "libmkl_rt.so.2", "libmkl_rt.so", "/System/Library/Frameworks/Accelerate.framework/Accelerate", "libopenblas.dylib", "libcblas.so.3", "libblas.so.3", "libblas.so"};
+        size_t i;
+        for (i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++){
+            if (candidates[i] != NULL && candidates[i][0] != '\0' && loadBlasBackend(candidates[i]) == 0){
+                return 0;
+            }
+        }
+        return -1;
+    }
+    void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (library == NULL){
+        return -1;
+    }
+    BlasBackend backend;
+    memset(&backend, 0, sizeof(backend));
+    snprintf(backend.name, sizeof(backend.name), "%s", path);
+    backend.library = library;
+    backend.sgemm = (BlasGemm)dlsym(library, "cblas_sgemm");
+    backend.sgemv = (BlasGemv)dlsym(library, "cblas_sgemv");
+    backend.saxpy = (BlasAxpy)dlsym(library, "cblas_saxpy");
+    backend.sscal = (BlasScal)dlsym(library, "cblas_sscal");
+
+    // a Fortran-only BLAS has none of the CBLAS names
+    if (backend.sgemm == NULL){
+        dlclose(library);
+        return -1;
+    }
+    setBlasBackend(backend);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void setBlasBackend(BlasBackend backend){
+#ifdef CRANIUM_USE_POSIX
+    if (activeBlas.library != NULL && activeBlas.library != backend.library){
+        dlclose(activeBlas.library);
+    }
+#endif
+    activeBlas = backend;
+}
+
+void useBuiltinBlas(){
+    BlasBackend builtin;
+    memset(&builtin, 0, sizeof(builtin));
+    snprintf(builtin.name, sizeof(builtin.name), "built-in");
+    setBlasBackend(builtin);
+}
+
+const BlasBackend* currentBlasBackend(){
+    return &activeBlas;
+}
+
+static GemmBlocking activeBlocking = {32, 256, 256};
+
+void setGemmBlocking(GemmBlocking blocking){
+    assert(blocking.rowBlock > 0 && blocking.depthBlock > 0 && blocking.colBlock > 0);
+    activeBlocking = blocking;
+}
+
+GemmBlocking currentGemmBlocking(){
+    return activeBlocking;
+}
+
+// into = AB in tiles, each a run of row updates over contiguous memory;
+// every entry starts at 0 and adds its terms in order of the shared index,
+// so the result matches a plain dot product per entry bit for bit
+static void blockedMultiplyInto(Matrix* A, Matrix* B, Matrix* into){
+    size_t M = A->rows, K = A->cols, N = B->cols;
+    size_t rowBlock = activeBlocking.rowBlock, depthBlock = activeBlocking.depthBlock, colBlock = activeBlocking.colBlock;
+    size_t i0, k0, j0, i, k, j;
+    memset(into->data, 0, sizeof(float) * M * N);
+    for (i0 = 0; i0 < M; i0 += rowBlock){
+        size_t iEnd = i0 + rowBlock < M ? i0 + rowBlock : M;
+        for (k0 = 0; k0 < K; k0 += depthBlock){
+            size_t kEnd = k0 + depthBlock < K ? k0 + depthBlock : K;
+            for (j0 = 0; j0 < N; j0 += colBlock){
+                size_t jEnd = j0 + colBlock < N ? j0 + colBlock : N;
+                for (i = i0; i < iEnd; i++){
+                    float* row = into->data + i * N;
+                    for (k = k0; k < kEnd; k++){
+                        float a = A->data[i * K + k];
+                        const float* b = B->data + k * N;
+                        for (j = j0; j < jEnd; j++){
+                            row[j] += a * b[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 static DataSet* createDataSet(size_t rows, size_t cols, float** data){
     DataSet* dataset = (DataSet*)malloc(sizeof(DataSet));
     dataset->rows = rows;
     dataset->cols = cols;
     dataset->data = data;
+    dataset->block = NULL;
+    return dataset;
+}
+
+DataSet* createDataSetContiguous(size_t rows, size_t cols){
+    float** data = (float**)malloc(sizeof(float*) * (rows > 0 ? rows : 1));
+    DataSet* dataset = createDataSet(rows, cols, data);
+    dataset->block = (float*)calloc(rows * cols > 0 ? rows * cols : 1, sizeof(float));
+    size_t i;
+    for (i = 0; i < rows; i++){
+        data[i] = dataset->block + i * cols;
+    }
     return dataset;
 }
 
@@ -130,6 +343,21 @@ DataSet** createBatches(DataSet* allData, int numBatches){
     return batches;
 }
 
+DataSet* createDataSetView(DataSet* source, size_t* indices, size_t numRows){
+    float** data = (float**)malloc(sizeof(float*) * (numRows > 0 ? numRows : 1));
+    size_t i;
+    for (i = 0; i < numRows; i++){
+        assert(indices[i] < source->rows);
+        data[i] = source->data[indices[i]];
+    }
+    return createDataSet(numRows, source->cols, data);
+}
+
+void destroyDataSetView(DataSet* view){
+    free(view->data);
+    free(view);
+}
+
 static Matrix** splitRows(DataSet* dataset){
     Matrix** rows = (Matrix**)malloc(sizeof(Matrix*) * dataset->rows);
     int i;
@@ -155,8 +383,13 @@ void shuffleTogether(DataSet* A, DataSet* B){
 
 static void destroyDataSet(DataSet* dataset){
     int i;
-    for (i = 0; i < dataset->rows; i++){
-        free(dataset->data[i]);
+    if (dataset->block != NULL){
+        free(dataset->block);
+    }
+    else{
+        for (i = 0; i < dataset->rows; i++){
+            free(dataset->data[i]);
+        }
     }
     free(dataset->data);
     free(dataset);
@@ -205,7 +438,9 @@ static void setMatrix(Matrix* mat, size_t row, size_t col, float val){
 
 void copyValuesInto(Matrix* from, Matrix* to){
     assert(from->rows == to->rows && from->cols == to->cols);
+    PROFILE_BEGIN(copy);
     memcpy(to->data, from->data, sizeof(float) * to->rows * to->cols);
+    PROFILE_END(copy, "copyValuesInto", -1, 0, 8.0 * to->rows * to->cols);
 }
 
 void printMatrix(Matrix* input){
@@ -220,52 +455,60 @@ void printMatrix(Matrix* input){
 }
 
 void zeroMatrix(Matrix* orig){
+    PROFILE_BEGIN(zero);
     memset(orig->data, 0, orig->rows * orig->cols * sizeof(float));
+    PROFILE_END(zero, "zeroMatrix", -1, 0, 4.0 * orig->rows * orig->cols);
 }
 
 Matrix* transpose(Matrix* orig){
     float* data = (float*)malloc(sizeof(float) * orig->rows * orig->cols);
     Matrix* transpose = createMatrix(orig->cols, orig->rows, data);
-    int i, j;
-    for (i = 0; i < orig->rows; i++){
-        for (j = 0; j < orig->cols; j++){
-            setMatrix(transpose, i, j, getMatrix(orig, i, j));
-        }
-    }
+    transposeInto(orig, transpose);
     return transpose;
 }
 
 void transposeInto(Matrix* orig, Matrix* origT){
     assert(orig->rows == origT->cols && orig->cols == origT->rows);
+    PROFILE_BEGIN(transpose);
     int i, j;
     for (i = 0; i < orig->rows; i++){
         for (j = 0; j < orig->cols; j++){
             setMatrix(origT, j, i, getMatrix(orig, i, j));
         }
     }
+    PROFILE_END(transpose, "transposeInto", -1, 0, 8.0 * orig->rows * orig->cols);
 }
 
 Matrix* add(Matrix* A, Matrix* B){
     assert(A->rows == B->rows && A->cols == B->cols);
     float* data = (float*)malloc(sizeof(float) * A->rows * B->rows);
     Matrix* result = createMatrix(A->rows, A->cols, data);
+    PROFILE_BEGIN(add);
     int i, j;
     for (i = 0; i < A->rows; i++){
         for (j = 0; j < A->cols; j++){
             setMatrix(result, i, j, getMatrix(B, i, j) + getMatrix(A, i, j));
         }
     }
+    PROFILE_END(add, "add", -1, A->rows * A->cols, 12.0 * A->rows * A->cols);
     return result;
 }
 
 void addTo(Matrix* from, Matrix* to){
     assert(from->rows == to->rows && from->cols == to->cols);
-    int i, j;
-    for (i = 0; i < from->rows; i++){
-        for (j = 0; j < from->cols; j++){
-            setMatrix(to, i, j, getMatrix(from, i, j) + getMatrix(to, i, j));
+    PROFILE_BEGIN(addTo);
+    if (activeBlas.saxpy != NULL && blasFitsVector(from->rows, from->cols)){
+        activeBlas.saxpy(from->rows * from->cols, 1, from->data, 1, to->data, 1);
+    }
+    else{
+        int i, j;
+        for (i = 0; i < from->rows; i++){
+            for (j = 0; j < from->cols; j++){
+                setMatrix(to, i, j, getMatrix(from, i, j) + getMatrix(to, i, j));
+            }
         }
     }
+    PROFILE_END(addTo, "addTo", -1, from->rows * from->cols, 12.0 * from->rows * from->cols);
 }
 
 // add B to each row of A
@@ -273,92 +516,130 @@ Matrix* addToEachRow(Matrix* A, Matrix* B){
     assert(A->cols == B->cols && B->rows == 1);
     float* data = (float*)malloc(sizeof(float) * A->rows * A->cols);
     Matrix* result = createMatrix(A->rows, A->cols, data);
+    PROFILE_BEGIN(addToEachRow);
     int i, j;
     for (i = 0; i < A->rows; i++){
         for (j = 0; j < A->cols; j++){
             setMatrix(result, i, j, getMatrix(A, i, j) + getMatrix(B, 0, j));
         }
     }
+    PROFILE_END(addToEachRow, "addToEachRow", -1, A->rows * A->cols, 8.0 * A->rows * A->cols + 4.0 * A->cols);
     return result;
 }
 
 void scalarMultiply(Matrix* orig, float c){
-    int i, j;
-    for (i = 0; i < orig->rows; i++){
-        for (j = 0; j < orig->cols; j++){
-            setMatrix(orig, i, j, getMatrix(orig, i, j) * c);
+    PROFILE_BEGIN(scalar);
+    if (activeBlas.sscal != NULL && blasFitsVector(orig->rows, orig->cols)){
+        activeBlas.sscal(orig->rows * orig->cols, c, orig->data, 1);
+    }
+    else{
+        int i, j;
+        for (i = 0; i < orig->rows; i++){
+            for (j = 0; j < orig->cols; j++){
+                setMatrix(orig, i, j, getMatrix(orig, i, j) * c);
+            }
         }
     }
+    PROFILE_END(scalar, "scalarMultiply", -1, orig->rows * orig->cols, 8.0 * orig->rows * orig->cols);
 }
 
 Matrix* multiply(Matrix* A, Matrix* B){
     assert(A->cols == B->rows);
     float* data = (float*)malloc(sizeof(float) * A->rows * B->cols);
     Matrix* result = createMatrix(A->rows, B->cols, data);
-#ifdef CRANIUM_USE_CBLAS
-    zeroMatrix(result);
-    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, A->rows, B->cols
-    , A->cols, 1, A->data, A->cols, B->data, B->cols, 1, result->data, result->cols);
-    return result;
-#endif
-    int i, j;
-    for (i = 0; i < A->rows; i++){
-        for (j = 0; j < B->cols; j++){
-            float sum = 0;
-            int k;
-            for (k = 0; k < B->rows; k++){
-                sum += getMatrix(A, i, k) * getMatrix(B, k, j);
-            }
-            setMatrix(result, i, j, sum);
-        }
-    }
+    multiplyInto(A, B, result);
     return result;
 }
 
 void multiplyInto(Matrix* A, Matrix* B, Matrix* into){
-#ifdef CRANIUM_USE_CBLAS
-    zeroMatrix(into);
-    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, A->rows, B->cols
-    , A->cols, 1, A->data, A->cols, B->data, B->cols, 1, into->data, into->cols);
-    return;
-#endif
     assert(A->cols == B->rows);
     assert(A->rows == into->rows && B->cols == into->cols);
-    int i, j;
-    for (i = 0; i < A->rows; i++){
-        for (j = 0; j < B->cols; j++){
-            float sum = 0;
-            int k;
-            for (k = 0; k < B->rows; k++){
-                sum += getMatrix(A, i, k) * getMatrix(B, k, j);
+    PROFILE_BEGIN(multiply);
+
+    // a single row, as in per-example passes, is a product with B^T
+    if (A->rows == 1 && activeBlas.sgemv != NULL && blasFits(1, B->cols, A->cols)){
+        activeBlas.sgemv(CRANIUM_BLAS_ROW_MAJOR, CRANIUM_BLAS_TRANS, B->rows, B->cols, 1, B->data, B->cols, A->data, 1, 0, into->data, 1);
+    }
+    else if (activeBlas.sgemm != NULL && blasFits(A->rows, B->cols, A->cols)){
+        activeBlas.sgemm(CRANIUM_BLAS_ROW_MAJOR, CRANIUM_BLAS_NO_TRANS, CRANIUM_BLAS_NO_TRANS, A->rows, B->cols, A->cols, 1, A->data, A->cols, B->data, B->cols, 0, into->data, into->cols);
+    }
+    else{
+        blockedMultiplyInto(A, B, into);
+    }
+    PROFILE_END(multiply, "multiplyInto", -1, 2.0 * A->rows * A->cols * B->cols, 4.0 * (A->rows * A->cols + B->rows * B->cols + into->rows * into->cols));
+}
+
+// rows of $A and $B are both contiguous, so each value is one dot product
+void multiplyTransposedInto(Matrix* A, Matrix* B, Matrix* into){
+    assert(A->cols == B->cols);
+    assert(A->rows == into->rows && B->rows == into->cols);
+    PROFILE_BEGIN(multiplyTransposed);
+    if (A->rows == 1 && activeBlas.sgemv != NULL && blasFits(1, B->rows, A->cols)){
+        activeBlas.sgemv(CRANIUM_BLAS_ROW_MAJOR, CRANIUM_BLAS_NO_TRANS, B->rows, B->cols, 1, B->data, B->cols, A->data, 1, 0, into->data, 1);
+    }
+    else if (activeBlas.sgemm != NULL && blasFits(A->rows, B->rows, A->cols)){
+        activeBlas.sgemm(CRANIUM_BLAS_ROW_MAJOR, CRANIUM_BLAS_NO_TRANS, CRANIUM_BLAS_TRANS, A->rows, B->rows, A->cols, 1, A->data, A->cols, B->data, B->cols, 0, into->data, into->cols);
+    }
+    else{
+        size_t i, j, k;
+        for (i = 0; i < A->rows; i++){
+            float* a = A->data + i * A->cols;
+            for (j = 0; j < B->rows; j++){
+                float* b = B->data + j * B->cols;
+                float sum = 0;
+                for (k = 0; k < A->cols; k++){
+                    sum += a[k] * b[k];
+                }
+                into->data[i * into->cols + j] = sum;
             }
-            setMatrix(into, i, j, sum);
         }
     }
+    PROFILE_END(multiplyTransposed, "multiplyTransposedInto", -1, 2.0 * A->rows * A->cols * B->rows, 4.0 * (A->rows * A->cols + B->rows * B->cols + into->rows * into->cols));
+}
+
+// one rank-one update per row of $A and $B, each over a contiguous row of $into
+void addTransposeMultiply(Matrix* A, Matrix* B, Matrix* into){
+    assert(A->rows == B->rows);
+    assert(A->cols == into->rows && B->cols == into->cols);
+    PROFILE_BEGIN(addTransposeMultiply);
+    if (activeBlas.sgemm != NULL && blasFits(A->cols, B->cols, A->rows)){
+        activeBlas.sgemm(CRANIUM_BLAS_ROW_MAJOR, CRANIUM_BLAS_TRANS, CRANIUM_BLAS_NO_TRANS, A->cols, B->cols, A->rows, 1, A->data, A->cols, B->data, B->cols, 1, into->data, into->cols);
+    }
+    else{
+        size_t r, i, j;
+        for (r = 0; r < A->rows; r++){
+            float* b = B->data + r * B->cols;
+            for (i = 0; i < A->cols; i++){
+                float a = A->data[r * A->cols + i];
+                float* row = into->data + i * into->cols;
+                for (j = 0; j < B->cols; j++){
+                    row[j] += a * b[j];
+                }
+            }
+        }
+    }
+    PROFILE_END(addTransposeMultiply, "addTransposeMultiply", -1, 2.0 * A->rows * A->cols * B->cols, 4.0 * (A->rows * A->cols + B->rows * B->cols + 2 * into->rows * into->cols));
 }
 
 Matrix* hadamard(Matrix* A, Matrix* B){
     assert(A->rows == B->rows && A->cols == B->cols);
     float* data = (float*)malloc(sizeof(float) * A->rows * A->cols);
     Matrix* result = createMatrix(A->rows, A->cols, data);
-    int i, j;
-    for (i = 0; i < A->rows; i++){
-        for (j = 0; j < A->cols; j++){
-            setMatrix(result, i, j, getMatrix(A, i, j) * getMatrix(B, i, j));
-        }
-    }
+    hadamardInto(A, B, result);
     return result;
 }
 
 void hadamardInto(Matrix* A, Matrix* B, Matrix* into){
     assert(A->rows == B->rows && A->cols == B->cols);
     assert(A->rows == into->rows && A->cols == into->cols);
+    PROFILE_BEGIN(hadamard);
     int i, j;
     for (i = 0; i < A->rows; i++){
         for (j = 0; j < A->cols; j++){
             setMatrix(into, i, j, getMatrix(A, i, j) * getMatrix(B, i, j));
         }
     }
+    PROFILE_END(hadamard, "hadamardInto", -1, A->rows * A->cols, 12.0 * A->rows * A->cols);
 }
 
 Matrix* copy(Matrix* orig){
@@ -6,14 +6,57 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
+// every block of weights or biases in a parameter arena starts on a
+// multiple of this many floats (64 bytes)
+#define PARAMETER_ALIGNMENT 16
+
 // represents a network as a composition of layers and connections
 typedef struct Network_ {
     size_t numLayers;
     Layer** layers;
     size_t numConnections;
     Connection** connections;
+    void* mapping; // file the weights are mapped from, if any
+    size_t mappingSize;
+    void* parameterBlock; // allocation holding the parameter arena
+    float* parameters; // every connection's weights, then every bias
+    size_t numParameters; // floats in the arena, padding included
+    float* featureMean; // mean of each input feature, if standardizing inputs
+    float* featureScale; // 1 / standard deviation of each input feature
+    int normalizationFolded; // if non-zero, the first weights apply the stats
 } Network;
 
+// buffers for forward passes that leave the network untouched, so that
+// threads each holding their own workspace can share one network
+typedef struct Workspace_ {
+    size_t maxRows;
+    size_t numLayers;
+    size_t* sizes;
+    Matrix** activations; // (rows x size) for every layer after the input,
+                          // and for the input once it needs standardizing
+    float* scratch; // input * U of the widest factorized connection
+    size_t scratchSize;
+} Workspace;
+
+// rows per chunk used by accuracy and the dataset losses until
+// setEvaluationDefaults changes it
+#define EVALUATION_CHUNK_ROWS 256
+
+// how accuracy, the dataset losses and serving workspaces split their rows
+typedef struct EvaluationDefaults_ {
+    size_t chunkRows; // rows per chunk
+    int numThreads; // threads the chunks are split across
+} EvaluationDefaults;
+
+// totals of a chunked evaluation of a network over a dataset
+typedef struct Evaluation_ {
+    size_t rows;
+    size_t numCorrect; // rows whose highest output is their class
+    double crossEntropy; // sum over rows of -sum(target * log(output))
+    double squaredError; // sum over rows of sum((target - output)^2)
+    double l2; // sum of squared weights
+} Evaluation;
+
 // constructor to create a network given sizes and functions
 // hiddenSizes is an array of sizes, where hiddenSizes[i] is the size
 // of the ith hidden layer
@@ -21,6 +64,55 @@ typedef struct Network_ {
 // where hiddenActivations[i] is the function of the ith hidden layer
 static Network* createNetwork(size_t numFeatures, size_t numHiddenLayers, size_t* hiddenSizes, Activation* hiddenActivations, size_t numOutputs, Activation outputActivation);
 
+// creates a network with $numLayers layers of the given sizes, where
+// activations[i] is the function of layer i + 1, without initializing weights
+static Network* allocateNetwork(size_t numLayers, size_t* layerSizes, Activation* activations);
+
+// sets the storage precision of every connection in the network
+static void setNetworkPrecision(Network* network, PRECISION precision);
+
+// lays out a parameter arena for $network, where the weights of connection i
+// start at $weightsOffset[i] and its bias at $biasOffset[i], all weights
+// coming before all biases; returns the length of the arena in floats
+static size_t parameterLayout(Network* network, size_t* weightsOffset, size_t* biasOffset);
+
+// allocates $count zeroed floats starting on a PARAMETER_ALIGNMENT boundary
+// $block is set to the pointer to free
+static float* allocateParameterArena(size_t count, void** block);
+
+// moves every weight and bias into one new arena, leaving the connection
+// matrices as views into it, so whole-model updates, norms and copies are
+// single passes; networks start out flat, so this is only needed after
+// connections are given new matrices
+static void flattenNetwork(Network* network);
+
+// returns 1 if every weight and bias is in the network's arena, as laid out
+// by parameterLayout, 0 otherwise
+static int isNetworkFlat(Network* network);
+
+// copies the weights and biases of $from into $to, which has the same shape,
+// along with the factors of factorized connections and the precision and
+// sparse pattern of each connection
+static void copyNetworkParameters(Network* from, Network* to);
+
+// returns the sum of squared weights, as used by L2 regularization
+static double weightSquaredSum(Network* network);
+
+// computes the mean and standard deviation of every feature of $data in one
+// pass; forward passes then standardize their input with them, as part of
+// copying it in, until they are folded
+static void computeNormalization(Network* network, DataSet* data);
+
+// standardizes each row of $input in place with the network's stats
+static void normalizeInput(Network* network, Matrix* input);
+
+// folds the stats into the weights and bias of the first connection, so
+// forward passes take raw inputs and run no normalization at all
+static void foldNormalization(Network* network);
+
+// takes the stats back out of the first connection, e.g. to train further
+static void unfoldNormalization(Network* network);
+
 // will propagate input through entire network
 // result will be stored in input field of last layer
 // input should be a matrix where each row is an input
@@ -31,6 +123,25 @@ static void forwardPass(Network* network, Matrix* input);
 // input should be a dataset where each row is an input
 static void forwardPassDataSet(Network* network, DataSet* input);
 
+// will propagate sparse input through entire network, in time proportional
+// to its stored entries in the first layer; result will be stored in input
+// field of last layer, and the input layer's store is left untouched
+static void forwardPassSparse(Network* network, SparseMatrix* input);
+
+// creates buffers for forward passes of up to $maxRows rows through $network
+static Workspace* createWorkspace(Network* network, size_t maxRows);
+
+// propagates $input through $network using only $workspace for storage and
+// returns the output, which stays valid until the next pass with $workspace
+// the workspace grows if the network's shape or the number of rows needs it
+static Matrix* forwardPassWorkspace(Network* network, Workspace* workspace, Matrix* input);
+
+// same as forwardPassWorkspace for sparse $input
+static Matrix* forwardPassWorkspaceSparse(Network* network, Workspace* workspace, SparseMatrix* input);
+
+// frees a workspace
+static void destroyWorkspace(Workspace* workspace);
+
 // calculate the cross entropy loss between two datasets with 
 // optional regularization (must provide network if using regularization)
 // [normal cross entropy] + 1/2(regStrength)[normal l2 reg]
@@ -50,8 +161,34 @@ static Matrix* getOuput(Network* network);
 static int* predict(Network* network);
 
 // return accuracy (num_correct / num_total) of network on predictions
+// evaluated in chunks, so it leaves the network's layers untouched
 static float accuracy(Network* network, DataSet* data, DataSet* classes);
 
+// passes $data through $network in chunks of $chunkRows rows using reused
+// buffers, so memory does not grow with the number of rows, and totals the
+// accuracy and losses against $classes; chunks are split across $numThreads
+// threads with CRANIUM_USE_POSIX, and totals are the same for any thread count
+static Evaluation evaluateNetwork(Network* network, DataSet* data, DataSet* classes, size_t chunkRows, int numThreads);
+
+// same as evaluateNetwork for sparse $data
+static Evaluation evaluateNetworkSparse(Network* network, SparseMatrix* data, DataSet* classes, size_t chunkRows, int numThreads);
+
+// same as accuracy for sparse $data
+static float accuracySparse(Network* network, SparseMatrix* data, DataSet* classes);
+
+// sets the chunk rows and thread count evaluation uses from now on, which
+// start as EVALUATION_CHUNK_ROWS on 1 thread
+static void setEvaluationDefaults(EvaluationDefaults defaults);
+
+// returns the chunk rows and thread count evaluation uses
+static EvaluationDefaults currentEvaluationDefaults();
+
+// same as crossEntropyLoss of the outputs for $data, evaluated in chunks
+static float crossEntropyLossDataSet(Network* network, DataSet* data, DataSet* classes, float regularizationStrength);
+
+// same as meanSquaredError of the outputs for $data, evaluated in chunks
+static float meanSquaredErrorDataSet(Network* network, DataSet* data, DataSet* classes, float regularizationStrength);
+
 // frees network, its layers, and its connections
 static void destroyNetwork(Network* network);
 
@@ -68,23 +205,45 @@ static Network* readNetwork(char* path);
 
 Network* createNetwork(size_t numFeatures, size_t numHiddenLayers, size_t* hiddenSizes, Activation* hiddenActivations, size_t numOutputs, Activation outputActivation){
     assert(numFeatures > 0 && numHiddenLayers >= 0 && numOutputs > 0);
+    size_t numLayers = 2 + numHiddenLayers;
+    size_t layerSizes[numLayers];
+    Activation activations[numLayers - 1];
+    int i;
+    layerSizes[0] = numFeatures;
+    for (i = 0; i < numHiddenLayers; i++){
+        layerSizes[i + 1] = hiddenSizes[i];
+        activations[i] = hiddenActivations[i];
+    }
+    layerSizes[numLayers - 1] = numOutputs;
+    activations[numLayers - 2] = outputActivation;
+
+    Network* network = allocateNetwork(numLayers, layerSizes, activations);
+    for (i = 0; i < network->numConnections; i++){
+        initializeConnection(network->connections[i]);
+    }
+    return network;
+}
+
+Network* allocateNetwork(size_t numLayers, size_t* layerSizes, Activation* activations){
+    assert(numLayers >= 2);
     Network* network = (Network*)malloc(sizeof(Network));
     
-    network->numLayers = 2 + numHiddenLayers;
+    network->numLayers = numLayers;
     Layer** layers = (Layer**)malloc(sizeof(Layer*) * network->numLayers);
     int i;
     for (i = 0; i < network->numLayers; i++){
+        assert(layerSizes[i] > 0);
         // create input
         if (i == 0){
-            layers[i] = createLayer(INPUT, numFeatures, NULL);
+            layers[i] = createLayer(INPUT, layerSizes[i], NULL);
         }
         //create output
         else if (i == network->numLayers - 1){
-            layers[i] = createLayer(OUTPUT, numOutputs, outputActivation);
+            layers[i] = createLayer(OUTPUT, layerSizes[i], activations[i - 1]);
         }
         // create hidden layer
         else{
-            layers[i] = createLayer(HIDDEN, hiddenSizes[i - 1], hiddenActivations[i - 1]);
+            layers[i] = createLayer(HIDDEN, layerSizes[i], activations[i - 1]);
         }
     }
     network->layers = layers;
@@ -93,26 +252,294 @@ Network* createNetwork(size_t numFeatures, size_t numHiddenLayers, size_t* hidde
     Connection** connections = (Connection**)malloc(sizeof(Connection*) * network->numConnections);
     for (i = 0; i < network->numConnections; i++){
         connections[i] = createConnection(network->layers[i], network->layers[i + 1]);
-        initializeConnection(connections[i]);
     }
     network->connections = connections;
+    network->mapping = NULL;
+    network->mappingSize = 0;
+    network->parameterBlock = NULL;
+    network->parameters = NULL;
+    network->numParameters = 0;
+    flattenNetwork(network);
+    network->featureMean = NULL;
+    network->featureScale = NULL;
+    network->normalizationFolded = 0;
 
     return network;
 }
 
+void setNetworkPrecision(Network* network, PRECISION precision){
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        setConnectionPrecision(network->connections[i], precision);
+    }
+}
+
+// rounds $count up to a whole number of aligned blocks
+static size_t alignParameters(size_t count){
+    return (count + PARAMETER_ALIGNMENT - 1) / PARAMETER_ALIGNMENT * PARAMETER_ALIGNMENT;
+}
+
+size_t parameterLayout(Network* network, size_t* weightsOffset, size_t* biasOffset){
+    size_t offset = 0;
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        Matrix* weights = network->connections[i]->weights;
+        weightsOffset[i] = offset;
+        offset += alignParameters(weights->rows * weights->cols);
+    }
+    for (i = 0; i < network->numConnections; i++){
+        biasOffset[i] = offset;
+        offset += alignParameters(network->connections[i]->bias->cols);
+    }
+    return offset;
+}
+
+float* allocateParameterArena(size_t count, void** block){
+    size_t alignment = sizeof(float) * PARAMETER_ALIGNMENT;
+    *block = calloc(sizeof(float) * count + alignment, 1);
+    return (float*)(((uintptr_t)*block + alignment - 1) / alignment * alignment);
+}
+
+// data the connections own is freed; data owned elsewhere (an older arena,
+// or a mapped file) is left alone
+void flattenNetwork(Network* network){
+    size_t weightsOffset[network->numConnections], biasOffset[network->numConnections];
+    size_t count = parameterLayout(network, weightsOffset, biasOffset);
+    void* block;
+    float* parameters = allocateParameterArena(count, &block);
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        memcpy(parameters + weightsOffset[i], con->weights->data, sizeof(float) * con->weights->rows * con->weights->cols);
+        memcpy(parameters + biasOffset[i], con->bias->data, sizeof(float) * con->bias->cols);
+        if (!con->external){
+            free(con->weights->data);
+            free(con->bias->data);
+        }
+        con->weights->data = parameters + weightsOffset[i];
+        con->bias->data = parameters + biasOffset[i];
+        con->external = 1;
+    }
+    free(network->parameterBlock);
+    network->parameterBlock = block;
+    network->parameters = parameters;
+    network->numParameters = count;
+}
+
+int isNetworkFlat(Network* network){
+    if (network->parameters == NULL){
+        return 0;
+    }
+    size_t weightsOffset[network->numConnections], biasOffset[network->numConnections];
+    if (parameterLayout(network, weightsOffset, biasOffset) != network->numParameters){
+        return 0;
+    }
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        Connection* con = network->connections[i];
+        if (con->weights->data != network->parameters + weightsOffset[i] || con->bias->data != network->parameters + biasOffset[i]){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void copyNetworkParameters(Network* from, Network* to){
+    assert(from->numConnections == to->numConnections);
+    int i;
+    if (isNetworkFlat(from) && isNetworkFlat(to) && from->numParameters == to->numParameters){
+        memcpy(to->parameters, from->parameters, sizeof(float) * from->numParameters);
+    }
+    else{
+        for (i = 0; i < from->numConnections; i++){
+            copyValuesInto(from->connections[i]->weights, to->connections[i]->weights);
+            copyValuesInto(from->connections[i]->bias, to->connections[i]->bias);
+        }
+    }
+    for (i = 0; i < to->numConnections; i++){
+        Connection* source = from->connections[i];
+        Connection* target = to->connections[i];
+        if (source->factorU == NULL){
+            unfactorizeConnection(target);
+        }
+        else if (target->factorU == NULL || target->factorU->cols != source->factorU->cols){
+            unfactorizeConnection(target);
+            target->factorU = copy(source->factorU);
+            target->factorV = copy(source->factorV);
+        }
+        else{
+            copyValuesInto(source->factorU, target->factorU);
+            copyValuesInto(source->factorV, target->factorV);
+        }
+        if (target->precision != source->precision){
+            setConnectionPrecision(target, source->precision);
+        }
+        // the pattern is copied rather than rebuilt, since kept weights may be zero
+        SparseMatrix* pattern = source->sparseWeights;
+        if (pattern == NULL){
+            densifyConnection(target);
+        }
+        else if (target->sparseWeights == NULL || target->sparseWeights->nonZero != pattern->nonZero
+                 || memcmp(target->sparseWeights->rowStart, pattern->rowStart, sizeof(size_t) * (pattern->rows + 1)) != 0
+                 || memcmp(target->sparseWeights->colIndex, pattern->colIndex, sizeof(size_t) * pattern->nonZero) != 0){
+            densifyConnection(target);
+            size_t* rowStart = (size_t*)malloc(sizeof(size_t) * (pattern->rows + 1));
+            size_t* colIndex = (size_t*)malloc(sizeof(size_t) * (pattern->nonZero > 0 ? pattern->nonZero : 1));
+            float* values = (float*)malloc(sizeof(float) * (pattern->nonZero > 0 ? pattern->nonZero : 1));
+            memcpy(rowStart, pattern->rowStart, sizeof(size_t) * (pattern->rows + 1));
+            memcpy(colIndex, pattern->colIndex, sizeof(size_t) * pattern->nonZero);
+            target->sparseWeights = createSparseMatrixFrom(pattern->rows, pattern->cols, rowStart, colIndex, values);
+        }
+        refreshConnection(target);
+    }
+}
+
+// the weights of a flat network are one run of the arena, padding being zero
+double weightSquaredSum(Network* network){
+    double sum = 0;
+    size_t j;
+    int i;
+    if (isNetworkFlat(network)){
+        size_t weightsOffset[network->numConnections], biasOffset[network->numConnections];
+        parameterLayout(network, weightsOffset, biasOffset);
+        for (j = 0; j < biasOffset[0]; j++){
+            sum += network->parameters[j] * network->parameters[j];
+        }
+        return sum;
+    }
+    for (i = 0; i < network->numConnections; i++){
+        Matrix* weights = network->connections[i]->weights;
+        for (j = 0; j < weights->rows * weights->cols; j++){
+            sum += weights->data[j] * weights->data[j];
+        }
+    }
+    return sum;
+}
+
+// Welford's running mean and variance, in doubles so that long datasets
+// do not lose precision
+void computeNormalization(Network* network, DataSet* data){
+    assert(data->cols == network->layers[0]->size && data->rows > 0);
+    if (network->normalizationFolded){
+        unfoldNormalization(network);
+    }
+    size_t i, j, cols = data->cols;
+    double* mean = (double*)calloc(cols, sizeof(double));
+    double* squares = (double*)calloc(cols, sizeof(double));
+    for (i = 0; i < data->rows; i++){
+        float* row = data->data[i];
+        for (j = 0; j < cols; j++){
+            double delta = row[j] - mean[j];
+            mean[j] += delta / (i + 1);
+            squares[j] += delta * (row[j] - mean[j]);
+        }
+    }
+    free(network->featureMean);
+    free(network->featureScale);
+    network->featureMean = (float*)malloc(sizeof(float) * cols);
+    network->featureScale = (float*)malloc(sizeof(float) * cols);
+    for (j = 0; j < cols; j++){
+        double deviation = sqrt(squares[j] / data->rows);
+        network->featureMean[j] = mean[j];
+        network->featureScale[j] = deviation > 0 ? 1 / deviation : 1;
+    }
+    free(mean);
+    free(squares);
+}
+
+void normalizeInput(Network* network, Matrix* input){
+    assert(input->cols == network->layers[0]->size);
+    size_t i, j;
+    for (i = 0; i < input->rows; i++){
+        float* row = input->data + i * input->cols;
+        for (j = 0; j < input->cols; j++){
+            row[j] = (row[j] - network->featureMean[j]) * network->featureScale[j];
+        }
+    }
+}
+
+// multiplies row $row of the U factor of $connection, if any, by $scale
+static void scaleFactorRow(Connection* connection, size_t row, float scale){
+    if (connection->factorU != NULL){
+        size_t j;
+        float* factor = connection->factorU->data + row * connection->factorU->cols;
+        for (j = 0; j < connection->factorU->cols; j++){
+            factor[j] *= scale;
+        }
+    }
+}
+
+// (x - mean) * scale * W + b = x * (scale W) + (b - (mean * scale) W)
+// the rows of U scale with those of W = UV, so a factorized first connection
+// keeps its rank
+void foldNormalization(Network* network){
+    assert(network->featureMean != NULL);
+    if (network->normalizationFolded){
+        return;
+    }
+    Connection* connection = network->connections[0];
+    Matrix* weights = connection->weights;
+    size_t i, j;
+    for (i = 0; i < weights->rows; i++){
+        float* row = weights->data + i * weights->cols;
+        float shift = network->featureMean[i] * network->featureScale[i];
+        for (j = 0; j < weights->cols; j++){
+            connection->bias->data[j] -= shift * row[j];
+            row[j] *= network->featureScale[i];
+        }
+        scaleFactorRow(connection, i, network->featureScale[i]);
+    }
+    refreshConnection(connection);
+    network->normalizationFolded = 1;
+}
+
+// takes the input stats out of folded first weights $weights, bias $bias
+// and U factor $factorU (NULL if not factorized), which need not be the
+// network's own, e.g. to snapshot them unfolded without changing the network
+static void unfoldValues(Network* network, float* weights, float* bias, float* factorU){
+    size_t rows = network->connections[0]->weights->rows, cols = network->connections[0]->weights->cols;
+    size_t rank = factorU != NULL ? network->connections[0]->factorU->cols : 0;
+    size_t i, j;
+    for (i = 0; i < rows; i++){
+        float* row = weights + i * cols;
+        for (j = 0; j < cols; j++){
+            bias[j] += network->featureMean[i] * row[j];
+            row[j] /= network->featureScale[i];
+        }
+        for (j = 0; j < rank; j++){
+            factorU[i * rank + j] *= 1 / network->featureScale[i];
+        }
+    }
+}
+
+void unfoldNormalization(Network* network){
+    if (!network->normalizationFolded){
+        return;
+    }
+    Connection* connection = network->connections[0];
+    unfoldValues(network, connection->weights->data, connection->bias->data, connection->factorU != NULL ? connection->factorU->data : NULL);
+    refreshConnection(connection);
+    network->normalizationFolded = 0;
+}
+
 void forwardPass(Network* network, Matrix* input){
     assert(input->cols == network->layers[0]->input->cols);
     destroyMatrix(network->layers[0]->input);
     network->layers[0]->input = copy(input);
+    if (network->featureMean != NULL && !network->normalizationFolded){
+        normalizeInput(network, network->layers[0]->input);
+    }
     int i;
-    Matrix* tmp,* tmp2;
+    Matrix* tmp;
     for (i = 0; i < network->numConnections; i++){
-        tmp = multiply(network->layers[i]->input, network->connections[i]->weights);
-        tmp2 = addToEachRow(tmp, network->connections[i]->bias);
+        PROFILE_BEGIN(layer);
+        float* data = (float*)malloc(sizeof(float) * input->rows * network->connections[i]->to->size);
+        tmp = createMatrix(input->rows, network->connections[i]->to->size, data);
+        connectionForwardInto(network->connections[i], network->layers[i]->input, tmp, NULL);
         destroyMatrix(network->connections[i]->to->input);
-        network->connections[i]->to->input = tmp2;
-        destroyMatrix(tmp);
+        network->connections[i]->to->input = tmp;
         activateLayer(network->connections[i]->to);
+        PROFILE_END(layer, "layerForward", i, connectionFlops(network->connections[i], input->rows), connectionBytes(network->connections[i], input->rows));
     }
 }
 
@@ -123,12 +550,139 @@ static void forwardPassDataSet(Network* network, DataSet* input){
     destroyMatrix(dataMatrix);
 }
 
+// centering would make the input dense, so stats must be folded first
+void forwardPassSparse(Network* network, SparseMatrix* input){
+    assert(input->cols == network->layers[0]->size);
+    assert(network->featureMean == NULL || network->normalizationFolded);
+    int i;
+    Matrix* tmp;
+    for (i = 0; i < network->numConnections; i++){
+        PROFILE_BEGIN(layer);
+        float* data = (float*)malloc(sizeof(float) * input->rows * network->connections[i]->to->size);
+        tmp = createMatrix(input->rows, network->connections[i]->to->size, data);
+        if (i == 0){
+            connectionForwardSparseInto(network->connections[i], input, tmp, NULL);
+        }
+        else{
+            connectionForwardInto(network->connections[i], network->layers[i]->input, tmp, NULL);
+        }
+        destroyMatrix(network->connections[i]->to->input);
+        network->connections[i]->to->input = tmp;
+        activateLayer(network->connections[i]->to);
+        PROFILE_END(layer, "layerForward", i, connectionFlops(network->connections[i], input->rows), connectionBytes(network->connections[i], input->rows));
+    }
+}
+
+Workspace* createWorkspace(Network* network, size_t maxRows){
+    assert(maxRows > 0);
+    Workspace* workspace = (Workspace*)malloc(sizeof(Workspace));
+    workspace->maxRows = maxRows;
+    workspace->numLayers = network->numLayers;
+    workspace->sizes = (size_t*)malloc(sizeof(size_t) * network->numLayers);
+    workspace->activations = (Matrix**)malloc(sizeof(Matrix*) * network->numLayers);
+    workspace->activations[0] = NULL;
+    workspace->scratchSize = 0;
+    int i;
+    for (i = 0; i < network->numLayers; i++){
+        workspace->sizes[i] = network->layers[i]->size;
+        if (i > 0){
+            workspace->activations[i] = createMatrixZeroes(maxRows, network->layers[i]->size);
+            workspace->scratchSize = MAX(workspace->scratchSize, connectionScratchSize(network->connections[i - 1], maxRows));
+        }
+    }
+    workspace->scratch = workspace->scratchSize > 0 ? (float*)malloc(sizeof(float) * workspace->scratchSize) : NULL;
+    return workspace;
+}
+
+// passes either dense $input or $sparseInput
+static Matrix* workspaceForward(Network* network, Workspace* workspace, Matrix* input, SparseMatrix* sparseInput){
+    size_t rows = input != NULL ? input->rows : sparseInput->rows;
+    assert((input != NULL ? input->cols : sparseInput->cols) == network->layers[0]->size);
+    int i, fits = workspace->numLayers == network->numLayers && rows <= workspace->maxRows;
+    for (i = 0; fits && i < network->numLayers; i++){
+        fits = workspace->sizes[i] == network->layers[i]->size;
+    }
+    if (!fits){
+        Workspace* grown = createWorkspace(network, MAX(rows, workspace->maxRows));
+        for (i = 0; i < workspace->numLayers; i++){
+            if (workspace->activations[i] != NULL){
+                destroyMatrix(workspace->activations[i]);
+            }
+        }
+        free(workspace->sizes);
+        free(workspace->activations);
+        free(workspace->scratch);
+        *workspace = *grown;
+        free(grown);
+    }
+
+    // factorizing after the workspace was made can need more scratch
+    size_t scratchSize = workspace->scratchSize;
+    for (i = 0; i < network->numConnections; i++){
+        scratchSize = MAX(scratchSize, connectionScratchSize(network->connections[i], workspace->maxRows));
+    }
+    if (scratchSize > workspace->scratchSize){
+        free(workspace->scratch);
+        workspace->scratch = (float*)malloc(sizeof(float) * scratchSize);
+        workspace->scratchSize = scratchSize;
+    }
+    Matrix* from = input;
+    if (network->featureMean != NULL && !network->normalizationFolded){
+        assert(sparseInput == NULL);
+        if (workspace->activations[0] == NULL){
+            workspace->activations[0] = createMatrixZeroes(workspace->maxRows, network->layers[0]->size);
+        }
+        from = workspace->activations[0];
+        from->rows = rows;
+        memcpy(from->data, input->data, sizeof(float) * rows * input->cols);
+        normalizeInput(network, from);
+    }
+    for (i = 0; i < network->numConnections; i++){
+        PROFILE_BEGIN(layer);
+        Matrix* to = workspace->activations[i + 1];
+        to->rows = rows;
+        if (i == 0 && sparseInput != NULL){
+            connectionForwardSparseInto(network->connections[i], sparseInput, to, workspace->scratch);
+        }
+        else{
+            connectionForwardInto(network->connections[i], from, to, workspace->scratch);
+        }
+        if (network->layers[i + 1]->activation != NULL){
+            network->layers[i + 1]->activation(to);
+        }
+        from = to;
+        PROFILE_END(layer, "layerForward", i, connectionFlops(network->connections[i], rows), connectionBytes(network->connections[i], rows));
+    }
+    return from;
+}
+
+Matrix* forwardPassWorkspace(Network* network, Workspace* workspace, Matrix* input){
+    return workspaceForward(network, workspace, input, NULL);
+}
+
+Matrix* forwardPassWorkspaceSparse(Network* network, Workspace* workspace, SparseMatrix* input){
+    return workspaceForward(network, workspace, NULL, input);
+}
+
+void destroyWorkspace(Workspace* workspace){
+    size_t i;
+    for (i = 0; i < workspace->numLayers; i++){
+        if (workspace->activations[i] != NULL){
+            destroyMatrix(workspace->activations[i]);
+        }
+    }
+    free(workspace->sizes);
+    free(workspace->activations);
+    free(workspace->scratch);
+    free(workspace);
+}
+
 // matrixes of size [num examples] x [num classes]
 float crossEntropyLoss(Network* network, Matrix* prediction, DataSet* actual, float regularizationStrength){
     assert(prediction->rows == actual->rows);
     assert(prediction->cols == actual->cols);
     float total_err = 0;
-    int i, j, k;
+    int i, j;
     for (i = 0; i < prediction->rows; i++){
         float cur_err = 0;
         for (j = 0; j < prediction->cols; j++){
@@ -136,17 +690,7 @@ float crossEntropyLoss(Network* network, Matrix* prediction, DataSet* actual, fl
         }
         total_err += cur_err;
     }
-    float reg_err = 0;
-    if (network != NULL){
-        for (i = 0; i < network->numConnections; i++){
-            Matrix* weights = network->connections[i]->weights;
-            for (j = 0; j < weights->rows; j++){
-                for (k = 0; k < weights->cols; k++){
-                    reg_err += getMatrix(weights, j, k) * getMatrix(weights, j, k);
-                }
-            }
-        }
-    }
+    float reg_err = network != NULL ? weightSquaredSum(network) : 0;
     return ((-1.0 / actual->rows) * total_err) + (regularizationStrength * .5 * reg_err);
 }
 
@@ -155,7 +699,7 @@ float meanSquaredError(Network* network, Matrix* prediction, DataSet* actual, fl
     assert(prediction->rows == actual->rows);
     assert(prediction->cols == actual->cols);
     float total_err = 0;
-    int i, j, k;
+    int i, j;
     for (i = 0; i < prediction->rows; i++){
         float cur_err = 0;
         for (j = 0; j < prediction->cols; j++){
@@ -164,17 +708,7 @@ float meanSquaredError(Network* network, Matrix* prediction, DataSet* actual, fl
         }
         total_err += cur_err;
     }
-    float reg_err = 0;
-    if (network != NULL){
-        for (i = 0; i < network->numConnections; i++){
-            Matrix* weights = network->connections[i]->weights;
-            for (j = 0; j < weights->rows; j++){
-                for (k = 0; k < weights->cols; k++){
-                    reg_err += getMatrix(weights, j, k) * getMatrix(weights, j, k);
-                }
-            }
-        }
-    }
+    float reg_err = network != NULL ? weightSquaredSum(network) : 0;
     return ((0.5 / actual->rows) * total_err) + (regularizationStrength * .5 * reg_err);
 }
 
@@ -198,20 +732,173 @@ int* predict(Network* network){
     return predictions;
 }
 
-float accuracy(Network* network, DataSet* data, DataSet* classes){
-    assert(data->rows == classes->rows);
+// totals of one chunk, kept apart so they can be summed in order
+typedef struct EvaluationChunk_ {
+    size_t numCorrect;
+    double crossEntropy;
+    double squaredError;
+} EvaluationChunk;
+
+// chunks evaluated by one thread
+typedef struct EvaluationRange_ {
+    Network* network;
+    DataSet* data;
+    SparseMatrix* sparseData;
+    DataSet* classes;
+    size_t chunkRows;
+    size_t firstChunk;
+    size_t lastChunk;
+    EvaluationChunk* chunks;
+} EvaluationRange;
+
+static void* evaluateRange(void* arg){
+    EvaluationRange* range = (EvaluationRange*)arg;
+    DataSet* data = range->data;
+    DataSet* classes = range->classes;
+    Workspace* workspace = createWorkspace(range->network, range->chunkRows);
+    Matrix* input = data != NULL ? createMatrixZeroes(range->chunkRows, data->cols) : NULL;
+    size_t chunk, i, j;
+    for (chunk = range->firstChunk; chunk < range->lastChunk; chunk++){
+        size_t first = chunk * range->chunkRows;
+        size_t numRows = MIN(range->chunkRows, classes->rows - first);
+        Matrix* output;
+        if (data != NULL){
+            input->rows = numRows;
+            for (i = 0; i < input->rows; i++){
+                memcpy(input->data + i * data->cols, data->data[first + i], sizeof(float) * data->cols);
+            }
+            output = forwardPassWorkspace(range->network, workspace, input);
+        }
+        else{
+            SparseMatrix rows = sparseRows(range->sparseData, first, numRows);
+            output = forwardPassWorkspaceSparse(range->network, workspace, &rows);
+        }
+
+        // same per-row arithmetic as predict, crossEntropyLoss and meanSquaredError
+        EvaluationChunk* totals = &range->chunks[chunk];
+        totals->numCorrect = 0;
+        totals->crossEntropy = 0;
+        totals->squaredError = 0;
+        for (i = 0; i < output->rows; i++){
+            float* target = classes->data[first + i];
+            float* row = output->data + i * output->cols;
+            float crossEntropy = 0, squaredError = 0;
+            size_t max = 0;
+            for (j = 0; j < output->cols; j++){
+                float difference = target[j] - row[j];
+                crossEntropy += target[j] * logf(MAX(FLT_MIN, row[j]));
+                squaredError += difference * difference;
+                if (row[j] > row[max]){
+                    max = j;
+                }
+            }
+            totals->numCorrect += target[max] == 1;
+            totals->crossEntropy -= crossEntropy;
+            totals->squaredError += squaredError;
+        }
+    }
+    if (input != NULL){
+        destroyMatrix(input);
+    }
+    destroyWorkspace(workspace);
+    return NULL;
+}
+
+// evaluates either dense $data or $sparseData
+static Evaluation evaluateRows(Network* network, DataSet* data, SparseMatrix* sparseData, DataSet* classes, size_t chunkRows, int numThreads){
+    assert((data != NULL ? data->rows : sparseData->rows) == classes->rows);
+    assert((data != NULL ? data->cols : sparseData->cols) == network->layers[0]->size);
     assert(classes->cols == network->layers[network->numLayers - 1]->size);
-    forwardPassDataSet(network, data);
-    int* predictions = predict(network);
-    float numCorrect = 0;
+    assert(chunkRows > 0 && numThreads >= 1);
+    Evaluation evaluation;
+    memset(&evaluation, 0, sizeof(evaluation));
+    evaluation.rows = classes->rows;
+    evaluation.l2 = weightSquaredSum(network);
     int i;
-    for (i = 0; i < data->rows; i++){
-        if (classes->data[i][predictions[i]] == 1){
-            numCorrect++;
+    size_t j;
+    size_t numChunks = (classes->rows + chunkRows - 1) / chunkRows;
+    if (numChunks == 0){
+        return evaluation;
+    }
+    EvaluationChunk* chunks = (EvaluationChunk*)malloc(sizeof(EvaluationChunk) * numChunks);
+    int numRanges = (int)MIN((size_t)numThreads, numChunks);
+    EvaluationRange ranges[numRanges];
+    for (i = 0; i < numRanges; i++){
+        ranges[i].network = network;
+        ranges[i].data = data;
+        ranges[i].sparseData = sparseData;
+        ranges[i].classes = classes;
+        ranges[i].chunkRows = chunkRows;
+        ranges[i].firstChunk = numChunks * i / numRanges;
+        ranges[i].lastChunk = numChunks * (i + 1) / numRanges;
+        ranges[i].chunks = chunks;
+    }
+#ifdef CRANIUM_USE_POSIX
+    pthread_t threads[numRanges];
+    int started[numRanges];
+    for (i = 1; i < numRanges; i++){
+        started[i] = pthread_create(&threads[i], NULL, evaluateRange, &ranges[i]) == 0;
+        if (!started[i]){
+            evaluateRange(&ranges[i]);
+        }
+    }
+    evaluateRange(&ranges[0]);
+    for (i = 1; i < numRanges; i++){
+        if (started[i]){
+            pthread_join(threads[i], NULL);
         }
     }
-    free(predictions);
-    return numCorrect / classes->rows;
+#else
+    for (i = 0; i < numRanges; i++){
+        evaluateRange(&ranges[i]);
+    }
+#endif
+    for (j = 0; j < numChunks; j++){
+        evaluation.numCorrect += chunks[j].numCorrect;
+        evaluation.crossEntropy += chunks[j].crossEntropy;
+        evaluation.squaredError += chunks[j].squaredError;
+    }
+    free(chunks);
+    return evaluation;
+}
+
+Evaluation evaluateNetwork(Network* network, DataSet* data, DataSet* classes, size_t chunkRows, int numThreads){
+    return evaluateRows(network, data, NULL, classes, chunkRows, numThreads);
+}
+
+Evaluation evaluateNetworkSparse(Network* network, SparseMatrix* data, DataSet* classes, size_t chunkRows, int numThreads){
+    return evaluateRows(network, NULL, data, classes, chunkRows, numThreads);
+}
+
+static EvaluationDefaults activeEvaluation = {EVALUATION_CHUNK_ROWS, 1};
+
+void setEvaluationDefaults(EvaluationDefaults defaults){
+    assert(defaults.chunkRows > 0 && defaults.numThreads >= 1);
+    activeEvaluation = defaults;
+}
+
+EvaluationDefaults currentEvaluationDefaults(){
+    return activeEvaluation;
+}
+
+float accuracy(Network* network, DataSet* data, DataSet* classes){
+    Evaluation evaluation = evaluateNetwork(network, data, classes, activeEvaluation.chunkRows, activeEvaluation.numThreads);
+    return (float)evaluation.numCorrect / classes->rows;
+}
+
+float accuracySparse(Network* network, SparseMatrix* data, DataSet* classes){
+    Evaluation evaluation = evaluateNetworkSparse(network, data, classes, activeEvaluation.chunkRows, activeEvaluation.numThreads);
+    return (float)evaluation.numCorrect / classes->rows;
+}
+
+float crossEntropyLossDataSet(Network* network, DataSet* data, DataSet* classes, float regularizationStrength){
+    Evaluation evaluation = evaluateNetwork(network, data, classes, activeEvaluation.chunkRows, activeEvaluation.numThreads);
+    return evaluation.crossEntropy / evaluation.rows + regularizationStrength * .5 * evaluation.l2;
+}
+
+float meanSquaredErrorDataSet(Network* network, DataSet* data, DataSet* classes, float regularizationStrength){
+    Evaluation evaluation = evaluateNetwork(network, data, classes, activeEvaluation.chunkRows, activeEvaluation.numThreads);
+    return .5 * evaluation.squaredError / evaluation.rows + regularizationStrength * .5 * evaluation.l2;
 }
 
 void destroyNetwork(Network* network){
@@ -224,10 +911,20 @@ void destroyNetwork(Network* network){
     }
     free(network->layers);
     free(network->connections);
+#ifdef CRANIUM_USE_POSIX
+    if (network->mapping != NULL){
+        munmap(network->mapping, network->mappingSize);
+    }
+#endif
+    free(network->parameterBlock);
+    free(network->featureMean);
+    free(network->featureScale);
     free(network);
 }
 
-// serializes in order: sizes --> weights --> bias
+// serializes in order: sizes --> weights --> bias --> optional sections
+// each optional section starts with a keyword line, so files written
+// before a section existed still read back correctly
 void saveNetwork(Network* network, char* path){
     FILE* fp = fopen(path, "w");
     int i, j, k;
@@ -263,6 +960,43 @@ void saveNetwork(Network* network, char* path){
         }
     }
 
+    // serialize storage precision of connections not in 32 bit floats
+    for (k = 0; k < network->numConnections; k++){
+        if (network->connections[k]->precision != FLOAT32){
+            fprintf(fp, "precision %d %s\n", k, getPrecisionName(network->connections[k]->precision));
+        }
+    }
+
+    // serialize which connections have a fixed sparse pattern
+    for (k = 0; k < network->numConnections; k++){
+        if (network->connections[k]->sparseWeights != NULL){
+            fprintf(fp, "pruned %d\n", k);
+        }
+    }
+
+    // serialize rank and factors of factorized connections, U then V in
+    // row-major ordering
+    for (k = 0; k < network->numConnections; k++){
+        Connection* con = network->connections[k];
+        if (con->factorU != NULL){
+            fprintf(fp, "factorized %d %zu\n", k, con->factorU->cols);
+            for (i = 0; i < con->factorU->rows * con->factorU->cols; i++){
+                fprintf(fp, "%a\n", con->factorU->data[i]);
+            }
+            for (i = 0; i < con->factorV->rows * con->factorV->cols; i++){
+                fprintf(fp, "%a\n", con->factorV->data[i]);
+            }
+        }
+    }
+
+    // serialize input normalization, one mean and scale per feature
+    if (network->featureMean != NULL){
+        fprintf(fp, "normalization %d\n", network->normalizationFolded);
+        for (i = 0; i < network->layers[0]->size; i++){
+            fprintf(fp, "%a %a\n", network->featureMean[i], network->featureScale[i]);
+        }
+    }
+
     fclose(fp);
 }
 
@@ -296,25 +1030,7 @@ Network* readNetwork(char* path){
     }
 
     // construct network structure
-    Network* network;
-    size_t inputSize = layerSizes[0];
-    size_t outputSize = layerSizes[numLayers - 1];
-    size_t numHiddenLayers = numLayers - 2;
-    Activation outputFunc = funcs[numLayers - 2];
-    if (numHiddenLayers > 0){
-        size_t hiddenSizes[numLayers - 2];
-        for (i = 0; i < numLayers - 2; i++){
-            hiddenSizes[i] = layerSizes[1 + i];
-        }
-        Activation hiddenFuncs[numLayers - 2];
-        for (i = 0; i < numLayers - 2; i++){
-            hiddenFuncs[i] = funcs[i];
-        }
-        network = createNetwork(inputSize, numHiddenLayers, hiddenSizes, hiddenFuncs, outputSize, outputFunc);
-    }
-    else{
-        network = createNetwork(inputSize, 0, NULL, NULL, outputSize, outputFunc);
-    }
+    Network* network = allocateNetwork(numLayers, layerSizes, funcs);
 
     // fill in weights
     for (k = 0; k < network->numConnections; k++){
@@ -338,6 +1054,53 @@ Network* readNetwork(char* path){
         }
     }
 
+    // read optional sections
+    char keyword[50], name[50];
+    while (fgets(buf, 50, fp) != NULL){
+        if (sscanf(buf, "%49s", keyword) != 1){
+            continue;
+        }
+        if (strcmp(keyword, "precision") == 0){
+            sscanf(buf, "%*s %d %49s", &k, name);
+            assert(k >= 0 && k < network->numConnections);
+            setConnectionPrecision(network->connections[k], getPrecisionByName(name));
+        }
+        else if (strcmp(keyword, "pruned") == 0){
+            sscanf(buf, "%*s %d", &k);
+            assert(k >= 0 && k < network->numConnections);
+            sparsifyConnection(network->connections[k]);
+        }
+        else if (strcmp(keyword, "factorized") == 0){
+            size_t rank;
+            sscanf(buf, "%*s %d %zu", &k, &rank);
+            assert(k >= 0 && k < network->numConnections);
+            Connection* con = network->connections[k];
+            assert(rank > 0 && rank <= con->weights->rows && rank <= con->weights->cols);
+            unfactorizeConnection(con);
+            con->factorU = createMatrixZeroes(con->weights->rows, rank);
+            con->factorV = createMatrixZeroes(rank, con->weights->cols);
+            for (i = 0; i < con->factorU->rows * con->factorU->cols; i++){
+                fgets(buf, 50, fp);
+                sscanf(buf, "%a", &con->factorU->data[i]);
+            }
+            for (i = 0; i < con->factorV->rows * con->factorV->cols; i++){
+                fgets(buf, 50, fp);
+                sscanf(buf, "%a", &con->factorV->data[i]);
+            }
+        }
+        else if (strcmp(keyword, "normalization") == 0){
+            sscanf(buf, "%*s %d", &network->normalizationFolded);
+            size_t size = network->layers[0]->size;
+            network->featureMean = (float*)malloc(sizeof(float) * size);
+            network->featureScale = (float*)malloc(sizeof(float) * size);
+            for (i = 0; i < size; i++){
+                fgets(buf, 50, fp);
+                sscanf(buf, "%a %a", &network->featureMean[i], &network->featureScale[i]);
+            }
+        }
+        memset(&buf[0], 0, 50);
+    }
+
     fclose(fp);
     return network;
 }
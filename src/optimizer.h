@@ -29,6 +29,109 @@ typedef struct ParameterSet_ {
     int verbose;
 } ParameterSet;
 
+// buffers reused across training steps, so that trainers can feed
+// examples from any source one at a time
+typedef struct TrainingState_ {
+    Network* network;
+    LOSS_FUNCTION lossFunction;
+    size_t numHidden;
+    Matrix** errori;
+    Matrix** dWi;
+    Matrix** dbi;
+    Matrix* beforeOutputT;
+    Matrix** WTi;
+    Matrix** errorLastTi;
+    Matrix** fprimei;
+    Matrix** inputTi;
+    Matrix** dWi_avg; // views into gradient
+    Matrix** dbi_avg;
+    Matrix** dWi_last; // views into velocity
+    Matrix** dbi_last;
+    Matrix** dUi; // gradient of the factors of factorized connections,
+    Matrix** dVi; // allocated on their first step
+    Matrix** dUi_last; // last step of the factors
+    Matrix** dVi_last;
+
+    // running total of the gradient and the last step, laid out as the
+    // network's parameter arena, so a step is one pass over all three
+    void* gradientBlock;
+    float* gradient;
+    void* velocityBlock;
+    float* velocity;
+
+    // position in a run of trainGradientDescent, so that it can resume
+    int epoch; // next step, counted from 1
+    size_t batch; // next batch of the current pass
+    uint64_t random; // state of the shuffling generator
+    size_t* order; // rows in their current shuffled order
+    size_t numRows;
+    int refold; // if non-zero, the input stats are out of the weights for
+                // the run and are folded back in when it ends
+
+    // if set, called after every step
+    void (*stepCallback)(struct TrainingState_* state, void* context);
+    void* stepContext;
+
+    // rows of the first weights given gradient by sparse examples this step
+    int sparseStep;
+    unsigned char* touched; // (rows of first weights), allocated on first use
+    size_t* touchedRows;
+    size_t numTouched;
+
+    // if set, gradientReady is called while the last example of a step is
+    // backpropagated, once per connection as its gradient becomes final,
+    // last connection first, so work on it can overlap the rest of the pass;
+    // gradientWait is then called before the step is applied, and if it
+    // returns non-zero the step is dropped and the run ends
+    void (*gradientReady)(struct TrainingState_* state, int connection, void* context);
+    int (*gradientWait)(struct TrainingState_* state, void* context);
+    void* gradientContext;
+    int lastExample; // set by trainers while the last example of a step runs
+    size_t normalizer; // if non-zero, divides steps in place of the rows trained on
+
+    // if set, adds the gradient of the dense rows $rows of a batch to the
+    // running total, in place of accumulateGradient on each row
+    void (*batchGradient)(struct TrainingState_* state, DataSet* data, DataSet* classes, size_t* rows, size_t numRows, void* context);
+    void* batchContext;
+} TrainingState;
+
+// allocates the buffers for training $network under $lossFunction
+static TrainingState* createTrainingState(Network* network, LOSS_FUNCTION lossFunction);
+
+// backpropagates one $example against $target and adds its gradient to
+// the running total
+static void accumulateGradient(TrainingState* state, Matrix* example, Matrix* target);
+
+// same as accumulateGradient for a one-row sparse $example, in time
+// proportional to its stored entries in the first layer; a step must not
+// mix sparse and dense examples
+// the step then updates only the first weights' rows this step's examples
+// touched, so regularization and momentum skip the other rows, which is
+// exact when both are zero
+static void accumulateGradientSparse(TrainingState* state, SparseMatrix* example, Matrix* target);
+
+// applies the accumulated gradient, divided by $normalizer, as one step
+// with regularization and momentum, then clears the running total
+// factorized connections step their factors instead, by the weights'
+// gradient carried through W = UV, and their weights are set to the new UV
+static void applyGradient(TrainingState* state, float learningRate, float regularizationStrength, float momentumFactor, size_t normalizer);
+
+// frees the buffers of a training state
+static void destroyTrainingState(TrainingState* state);
+
+// runs gradient descent steps from the position recorded in $state until
+// step $maxIters, shuffling the order rows are visited in (the rows of
+// $data and $classes themselves are not moved)
+// a state restored from a checkpoint continues exactly where it was saved
+// with input stats, examples are standardized as they are gathered, and
+// folded stats are taken out of the weights for training and put back after
+// parameters are as in batchGradientDescent
+static void trainGradientDescent(TrainingState* state, DataSet* data, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose);
+
+// same as trainGradientDescent for sparse $data, with one row per example
+// sparse examples are not standardized, so input stats must be folded
+static void trainGradientDescentSparse(TrainingState* state, SparseMatrix* data, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose);
+
 // batch gradient descent main function
 // $network is the network to be trained
 // $data is the training data
@@ -43,6 +146,9 @@ typedef struct ParameterSet_ {
 // $verbose, if non-zero, will print loss every 100 epochs
 static void batchGradientDescent(Network* network, DataSet* data, DataSet* classes, LOSS_FUNCTION lossFunction, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose);
 
+// same as batchGradientDescent for sparse $data, with one row per example
+static void batchGradientDescentSparse(Network* network, SparseMatrix* data, DataSet* classes, LOSS_FUNCTION lossFunction, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose);
+
 // optimizes given parameters
 static void optimize(ParameterSet params){
     batchGradientDescent(params.network, params.data, params.classes, params.lossFunction, params.batchSize, params.learningRate, params.searchTime, params.regularizationStrength, params.momentumFactor, params.maxIters, params.shuffle, params.verbose);
@@ -53,259 +159,521 @@ static void optimize(ParameterSet params){
     Begin functions.
 */
 
-void batchGradientDescent(Network* network, DataSet* data, DataSet* classes, LOSS_FUNCTION lossFunction, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle,  int verbose){
-    assert(network->layers[0]->size == data->cols);
-    assert(data->rows == classes->rows);
-    assert(network->layers[network->numLayers - 1]->size == classes->cols);
-    assert(batchSize <= data->rows);
-    assert(maxIters >= 1);
-
-    int i, j, k;
+TrainingState* createTrainingState(Network* network, LOSS_FUNCTION lossFunction){
+    if (!isNetworkFlat(network)){
+        flattenNetwork(network);
+    }
+    TrainingState* state = (TrainingState*)malloc(sizeof(TrainingState));
+    state->network = network;
+    state->lossFunction = lossFunction;
+    int i, k;
 
     // these will be reused per training instance
-    Matrix* errori[network->numLayers];
-    Matrix* dWi[network->numConnections];
-    Matrix* dbi[network->numConnections];
-    Matrix* regi[network->numConnections];
-    Matrix* beforeOutputT = createMatrixZeroes(network->layers[network->numLayers - 2]->size, 1);
+    state->errori = (Matrix**)malloc(sizeof(Matrix*) * network->numLayers);
+    state->dWi = (Matrix**)malloc(sizeof(Matrix*) * network->numConnections);
+    state->dbi = (Matrix**)malloc(sizeof(Matrix*) * network->numConnections);
+    state->beforeOutputT = createMatrixZeroes(network->layers[network->numLayers - 2]->size, 1);
     for (i = 0; i < network->numConnections; i++){
-        errori[i] = createMatrixZeroes(1, network->layers[i]->size);
-        dWi[i] = createMatrixZeroes(network->connections[i]->weights->rows, network->connections[i]->weights->cols);
-        dbi[i] = createMatrixZeroes(1, network->connections[i]->bias->cols);
-        regi[i] = createMatrixZeroes(network->connections[i]->weights->rows, network->connections[i]->weights->cols);
+        state->errori[i] = createMatrixZeroes(1, network->layers[i]->size);
+        state->dWi[i] = createMatrixZeroes(network->connections[i]->weights->rows, network->connections[i]->weights->cols);
+        state->dbi[i] = createMatrixZeroes(1, network->connections[i]->bias->cols);
     }
-    errori[i] = createMatrixZeroes(1, network->layers[i]->size);
+    state->errori[i] = createMatrixZeroes(1, network->layers[i]->size);
 
     // these will be reused per training instance if network has hidden layers
-    int numHidden = network->numLayers - 2;
-    Matrix** WTi,** errorLastTi,** fprimei,** inputTi;
-    if (numHidden > 0){
-        WTi = (Matrix**)malloc(sizeof(Matrix*) * numHidden);
-        errorLastTi = (Matrix**)malloc(sizeof(Matrix*) * numHidden);
-        fprimei = (Matrix**)malloc(sizeof(Matrix*) * numHidden);
-        inputTi = (Matrix**)malloc(sizeof(Matrix*) * numHidden);
-        for (k = 0; k < numHidden; k++){
-            WTi[k] = createMatrixZeroes(network->connections[k + 1]->weights->cols, network->connections[k + 1]->weights->rows);
-            errorLastTi[k] = createMatrixZeroes(1, WTi[k]->cols);
-            fprimei[k] = createMatrixZeroes(1, network->connections[k]->to->size);
-            inputTi[k] = createMatrixZeroes(network->connections[k]->from->size, 1);
-        }
+    state->numHidden = network->numLayers - 2;
+    state->WTi = (Matrix**)malloc(sizeof(Matrix*) * (state->numHidden + 1));
+    state->errorLastTi = (Matrix**)malloc(sizeof(Matrix*) * (state->numHidden + 1));
+    state->fprimei = (Matrix**)malloc(sizeof(Matrix*) * (state->numHidden + 1));
+    state->inputTi = (Matrix**)malloc(sizeof(Matrix*) * (state->numHidden + 1));
+    for (k = 0; k < state->numHidden; k++){
+        state->WTi[k] = createMatrixZeroes(network->connections[k + 1]->weights->cols, network->connections[k + 1]->weights->rows);
+        state->errorLastTi[k] = createMatrixZeroes(1, state->WTi[k]->cols);
+        state->fprimei[k] = createMatrixZeroes(1, network->connections[k]->to->size);
+        state->inputTi[k] = createMatrixZeroes(network->connections[k]->from->size, 1);
     }
 
-    // these will be reused per epoch
-    Matrix* dWi_avg[network->numConnections];
-    Matrix* dbi_avg[network->numConnections];
-    Matrix* dWi_last[network->numConnections];
-    Matrix* dbi_last[network->numConnections];
+    // these will be reused per step
+    size_t weightsOffset[network->numConnections], biasOffset[network->numConnections];
+    parameterLayout(network, weightsOffset, biasOffset);
+    state->gradient = allocateParameterArena(network->numParameters, &state->gradientBlock);
+    state->velocity = allocateParameterArena(network->numParameters, &state->velocityBlock);
+    state->dWi_avg = (Matrix**)malloc(sizeof(Matrix*) * network->numConnections);
+    state->dbi_avg = (Matrix**)malloc(sizeof(Matrix*) * network->numConnections);
+    state->dWi_last = (Matrix**)malloc(sizeof(Matrix*) * network->numConnections);
+    state->dbi_last = (Matrix**)malloc(sizeof(Matrix*) * network->numConnections);
     for (i = 0; i < network->numConnections; i++){
-        dWi_avg[i] = createMatrixZeroes(network->connections[i]->weights->rows, network->connections[i]->weights->cols);
-        dbi_avg[i] = createMatrixZeroes(1, network->connections[i]->bias->cols);
-        dWi_last[i] = createMatrixZeroes(network->connections[i]->weights->rows, network->connections[i]->weights->cols);
-        dbi_last[i] = createMatrixZeroes(1, network->connections[i]->bias->cols);
+        state->dWi_avg[i] = createMatrix(network->connections[i]->weights->rows, network->connections[i]->weights->cols, state->gradient + weightsOffset[i]);
+        state->dbi_avg[i] = createMatrix(1, network->connections[i]->bias->cols, state->gradient + biasOffset[i]);
+        state->dWi_last[i] = createMatrix(network->connections[i]->weights->rows, network->connections[i]->weights->cols, state->velocity + weightsOffset[i]);
+        state->dbi_last[i] = createMatrix(1, network->connections[i]->bias->cols, state->velocity + biasOffset[i]);
     }
+    state->dUi = (Matrix**)calloc(network->numConnections, sizeof(Matrix*));
+    state->dVi = (Matrix**)calloc(network->numConnections, sizeof(Matrix*));
+    state->dUi_last = (Matrix**)calloc(network->numConnections, sizeof(Matrix*));
+    state->dVi_last = (Matrix**)calloc(network->numConnections, sizeof(Matrix*));
 
-    int numBatches = (data->rows / batchSize) + (data->rows % batchSize != 0 ? 1 : 0);
-    int training, batch, epoch, layer;
-    DataSet** dataBatches,** classBatches;
-    epoch = 1;
-    while (epoch <= maxIters){
-        // shuffle all data and classes but maintain training/class alignment
-        if (shuffle != 0){
-            shuffleTogether(data, classes);
-        }
+    state->epoch = 1;
+    state->batch = 0;
+    state->random = ((uint64_t)rand() << 32) ^ rand();
+    state->order = NULL;
+    state->numRows = 0;
+    state->refold = 0;
+    state->stepCallback = NULL;
+    state->stepContext = NULL;
+    state->sparseStep = 0;
+    state->touched = NULL;
+    state->touchedRows = NULL;
+    state->numTouched = 0;
+    state->gradientReady = NULL;
+    state->gradientWait = NULL;
+    state->gradientContext = NULL;
+    state->lastExample = 0;
+    state->normalizer = 0;
+    state->batchGradient = NULL;
+    state->batchContext = NULL;
+    return state;
+}
 
-        // split into overall batches
-        dataBatches = createBatches(data, numBatches);
-        classBatches = createBatches(classes, numBatches);
-        for (batch = 0; batch < numBatches && epoch <= maxIters; batch++, epoch++){
-            // find current batch
-            int curBatchSize = batch == numBatches - 1 ? (data->rows % batchSize != 0 ? data->rows % batchSize : batchSize) : batchSize;
-            DataSet* batchTraining = dataBatches[batch];
-            DataSet* batchClasses = classBatches[batch];
-            Matrix** splitTraining = splitRows(batchTraining);
-            Matrix** splitClasses = splitRows(batchClasses);
-            for (training = 0; training < curBatchSize; training++){
-                // current data point to train on
-                Matrix* example = splitTraining[training];
-                Matrix* target = splitClasses[training];
-                
-                // pass error forward
-                forwardPass(network, example);
-                
-                // calculate each iteration of backpropagation
-                for (layer = network->numLayers - 1; layer > 0; layer--){
-                    Layer* to = network->layers[layer];
-                    Connection* con = network->connections[layer - 1];
-                    if (layer == network->numLayers - 1){
-                        // calculate output layer's error
-                        copyValuesInto(to->input, errori[layer]);
-                        if (lossFunction == CROSS_ENTROPY_LOSS){
-                            for (j = 0; j < errori[layer]->cols; j++){
-                                errori[layer]->data[j] -= target->data[j];
-                            }
-                        }
-                        else{
-                            for (j = 0; j < errori[layer]->cols; j++){
-                                errori[layer]->data[j] -= target->data[j];
-                            }
-                        }
-
-                        // calculate dWi and dbi
-                        transposeInto(con->from->input, beforeOutputT);
-                        multiplyInto(beforeOutputT, errori[layer], dWi[layer - 1]);
-                        copyValuesInto(errori[layer], dbi[layer - 1]);
-                    }
-                    else{
-                        // calculate error term for hidden layer
-                        int hiddenLayer = layer - 1;
-                        transposeInto(network->connections[layer]->weights, WTi[hiddenLayer]);
-                        multiplyInto(errori[layer + 1], WTi[hiddenLayer], errorLastTi[hiddenLayer]);
-                        copyValuesInto(con->to->input, fprimei[hiddenLayer]);
-                        float (*derivative)(float) = activationDerivative(con->to->activation);
-                        for (j = 0; j < fprimei[hiddenLayer]->cols; j++){
-                            fprimei[hiddenLayer]->data[j] = derivative(fprimei[hiddenLayer]->data[j]);
-                        }
-                        hadamardInto(errorLastTi[hiddenLayer], fprimei[hiddenLayer], errori[layer]);
-
-                        // calculate dWi and dbi
-                        transposeInto(con->from->input, inputTi[hiddenLayer]);
-                        multiplyInto(inputTi[hiddenLayer], errori[layer], dWi[layer - 1]);
-                        copyValuesInto(errori[layer], dbi[layer - 1]);
-                    }
-                }
+// backpropagates either dense $example or $sparseExample; the gradient of
+// the first weights for a sparse example goes straight into the touched rows
+// of the running total, so nothing as wide as the input is read or written
+static void backpropagate(TrainingState* state, Matrix* example, SparseMatrix* sparseExample, Matrix* target){
+    Network* network = state->network;
+    Matrix** errori = state->errori;
+    int i, j, layer;
+    assert(state->sparseStep == (sparseExample != NULL) || state->numTouched == 0);
+    state->sparseStep = sparseExample != NULL;
 
-                // add one example's contribution to total gradient
-                for (i = 0; i < network->numConnections; i++){
-                    addTo(dWi[i], dWi_avg[i]);
-                    addTo(dbi[i], dbi_avg[i]);
-                }
+    // pass error forward
+    if (sparseExample != NULL){
+        forwardPassSparse(network, sparseExample);
+    }
+    else{
+        forwardPass(network, example);
+    }
 
-                // zero out reusable matrices
-                zeroMatrix(beforeOutputT);
-                for (i = 0; i < network->numConnections; i++){
-                    zeroMatrix(errori[i]);
-                    zeroMatrix(dWi[i]);
-                    zeroMatrix(dbi[i]);
+    // remember which rows of the first weights now hold gradient
+    if (sparseExample != NULL){
+        Matrix* weights = network->connections[0]->weights;
+        if (state->touched == NULL){
+            state->touched = (unsigned char*)calloc(weights->rows, sizeof(unsigned char));
+            state->touchedRows = (size_t*)malloc(sizeof(size_t) * weights->rows);
+        }
+        size_t p;
+        for (p = sparseExample->rowStart[0]; p < sparseExample->rowStart[1]; p++){
+            size_t row = sparseExample->colIndex[p];
+            if (!state->touched[row]){
+                state->touched[row] = 1;
+                state->touchedRows[state->numTouched++] = row;
+            }
+        }
+    }
+
+    // calculate each iteration of backpropagation
+    for (layer = network->numLayers - 1; layer > 0; layer--){
+        PROFILE_BEGIN(layer);
+        Layer* to = network->layers[layer];
+        Connection* con = network->connections[layer - 1];
+        if (layer == network->numLayers - 1){
+            // calculate output layer's error
+            copyValuesInto(to->input, errori[layer]);
+            if (state->lossFunction == CROSS_ENTROPY_LOSS){
+                for (j = 0; j < errori[layer]->cols; j++){
+                    errori[layer]->data[j] -= target->data[j];
                 }
-                zeroMatrix(errori[i]);
-                if (numHidden > 0){
-                    for (i = 0; i < numHidden; i++){
-                        zeroMatrix(WTi[i]);
-                        zeroMatrix(errorLastTi[i]);
-                        zeroMatrix(fprimei[i]);
-                        zeroMatrix(inputTi[i]);
-                    }
+            }
+            else{
+                for (j = 0; j < errori[layer]->cols; j++){
+                    errori[layer]->data[j] -= target->data[j];
                 }
             }
 
-            // calculate learning rate for this epoch
-            float currentLearningRate = searchTime == 0 ? learningRate : learningRate / (1 + (epoch / searchTime));
-            
-            // average out gradients and add learning rate
-            for (i = 0; i < network->numConnections; i++){
-                scalarMultiply(dWi_avg[i], currentLearningRate / data->rows);
-                scalarMultiply(dbi_avg[i], currentLearningRate / data->rows);
+            // calculate dWi and dbi
+            if (layer == 1 && sparseExample != NULL){
+                addSparseTransposeMultiply(sparseExample, errori[layer], state->dWi_avg[0]);
             }
-
-            // add regularization
-            for (i = 0; i < network->numConnections; i++){
-                copyValuesInto(network->connections[i]->weights, regi[i]);
-                scalarMultiply(regi[i], regularizationStrength);
-                addTo(regi[i], dWi_avg[i]);
+            else{
+                transposeInto(con->from->input, state->beforeOutputT);
+                multiplyInto(state->beforeOutputT, errori[layer], state->dWi[layer - 1]);
             }
-
-            // add momentum
-            for (i = 0; i < network->numConnections; i++){
-                scalarMultiply(dWi_last[i], momentumFactor);
-                scalarMultiply(dbi_last[i], momentumFactor);
-                addTo(dWi_last[i], dWi_avg[i]);
-                addTo(dbi_last[i], dbi_avg[i]);
+            copyValuesInto(errori[layer], state->dbi[layer - 1]);
+        }
+        else{
+            // calculate error term for hidden layer
+            int hiddenLayer = layer - 1;
+            transposeInto(network->connections[layer]->weights, state->WTi[hiddenLayer]);
+            multiplyInto(errori[layer + 1], state->WTi[hiddenLayer], state->errorLastTi[hiddenLayer]);
+            copyValuesInto(con->to->input, state->fprimei[hiddenLayer]);
+            float (*derivative)(float) = activationDerivative(con->to->activation);
+            for (j = 0; j < state->fprimei[hiddenLayer]->cols; j++){
+                state->fprimei[hiddenLayer]->data[j] = derivative(state->fprimei[hiddenLayer]->data[j]);
             }
+            hadamardInto(state->errorLastTi[hiddenLayer], state->fprimei[hiddenLayer], errori[layer]);
 
-            // adjust weights and bias
-            for (i = 0; i < network->numConnections; i++){
-                scalarMultiply(dWi_avg[i], -1);
-                scalarMultiply(dbi_avg[i], -1);
-                addTo(dWi_avg[i], network->connections[i]->weights);
-                addTo(dbi_avg[i], network->connections[i]->bias);
+            // calculate dWi and dbi
+            if (layer == 1 && sparseExample != NULL){
+                addSparseTransposeMultiply(sparseExample, errori[layer], state->dWi_avg[0]);
             }
-
-            // cache weight and bias updates for momentum
-            for (i = 0; i < network->numConnections; i++){
-                copyValuesInto(dWi_avg[i], dWi_last[i]);
-                copyValuesInto(dbi_avg[i], dbi_last[i]);
-                // make positive again for next epoch
-                scalarMultiply(dWi_last[i], -1);
-                scalarMultiply(dbi_last[i], -1);
+            else{
+                transposeInto(con->from->input, state->inputTi[hiddenLayer]);
+                multiplyInto(state->inputTi[hiddenLayer], errori[layer], state->dWi[layer - 1]);
             }
+            copyValuesInto(errori[layer], state->dbi[layer - 1]);
+        }
 
-            // zero out reusable average matrices and regularization matrices
-            for (i = 0; i < network->numConnections; i++){
-                zeroMatrix(dWi_avg[i]);
-                zeroMatrix(dbi_avg[i]);
-                zeroMatrix(regi[i]);
-            }
+        // add one example's contribution to total gradient
+        if (layer > 1 || sparseExample == NULL){
+            addTo(state->dWi[layer - 1], state->dWi_avg[layer - 1]);
+        }
+        addTo(state->dbi[layer - 1], state->dbi_avg[layer - 1]);
+        if (state->lastExample && state->gradientReady != NULL){
+            state->gradientReady(state, layer - 1, state->gradientContext);
+        }
 
-            // free list of training examples
-            for (i = 0; i < curBatchSize; i++){
-                free(splitTraining[i]);
-                free(splitClasses[i]);
-            }
-            free(splitTraining);
-            free(splitClasses);
-
-            // if verbose is set, print loss every 100 epochs
-            if (verbose != 0){
-                if (epoch % 100 == 0 || epoch == 1){
-                    forwardPassDataSet(network, data);
-                    if (lossFunction == CROSS_ENTROPY_LOSS){
-                        printf("EPOCH %d: loss is %f\n", epoch, crossEntropyLoss(network, getOuput(network), classes, regularizationStrength));
-                    }
-                    else{
-                        printf("EPOCH %d: loss is %f\n", epoch, meanSquaredError(network, getOuput(network), classes, regularizationStrength));
-                    }
-                }
-            }
+        // counted as a product for the error of the layer before and one for
+        // the weight gradient, the input layer having no error term
+        PROFILE_END(layer, "layerBackward", layer - 1, (layer > 1 ? 2 : 1) * connectionFlops(con, 1), 2 * connectionBytes(con, 1));
+    }
+
+    // zero out reusable matrices
+    PROFILE_BEGIN(reset);
+    if (sparseExample == NULL || network->numConnections > 1){
+        zeroMatrix(state->beforeOutputT);
+    }
+    for (i = 0; i < network->numConnections; i++){
+        // the input layer has no error term
+        if (i > 0){
+            zeroMatrix(errori[i]);
+        }
+        if (i > 0 || sparseExample == NULL){
+            zeroMatrix(state->dWi[i]);
+        }
+        zeroMatrix(state->dbi[i]);
+    }
+    zeroMatrix(errori[i]);
+    for (i = 0; i < state->numHidden; i++){
+        zeroMatrix(state->WTi[i]);
+        zeroMatrix(state->errorLastTi[i]);
+        zeroMatrix(state->fprimei[i]);
+        if (i > 0 || sparseExample == NULL){
+            zeroMatrix(state->inputTi[i]);
+        }
+    }
+    PROFILE_END(reset, "clearBackpropagation", -1, 0, 0);
+}
+
+void accumulateGradient(TrainingState* state, Matrix* example, Matrix* target){
+    backpropagate(state, example, NULL, target);
+}
+
+void accumulateGradientSparse(TrainingState* state, SparseMatrix* example, Matrix* target){
+    assert(example->rows == 1);
+    backpropagate(state, NULL, example, target);
+}
+
+// with $step = gradient * $scale + value * $regularizationStrength +
+// velocity * $momentumFactor, moves $count values by -$step, keeps $step as
+// their velocity and clears their gradient
+static void stepValues(float* values, float* gradient, float* velocity, size_t count, float scale, float regularizationStrength, float momentumFactor){
+    size_t j;
+    for (j = 0; j < count; j++){
+        float step = gradient[j] * scale;
+        step += values[j] * regularizationStrength;
+        step += velocity[j] * momentumFactor;
+        values[j] += -step;
+        velocity[j] = fabsf(step) >= FLT_MIN ? step : 0;
+        gradient[j] = 0;
+    }
+}
+
+// steps the first weights' rows touched by sparse examples, with the same
+// arithmetic applyGradient uses for every weight, and clears them; the rows
+// of a factorized connection are left for its factor step
+static void applyTouchedRows(TrainingState* state, float learningRate, float regularizationStrength, float momentumFactor, size_t normalizer){
+    Connection* connection = state->network->connections[0];
+    Matrix* weights = connection->weights;
+    size_t t;
+    for (t = 0; t < state->numTouched; t++){
+        size_t row = state->touchedRows[t];
+        if (connection->factorU == NULL){
+            size_t start = row * weights->cols;
+            stepValues(weights->data + start, state->dWi_avg[0]->data + start, state->dWi_last[0]->data + start, weights->cols, learningRate / normalizer, regularizationStrength, momentumFactor);
         }
+        state->touched[row] = 0;
+    }
+    state->numTouched = 0;
+    state->sparseStep = 0;
+}
 
-        // free batch data for next batch creation
-        for (i = 0; i < numBatches; i++){
-            free(dataBatches[i]);
-            free(classBatches[i]);
+// allocates the factor buffers of factorized connection $i, with no
+// velocity, unless they already match its factors
+static void prepareFactorBuffers(TrainingState* state, int i){
+    Connection* connection = state->network->connections[i];
+    Matrix* U = connection->factorU;
+    Matrix* V = connection->factorV;
+    if (state->dUi[i] == NULL || state->dUi[i]->rows != U->rows || state->dUi[i]->cols != U->cols || state->dVi[i]->cols != V->cols){
+        if (state->dUi[i] != NULL){
+            destroyMatrix(state->dUi[i]);
+            destroyMatrix(state->dVi[i]);
+            destroyMatrix(state->dUi_last[i]);
+            destroyMatrix(state->dVi_last[i]);
         }
-        free(dataBatches);
-        free(classBatches);
+        state->dUi[i] = createMatrixZeroes(U->rows, U->cols);
+        state->dVi[i] = createMatrixZeroes(V->rows, V->cols);
+        state->dUi_last[i] = createMatrixZeroes(U->rows, U->cols);
+        state->dVi_last[i] = createMatrixZeroes(V->rows, V->cols);
     }
+}
+
+// with G the gradient of the weights W = UV of factorized connection $i,
+// the gradients of its factors are G V^T and U^T G; both are taken before
+// either factor moves, and G is cleared
+// returns the number of values stepped
+static size_t applyFactorGradient(TrainingState* state, int i, float scale, float regularizationStrength, float momentumFactor){
+    Connection* connection = state->network->connections[i];
+    Matrix* U = connection->factorU;
+    Matrix* V = connection->factorV;
+    Matrix* G = state->dWi_avg[i];
+    prepareFactorBuffers(state, i);
+    multiplyTransposedInto(G, V, state->dUi[i]);
+    zeroMatrix(state->dVi[i]);
+    addTransposeMultiply(U, G, state->dVi[i]);
+    stepValues(U->data, state->dUi[i]->data, state->dUi_last[i]->data, U->rows * U->cols, scale, regularizationStrength, momentumFactor);
+    stepValues(V->data, state->dVi[i]->data, state->dVi_last[i]->data, V->rows * V->cols, scale, regularizationStrength, momentumFactor);
+    zeroMatrix(G);
+    return U->rows * U->cols + V->rows * V->cols;
+}
+
+// with $step = gradient * rate + weight * regularization + velocity * momentum,
+// the same arithmetic the per-matrix updates did, in one pass over the arenas
+void applyGradient(TrainingState* state, float learningRate, float regularizationStrength, float momentumFactor, size_t normalizer){
+    Network* network = state->network;
+    assert(isNetworkFlat(network));
+    PROFILE_BEGIN(apply);
+    size_t weightsOffset[network->numConnections], biasOffset[network->numConnections];
+    parameterLayout(network, weightsOffset, biasOffset);
+    float* parameters = network->parameters;
+    float* gradient = state->gradient;
+    float* velocity = state->velocity;
+    float scale = learningRate / normalizer;
+    size_t stepped = 0;
+    int i;
 
-    // free all reusable matrices
-    destroyMatrix(beforeOutputT);
+    // sparse steps update the first weights only where they have gradient
+    int sparseStep = state->sparseStep;
+    if (sparseStep){
+        applyTouchedRows(state, learningRate, regularizationStrength, momentumFactor, normalizer);
+    }
+
+    // weights are regularized, biases are not
     for (i = 0; i < network->numConnections; i++){
-        destroyMatrix(errori[i]);
-        destroyMatrix(dWi[i]);
-        destroyMatrix(dbi[i]);
+        size_t start = weightsOffset[i];
+        size_t end = i + 1 < network->numConnections ? weightsOffset[i + 1] : biasOffset[0];
+        if (network->connections[i]->factorU != NULL){
+            stepped += applyFactorGradient(state, i, scale, regularizationStrength, momentumFactor);
+        }
+        else if (i > 0 || !sparseStep){
+            stepValues(parameters + start, gradient + start, velocity + start, end - start, scale, regularizationStrength, momentumFactor);
+            stepped += end - start;
+        }
+    }
+    size_t biases = network->numParameters - biasOffset[0];
+    stepValues(parameters + biasOffset[0], gradient + biasOffset[0], velocity + biasOffset[0], biases, scale, 0, momentumFactor);
+    stepped += biases;
+    for (i = 0; i < network->numConnections; i++){
+        refreshConnection(network->connections[i]);
     }
-    destroyMatrix(errori[i]);
+    PROFILE_END(apply, "applyGradient", -1, 6.0 * stepped, 24.0 * stepped);
+}
 
+// a state restored from a checkpoint but not trained still owes the fold
+void destroyTrainingState(TrainingState* state){
+    Network* network = state->network;
+    int i;
+    if (state->refold){
+        foldNormalization(network);
+    }
+    destroyMatrix(state->beforeOutputT);
     for (i = 0; i < network->numConnections; i++){
-        destroyMatrix(dWi_avg[i]);
-        destroyMatrix(dbi_avg[i]);
-        destroyMatrix(dWi_last[i]);
-        destroyMatrix(dbi_last[i]);
-        destroyMatrix(regi[i]);
+        destroyMatrix(state->errori[i]);
+        destroyMatrix(state->dWi[i]);
+        destroyMatrix(state->dbi[i]);
+        free(state->dWi_avg[i]);
+        free(state->dbi_avg[i]);
+        free(state->dWi_last[i]);
+        free(state->dbi_last[i]);
+        if (state->dUi[i] != NULL){
+            destroyMatrix(state->dUi[i]);
+            destroyMatrix(state->dVi[i]);
+            destroyMatrix(state->dUi_last[i]);
+            destroyMatrix(state->dVi_last[i]);
+        }
+    }
+    destroyMatrix(state->errori[i]);
+    for (i = 0; i < state->numHidden; i++){
+        destroyMatrix(state->WTi[i]);
+        destroyMatrix(state->errorLastTi[i]);
+        destroyMatrix(state->fprimei[i]);
+        destroyMatrix(state->inputTi[i]);
+    }
+    free(state->errori);
+    free(state->dWi);
+    free(state->dbi);
+    free(state->WTi);
+    free(state->errorLastTi);
+    free(state->fprimei);
+    free(state->inputTi);
+    free(state->dWi_avg);
+    free(state->dbi_avg);
+    free(state->dWi_last);
+    free(state->dbi_last);
+    free(state->dUi);
+    free(state->dVi);
+    free(state->dUi_last);
+    free(state->dVi_last);
+    free(state->gradientBlock);
+    free(state->velocityBlock);
+    free(state->order);
+    free(state->touched);
+    free(state->touchedRows);
+    free(state);
+}
+
+// trains on either dense $data or $sparseData
+static void trainRows(TrainingState* state, DataSet* data, SparseMatrix* sparseData, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose){
+    Network* network = state->network;
+    size_t numRows = classes->rows;
+    assert(network->layers[0]->size == (data != NULL ? data->cols : sparseData->cols));
+    assert((data != NULL ? data->rows : sparseData->rows) == numRows);
+    assert(network->layers[network->numLayers - 1]->size == classes->cols);
+    assert(batchSize >= 1 && batchSize <= numRows);
+    assert(maxIters >= 1);
+
+    size_t i;
+    if (state->order == NULL){
+        state->numRows = numRows;
+        state->order = (size_t*)malloc(sizeof(size_t) * numRows);
+        for (i = 0; i < numRows; i++){
+            state->order[i] = i;
+        }
     }
+    assert(state->numRows == numRows);
 
-    if (numHidden > 0){
-        for (i = 0; i < numHidden; i++){
-            destroyMatrix(WTi[i]);
-            destroyMatrix(errorLastTi[i]);
-            destroyMatrix(fprimei[i]);
-            destroyMatrix(inputTi[i]);
+    // dense examples are standardized as they are copied into the network,
+    // so the stats come out of the weights while training; sparse ones are
+    // not, so they train the folded weights
+    if (data != NULL && network->normalizationFolded){
+        unfoldNormalization(network);
+        state->refold = 1;
+    }
+    else if (data == NULL && state->refold){
+        foldNormalization(network);
+        state->refold = 0;
+    }
+
+    size_t numBatches = (numRows / batchSize) + (numRows % batchSize != 0 ? 1 : 0);
+    Matrix* example = createMatrix(1, network->layers[0]->size, NULL);
+    Matrix* target = createMatrix(1, classes->cols, NULL);
+    while (state->epoch <= maxIters){
+        // shuffle the visiting order at the start of every pass
+        if (state->batch == 0 && shuffle != 0){
+            PROFILE_BEGIN(shuffle);
+            for (i = 0; i + 1 < numRows; i++){
+                size_t j = i + randomBelow(&state->random, numRows - i);
+                size_t tmp = state->order[j];
+                state->order[j] = state->order[i];
+                state->order[i] = tmp;
+            }
+            PROFILE_END(shuffle, "shuffle", -1, 0, 16.0 * numRows);
+        }
+
+        // train on the current batch
+        PROFILE_BEGIN(batch);
+        size_t first = state->batch * batchSize;
+        size_t last = MIN(first + batchSize, numRows);
+        if (data != NULL && state->batchGradient != NULL){
+            state->batchGradient(state, data, classes, state->order + first, last - first, state->batchContext);
+            first = last;
+        }
+        for (i = first; i < last; i++){
+            state->lastExample = i + 1 == last;
+            target->data = classes->data[state->order[i]];
+            if (data != NULL){
+                example->data = data->data[state->order[i]];
+                accumulateGradient(state, example, target);
+            }
+            else{
+                SparseMatrix row = sparseRows(sparseData, state->order[i], 1);
+                accumulateGradientSparse(state, &row, target);
+            }
+        }
+        state->lastExample = 0;
+        PROFILE_END(batch, "trainBatch", -1, 0, 0);
+        if (state->gradientWait != NULL){
+            PROFILE_BEGIN(wait);
+            int dropped = state->gradientWait(state, state->gradientContext);
+            PROFILE_END(wait, "gradientWait", -1, 0, 0);
+            if (dropped){
+                memset(state->gradient, 0, sizeof(float) * network->numParameters);
+                break;
+            }
+        }
+
+        // calculate learning rate for this epoch
+        int epoch = state->epoch;
+        float currentLearningRate = searchTime == 0 ? learningRate : learningRate / (1 + (epoch / searchTime));
+        applyGradient(state, currentLearningRate, regularizationStrength, momentumFactor, state->normalizer != 0 ? state->normalizer : numRows);
+        state->batch = (state->batch + 1) % numBatches;
+        state->epoch++;
+
+        // if verbose is set, print loss every 100 epochs
+        if (verbose != 0){
+            if (epoch % 100 == 0 || epoch == 1){
+                PROFILE_BEGIN(evaluate);
+                EvaluationDefaults defaults = currentEvaluationDefaults();
+                Evaluation evaluation = data != NULL ? evaluateNetwork(network, data, classes, defaults.chunkRows, defaults.numThreads) : evaluateNetworkSparse(network, sparseData, classes, defaults.chunkRows, defaults.numThreads);
+                float regularization = regularizationStrength * .5 * evaluation.l2;
+                if (state->lossFunction == CROSS_ENTROPY_LOSS){
+                    printf("EPOCH %d: loss is %f\n", epoch, evaluation.crossEntropy / evaluation.rows + regularization);
+                }
+                else{
+                    printf("EPOCH %d: loss is %f\n", epoch, .5 * evaluation.squaredError / evaluation.rows + regularization);
+                }
+                PROFILE_END(evaluate, "reportLoss", -1, 0, 0);
+            }
+        }
+
+        if (state->stepCallback != NULL){
+            state->stepCallback(state, state->stepContext);
         }
-        free(WTi);
-        free(errorLastTi);
-        free(fprimei);
-        free(inputTi);
     }
+    free(example);
+    free(target);
+    if (state->refold){
+        foldNormalization(network);
+        state->refold = 0;
+    }
+}
+
+void trainGradientDescent(TrainingState* state, DataSet* data, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose){
+    trainRows(state, data, NULL, classes, batchSize, learningRate, searchTime, regularizationStrength, momentumFactor, maxIters, shuffle, verbose);
+}
+
+void trainGradientDescentSparse(TrainingState* state, SparseMatrix* data, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose){
+    trainRows(state, NULL, data, classes, batchSize, learningRate, searchTime, regularizationStrength, momentumFactor, maxIters, shuffle, verbose);
+}
+
+void batchGradientDescent(Network* network, DataSet* data, DataSet* classes, LOSS_FUNCTION lossFunction, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle,  int verbose){
+    TrainingState* state = createTrainingState(network, lossFunction);
+    trainGradientDescent(state, data, classes, batchSize, learningRate, searchTime, regularizationStrength, momentumFactor, maxIters, shuffle, verbose);
+    destroyTrainingState(state);
+}
+
+void batchGradientDescentSparse(Network* network, SparseMatrix* data, DataSet* classes, LOSS_FUNCTION lossFunction, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose){
+    TrainingState* state = createTrainingState(network, lossFunction);
+    trainGradientDescentSparse(state, data, classes, batchSize, learningRate, searchTime, regularizationStrength, momentumFactor, maxIters, shuffle, verbose);
+    destroyTrainingState(state);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,497 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+#include "optimizer.h"
+#include "placement.h"
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// order in which a stage runs the micro-batches of a step
+typedef enum PIPELINE_SCHEDULE_ {
+    PIPELINE_GPIPE, // every forward pass, then every backward pass
+    PIPELINE_1F1B // alternates forward and backward once the pipeline is full
+} PIPELINE_SCHEDULE;
+
+// trains a network with consecutive runs of its connections on different
+// threads; each step's batch is cut into micro-batches that flow forward
+// through the stages and back, and every stage adds its connections'
+// gradient into the training state before the step is applied
+// stages run on threads with CRANIUM_USE_POSIX, and one after another otherwise
+typedef struct Pipeline_ {
+    TrainingState* state;
+    int numStages;
+    int* firstConnection; // stage s owns [firstConnection[s], firstConnection[s + 1])
+    size_t numMicroBatches;
+    size_t microBatchRows; // most rows a micro-batch can hold
+    PIPELINE_SCHEDULE schedule;
+    CpuTopology* topology; // stage threads are pinned as its workers, if not NULL
+
+    Matrix*** activations; // [layer][micro-batch], layer 0 being the input
+    Matrix*** errors; // [layer][micro-batch], for layers after the input
+    Matrix** targets; // [micro-batch]
+    unsigned char* forwardDone; // [stage * numMicroBatches + micro-batch]
+    unsigned char* backwardDone;
+
+    // time each stage spent computing, and the time steps took, since the
+    // last reset
+    double* busySeconds;
+    double wallSeconds;
+    size_t steps;
+
+#ifdef CRANIUM_USE_POSIX
+    pthread_t* threads; // stages from firstThread on; the caller runs the rest
+    int firstThread; // 0 when pinned, so the caller's affinity is left alone
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint64_t generation; // steps released to the stages
+    int finished; // stages done with the current step
+    int stop;
+#endif
+} Pipeline;
+
+// splits the connections of the network of $state into $numStages stages of
+// about equal weight count and allocates buffers for $numMicroBatches
+// micro-batches of a batch of up to $maxBatchSize rows
+// with a $topology, stage s runs on a thread pinned as worker s of
+// $numStages, so neighbouring stages share a node; either way each stage
+// thread allocates the activations it produces, placing them in its memory
+static Pipeline* createPipeline(TrainingState* state, int numStages, size_t numMicroBatches, size_t maxBatchSize, PIPELINE_SCHEDULE schedule, CpuTopology* topology);
+
+// same as trainGradientDescent on dense data, with each batch run through
+// $pipeline; gives the same steps up to the order gradients are summed in
+static void pipelineGradientDescent(Pipeline* pipeline, DataSet* data, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose);
+
+// fraction of the step time $stage spent computing
+static float stageUtilization(Pipeline* pipeline, int stage);
+
+// fraction of all stages' step time spent waiting, ideally
+// (stages - 1) / (micro-batches + stages - 1)
+static float bubbleFraction(Pipeline* pipeline);
+
+// clears the time measurements
+static void resetPipelineStats(Pipeline* pipeline);
+
+// stops the stage threads and frees a pipeline, but not its training state
+static void destroyPipeline(Pipeline* pipeline);
+
+
+/*
+    Begin functions.
+*/
+
+// passes micro-batch $m through the connections of $stage
+static void stageForward(Pipeline* pipeline, int stage, size_t m){
+    Network* network = pipeline->state->network;
+    int c;
+    if (pipeline->activations[0][m]->rows == 0){
+        return;
+    }
+    for (c = pipeline->firstConnection[stage]; c < pipeline->firstConnection[stage + 1]; c++){
+        PROFILE_BEGIN(layer);
+        Matrix* output = pipeline->activations[c + 1][m];
+        connectionForwardInto(network->connections[c], pipeline->activations[c][m], output, NULL);
+        if (network->layers[c + 1]->activation != NULL){
+            network->layers[c + 1]->activation(output);
+        }
+        PROFILE_END(layer, "layerForward", c, connectionFlops(network->connections[c], output->rows), connectionBytes(network->connections[c], output->rows));
+    }
+}
+
+// backpropagates micro-batch $m through the connections of $stage, adding
+// their gradient to the running total and leaving the error term of the
+// stage's input layer for the stage before
+static void stageBackward(Pipeline* pipeline, int stage, size_t m){
+    TrainingState* state = pipeline->state;
+    Network* network = state->network;
+    size_t r, j;
+    int c;
+    if (pipeline->activations[0][m]->rows == 0){
+        return;
+    }
+    for (c = pipeline->firstConnection[stage + 1] - 1; c >= pipeline->firstConnection[stage]; c--){
+        PROFILE_BEGIN(layer);
+        Matrix* error = pipeline->errors[c + 1][m];
+        if (c == network->numConnections - 1){
+            // output error is the same for both losses
+            Matrix* output = pipeline->activations[c + 1][m];
+            Matrix* target = pipeline->targets[m];
+            for (j = 0; j < output->rows * output->cols; j++){
+                error->data[j] = output->data[j] - target->data[j];
+            }
+        }
+        addTransposeMultiply(pipeline->activations[c][m], error, state->dWi_avg[c]);
+        float* bias = state->dbi_avg[c]->data;
+        for (r = 0; r < error->rows; r++){
+            for (j = 0; j < error->cols; j++){
+                bias[j] += error->data[r * error->cols + j];
+            }
+        }
+
+        // the input layer has no error term
+        if (c > 0){
+            Matrix* previous = pipeline->errors[c][m];
+            Matrix* input = pipeline->activations[c][m];
+            multiplyTransposedInto(error, network->connections[c]->weights, previous);
+            float (*derivative)(float) = activationDerivative(network->layers[c]->activation);
+            for (j = 0; j < previous->rows * previous->cols; j++){
+                previous->data[j] *= derivative(input->data[j]);
+            }
+        }
+        PROFILE_END(layer, "layerBackward", c, (c > 0 ? 2 : 1) * connectionFlops(network->connections[c], error->rows), 2 * connectionBytes(network->connections[c], error->rows));
+    }
+}
+
+// the $k-th operation of $stage in a step: a forward pass if $forward is set
+// and a backward pass otherwise, of micro-batch $m
+static void scheduledOperation(Pipeline* pipeline, int stage, size_t k, int* forward, size_t* m){
+    size_t numMicroBatches = pipeline->numMicroBatches;
+    if (pipeline->schedule == PIPELINE_GPIPE){
+        *forward = k < numMicroBatches;
+        *m = k % numMicroBatches;
+        return;
+    }
+
+    // later stages need fewer passes in flight before their first backward
+    size_t warmup = MIN((size_t)(pipeline->numStages - 1 - stage), numMicroBatches);
+    size_t steady = 2 * (numMicroBatches - warmup);
+    if (k < warmup){
+        *forward = 1;
+        *m = k;
+    }
+    else if (k - warmup < steady){
+        *forward = (k - warmup) % 2 == 0;
+        *m = *forward ? warmup + (k - warmup) / 2 : (k - warmup) / 2;
+    }
+    else{
+        *forward = 0;
+        *m = numMicroBatches - warmup + (k - warmup - steady);
+    }
+}
+
+// allocates the micro-batch buffers of the layers $stage writes: the
+// outputs of its connections, with their error terms, plus the input for
+// the first stage and the targets for the last
+static void allocateStageBuffers(Pipeline* pipeline, int stage){
+    Network* network = pipeline->state->network;
+    size_t m, rows = pipeline->microBatchRows;
+    int l;
+    for (m = 0; m < pipeline->numMicroBatches; m++){
+        if (stage == 0){
+            pipeline->activations[0][m] = createMatrixZeroes(rows, network->layers[0]->size);
+            pipeline->errors[0][m] = NULL;
+        }
+        for (l = pipeline->firstConnection[stage] + 1; l <= pipeline->firstConnection[stage + 1]; l++){
+            pipeline->activations[l][m] = createMatrixZeroes(rows, network->layers[l]->size);
+            pipeline->errors[l][m] = createMatrixZeroes(rows, network->layers[l]->size);
+        }
+        if (stage == pipeline->numStages - 1){
+            pipeline->targets[m] = createMatrixZeroes(rows, network->layers[network->numLayers - 1]->size);
+        }
+    }
+}
+
+#ifdef CRANIUM_USE_POSIX
+// waits until $flag is set by another stage
+static void awaitFlag(Pipeline* pipeline, unsigned char* flag){
+    pthread_mutex_lock(&pipeline->lock);
+    while (!*flag){
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+static void raiseFlag(Pipeline* pipeline, unsigned char* flag){
+    pthread_mutex_lock(&pipeline->lock);
+    *flag = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// runs the operations of $stage for one step, each once its input is ready
+static void runStage(Pipeline* pipeline, int stage){
+    size_t numMicroBatches = pipeline->numMicroBatches, k, m;
+    int forward;
+    for (k = 0; k < 2 * numMicroBatches; k++){
+        scheduledOperation(pipeline, stage, k, &forward, &m);
+        if (forward && stage > 0){
+            awaitFlag(pipeline, &pipeline->forwardDone[(stage - 1) * numMicroBatches + m]);
+        }
+        if (!forward && stage < pipeline->numStages - 1){
+            awaitFlag(pipeline, &pipeline->backwardDone[(stage + 1) * numMicroBatches + m]);
+        }
+        double start = monotonicSeconds();
+        if (forward){
+            stageForward(pipeline, stage, m);
+        }
+        else{
+            stageBackward(pipeline, stage, m);
+        }
+        pipeline->busySeconds[stage] += monotonicSeconds() - start;
+        raiseFlag(pipeline, forward ? &pipeline->forwardDone[stage * numMicroBatches + m] : &pipeline->backwardDone[stage * numMicroBatches + m]);
+    }
+}
+
+typedef struct StageThread_ {
+    Pipeline* pipeline;
+    int stage;
+} StageThread;
+
+static void* stageLoop(void* argument){
+    StageThread* thread = (StageThread*)argument;
+    Pipeline* pipeline = thread->pipeline;
+    int stage = thread->stage;
+    free(thread);
+    if (pipeline->topology != NULL){
+        pinThread(pipeline->topology, stage, pipeline->numStages);
+    }
+    allocateStageBuffers(pipeline, stage);
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->finished++;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    uint64_t seen = 0;
+    while (1){
+        pthread_mutex_lock(&pipeline->lock);
+        while (pipeline->generation == seen && !pipeline->stop){
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        if (pipeline->stop){
+            pthread_mutex_unlock(&pipeline->lock);
+            return NULL;
+        }
+        seen = pipeline->generation;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        runStage(pipeline, stage);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->finished++;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+}
+#endif
+
+// runs every stage over the micro-batches already in place
+static void runPipelineStep(Pipeline* pipeline){
+    size_t numMicroBatches = pipeline->numMicroBatches;
+    int numStages = pipeline->numStages;
+    memset(pipeline->forwardDone, 0, numStages * numMicroBatches);
+    memset(pipeline->backwardDone, 0, numStages * numMicroBatches);
+    double start = monotonicSeconds();
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->generation++;
+    pipeline->finished = 0;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    if (pipeline->firstThread > 0){
+        runStage(pipeline, 0);
+    }
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->finished += pipeline->firstThread;
+    while (pipeline->finished < numStages){
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+#else
+    size_t m;
+    int stage;
+    for (m = 0; m < numMicroBatches; m++){
+        for (stage = 0; stage < numStages; stage++){
+            double opStart = monotonicSeconds();
+            stageForward(pipeline, stage, m);
+            pipeline->busySeconds[stage] += monotonicSeconds() - opStart;
+        }
+    }
+    for (m = 0; m < numMicroBatches; m++){
+        for (stage = numStages - 1; stage >= 0; stage--){
+            double opStart = monotonicSeconds();
+            stageBackward(pipeline, stage, m);
+            pipeline->busySeconds[stage] += monotonicSeconds() - opStart;
+        }
+    }
+#endif
+    pipeline->wallSeconds += monotonicSeconds() - start;
+    pipeline->steps++;
+}
+
+Pipeline* createPipeline(TrainingState* state, int numStages, size_t numMicroBatches, size_t maxBatchSize, PIPELINE_SCHEDULE schedule, CpuTopology* topology){
+    Network* network = state->network;
+    assert(numStages >= 1 && numStages <= network->numConnections);
+    assert(numMicroBatches >= 1 && maxBatchSize >= 1);
+    Pipeline* pipeline = (Pipeline*)malloc(sizeof(Pipeline));
+    pipeline->state = state;
+    pipeline->numStages = numStages;
+    pipeline->numMicroBatches = numMicroBatches;
+    pipeline->microBatchRows = (maxBatchSize + numMicroBatches - 1) / numMicroBatches;
+    pipeline->schedule = schedule;
+    pipeline->topology = topology;
+    int c, l, s;
+
+    // cut where the running weight count passes each stage's share, keeping
+    // at least one connection per stage
+    pipeline->firstConnection = (int*)malloc(sizeof(int) * (numStages + 1));
+    double total = 0, running = 0;
+    for (c = 0; c < network->numConnections; c++){
+        total += (double)network->connections[c]->weights->rows * network->connections[c]->weights->cols;
+    }
+    pipeline->firstConnection[0] = 0;
+    s = 1;
+    for (c = 0; c < network->numConnections && s < numStages; c++){
+        running += (double)network->connections[c]->weights->rows * network->connections[c]->weights->cols;
+        int remaining = network->numConnections - (c + 1);
+        if (running >= total * s / numStages || remaining == numStages - s){
+            pipeline->firstConnection[s++] = c + 1;
+        }
+    }
+    pipeline->firstConnection[numStages] = network->numConnections;
+
+    pipeline->activations = (Matrix***)malloc(sizeof(Matrix**) * network->numLayers);
+    pipeline->errors = (Matrix***)malloc(sizeof(Matrix**) * network->numLayers);
+    for (l = 0; l < network->numLayers; l++){
+        pipeline->activations[l] = (Matrix**)malloc(sizeof(Matrix*) * numMicroBatches);
+        pipeline->errors[l] = (Matrix**)malloc(sizeof(Matrix*) * numMicroBatches);
+    }
+    pipeline->targets = (Matrix**)malloc(sizeof(Matrix*) * numMicroBatches);
+    pipeline->forwardDone = (unsigned char*)calloc(numStages * numMicroBatches, sizeof(unsigned char));
+    pipeline->backwardDone = (unsigned char*)calloc(numStages * numMicroBatches, sizeof(unsigned char));
+    pipeline->busySeconds = (double*)calloc(numStages, sizeof(double));
+    pipeline->wallSeconds = 0;
+    pipeline->steps = 0;
+
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->changed, NULL);
+    pipeline->generation = 0;
+    pipeline->finished = 0;
+    pipeline->stop = 0;
+    pipeline->firstThread = topology != NULL ? 0 : 1;
+    pipeline->threads = (pthread_t*)malloc(sizeof(pthread_t) * numStages);
+    for (s = 0; s < pipeline->firstThread; s++){
+        allocateStageBuffers(pipeline, s);
+    }
+    for (s = pipeline->firstThread; s < numStages; s++){
+        StageThread* thread = (StageThread*)malloc(sizeof(StageThread));
+        thread->pipeline = pipeline;
+        thread->stage = s;
+        pthread_create(&pipeline->threads[s], NULL, stageLoop, thread);
+    }
+
+    // the buffers are in place once every thread has checked in
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->finished < numStages - pipeline->firstThread){
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+#else
+    for (s = 0; s < numStages; s++){
+        allocateStageBuffers(pipeline, s);
+    }
+#endif
+    return pipeline;
+}
+
+// gathers $numRows rows of a batch into the micro-batches, split as evenly
+// as possible, and runs them through the stages
+static void pipelineBatch(TrainingState* state, DataSet* data, DataSet* classes, size_t* rows, size_t numRows, void* context){
+    Pipeline* pipeline = (Pipeline*)context;
+    Network* network = state->network;
+    size_t numMicroBatches = pipeline->numMicroBatches, m, i;
+    int l;
+    assert(numRows <= numMicroBatches * pipeline->microBatchRows);
+    for (m = 0; m < numMicroBatches; m++){
+        size_t first = numRows * m / numMicroBatches;
+        size_t count = numRows * (m + 1) / numMicroBatches - first;
+        for (l = 0; l < network->numLayers; l++){
+            pipeline->activations[l][m]->rows = count;
+            if (l > 0){
+                pipeline->errors[l][m]->rows = count;
+            }
+        }
+        pipeline->targets[m]->rows = count;
+        Matrix* input = pipeline->activations[0][m];
+        for (i = 0; i < count; i++){
+            memcpy(input->data + i * input->cols, data->data[rows[first + i]], sizeof(float) * input->cols);
+            memcpy(pipeline->targets[m]->data + i * classes->cols, classes->data[rows[first + i]], sizeof(float) * classes->cols);
+        }
+        if (network->featureMean != NULL && !network->normalizationFolded){
+            normalizeInput(network, input);
+        }
+    }
+    runPipelineStep(pipeline);
+}
+
+void pipelineGradientDescent(Pipeline* pipeline, DataSet* data, DataSet* classes, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int maxIters, int shuffle, int verbose){
+    TrainingState* state = pipeline->state;
+    assert(batchSize <= pipeline->numMicroBatches * pipeline->microBatchRows);
+    state->batchGradient = pipelineBatch;
+    state->batchContext = pipeline;
+    trainGradientDescent(state, data, classes, batchSize, learningRate, searchTime, regularizationStrength, momentumFactor, maxIters, shuffle, verbose);
+    state->batchGradient = NULL;
+    state->batchContext = NULL;
+}
+
+float stageUtilization(Pipeline* pipeline, int stage){
+    return pipeline->wallSeconds > 0 ? pipeline->busySeconds[stage] / pipeline->wallSeconds : 0;
+}
+
+float bubbleFraction(Pipeline* pipeline){
+    double busy = 0;
+    int s;
+    for (s = 0; s < pipeline->numStages; s++){
+        busy += pipeline->busySeconds[s];
+    }
+    return pipeline->wallSeconds > 0 ? 1 - busy / (pipeline->numStages * pipeline->wallSeconds) : 0;
+}
+
+void resetPipelineStats(Pipeline* pipeline){
+    memset(pipeline->busySeconds, 0, sizeof(double) * pipeline->numStages);
+    pipeline->wallSeconds = 0;
+    pipeline->steps = 0;
+}
+
+void destroyPipeline(Pipeline* pipeline){
+    Network* network = pipeline->state->network;
+    int l;
+    size_t m;
+#ifdef CRANIUM_USE_POSIX
+    int s;
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->stop = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    for (s = pipeline->firstThread; s < pipeline->numStages; s++){
+        pthread_join(pipeline->threads[s], NULL);
+    }
+    free(pipeline->threads);
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->changed);
+#endif
+    for (l = 0; l < network->numLayers; l++){
+        for (m = 0; m < pipeline->numMicroBatches; m++){
+            destroyMatrix(pipeline->activations[l][m]);
+            if (l > 0){
+                destroyMatrix(pipeline->errors[l][m]);
+            }
+        }
+        free(pipeline->activations[l]);
+        free(pipeline->errors[l]);
+    }
+    for (m = 0; m < pipeline->numMicroBatches; m++){
+        destroyMatrix(pipeline->targets[m]);
+    }
+    free(pipeline->activations);
+    free(pipeline->errors);
+    free(pipeline->targets);
+    free(pipeline->forwardDone);
+    free(pipeline->backwardDone);
+    free(pipeline->busySeconds);
+    free(pipeline->firstConnection);
+    free(pipeline);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,434 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// the CPUs this process may run on, grouped by the NUMA node whose memory
+// is closest to them
+typedef struct CpuTopology_ {
+    int numNodes;
+    int numCpus;
+    int* cpus; // CPU ids, node after node
+    int* firstCpu; // node n holds cpus[firstCpu[n]] up to cpus[firstCpu[n + 1]]
+} CpuTopology;
+
+// a copy of a network per node, each allocated and first written by a
+// thread running on that node, so that its pages are in that node's memory
+typedef struct NodeReplicas_ {
+    CpuTopology* topology;
+    Network** networks; // [node]
+} NodeReplicas;
+
+// reads the nodes and their CPUs from /sys on Linux, keeping the CPUs this
+// process is allowed to run on; without NUMA information, or elsewhere,
+// every CPU is put in one node
+static CpuTopology* detectTopology();
+
+// builds a topology from $numCpus CPU ids and the node, counting from 0,
+// of each; CPUs may be listed under several nodes, for instance to try
+// node groups on a machine with a single node
+static CpuTopology* createTopology(int numCpus, int* cpus, int* nodes);
+
+// frees a topology
+static void destroyTopology(CpuTopology* topology);
+
+// returns the CPU worker $worker of $numWorkers runs on; workers are spread
+// evenly over the CPUs in node order, so consecutive workers form one group
+// per node, sized by the node's share of the CPUs
+static int workerCpu(CpuTopology* topology, int worker, int numWorkers);
+
+// returns the node worker $worker of $numWorkers runs on
+static int workerNode(CpuTopology* topology, int worker, int numWorkers);
+
+// pins the calling thread to the CPU of worker $worker of $numWorkers
+// returns 0 on success, and -1 if pinning is refused or unsupported (it
+// needs CRANIUM_USE_POSIX on Linux), leaving the thread where it was
+static int pinThread(CpuTopology* topology, int worker, int numWorkers);
+
+// pins the calling thread to every CPU of $node, returning as pinThread
+static int pinThreadToNode(CpuTopology* topology, int node);
+
+// copies $network, with its input standardization, once per node of
+// $topology, which must outlive the replicas
+static NodeReplicas* createNodeReplicas(Network* network, CpuTopology* topology);
+
+// copies the parameters of $network into every replica, which stay where
+// they were placed
+static void updateNodeReplicas(NodeReplicas* replicas, Network* network);
+
+// frees the replicas, but not their topology
+static void destroyNodeReplicas(NodeReplicas* replicas);
+
+// same as evaluateNetwork, on $numThreads threads pinned as workers of
+// $topology, each allocating its own workspace; threads read the replica of
+// their node if $replicas is not NULL, and $network otherwise
+static Evaluation evaluateNetworkPinned(Network* network, NodeReplicas* replicas, CpuTopology* topology, DataSet* data, DataSet* classes, size_t chunkRows, int numThreads);
+
+
+/*
+    Begin functions.
+*/
+
+#if defined(CRANIUM_USE_POSIX) && defined(__linux__)
+// marks the CPUs or nodes of a list such as "0-3,8-11" in the file at $path
+static int readCpuList(const char* path, unsigned char* flags){
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL){
+        return -1;
+    }
+    char buf[4096];
+    char* text = fgets(buf, sizeof(buf), fp);
+    fclose(fp);
+    if (text == NULL){
+        return -1;
+    }
+    while (1){
+        char* end;
+        long first = strtol(text, &end, 10), last = first;
+        if (end == text){
+            break;
+        }
+        text = end;
+        if (*text == '-'){
+            last = strtol(text + 1, &end, 10);
+            text = end;
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++){
+            if (first >= 0){
+                flags[first] = 1;
+            }
+        }
+        if (*text != ','){
+            break;
+        }
+        text++;
+    }
+    return 0;
+}
+#endif
+
+CpuTopology* detectTopology(){
+    int numCpus = 0;
+#if defined(CRANIUM_USE_POSIX) && defined(__linux__)
+    int cpus[CPU_SETSIZE], nodes[CPU_SETSIZE], nodeOf[CPU_SETSIZE];
+    unsigned char onlineNodes[CPU_SETSIZE], nodeCpus[CPU_SETSIZE];
+    int cpu, node, numNodes = 0, unplaced = 0;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+        CPU_ZERO(&allowed);
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (cpu = 0; cpu < online && cpu < CPU_SETSIZE; cpu++){
+            CPU_SET(cpu, &allowed);
+        }
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++){
+        nodeOf[cpu] = -1;
+    }
+
+    // nodes without allowed CPUs are left out, and the rest renumbered
+    memset(onlineNodes, 0, sizeof(onlineNodes));
+    if (readCpuList("/sys/devices/system/node/online", onlineNodes) == 0){
+        for (node = 0; node < CPU_SETSIZE; node++){
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            memset(nodeCpus, 0, sizeof(nodeCpus));
+            if (!onlineNodes[node] || readCpuList(path, nodeCpus) != 0){
+                continue;
+            }
+            int found = 0;
+            for (cpu = 0; cpu < CPU_SETSIZE; cpu++){
+                if (nodeCpus[cpu] && CPU_ISSET(cpu, &allowed) && nodeOf[cpu] < 0){
+                    nodeOf[cpu] = numNodes;
+                    found = 1;
+                }
+            }
+            numNodes += found;
+        }
+    }
+
+    // CPUs no node claims get a node of their own
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++){
+        if (CPU_ISSET(cpu, &allowed) && nodeOf[cpu] < 0){
+            nodeOf[cpu] = numNodes;
+            unplaced = 1;
+        }
+    }
+    numNodes += unplaced;
+    for (node = 0; node < numNodes; node++){
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++){
+            if (nodeOf[cpu] == node){
+                cpus[numCpus] = cpu;
+                nodes[numCpus++] = node;
+            }
+        }
+    }
+#else
+#ifdef CRANIUM_USE_POSIX
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    numCpus = (int)MAX(1, MIN(online, 1024));
+#else
+    numCpus = 1;
+#endif
+    int cpus[numCpus], nodes[numCpus];
+    int cpu;
+    for (cpu = 0; cpu < numCpus; cpu++){
+        cpus[cpu] = cpu;
+        nodes[cpu] = 0;
+    }
+#endif
+    if (numCpus == 0){
+        cpus[0] = 0;
+        nodes[0] = 0;
+        numCpus = 1;
+    }
+    return createTopology(numCpus, cpus, nodes);
+}
+
+CpuTopology* createTopology(int numCpus, int* cpus, int* nodes){
+    assert(numCpus >= 1);
+    CpuTopology* topology = (CpuTopology*)malloc(sizeof(CpuTopology));
+    int i, n, numNodes = 0;
+    for (i = 0; i < numCpus; i++){
+        assert(nodes[i] >= 0 && cpus[i] >= 0);
+        numNodes = MAX(numNodes, nodes[i] + 1);
+    }
+    topology->numNodes = numNodes;
+    topology->numCpus = numCpus;
+    topology->cpus = (int*)malloc(sizeof(int) * numCpus);
+    topology->firstCpu = (int*)calloc(numNodes + 1, sizeof(int));
+
+    // counting sort by node, keeping the given order within a node
+    for (i = 0; i < numCpus; i++){
+        topology->firstCpu[nodes[i] + 1]++;
+    }
+    for (n = 0; n < numNodes; n++){
+        assert(topology->firstCpu[n + 1] > 0);
+        topology->firstCpu[n + 1] += topology->firstCpu[n];
+    }
+    int filled[numNodes];
+    memset(filled, 0, sizeof(filled));
+    for (i = 0; i < numCpus; i++){
+        topology->cpus[topology->firstCpu[nodes[i]] + filled[nodes[i]]++] = cpus[i];
+    }
+    return topology;
+}
+
+void destroyTopology(CpuTopology* topology){
+    free(topology->cpus);
+    free(topology->firstCpu);
+    free(topology);
+}
+
+// index into the topology's CPUs of worker $worker
+static int workerSlot(CpuTopology* topology, int worker, int numWorkers){
+    assert(worker >= 0 && worker < numWorkers);
+    return (int)((long long)worker * topology->numCpus / numWorkers);
+}
+
+int workerCpu(CpuTopology* topology, int worker, int numWorkers){
+    return topology->cpus[workerSlot(topology, worker, numWorkers)];
+}
+
+int workerNode(CpuTopology* topology, int worker, int numWorkers){
+    int slot = workerSlot(topology, worker, numWorkers), node = 0;
+    while (topology->firstCpu[node + 1] <= slot){
+        node++;
+    }
+    return node;
+}
+
+int pinThread(CpuTopology* topology, int worker, int numWorkers){
+#if defined(CRANIUM_USE_POSIX) && defined(__linux__)
+    int cpu = workerCpu(topology, worker, numWorkers);
+    if (cpu >= CPU_SETSIZE){
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    workerSlot(topology, worker, numWorkers);
+    return -1;
+#endif
+}
+
+int pinThreadToNode(CpuTopology* topology, int node){
+    assert(node >= 0 && node < topology->numNodes);
+#if defined(CRANIUM_USE_POSIX) && defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    int i;
+    for (i = topology->firstCpu[node]; i < topology->firstCpu[node + 1]; i++){
+        if (topology->cpus[i] < CPU_SETSIZE){
+            CPU_SET(topology->cpus[i], &set);
+        }
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+typedef struct ReplicaJob_ {
+    Network* network;
+    CpuTopology* topology;
+    int node;
+    Network* replica;
+} ReplicaJob;
+
+// allocates and fills one replica from a thread on its node
+static void* buildReplica(void* argument){
+    ReplicaJob* job = (ReplicaJob*)argument;
+    Network* network = job->network;
+    pinThreadToNode(job->topology, job->node);
+    size_t sizes[network->numLayers];
+    Activation activations[network->numLayers];
+    int i;
+    for (i = 0; i < network->numLayers; i++){
+        sizes[i] = network->layers[i]->size;
+        activations[i] = i + 1 < network->numLayers ? network->layers[i + 1]->activation : NULL;
+    }
+    Network* replica = allocateNetwork(network->numLayers, sizes, activations);
+    copyNetworkParameters(network, replica);
+    if (network->featureMean != NULL){
+        size_t inputs = network->layers[0]->size;
+        replica->featureMean = (float*)malloc(sizeof(float) * inputs);
+        replica->featureScale = (float*)malloc(sizeof(float) * inputs);
+        memcpy(replica->featureMean, network->featureMean, sizeof(float) * inputs);
+        memcpy(replica->featureScale, network->featureScale, sizeof(float) * inputs);
+    }
+    replica->normalizationFolded = network->normalizationFolded;
+    job->replica = replica;
+    return NULL;
+}
+
+NodeReplicas* createNodeReplicas(Network* network, CpuTopology* topology){
+    NodeReplicas* replicas = (NodeReplicas*)malloc(sizeof(NodeReplicas));
+    replicas->topology = topology;
+    replicas->networks = (Network**)malloc(sizeof(Network*) * topology->numNodes);
+    ReplicaJob jobs[topology->numNodes];
+    int n;
+    for (n = 0; n < topology->numNodes; n++){
+        jobs[n].network = network;
+        jobs[n].topology = topology;
+        jobs[n].node = n;
+        jobs[n].replica = NULL;
+    }
+#ifdef CRANIUM_USE_POSIX
+    // one node at a time, so the pinned threads never compete
+    for (n = 0; n < topology->numNodes; n++){
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, buildReplica, &jobs[n]) == 0){
+            pthread_join(thread, NULL);
+        }
+        else{
+            buildReplica(&jobs[n]);
+        }
+    }
+#else
+    for (n = 0; n < topology->numNodes; n++){
+        buildReplica(&jobs[n]);
+    }
+#endif
+    for (n = 0; n < topology->numNodes; n++){
+        replicas->networks[n] = jobs[n].replica;
+    }
+    return replicas;
+}
+
+void updateNodeReplicas(NodeReplicas* replicas, Network* network){
+    int n;
+    for (n = 0; n < replicas->topology->numNodes; n++){
+        copyNetworkParameters(network, replicas->networks[n]);
+    }
+}
+
+void destroyNodeReplicas(NodeReplicas* replicas){
+    int n;
+    for (n = 0; n < replicas->topology->numNodes; n++){
+        destroyNetwork(replicas->networks[n]);
+    }
+    free(replicas->networks);
+    free(replicas);
+}
+
+typedef struct PinnedRange_ {
+    EvaluationRange range;
+    CpuTopology* topology;
+    int worker;
+    int numWorkers;
+} PinnedRange;
+
+static void* evaluatePinnedRange(void* argument){
+    PinnedRange* pinned = (PinnedRange*)argument;
+    pinThread(pinned->topology, pinned->worker, pinned->numWorkers);
+    return evaluateRange(&pinned->range);
+}
+
+Evaluation evaluateNetworkPinned(Network* network, NodeReplicas* replicas, CpuTopology* topology, DataSet* data, DataSet* classes, size_t chunkRows, int numThreads){
+    assert(data->rows == classes->rows && data->cols == network->layers[0]->size);
+    assert(classes->cols == network->layers[network->numLayers - 1]->size);
+    assert(chunkRows > 0 && numThreads >= 1);
+    assert(replicas == NULL || replicas->topology == topology);
+    Evaluation evaluation;
+    memset(&evaluation, 0, sizeof(evaluation));
+    evaluation.rows = classes->rows;
+    evaluation.l2 = weightSquaredSum(network);
+    int i;
+    size_t j;
+    size_t numChunks = (classes->rows + chunkRows - 1) / chunkRows;
+    if (numChunks == 0){
+        return evaluation;
+    }
+    EvaluationChunk* chunks = (EvaluationChunk*)malloc(sizeof(EvaluationChunk) * numChunks);
+    int numRanges = (int)MIN((size_t)numThreads, numChunks);
+    PinnedRange ranges[numRanges];
+    for (i = 0; i < numRanges; i++){
+        EvaluationRange* range = &ranges[i].range;
+        range->network = replicas != NULL ? replicas->networks[workerNode(topology, i, numRanges)] : network;
+        range->data = data;
+        range->sparseData = NULL;
+        range->classes = classes;
+        range->chunkRows = chunkRows;
+        range->firstChunk = numChunks * i / numRanges;
+        range->lastChunk = numChunks * (i + 1) / numRanges;
+        range->chunks = chunks;
+        ranges[i].topology = topology;
+        ranges[i].worker = i;
+        ranges[i].numWorkers = numRanges;
+    }
+#ifdef CRANIUM_USE_POSIX
+    // every range gets a thread, leaving the caller's affinity alone
+    pthread_t threads[numRanges];
+    int started[numRanges];
+    for (i = 0; i < numRanges; i++){
+        started[i] = pthread_create(&threads[i], NULL, evaluatePinnedRange, &ranges[i]) == 0;
+        if (!started[i]){
+            evaluateRange(&ranges[i].range);
+        }
+    }
+    for (i = 0; i < numRanges; i++){
+        if (started[i]){
+            pthread_join(threads[i], NULL);
+        }
+    }
+#else
+    for (i = 0; i < numRanges; i++){
+        evaluateRange(&ranges[i].range);
+    }
+#endif
+    for (j = 0; j < numChunks; j++){
+        evaluation.numCorrect += chunks[j].numCorrect;
+        evaluation.crossEntropy += chunks[j].crossEntropy;
+        evaluation.squaredError += chunks[j].squaredError;
+    }
+    free(chunks);
+    return evaluation;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include "std_includes.h"
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Uncomment the below line, or compile with -DCRANIUM_PROFILE, to time every
+   matrix operation, layer pass and training phase; without it the
+   instrumentation compiles to nothing */
+// #define CRANIUM_PROFILE
+
+// PROFILE_BEGIN(scope) starts timing at a point in a function, and
+// PROFILE_END(scope, name, index, flops, bytes) records the time since as
+// one call of operation $name ($index being a layer or stage, or -1), doing
+// $flops floating-point operations over $bytes of memory
+#ifdef CRANIUM_PROFILE
+#define PROFILE_BEGIN(scope) uint64_t profileStart_##scope = __atomic_load_n(&profileEnabled, __ATOMIC_ACQUIRE) ? profileClock() : 0
+#define PROFILE_END(scope, name, index, flops, bytes) do { if (profileStart_##scope != 0){ profileRecord(name, index, profileStart_##scope, (double)(flops), (double)(bytes)); } } while (0)
+#else
+#define PROFILE_BEGIN(scope)
+#define PROFILE_END(scope, name, index, flops, bytes)
+#endif
+
+// totals for one operation on one thread
+typedef struct ProfileOp_ {
+    const char* name;
+    int index;
+    uint64_t calls;
+    uint64_t nanoseconds;
+    double flops;
+    double bytes;
+} ProfileOp;
+
+// one call, kept for the trace
+typedef struct ProfileEvent_ {
+    const char* name;
+    int index;
+    uint64_t start; // nanoseconds since profiling started
+    uint64_t duration;
+    double flops;
+    double bytes;
+} ProfileEvent;
+
+// what one thread recorded; a thread that exits leaves its slot to the next
+// new thread, so pools of short-lived threads share a few slots
+typedef struct ProfileThread_ {
+    int id;
+    int alive;
+    ProfileOp* ops;
+    int numOps;
+    int opCapacity;
+    ProfileEvent* events;
+    size_t numEvents;
+    size_t eventCapacity;
+    size_t droppedEvents;
+} ProfileThread;
+
+// clears what was recorded and starts recording, keeping the first
+// $maxTraceEvents calls of each thread for writeProfileTrace (0 for totals
+// only); does nothing without CRANIUM_PROFILE
+// call while no other thread is inside an instrumented operation
+static void startProfiling(size_t maxTraceEvents);
+
+// stops recording, keeping what was recorded
+static void stopProfiling();
+
+// prints, for each operation, its calls, inclusive time, share of the time
+// profiled, FLOP/s and bytes/s, summed over threads, most time first; with
+// $perThread, also prints the table of each thread
+// call once the threads that recorded are idle
+static void printProfile(FILE* stream, int perThread);
+
+// writes the kept calls as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev), one row per thread, returning 0 on success and -1 on
+// failure or without CRANIUM_PROFILE
+static int writeProfileTrace(const char* path);
+
+#ifdef CRANIUM_PROFILE
+
+static int profileEnabled = 0;
+static size_t profileMaxEvents = 0;
+static uint64_t profileOrigin = 0;
+static uint64_t profileStopped = 0;
+static ProfileThread** profileThreads = NULL;
+static int profileNumThreads = 0;
+#ifdef CRANIUM_USE_POSIX
+static pthread_mutex_t profileLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t profileKey;
+static pthread_once_t profileKeyOnce = PTHREAD_ONCE_INIT;
+#endif
+
+// monotonic nanoseconds, never 0
+static uint64_t profileClock(){
+    return monotonicNanoseconds() + 1;
+}
+
+static ProfileThread* newProfileThread(){
+    int i;
+    for (i = 0; i < profileNumThreads; i++){
+        if (!profileThreads[i]->alive){
+            profileThreads[i]->alive = 1;
+            return profileThreads[i];
+        }
+    }
+    profileThreads = (ProfileThread**)realloc(profileThreads, sizeof(ProfileThread*) * (profileNumThreads + 1));
+    ProfileThread* thread = (ProfileThread*)calloc(1, sizeof(ProfileThread));
+    thread->id = profileNumThreads;
+    thread->alive = 1;
+    profileThreads[profileNumThreads++] = thread;
+    return thread;
+}
+
+#ifdef CRANIUM_USE_POSIX
+static void releaseProfileThread(void* thread){
+    pthread_mutex_lock(&profileLock);
+    ((ProfileThread*)thread)->alive = 0;
+    pthread_mutex_unlock(&profileLock);
+}
+
+static void createProfileKey(){
+    pthread_key_create(&profileKey, releaseProfileThread);
+}
+#endif
+
+// the slot of the calling thread, taken on its first call
+static ProfileThread* currentProfileThread(){
+#ifdef CRANIUM_USE_POSIX
+    pthread_once(&profileKeyOnce, createProfileKey);
+    ProfileThread* thread = (ProfileThread*)pthread_getspecific(profileKey);
+    if (thread == NULL){
+        pthread_mutex_lock(&profileLock);
+        thread = newProfileThread();
+        pthread_mutex_unlock(&profileLock);
+        pthread_setspecific(profileKey, thread);
+    }
+    return thread;
+#else
+    return profileNumThreads > 0 ? profileThreads[0] : newProfileThread();
+#endif
+}
+
+static void profileRecord(const char* name, int index, uint64_t start, double flops, double bytes){
+    uint64_t end = profileClock();
+    if (!__atomic_load_n(&profileEnabled, __ATOMIC_ACQUIRE) || start < profileOrigin){
+        return;
+    }
+    ProfileThread* thread = currentProfileThread();
+    int i;
+    for (i = 0; i < thread->numOps; i++){
+        ProfileOp* op = &thread->ops[i];
+        if (op->index == index && (op->name == name || strcmp(op->name, name) == 0)){
+            break;
+        }
+    }
+    if (i == thread->numOps){
+        if (thread->numOps == thread->opCapacity){
+            thread->opCapacity = thread->opCapacity > 0 ? 2 * thread->opCapacity : 32;
+            thread->ops = (ProfileOp*)realloc(thread->ops, sizeof(ProfileOp) * thread->opCapacity);
+        }
+        ProfileOp blank = {name, index, 0, 0, 0, 0};
+        thread->ops[thread->numOps++] = blank;
+    }
+    ProfileOp* op = &thread->ops[i];
+    op->calls++;
+    op->nanoseconds += end - start;
+    op->flops += flops;
+    op->bytes += bytes;
+
+    if (thread->numEvents == profileMaxEvents){
+        thread->droppedEvents += profileMaxEvents > 0;
+        return;
+    }
+    if (thread->numEvents == thread->eventCapacity){
+        thread->eventCapacity = thread->eventCapacity > 0 ? 2 * thread->eventCapacity : 1024;
+        thread->eventCapacity = thread->eventCapacity < profileMaxEvents ? thread->eventCapacity : profileMaxEvents;
+        thread->events = (ProfileEvent*)realloc(thread->events, sizeof(ProfileEvent) * thread->eventCapacity);
+    }
+    ProfileEvent event = {name, index, start - profileOrigin, end - start, flops, bytes};
+    thread->events[thread->numEvents++] = event;
+}
+
+// sorts operations by time, most first
+static int compareProfileOps(const void* a, const void* b){
+    uint64_t x = ((const ProfileOp*)a)->nanoseconds, y = ((const ProfileOp*)b)->nanoseconds;
+    return x > y ? -1 : x < y;
+}
+
+static void printProfileOps(FILE* stream, ProfileOp* ops, int numOps, double seconds){
+    qsort(ops, numOps, sizeof(ProfileOp), compareProfileOps);
+    fprintf(stream, "%-28s %10s %12s %7s %10s %9s %9s\n", "operation", "calls", "total ms", "%", "avg us", "GFLOP/s", "GB/s");
+    int i;
+    for (i = 0; i < numOps; i++){
+        ProfileOp* op = &ops[i];
+        char name[64];
+        if (op->index >= 0){
+            snprintf(name, sizeof(name), "%s[%d]", op->name, op->index);
+        }
+        else{
+            snprintf(name, sizeof(name), "%s", op->name);
+        }
+        double opSeconds = op->nanoseconds * 1e-9;
+        fprintf(stream, "%-28s %10llu %12.3f %6.1f%% %10.3f %9.3f %9.3f\n", name, (unsigned long long)op->calls, opSeconds * 1e3, seconds > 0 ? 100 * opSeconds / seconds : 0, opSeconds * 1e6 / op->calls, opSeconds > 0 ? op->flops / opSeconds * 1e-9 : 0, opSeconds > 0 ? op->bytes / opSeconds * 1e-9 : 0);
+    }
+}
+
+#endif
+
+/*
+    Begin functions.
+*/
+
+void startProfiling(size_t maxTraceEvents){
+#ifdef CRANIUM_PROFILE
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_lock(&profileLock);
+#endif
+    int i;
+    for (i = 0; i < profileNumThreads; i++){
+        ProfileThread* thread = profileThreads[i];
+        thread->numOps = 0;
+        thread->numEvents = 0;
+        thread->droppedEvents = 0;
+    }
+    profileMaxEvents = maxTraceEvents;
+    profileOrigin = profileClock();
+    __atomic_store_n(&profileEnabled, 1, __ATOMIC_RELEASE);
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_unlock(&profileLock);
+#endif
+#endif
+}
+
+void stopProfiling(){
+#ifdef CRANIUM_PROFILE
+    if (__atomic_load_n(&profileEnabled, __ATOMIC_ACQUIRE)){
+        profileStopped = profileClock();
+        __atomic_store_n(&profileEnabled, 0, __ATOMIC_RELEASE);
+    }
+#endif
+}
+
+void printProfile(FILE* stream, int perThread){
+#ifdef CRANIUM_PROFILE
+    double seconds = ((__atomic_load_n(&profileEnabled, __ATOMIC_ACQUIRE) ? profileClock() : profileStopped) - profileOrigin) * 1e-9;
+    int i, j, k, numOps = 0, capacity = 0;
+    ProfileOp* totals = NULL;
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_lock(&profileLock);
+#endif
+    for (i = 0; i < profileNumThreads; i++){
+        ProfileThread* thread = profileThreads[i];
+        for (j = 0; j < thread->numOps; j++){
+            ProfileOp* op = &thread->ops[j];
+            for (k = 0; k < numOps; k++){
+                if (totals[k].index == op->index && strcmp(totals[k].name, op->name) == 0){
+                    break;
+                }
+            }
+            if (k == numOps){
+                if (numOps == capacity){
+                    capacity = capacity > 0 ? 2 * capacity : 32;
+                    totals = (ProfileOp*)realloc(totals, sizeof(ProfileOp) * capacity);
+                }
+                ProfileOp blank = {op->name, op->index, 0, 0, 0, 0};
+                totals[numOps++] = blank;
+            }
+            totals[k].calls += op->calls;
+            totals[k].nanoseconds += op->nanoseconds;
+            totals[k].flops += op->flops;
+            totals[k].bytes += op->bytes;
+        }
+    }
+    fprintf(stream, "profile of %.3f s on %d threads (times include nested operations)\n", seconds, profileNumThreads);
+    printProfileOps(stream, totals, numOps, seconds);
+    for (i = 0; perThread && i < profileNumThreads; i++){
+        ProfileThread* thread = profileThreads[i];
+        if (thread->numOps == 0){
+            continue;
+        }
+        fprintf(stream, "\nthread %d\n", thread->id);
+        printProfileOps(stream, thread->ops, thread->numOps, seconds);
+    }
+    for (i = 0; i < profileNumThreads; i++){
+        if (profileThreads[i]->droppedEvents > 0){
+            fprintf(stream, "thread %d: %zu calls past the trace limit were counted but not traced\n", profileThreads[i]->id, profileThreads[i]->droppedEvents);
+        }
+    }
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_unlock(&profileLock);
+#endif
+    free(totals);
+#else
+    fprintf(stream, "profiling is off; compile with -DCRANIUM_PROFILE\n");
+#endif
+}
+
+int writeProfileTrace(const char* path){
+#ifdef CRANIUM_PROFILE
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL){
+        return -1;
+    }
+    fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"cranium\"}}");
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_lock(&profileLock);
+#endif
+    int i;
+    size_t e;
+    for (i = 0; i < profileNumThreads; i++){
+        ProfileThread* thread = profileThreads[i];
+        fprintf(fp, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}", thread->id, thread->id);
+        for (e = 0; e < thread->numEvents; e++){
+            ProfileEvent* event = &thread->events[e];
+            fprintf(fp, ",\n{\"name\": \"%s", event->name);
+            if (event->index >= 0){
+                fprintf(fp, "[%d]", event->index);
+            }
+            fprintf(fp, "\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"flops\": %.0f, \"bytes\": %.0f}}", thread->id, event->start * 1e-3, event->duration * 1e-3, event->flops, event->bytes);
+        }
+    }
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_unlock(&profileLock);
+#endif
+    fprintf(fp, "\n]}\n");
+    int failed = ferror(fp);
+    return fclose(fp) != 0 || failed ? -1 : 0;
+#else
+    return -1;
+#endif
+}
+
+#endif
\ No newline at end of file
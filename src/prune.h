@@ -0,0 +1,245 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+#include "optimizer.h"
+
+#ifndef PRUNE_H
+#define PRUNE_H
+
+// zeroes every weight of $connection with magnitude below $threshold
+// and fixes the remaining non-zero weights as its sparse pattern
+static void pruneConnection(Connection* connection, float threshold);
+
+// zeroes the smallest-magnitude weights of $connection until the given
+// fraction of them is zero, and fixes the rest as its sparse pattern
+static void pruneConnectionToSparsity(Connection* connection, float sparsity);
+
+// prunes every connection of the network to the given sparsity
+static void pruneNetwork(Network* network, float sparsity);
+
+// prunes the network to $sparsity over $rounds equal steps, training with
+// $params after each step so the remaining weights can compensate
+static void pruneAndFineTune(ParameterSet params, float sparsity, int rounds);
+
+// returns fraction of all weights in the network that are zero
+static float networkSparsity(Network* network);
+
+// removes hidden neurons whose mean absolute activation over $sample is at
+// most $activationThreshold, or whose outgoing weights have an L2 norm of
+// at most $weightThreshold, shrinking the layers and connections around them
+// the mean output of each removed neuron is folded into the next bias
+// every hidden layer keeps at least one neuron
+// returns the number of neurons removed
+static size_t pruneNeurons(Network* network, DataSet* sample, float activationThreshold, float weightThreshold);
+
+
+/*
+    Begin functions.
+*/
+
+void pruneConnection(Connection* connection, float threshold){
+    size_t i;
+    Matrix* weights = connection->weights;
+    for (i = 0; i < weights->rows * weights->cols; i++){
+        if (fabsf(weights->data[i]) < threshold){
+            weights->data[i] = 0;
+        }
+    }
+    sparsifyConnection(connection);
+    refreshConnection(connection);
+}
+
+static int compareMagnitudes(const void* a, const void* b){
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+void pruneConnectionToSparsity(Connection* connection, float sparsity){
+    assert(sparsity >= 0 && sparsity <= 1);
+    Matrix* weights = connection->weights;
+    size_t size = weights->rows * weights->cols;
+    size_t toPrune = (size_t)(sparsity * size);
+    if (toPrune == 0){
+        sparsifyConnection(connection);
+        return;
+    }
+    float* magnitudes = (float*)malloc(sizeof(float) * size);
+    size_t i;
+    for (i = 0; i < size; i++){
+        magnitudes[i] = fabsf(weights->data[i]);
+    }
+    qsort(magnitudes, size, sizeof(float), compareMagnitudes);
+    float threshold = magnitudes[toPrune - 1];
+    free(magnitudes);
+
+    // everything strictly below the threshold goes, then ties until the count is met
+    size_t pruned = 0;
+    for (i = 0; i < size; i++){
+        if (fabsf(weights->data[i]) < threshold){
+            weights->data[i] = 0;
+            pruned++;
+        }
+    }
+    for (i = 0; i < size && pruned < toPrune; i++){
+        if (fabsf(weights->data[i]) == threshold && weights->data[i] != 0){
+            weights->data[i] = 0;
+            pruned++;
+        }
+    }
+    sparsifyConnection(connection);
+    refreshConnection(connection);
+}
+
+void pruneNetwork(Network* network, float sparsity){
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        pruneConnectionToSparsity(network->connections[i], sparsity);
+    }
+}
+
+void pruneAndFineTune(ParameterSet params, float sparsity, int rounds){
+    assert(rounds >= 1);
+    int round;
+    for (round = 1; round <= rounds; round++){
+        pruneNetwork(params.network, sparsity * round / rounds);
+        optimize(params);
+    }
+}
+
+float networkSparsity(Network* network){
+    size_t zero = 0, total = 0, i;
+    int k;
+    for (k = 0; k < network->numConnections; k++){
+        Matrix* weights = network->connections[k]->weights;
+        for (i = 0; i < weights->rows * weights->cols; i++){
+            zero += weights->data[i] == 0;
+        }
+        total += weights->rows * weights->cols;
+    }
+    return (float)zero / total;
+}
+
+// returns a matrix with only the columns of $orig marked in $keep
+static Matrix* keepColumns(Matrix* orig, int* keep, size_t kept){
+    Matrix* result = createMatrixZeroes(orig->rows, kept);
+    size_t i, j, col;
+    for (i = 0; i < orig->rows; i++){
+        for (j = 0, col = 0; j < orig->cols; j++){
+            if (keep[j]){
+                setMatrix(result, i, col++, getMatrix(orig, i, j));
+            }
+        }
+    }
+    return result;
+}
+
+// returns a matrix with only the rows of $orig marked in $keep
+static Matrix* keepRows(Matrix* orig, int* keep, size_t kept){
+    Matrix* result = createMatrixZeroes(kept, orig->cols);
+    size_t i, row;
+    for (i = 0, row = 0; i < orig->rows; i++){
+        if (keep[i]){
+            memcpy(result->data + row++ * orig->cols, orig->data + i * orig->cols, sizeof(float) * orig->cols);
+        }
+    }
+    return result;
+}
+
+size_t pruneNeurons(Network* network, DataSet* sample, float activationThreshold, float weightThreshold){
+    assert(sample->cols == network->layers[0]->size);
+    forwardPassDataSet(network, sample);
+    size_t removed = 0, i, j;
+    int layer;
+    for (layer = 1; layer < network->numLayers - 1; layer++){
+        Layer* hidden = network->layers[layer];
+        Connection* in = network->connections[layer - 1];
+        Connection* out = network->connections[layer];
+
+        // find mean activations and outgoing weight norms
+        float* meanAbs = (float*)malloc(sizeof(float) * hidden->size);
+        float* mean = (float*)malloc(sizeof(float) * hidden->size);
+        int* keep = (int*)malloc(sizeof(int) * hidden->size);
+        size_t kept = 0;
+        for (j = 0; j < hidden->size; j++){
+            mean[j] = 0;
+            meanAbs[j] = 0;
+            for (i = 0; i < hidden->input->rows; i++){
+                mean[j] += getMatrix(hidden->input, i, j);
+                meanAbs[j] += fabsf(getMatrix(hidden->input, i, j));
+            }
+            mean[j] /= hidden->input->rows;
+            meanAbs[j] /= hidden->input->rows;
+            float norm = 0;
+            for (i = 0; i < out->weights->cols; i++){
+                norm += getMatrix(out->weights, j, i) * getMatrix(out->weights, j, i);
+            }
+            keep[j] = meanAbs[j] > activationThreshold && sqrtf(norm) > weightThreshold;
+            kept += keep[j];
+        }
+
+        // keep the most active neuron of an otherwise empty layer
+        if (kept == 0){
+            size_t best = 0;
+            for (j = 1; j < hidden->size; j++){
+                if (meanAbs[j] > meanAbs[best]){
+                    best = j;
+                }
+            }
+            keep[best] = 1;
+            kept = 1;
+        }
+        if (kept == hidden->size){
+            free(meanAbs);
+            free(mean);
+            free(keep);
+            continue;
+        }
+
+        // fold the mean contribution of removed neurons into the next bias
+        for (j = 0; j < hidden->size; j++){
+            if (!keep[j]){
+                for (i = 0; i < out->bias->cols; i++){
+                    out->bias->data[i] += mean[j] * getMatrix(out->weights, j, i);
+                }
+            }
+        }
+
+        // shrink incoming columns, outgoing rows, and the layer itself
+        Matrix* weightsIn = keepColumns(in->weights, keep, kept);
+        Matrix* biasIn = keepColumns(in->bias, keep, kept);
+        Matrix* weightsOut = keepRows(out->weights, keep, kept);
+        Matrix* activations = keepColumns(hidden->input, keep, kept);
+        setConnectionMatrices(in, weightsIn, biasIn);
+        setConnectionMatrices(out, weightsOut, copy(out->bias));
+        if (in->factorU != NULL){
+            Matrix* factorV = keepColumns(in->factorV, keep, kept);
+            destroyMatrix(in->factorV);
+            in->factorV = factorV;
+        }
+        if (out->factorU != NULL){
+            Matrix* factorU = keepRows(out->factorU, keep, kept);
+            destroyMatrix(out->factorU);
+            out->factorU = factorU;
+        }
+        destroyMatrix(hidden->input);
+        hidden->input = activations;
+        removed += hidden->size - kept;
+        hidden->size = kept;
+        rebuildConnection(in);
+        rebuildConnection(out);
+        free(meanAbs);
+        free(mean);
+        free(keep);
+    }
+
+    // the shrunk matrices were allocated on their own
+    if (removed > 0){
+        flattenNetwork(network);
+    }
+    return removed;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,469 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+#include "optimizer.h"
+#include "placement.h"
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// values to try for each hyperparameter of a search; a list with no values
+// keeps the template's value, and every combination is one trial
+typedef struct SearchSpace_ {
+    float* learningRates;
+    size_t numLearningRates;
+    size_t* batchSizes;
+    size_t numBatchSizes;
+    float* momentumFactors;
+    size_t numMomentumFactors;
+    float* regularizationStrengths;
+    size_t numRegularizationStrengths;
+    size_t** hiddenSizes; // sizes of the hidden layers of each architecture
+    size_t* numHiddenLayers;
+    size_t numArchitectures;
+} SearchSpace;
+
+// one combination of hyperparameters and how it fared
+typedef struct SearchTrial_ {
+    float learningRate;
+    size_t batchSize;
+    float momentumFactor;
+    float regularizationStrength;
+    size_t* hiddenSizes; // points into the search space or the result
+    size_t numHiddenLayers;
+    int steps; // steps trained before the search ended or dropped the trial
+    float loss; // on the validation data after its last round, without regularization
+    float accuracy;
+    double seconds; // wall time spent training and evaluating it
+    Network* network; // kept for the best trial only
+    TrainingState* state;
+} SearchTrial;
+
+// trials of a search ranked best first: those that survived more rounds
+// come before those dropped earlier, and each group is ordered by loss
+typedef struct SearchResult_ {
+    SearchTrial* trials;
+    size_t numTrials;
+    int numRounds;
+    double seconds;
+    size_t* templateHiddenSizes; // the template's, for trials that keep them
+} SearchResult;
+
+// scores of one configuration on each fold's held-out rows, without
+// regularization, and their mean and standard deviation over the folds
+typedef struct CrossValidation_ {
+    int numFolds;
+    float* loss;
+    float* accuracy;
+    float meanLoss;
+    float deviationLoss;
+    float meanAccuracy;
+    float deviationAccuracy;
+    double seconds;
+} CrossValidation;
+
+// runs $work on each of $numItems items of $itemSize bytes starting at $items,
+// handing the next item to whichever of $numThreads threads is free
+// (threads need CRANIUM_USE_POSIX; otherwise items run one after another)
+// with a $topology, the threads are pinned as its workers and the caller
+// only waits for them; NULL leaves placement to the scheduler
+static void parallelForEach(void* items, size_t numItems, size_t itemSize, void (*work)(void* item), int numThreads, CpuTopology* topology);
+
+// trains a network for every combination in $space on a pool of $numThreads
+// threads (pinned as workers of $topology, if not NULL), all reading
+// $params.data and $params.classes, which are never
+// modified; the template $params.network gives the input, output and
+// activations, and is not trained
+// with successive halving, each round trains the surviving trials further,
+// scores them on $validationData and $validationClasses (the training data
+// if NULL) and keeps the best 1 / $halvingRate; the last round reaches
+// $params.maxIters steps, and earlier rounds $halvingRate times fewer each
+// a $halvingRate of 1 trains every trial to the end
+// verbose prints a line per round
+static SearchResult* searchHyperparameters(ParameterSet params, SearchSpace* space, DataSet* validationData, DataSet* validationClasses, int halvingRate, int numThreads, CpuTopology* topology);
+
+// frees a search result and the best trial's network
+static void destroySearchResult(SearchResult* result);
+
+// splits the rows of $params.data into $numFolds folds (in a random order if
+// $params.shuffle is set) and trains one model per fold on the other folds,
+// on a pool of $numThreads threads (pinned as workers of $topology, if not
+// NULL), then scores each on its own fold with
+// the chunked evaluator
+// folds are views of the shared rows, so memory beyond the dataset is an
+// index per row and fold plus one network and training state per model;
+// every model starts from the template $params.network's parameters, which
+// are not trained
+static CrossValidation* crossValidate(ParameterSet params, int numFolds, int numThreads, CpuTopology* topology);
+
+// frees the scores of a cross-validation
+static void destroyCrossValidation(CrossValidation* validation);
+
+
+/*
+    Begin functions.
+*/
+
+#ifdef CRANIUM_USE_POSIX
+typedef struct ParallelQueue_ {
+    char* items;
+    size_t numItems;
+    size_t itemSize;
+    void (*work)(void* item);
+    size_t next;
+    pthread_mutex_t lock;
+    CpuTopology* topology;
+} ParallelQueue;
+
+static void* drainQueue(void* argument){
+    ParallelQueue* queue = (ParallelQueue*)argument;
+    while (1){
+        pthread_mutex_lock(&queue->lock);
+        size_t item = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (item >= queue->numItems){
+            return NULL;
+        }
+        queue->work(queue->items + item * queue->itemSize);
+    }
+}
+
+typedef struct QueueWorker_ {
+    ParallelQueue* queue;
+    int worker;
+    int numWorkers;
+} QueueWorker;
+
+static void* drainQueuePinned(void* argument){
+    QueueWorker* worker = (QueueWorker*)argument;
+    pinThread(worker->queue->topology, worker->worker, worker->numWorkers);
+    return drainQueue(worker->queue);
+}
+#endif
+
+void parallelForEach(void* items, size_t numItems, size_t itemSize, void (*work)(void* item), int numThreads, CpuTopology* topology){
+    size_t i;
+#ifdef CRANIUM_USE_POSIX
+    int numWorkers = (int)MIN((size_t)MAX(numThreads, 1), numItems), w;
+    if (numWorkers > 1 || (numWorkers == 1 && topology != NULL)){
+        ParallelQueue queue = {(char*)items, numItems, itemSize, work, 0};
+        pthread_mutex_init(&queue.lock, NULL);
+        queue.topology = topology;
+        pthread_t threads[numWorkers];
+        QueueWorker workers[numWorkers];
+        int started[numWorkers];
+        int firstThread = topology != NULL ? 0 : 1;
+        for (w = firstThread; w < numWorkers; w++){
+            workers[w].queue = &queue;
+            workers[w].worker = w;
+            workers[w].numWorkers = numWorkers;
+            started[w] = pthread_create(&threads[w], NULL, topology != NULL ? drainQueuePinned : drainQueue, topology != NULL ? (void*)&workers[w] : (void*)&queue) == 0;
+        }
+        if (firstThread > 0){
+            drainQueue(&queue);
+        }
+        for (w = firstThread; w < numWorkers; w++){
+            if (started[w]){
+                pthread_join(threads[w], NULL);
+            }
+        }
+
+        // items left by threads that failed to start
+        drainQueue(&queue);
+        pthread_mutex_destroy(&queue.lock);
+        return;
+    }
+#endif
+    for (i = 0; i < numItems; i++){
+        work((char*)items + i * itemSize);
+    }
+}
+
+// one trial's share of a round
+typedef struct SearchTask_ {
+    SearchTrial* trial;
+    ParameterSet* params;
+    DataSet* validationData;
+    DataSet* validationClasses;
+    int steps;
+} SearchTask;
+
+static void runSearchTask(void* item){
+    SearchTask* task = (SearchTask*)item;
+    SearchTrial* trial = task->trial;
+    ParameterSet* params = task->params;
+    double start = monotonicSeconds();
+    trainGradientDescent(trial->state, params->data, params->classes, trial->batchSize, trial->learningRate, params->searchTime, trial->regularizationStrength, trial->momentumFactor, task->steps, params->shuffle, 0);
+    Evaluation evaluation = evaluateNetwork(trial->network, task->validationData, task->validationClasses, EVALUATION_CHUNK_ROWS, 1);
+    float loss = params->lossFunction == CROSS_ENTROPY_LOSS ? evaluation.crossEntropy / evaluation.rows : .5 * evaluation.squaredError / evaluation.rows;
+    trial->loss = isnan(loss) ? INFINITY : loss;
+    trial->accuracy = (float)evaluation.numCorrect / evaluation.rows;
+    trial->steps = task->steps;
+    trial->seconds += monotonicSeconds() - start;
+}
+
+// orders trials by rounds survived, then by loss
+static int compareTrials(const void* a, const void* b){
+    const SearchTrial* x = (const SearchTrial*)a;
+    const SearchTrial* y = (const SearchTrial*)b;
+    if (x->steps != y->steps){
+        return x->steps > y->steps ? -1 : 1;
+    }
+    if (x->loss != y->loss){
+        return x->loss < y->loss ? -1 : 1;
+    }
+    return (x->network == NULL) - (y->network == NULL);
+}
+
+SearchResult* searchHyperparameters(ParameterSet params, SearchSpace* space, DataSet* validationData, DataSet* validationClasses, int halvingRate, int numThreads, CpuTopology* topology){
+    Network* prototype = params.network;
+    assert(params.data->rows == params.classes->rows && params.maxIters >= 1 && halvingRate >= 1);
+    if (validationData == NULL){
+        validationData = params.data;
+        validationClasses = params.classes;
+    }
+    double searchStart = monotonicSeconds();
+
+    // the template's own values stand in for lists left empty
+    SearchResult* result = (SearchResult*)malloc(sizeof(SearchResult));
+    result->templateHiddenSizes = (size_t*)malloc(sizeof(size_t) * prototype->numLayers);
+    Activation templateActivations[prototype->numLayers];
+    int i;
+    for (i = 1; i + 1 < prototype->numLayers; i++){
+        result->templateHiddenSizes[i - 1] = prototype->layers[i]->size;
+        templateActivations[i - 1] = prototype->layers[i]->activation;
+    }
+    size_t numTemplateHidden = prototype->numLayers - 2;
+    size_t numLearningRates = MAX(space->numLearningRates, 1);
+    size_t numBatchSizes = MAX(space->numBatchSizes, 1);
+    size_t numMomentumFactors = MAX(space->numMomentumFactors, 1);
+    size_t numRegularizationStrengths = MAX(space->numRegularizationStrengths, 1);
+    size_t numArchitectures = MAX(space->numArchitectures, 1);
+
+    result->numTrials = numLearningRates * numBatchSizes * numMomentumFactors * numRegularizationStrengths * numArchitectures;
+    result->trials = (SearchTrial*)calloc(result->numTrials, sizeof(SearchTrial));
+    size_t t, l, b, m, r, a;
+    t = 0;
+    for (a = 0; a < numArchitectures; a++){
+        for (l = 0; l < numLearningRates; l++){
+            for (b = 0; b < numBatchSizes; b++){
+                for (m = 0; m < numMomentumFactors; m++){
+                    for (r = 0; r < numRegularizationStrengths; r++){
+                        SearchTrial* trial = &result->trials[t++];
+                        trial->learningRate = space->numLearningRates > 0 ? space->learningRates[l] : params.learningRate;
+                        trial->batchSize = MIN(space->numBatchSizes > 0 ? space->batchSizes[b] : params.batchSize, params.data->rows);
+                        trial->momentumFactor = space->numMomentumFactors > 0 ? space->momentumFactors[m] : params.momentumFactor;
+                        trial->regularizationStrength = space->numRegularizationStrengths > 0 ? space->regularizationStrengths[r] : params.regularizationStrength;
+                        trial->hiddenSizes = space->numArchitectures > 0 ? space->hiddenSizes[a] : result->templateHiddenSizes;
+                        trial->numHiddenLayers = space->numArchitectures > 0 ? space->numHiddenLayers[a] : numTemplateHidden;
+                    }
+                }
+            }
+        }
+    }
+
+    // networks are built up front, since their initialization draws on rand()
+    for (t = 0; t < result->numTrials; t++){
+        SearchTrial* trial = &result->trials[t];
+        Activation activations[MAX(trial->numHiddenLayers, 1)];
+        for (i = 0; i < trial->numHiddenLayers; i++){
+            activations[i] = numTemplateHidden > 0 ? templateActivations[MIN((size_t)i, numTemplateHidden - 1)] : relu;
+        }
+        trial->network = createNetwork(prototype->layers[0]->size, trial->numHiddenLayers, trial->hiddenSizes, activations, prototype->layers[prototype->numLayers - 1]->size, prototype->layers[prototype->numLayers - 1]->activation);
+        if (prototype->featureMean != NULL){
+            size_t inputs = prototype->layers[0]->size;
+            trial->network->featureMean = (float*)malloc(sizeof(float) * inputs);
+            trial->network->featureScale = (float*)malloc(sizeof(float) * inputs);
+            memcpy(trial->network->featureMean, prototype->featureMean, sizeof(float) * inputs);
+            memcpy(trial->network->featureScale, prototype->featureScale, sizeof(float) * inputs);
+        }
+        trial->state = createTrainingState(trial->network, params.lossFunction);
+    }
+
+    // rounds until one more halving would leave a single trial
+    int numRounds = 1;
+    size_t survivors = result->numTrials;
+    while (halvingRate > 1 && survivors > (size_t)halvingRate){
+        survivors = (survivors + halvingRate - 1) / halvingRate;
+        numRounds++;
+    }
+    result->numRounds = numRounds;
+
+    SearchTask* tasks = (SearchTask*)malloc(sizeof(SearchTask) * result->numTrials);
+    survivors = result->numTrials;
+    int round;
+    for (round = 0; round < numRounds; round++){
+        double budget = params.maxIters;
+        for (i = round; i + 1 < numRounds; i++){
+            budget /= halvingRate;
+        }
+        for (t = 0; t < survivors; t++){
+            tasks[t].trial = &result->trials[t];
+            tasks[t].params = &params;
+            tasks[t].validationData = validationData;
+            tasks[t].validationClasses = validationClasses;
+            tasks[t].steps = MAX((int)budget, 1);
+        }
+        parallelForEach(tasks, survivors, sizeof(SearchTask), runSearchTask, numThreads, topology);
+        qsort(result->trials, survivors, sizeof(SearchTrial), compareTrials);
+        if (params.verbose){
+            printf("ROUND %d: %zu trials at %d steps, best loss %f\n", round + 1, survivors, tasks[0].steps, result->trials[0].loss);
+        }
+
+        // the dropped trials give their memory back straight away
+        size_t kept = round + 1 < numRounds ? (survivors + halvingRate - 1) / halvingRate : 1;
+        for (t = kept; t < survivors; t++){
+            destroyTrainingState(result->trials[t].state);
+            destroyNetwork(result->trials[t].network);
+            result->trials[t].state = NULL;
+            result->trials[t].network = NULL;
+        }
+        survivors = kept;
+    }
+    destroyTrainingState(result->trials[0].state);
+    result->trials[0].state = NULL;
+    free(tasks);
+    qsort(result->trials, result->numTrials, sizeof(SearchTrial), compareTrials);
+    result->seconds = monotonicSeconds() - searchStart;
+    return result;
+}
+
+// one fold's model, trained on $trainData and scored on $heldOutData
+typedef struct FoldTask_ {
+    ParameterSet* params;
+    DataSet* trainData;
+    DataSet* trainClasses;
+    DataSet* heldOutData;
+    DataSet* heldOutClasses;
+    Network* network;
+    TrainingState* state;
+    float loss;
+    float accuracy;
+} FoldTask;
+
+static void runFoldTask(void* item){
+    FoldTask* task = (FoldTask*)item;
+    ParameterSet* params = task->params;
+    trainGradientDescent(task->state, task->trainData, task->trainClasses, MIN(params->batchSize, task->trainData->rows), params->learningRate, params->searchTime, params->regularizationStrength, params->momentumFactor, params->maxIters, params->shuffle, 0);
+    destroyTrainingState(task->state);
+    Evaluation evaluation = evaluateNetwork(task->network, task->heldOutData, task->heldOutClasses, EVALUATION_CHUNK_ROWS, 1);
+    task->loss = params->lossFunction == CROSS_ENTROPY_LOSS ? evaluation.crossEntropy / evaluation.rows : .5 * evaluation.squaredError / evaluation.rows;
+    task->accuracy = (float)evaluation.numCorrect / evaluation.rows;
+}
+
+CrossValidation* crossValidate(ParameterSet params, int numFolds, int numThreads, CpuTopology* topology){
+    Network* prototype = params.network;
+    size_t numRows = params.data->rows;
+    assert(params.classes->rows == numRows && numFolds >= 2 && (size_t)numFolds <= numRows);
+    double start = monotonicSeconds();
+
+    // the visiting order is drawn once, so each fold is a slice of it
+    size_t* order = (size_t*)malloc(sizeof(size_t) * numRows);
+    size_t i, j;
+    for (i = 0; i < numRows; i++){
+        order[i] = i;
+    }
+    if (params.shuffle){
+        uint64_t random = ((uint64_t)rand() << 32) ^ rand();
+        for (i = 0; i + 1 < numRows; i++){
+            j = i + randomBelow(&random, numRows - i);
+            size_t tmp = order[j];
+            order[j] = order[i];
+            order[i] = tmp;
+        }
+    }
+
+    // every model is a copy of the template, built here since training
+    // states draw on rand()
+    size_t layerSizes[prototype->numLayers];
+    Activation activations[prototype->numLayers];
+    int f, l;
+    for (l = 0; l < prototype->numLayers; l++){
+        layerSizes[l] = prototype->layers[l]->size;
+        activations[l] = l + 1 < prototype->numLayers ? prototype->layers[l + 1]->activation : NULL;
+    }
+    FoldTask* tasks = (FoldTask*)malloc(sizeof(FoldTask) * numFolds);
+    size_t* trainRows = (size_t*)malloc(sizeof(size_t) * numRows);
+    for (f = 0; f < numFolds; f++){
+        size_t first = numRows * f / numFolds, last = numRows * (f + 1) / numFolds, count = 0;
+        for (i = 0; i < numRows; i++){
+            if (i < first || i >= last){
+                trainRows[count++] = order[i];
+            }
+        }
+        FoldTask* task = &tasks[f];
+        task->params = &params;
+        task->trainData = createDataSetView(params.data, trainRows, count);
+        task->trainClasses = createDataSetView(params.classes, trainRows, count);
+        task->heldOutData = createDataSetView(params.data, order + first, last - first);
+        task->heldOutClasses = createDataSetView(params.classes, order + first, last - first);
+        task->network = allocateNetwork(prototype->numLayers, layerSizes, activations);
+        copyNetworkParameters(prototype, task->network);
+        if (prototype->featureMean != NULL){
+            size_t inputs = prototype->layers[0]->size;
+            task->network->featureMean = (float*)malloc(sizeof(float) * inputs);
+            task->network->featureScale = (float*)malloc(sizeof(float) * inputs);
+            memcpy(task->network->featureMean, prototype->featureMean, sizeof(float) * inputs);
+            memcpy(task->network->featureScale, prototype->featureScale, sizeof(float) * inputs);
+            task->network->normalizationFolded = prototype->normalizationFolded;
+        }
+        task->state = createTrainingState(task->network, params.lossFunction);
+    }
+    free(trainRows);
+    free(order);
+
+    parallelForEach(tasks, numFolds, sizeof(FoldTask), runFoldTask, numThreads, topology);
+
+    CrossValidation* validation = (CrossValidation*)malloc(sizeof(CrossValidation));
+    validation->numFolds = numFolds;
+    validation->loss = (float*)malloc(sizeof(float) * numFolds);
+    validation->accuracy = (float*)malloc(sizeof(float) * numFolds);
+    double lossSum = 0, accuracySum = 0, lossSquares = 0, accuracySquares = 0;
+    for (f = 0; f < numFolds; f++){
+        validation->loss[f] = tasks[f].loss;
+        validation->accuracy[f] = tasks[f].accuracy;
+        lossSum += tasks[f].loss;
+        accuracySum += tasks[f].accuracy;
+        destroyDataSetView(tasks[f].trainData);
+        destroyDataSetView(tasks[f].trainClasses);
+        destroyDataSetView(tasks[f].heldOutData);
+        destroyDataSetView(tasks[f].heldOutClasses);
+        destroyNetwork(tasks[f].network);
+    }
+    validation->meanLoss = lossSum / numFolds;
+    validation->meanAccuracy = accuracySum / numFolds;
+    for (f = 0; f < numFolds; f++){
+        lossSquares += (tasks[f].loss - validation->meanLoss) * (tasks[f].loss - validation->meanLoss);
+        accuracySquares += (tasks[f].accuracy - validation->meanAccuracy) * (tasks[f].accuracy - validation->meanAccuracy);
+    }
+    validation->deviationLoss = sqrt(lossSquares / numFolds);
+    validation->deviationAccuracy = sqrt(accuracySquares / numFolds);
+    free(tasks);
+    validation->seconds = monotonicSeconds() - start;
+    if (params.verbose){
+        printf("%d-FOLD: loss %f +- %f, accuracy %f +- %f\n", numFolds, validation->meanLoss, validation->deviationLoss, validation->meanAccuracy, validation->deviationAccuracy);
+    }
+    return validation;
+}
+
+void destroyCrossValidation(CrossValidation* validation){
+    free(validation->loss);
+    free(validation->accuracy);
+    free(validation);
+}
+
+void destroySearchResult(SearchResult* result){
+    size_t t;
+    for (t = 0; t < result->numTrials; t++){
+        if (result->trials[t].network != NULL){
+            destroyNetwork(result->trials[t].network);
+        }
+    }
+    free(result->trials);
+    free(result->templateHiddenSizes);
+    free(result);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+
+#ifndef SERVING_H
+#define SERVING_H
+
+// reader slots share no cache line, so readers never contend
+#define SERVING_CACHE_LINE 64
+
+// epoch a reader is inside, or 0 when it holds no network
+typedef struct ReaderSlot_ {
+    uint64_t epoch;
+    char padding[SERVING_CACHE_LINE - sizeof(uint64_t)];
+} ReaderSlot;
+
+// a network replaced by a newer one, waiting until no reader can hold it
+typedef struct RetiredNetwork_ {
+    Network* network;
+    uint64_t epoch;
+    struct RetiredNetwork_* next;
+} RetiredNetwork;
+
+// loads a network from a file, such as readNetwork, readNetworkBinary or mapNetwork
+typedef Network* (*NetworkLoader)(const char* path);
+
+// serves one network to many reader threads while it is replaced
+// readers publish the epoch they entered in their own slot and read the
+// current network with atomic loads only; replaced networks are freed once
+// every reader has left the epochs in which it could have seen them
+// needs the GCC atomic builtins, and CRANIUM_USE_POSIX for loading in the background
+typedef struct ModelServer_ {
+    Network* current;
+    uint64_t epoch;
+    ReaderSlot* readers;
+    size_t maxReaders;
+    size_t numReaders;
+    RetiredNetwork* retired;
+    size_t numRetired;
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_t lock; // taken by writers only
+    pthread_t loader;
+    int loading;
+#endif
+    char* loadPath;
+    NetworkLoader loadFunction;
+    int loadStatus;
+} ModelServer;
+
+// creates a server publishing $network to at most $maxReaders reader threads
+// the server owns $network and every network later published to it
+static ModelServer* createModelServer(Network* network, size_t maxReaders);
+
+// claims a reader slot for the calling thread
+// returns the reader id, or -1 if every slot is taken
+static int registerReader(ModelServer* server);
+
+// enters a read-side section for $reader and returns the current network,
+// which stays valid until releaseNetwork; takes no lock
+static Network* acquireNetwork(ModelServer* server, int reader);
+
+// leaves the read-side section of $reader
+static void releaseNetwork(ModelServer* server, int reader);
+
+// creates a workspace for the current network of $reader that holds the
+// rows of one evaluation chunk, the size requests are best batched to
+static Workspace* createServingWorkspace(ModelServer* server, int reader);
+
+// propagates $input through the current network on behalf of $reader and
+// returns the output held in $workspace
+static Matrix* serveForwardPass(ModelServer* server, int reader, Workspace* workspace, Matrix* input);
+
+// atomically replaces the served network with $network; passes already
+// running finish on the old one, which is freed once no reader holds it
+static void publishNetwork(ModelServer* server, Network* network);
+
+// frees every replaced network that no reader can still hold
+// returns the number of networks still waiting
+static size_t reclaimNetworks(ModelServer* server);
+
+// loads the network at $path with $loader and publishes it, on a background
+// thread with CRANIUM_USE_POSIX, waiting first for any earlier reload
+static void reloadNetworkAsync(ModelServer* server, const char* path, NetworkLoader loader);
+
+// waits for the last reload to finish
+// returns 0 if it published a network, -1 if loading failed
+static int waitForReload(ModelServer* server);
+
+// waits for reloads and frees the server and every network it holds;
+// readers must have stopped
+static void destroyModelServer(ModelServer* server);
+
+
+/*
+    Begin functions.
+*/
+
+ModelServer* createModelServer(Network* network, size_t maxReaders){
+    assert(network != NULL && maxReaders > 0);
+    ModelServer* server = (ModelServer*)malloc(sizeof(ModelServer));
+    server->current = network;
+    server->epoch = 1;
+    server->readers = (ReaderSlot*)calloc(maxReaders, sizeof(ReaderSlot));
+    server->maxReaders = maxReaders;
+    server->numReaders = 0;
+    server->retired = NULL;
+    server->numRetired = 0;
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_init(&server->lock, NULL);
+    server->loading = 0;
+#endif
+    server->loadPath = NULL;
+    server->loadFunction = NULL;
+    server->loadStatus = 0;
+    return server;
+}
+
+int registerReader(ModelServer* server){
+    size_t reader = __atomic_fetch_add(&server->numReaders, 1, __ATOMIC_RELAXED);
+    if (reader >= server->maxReaders){
+        __atomic_fetch_sub(&server->numReaders, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return (int)reader;
+}
+
+// the slot is published before the network is read, and both are
+// sequentially consistent, so a writer that later sees the slot empty or in
+// a newer epoch knows this reader cannot hold what it retired
+Network* acquireNetwork(ModelServer* server, int reader){
+    uint64_t epoch = __atomic_load_n(&server->epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&server->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&server->current, __ATOMIC_SEQ_CST);
+}
+
+void releaseNetwork(ModelServer* server, int reader){
+    __atomic_store_n(&server->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+Workspace* createServingWorkspace(ModelServer* server, int reader){
+    Workspace* workspace = createWorkspace(acquireNetwork(server, reader), currentEvaluationDefaults().chunkRows);
+    releaseNetwork(server, reader);
+    return workspace;
+}
+
+Matrix* serveForwardPass(ModelServer* server, int reader, Workspace* workspace, Matrix* input){
+    Network* network = acquireNetwork(server, reader);
+    Matrix* output = forwardPassWorkspace(network, workspace, input);
+    releaseNetwork(server, reader);
+    return output;
+}
+
+// frees retired networks older than every active reader; caller holds the lock
+static size_t reclaimLocked(ModelServer* server){
+    uint64_t oldest = UINT64_MAX;
+    size_t i, numReaders = MIN(__atomic_load_n(&server->numReaders, __ATOMIC_SEQ_CST), server->maxReaders);
+    for (i = 0; i < numReaders; i++){
+        uint64_t epoch = __atomic_load_n(&server->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest){
+            oldest = epoch;
+        }
+    }
+    RetiredNetwork** link = &server->retired;
+    while (*link != NULL){
+        RetiredNetwork* entry = *link;
+        if (entry->epoch < oldest){
+            *link = entry->next;
+            destroyNetwork(entry->network);
+            free(entry);
+            server->numRetired--;
+        }
+        else{
+            link = &entry->next;
+        }
+    }
+    return server->numRetired;
+}
+
+void publishNetwork(ModelServer* server, Network* network){
+    assert(network != NULL);
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_lock(&server->lock);
+#endif
+    Network* old = __atomic_exchange_n(&server->current, network, __ATOMIC_SEQ_CST);
+
+    // readers in this epoch or earlier may hold the old network; readers
+    // entering the next one cannot
+    RetiredNetwork* entry = (RetiredNetwork*)malloc(sizeof(RetiredNetwork));
+    entry->network = old;
+    entry->epoch = __atomic_fetch_add(&server->epoch, 1, __ATOMIC_SEQ_CST);
+    entry->next = server->retired;
+    server->retired = entry;
+    server->numRetired++;
+    reclaimLocked(server);
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_unlock(&server->lock);
+#endif
+}
+
+size_t reclaimNetworks(ModelServer* server){
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_lock(&server->lock);
+#endif
+    size_t waiting = reclaimLocked(server);
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_unlock(&server->lock);
+#endif
+    return waiting;
+}
+
+static void* runReload(void* arg){
+    ModelServer* server = (ModelServer*)arg;
+    Network* network = server->loadFunction(server->loadPath);
+    if (network == NULL){
+        server->loadStatus = -1;
+        return NULL;
+    }
+    publishNetwork(server, network);
+    server->loadStatus = 0;
+    return NULL;
+}
+
+void reloadNetworkAsync(ModelServer* server, const char* path, NetworkLoader loader){
+    waitForReload(server);
+    free(server->loadPath);
+    server->loadPath = (char*)malloc(strlen(path) + 1);
+    strcpy(server->loadPath, path);
+    server->loadFunction = loader;
+#ifdef CRANIUM_USE_POSIX
+    if (pthread_create(&server->loader, NULL, runReload, server) == 0){
+        server->loading = 1;
+        return;
+    }
+#endif
+    runReload(server);
+}
+
+int waitForReload(ModelServer* server){
+#ifdef CRANIUM_USE_POSIX
+    if (server->loading){
+        pthread_join(server->loader, NULL);
+        server->loading = 0;
+    }
+#endif
+    return server->loadStatus;
+}
+
+void destroyModelServer(ModelServer* server){
+    waitForReload(server);
+    while (server->retired != NULL){
+        RetiredNetwork* entry = server->retired;
+        server->retired = entry->next;
+        destroyNetwork(entry->network);
+        free(entry);
+    }
+    destroyNetwork(server->current);
+#ifdef CRANIUM_USE_POSIX
+    pthread_mutex_destroy(&server->lock);
+#endif
+    free(server->loadPath);
+    free(server->readers);
+    free(server);
+}
+
+#endif
\ No newline at end of file
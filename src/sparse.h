@@ -0,0 +1,244 @@
+#include "std_includes.h"
+#include "matrix.h"
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+// densities above this run the dense kernels instead of the sparse ones,
+// since scattered accesses stop paying for the skipped multiplications
+#ifndef CRANIUM_SPARSE_MAX_DENSITY
+#define CRANIUM_SPARSE_MAX_DENSITY 0.3
+#endif
+
+// represents a matrix in compressed sparse row (CSR) format
+// the entries of row i are values[rowStart[i]] to values[rowStart[i + 1] - 1],
+// with columns given by the matching entries of colIndex, in increasing order
+typedef struct SparseMatrix_ {
+    size_t rows;
+    size_t cols;
+    size_t nonZero;
+    size_t* rowStart; // (rows + 1)
+    size_t* colIndex; // (nonZero)
+    float* values; // (nonZero)
+} SparseMatrix;
+
+// creates a sparse matrix holding the non-zero entries of $orig
+static SparseMatrix* createSparseMatrix(Matrix* orig);
+
+// creates a sparse matrix from CSR arrays, which it takes ownership of
+static SparseMatrix* createSparseMatrixFrom(size_t rows, size_t cols, size_t* rowStart, size_t* colIndex, float* values);
+
+// creates a sparse matrix holding the non-zero entries of $data, with one
+// row per example, to be used as sparse input to a network
+static SparseMatrix* createSparseDataSet(DataSet* data);
+
+// returns a view of $numRows rows of $sparse starting at $first, sharing
+// its storage; the view must not be destroyed
+static SparseMatrix sparseRows(SparseMatrix* sparse, size_t first, size_t numRows);
+
+// returns fraction of entries that are stored
+static float sparseDensity(SparseMatrix* sparse);
+
+// copies entries of $from at the stored positions of $to into $to, and
+// zeroes every other entry of $from
+static void refreshSparseFrom(Matrix* from, SparseMatrix* to);
+
+// converts a sparse matrix to a dense one
+static Matrix* sparseToMatrix(SparseMatrix* sparse);
+
+// multiplies $A and sparse $B (ordering: AB) and places values into $into
+static void multiplyDenseSparseInto(Matrix* A, SparseMatrix* B, Matrix* into);
+
+// multiplies sparse $A and $B (ordering: AB) and places values into $into,
+// reading only the rows of $B named by stored columns of $A
+static void multiplySparseDenseInto(SparseMatrix* A, Matrix* B, Matrix* into);
+
+// adds the transpose of sparse $A times $B to $into, writing only the rows
+// of $into named by stored columns of $A
+static void addSparseTransposeMultiply(SparseMatrix* A, Matrix* B, Matrix* into);
+
+// frees a sparse matrix and its data
+static void destroySparseMatrix(SparseMatrix* sparse);
+
+
+/*
+    Begin functions.
+*/
+
+SparseMatrix* createSparseMatrix(Matrix* orig){
+    SparseMatrix* sparse = (SparseMatrix*)malloc(sizeof(SparseMatrix));
+    sparse->rows = orig->rows;
+    sparse->cols = orig->cols;
+    size_t i, j, count = 0;
+    for (i = 0; i < orig->rows * orig->cols; i++){
+        if (orig->data[i] != 0){
+            count++;
+        }
+    }
+    sparse->nonZero = count;
+    sparse->rowStart = (size_t*)malloc(sizeof(size_t) * (orig->rows + 1));
+    sparse->colIndex = (size_t*)malloc(sizeof(size_t) * (count > 0 ? count : 1));
+    sparse->values = (float*)malloc(sizeof(float) * (count > 0 ? count : 1));
+    count = 0;
+    for (i = 0; i < orig->rows; i++){
+        sparse->rowStart[i] = count;
+        for (j = 0; j < orig->cols; j++){
+            float val = getMatrix(orig, i, j);
+            if (val != 0){
+                sparse->colIndex[count] = j;
+                sparse->values[count] = val;
+                count++;
+            }
+        }
+    }
+    sparse->rowStart[orig->rows] = count;
+    return sparse;
+}
+
+SparseMatrix* createSparseMatrixFrom(size_t rows, size_t cols, size_t* rowStart, size_t* colIndex, float* values){
+    assert(rowStart[0] == 0);
+    SparseMatrix* sparse = (SparseMatrix*)malloc(sizeof(SparseMatrix));
+    sparse->rows = rows;
+    sparse->cols = cols;
+    sparse->nonZero = rowStart[rows];
+    sparse->rowStart = rowStart;
+    sparse->colIndex = colIndex;
+    sparse->values = values;
+    return sparse;
+}
+
+SparseMatrix* createSparseDataSet(DataSet* data){
+    size_t i, j, count = 0;
+    for (i = 0; i < data->rows; i++){
+        for (j = 0; j < data->cols; j++){
+            count += data->data[i][j] != 0;
+        }
+    }
+    size_t* rowStart = (size_t*)malloc(sizeof(size_t) * (data->rows + 1));
+    size_t* colIndex = (size_t*)malloc(sizeof(size_t) * (count > 0 ? count : 1));
+    float* values = (float*)malloc(sizeof(float) * (count > 0 ? count : 1));
+    count = 0;
+    for (i = 0; i < data->rows; i++){
+        rowStart[i] = count;
+        for (j = 0; j < data->cols; j++){
+            if (data->data[i][j] != 0){
+                colIndex[count] = j;
+                values[count] = data->data[i][j];
+                count++;
+            }
+        }
+    }
+    rowStart[data->rows] = count;
+    return createSparseMatrixFrom(data->rows, data->cols, rowStart, colIndex, values);
+}
+
+// row offsets stay absolute, so the view indexes the shared arrays directly
+SparseMatrix sparseRows(SparseMatrix* sparse, size_t first, size_t numRows){
+    assert(first + numRows <= sparse->rows);
+    SparseMatrix view = *sparse;
+    view.rows = numRows;
+    view.rowStart = sparse->rowStart + first;
+    view.nonZero = view.rowStart[numRows] - view.rowStart[0];
+    return view;
+}
+
+float sparseDensity(SparseMatrix* sparse){
+    return (float)sparse->nonZero / (sparse->rows * sparse->cols);
+}
+
+void refreshSparseFrom(Matrix* from, SparseMatrix* to){
+    assert(from->rows == to->rows && from->cols == to->cols);
+    size_t i, j;
+    for (i = 0; i < from->rows; i++){
+        size_t p = to->rowStart[i];
+        for (j = 0; j < from->cols; j++){
+            if (p < to->rowStart[i + 1] && to->colIndex[p] == j){
+                to->values[p++] = getMatrix(from, i, j);
+            }
+            else{
+                setMatrix(from, i, j, 0);
+            }
+        }
+    }
+}
+
+Matrix* sparseToMatrix(SparseMatrix* sparse){
+    Matrix* dense = createMatrixZeroes(sparse->rows, sparse->cols);
+    size_t i, p;
+    for (i = 0; i < sparse->rows; i++){
+        for (p = sparse->rowStart[i]; p < sparse->rowStart[i + 1]; p++){
+            setMatrix(dense, i, sparse->colIndex[p], sparse->values[p]);
+        }
+    }
+    return dense;
+}
+
+// each input value scatters into the output row through the stored
+// entries of the matching weight row
+void multiplyDenseSparseInto(Matrix* A, SparseMatrix* B, Matrix* into){
+    assert(A->cols == B->rows);
+    assert(A->rows == into->rows && B->cols == into->cols);
+    PROFILE_BEGIN(denseSparse);
+    size_t i, k, p;
+    for (i = 0; i < A->rows; i++){
+        float* row = into->data + i * into->cols;
+        memset(row, 0, sizeof(float) * into->cols);
+        for (k = 0; k < A->cols; k++){
+            float a = getMatrix(A, i, k);
+            if (a == 0){
+                continue;
+            }
+            for (p = B->rowStart[k]; p < B->rowStart[k + 1]; p++){
+                row[B->colIndex[p]] += a * B->values[p];
+            }
+        }
+    }
+    PROFILE_END(denseSparse, "multiplyDenseSparseInto", -1, 2.0 * A->rows * (B->rowStart[B->rows] - B->rowStart[0]), 4.0 * (A->rows * A->cols + into->rows * into->cols) + 8.0 * (B->rowStart[B->rows] - B->rowStart[0]));
+}
+
+// each stored input value gathers the matching row of $B into the output row
+void multiplySparseDenseInto(SparseMatrix* A, Matrix* B, Matrix* into){
+    assert(A->cols == B->rows);
+    assert(A->rows == into->rows && B->cols == into->cols);
+    PROFILE_BEGIN(sparseDense);
+    size_t i, j, p;
+    for (i = 0; i < A->rows; i++){
+        float* row = into->data + i * into->cols;
+        memset(row, 0, sizeof(float) * into->cols);
+        for (p = A->rowStart[i]; p < A->rowStart[i + 1]; p++){
+            float a = A->values[p];
+            float* from = B->data + A->colIndex[p] * B->cols;
+            for (j = 0; j < B->cols; j++){
+                row[j] += a * from[j];
+            }
+        }
+    }
+    PROFILE_END(sparseDense, "multiplySparseDenseInto", -1, 2.0 * (A->rowStart[A->rows] - A->rowStart[0]) * B->cols, 8.0 * (A->rowStart[A->rows] - A->rowStart[0]) + 4.0 * ((A->rowStart[A->rows] - A->rowStart[0]) * B->cols + into->rows * into->cols));
+}
+
+void addSparseTransposeMultiply(SparseMatrix* A, Matrix* B, Matrix* into){
+    assert(A->rows == B->rows);
+    assert(A->cols == into->rows && B->cols == into->cols);
+    PROFILE_BEGIN(sparseTranspose);
+    size_t i, j, p;
+    for (i = 0; i < A->rows; i++){
+        float* from = B->data + i * B->cols;
+        for (p = A->rowStart[i]; p < A->rowStart[i + 1]; p++){
+            float a = A->values[p];
+            float* row = into->data + A->colIndex[p] * into->cols;
+            for (j = 0; j < B->cols; j++){
+                row[j] += a * from[j];
+            }
+        }
+    }
+    PROFILE_END(sparseTranspose, "addSparseTransposeMultiply", -1, 2.0 * (A->rowStart[A->rows] - A->rowStart[0]) * B->cols, 8.0 * (A->rowStart[A->rows] - A->rowStart[0]) + 4.0 * (B->rows * B->cols + 2 * (A->rowStart[A->rows] - A->rowStart[0]) * B->cols));
+}
+
+void destroySparseMatrix(SparseMatrix* sparse){
+    free(sparse->rowStart);
+    free(sparse->colIndex);
+    free(sparse->values);
+    free(sparse);
+}
+
+#endif
\ No newline at end of file
@@ -1,6 +1,16 @@
 #ifndef STD_INCLUDES_H
 #define STD_INCLUDES_H
 
+/* Uncomment the below line to use POSIX features (memory mapping, threads, sockets, CPU affinity) */
+// #define CRANIUM_USE_POSIX
+#if defined(CRANIUM_USE_POSIX) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+// CPU affinity is a GNU extension on Linux
+#if defined(CRANIUM_USE_POSIX) && defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <assert.h>
 #include <math.h>
 #include <float.h>
@@ -8,5 +18,40 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <locale.h>
+
+#ifdef CRANIUM_USE_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+// monotonic wall-clock nanoseconds, for timing work that may run on
+// several threads; without CRANIUM_USE_POSIX this is processor time, the
+// only clock C99 has
+static uint64_t monotonicNanoseconds(){
+#ifdef CRANIUM_USE_POSIX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    return (uint64_t)((double)clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+// the same clock in seconds
+static double monotonicSeconds(){
+    return monotonicNanoseconds() * 1e-9;
+}
 
 #endif
\ No newline at end of file
@@ -0,0 +1,487 @@
+#include "std_includes.h"
+#include "matrix.h"
+#include "function.h"
+#include "layer.h"
+#include "network.h"
+#include "optimizer.h"
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#define DATAFILE_MAGIC "CRANDATA"
+#define DATAFILE_VERSION 1
+#define DATAFILE_ENDIANNESS 0x01020304u
+
+// header at the start of a binary dataset file, followed by fixed-stride
+// rows of numFeatures floats and then either numOutputs floats or, for
+// labelled files, one int32 class label
+typedef struct DataFileHeader_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianness;
+    uint64_t rows;
+    uint64_t numFeatures;
+    uint64_t numOutputs;
+    uint32_t labels;
+    uint32_t rowSize; // bytes per row
+    uint8_t reserved[16];
+} DataFileHeader;
+
+// an open binary dataset file
+typedef struct DataFile_ {
+    DataFileHeader header;
+    FILE* fp;
+} DataFile;
+
+// appends rows to a binary dataset file
+typedef struct DataWriter_ {
+    DataFileHeader header;
+    FILE* fp;
+} DataWriter;
+
+// convenience struct for easier parameter filling
+typedef struct StreamParameterSet_ {
+    Network* network;
+    DataFile* file;
+    LOSS_FUNCTION lossFunction;
+    size_t batchSize;
+    float learningRate;
+    float searchTime;
+    float regularizationStrength;
+    float momentumFactor;
+    int numPasses;
+    size_t memoryBudget;
+    size_t windowChunks;
+    int verbose;
+} StreamParameterSet;
+
+// creates a dataset file at $path for rows of $numFeatures features and
+// $numOutputs targets; if $labels is non-zero each row stores only the
+// index of its class, and is expanded to $numOutputs one-hot targets when read
+// returns NULL if the file could not be created
+static DataWriter* createDataWriter(const char* path, size_t numFeatures, size_t numOutputs, int labels);
+
+// appends one row; for labelled files the index of the largest target is stored
+// returns 0 on success, -1 on failure
+static int writeDataRow(DataWriter* writer, const float* features, const float* targets);
+
+// appends one row with class $label to a labelled file
+// returns 0 on success, -1 on failure
+static int writeDataLabel(DataWriter* writer, const float* features, int label);
+
+// records the row count and closes the file
+// returns 0 on success, -1 on failure
+static int closeDataWriter(DataWriter* writer);
+
+// writes $data and $classes to a dataset file at $path
+// returns 0 on success, -1 on failure
+static int saveDataSetBinary(DataSet* data, DataSet* classes, const char* path, int labels);
+
+// opens a dataset file for chunked reads
+// returns NULL if the file is missing or invalid
+static DataFile* openDataFile(const char* path);
+
+// reads $count raw rows starting at $first into $buffer, which must hold
+// $count * rowSize bytes; safe to call from several threads with CRANIUM_USE_POSIX
+// returns 0 on success, -1 on failure
+static int readDataRows(DataFile* file, size_t first, size_t count, void* buffer);
+
+// returns the features of a raw row read by readDataRows
+static float* dataRowFeatures(DataFile* file, void* row);
+
+// places the targets of a raw row read by readDataRows into $targets
+// returns 0 on success, -1 if the row's class label is out of range (the
+// targets are then all zero)
+static int dataRowTargets(DataFile* file, void* row, float* targets);
+
+// closes a dataset file
+static void closeDataFile(DataFile* file);
+
+// trains $network on a dataset file too large to hold in memory
+// the file is read in chunks, a window of $windowChunks randomly chosen
+// chunks is shuffled together and trained on while the next window is read
+// ahead (on a thread with CRANIUM_USE_POSIX), and the two windows together
+// stay within $memoryBudget bytes, which must hold at least
+// $windowChunks * (2 * row size + sizeof(size_t)) bytes for a row per chunk
+// gradients are averaged over each batch of $batchSize rows, rather than over
+// the whole dataset as in batchGradientDescent
+// $numPasses is the number of times every row is visited
+// $verbose, if non-zero, will print the mean loss of every pass
+// other parameters are as in batchGradientDescent
+// returns the number of batches trained on, or -1 if the budget is too
+// small to hold a row per chunk, or if a chunk could not be read or a row
+// has an invalid label, in which case training stops there and keeps the
+// updates made so far
+static long streamingGradientDescent(Network* network, DataFile* file, LOSS_FUNCTION lossFunction, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int numPasses, size_t memoryBudget, size_t windowChunks, int verbose);
+
+// optimizes given parameters
+static long optimizeStream(StreamParameterSet params){
+    return streamingGradientDescent(params.network, params.file, params.lossFunction, params.batchSize, params.learningRate, params.searchTime, params.regularizationStrength, params.momentumFactor, params.numPasses, params.memoryBudget, params.windowChunks, params.verbose);
+}
+
+
+/*
+    Begin functions.
+*/
+
+DataWriter* createDataWriter(const char* path, size_t numFeatures, size_t numOutputs, int labels){
+    assert(numFeatures > 0 && numOutputs > 0);
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL){
+        return NULL;
+    }
+    DataWriter* writer = (DataWriter*)malloc(sizeof(DataWriter));
+    memset(&writer->header, 0, sizeof(DataFileHeader));
+    memcpy(writer->header.magic, DATAFILE_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = DATAFILE_VERSION;
+    writer->header.endianness = DATAFILE_ENDIANNESS;
+    writer->header.numFeatures = numFeatures;
+    writer->header.numOutputs = numOutputs;
+    writer->header.labels = labels != 0;
+    writer->header.rowSize = sizeof(float) * (numFeatures + (labels != 0 ? 1 : numOutputs));
+    writer->fp = fp;
+
+    // rows are counted in the header when the writer is closed
+    if (fwrite(&writer->header, sizeof(DataFileHeader), 1, fp) != 1){
+        fclose(fp);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int writeDataRow(DataWriter* writer, const float* features, const float* targets){
+    if (writer->header.labels){
+        int label = 0;
+        size_t i;
+        for (i = 1; i < writer->header.numOutputs; i++){
+            if (targets[i] > targets[label]){
+                label = i;
+            }
+        }
+        return writeDataLabel(writer, features, label);
+    }
+    if (fwrite(features, sizeof(float), writer->header.numFeatures, writer->fp) != writer->header.numFeatures
+        || fwrite(targets, sizeof(float), writer->header.numOutputs, writer->fp) != writer->header.numOutputs){
+        return -1;
+    }
+    writer->header.rows++;
+    return 0;
+}
+
+int writeDataLabel(DataWriter* writer, const float* features, int label){
+    assert(writer->header.labels && label >= 0 && label < writer->header.numOutputs);
+    int32_t stored = label;
+    if (fwrite(features, sizeof(float), writer->header.numFeatures, writer->fp) != writer->header.numFeatures
+        || fwrite(&stored, sizeof(stored), 1, writer->fp) != 1){
+        return -1;
+    }
+    writer->header.rows++;
+    return 0;
+}
+
+int closeDataWriter(DataWriter* writer){
+    int ok = fseek(writer->fp, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&writer->header, sizeof(DataFileHeader), 1, writer->fp) == 1;
+    ok = (fclose(writer->fp) == 0) && ok;
+    free(writer);
+    return ok ? 0 : -1;
+}
+
+int saveDataSetBinary(DataSet* data, DataSet* classes, const char* path, int labels){
+    assert(data->rows == classes->rows);
+    DataWriter* writer = createDataWriter(path, data->cols, classes->cols, labels);
+    if (writer == NULL){
+        return -1;
+    }
+    int ok = 1;
+    size_t i;
+    for (i = 0; i < data->rows && ok; i++){
+        ok = writeDataRow(writer, data->data[i], classes->data[i]) == 0;
+    }
+    ok = (closeDataWriter(writer) == 0) && ok;
+    return ok ? 0 : -1;
+}
+
+DataFile* openDataFile(const char* path){
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL){
+        return NULL;
+    }
+    DataFile* file = (DataFile*)malloc(sizeof(DataFile));
+    file->fp = fp;
+    DataFileHeader* header = &file->header;
+    int valid = fread(header, sizeof(DataFileHeader), 1, fp) == 1
+        && memcmp(header->magic, DATAFILE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == DATAFILE_VERSION && header->endianness == DATAFILE_ENDIANNESS
+        && header->numFeatures > 0 && header->numOutputs > 0
+        && header->rowSize == sizeof(float) * (header->numFeatures + (header->labels ? 1 : header->numOutputs));
+
+    // the file must hold every row it claims
+    valid = valid && fseek(fp, 0, SEEK_END) == 0 && ftell(fp) >= 0
+        && (uint64_t)ftell(fp) == sizeof(DataFileHeader) + header->rows * header->rowSize;
+    if (!valid){
+        closeDataFile(file);
+        return NULL;
+    }
+    return file;
+}
+
+int readDataRows(DataFile* file, size_t first, size_t count, void* buffer){
+    if (first + count > file->header.rows){
+        return -1;
+    }
+    size_t size = count * file->header.rowSize;
+    size_t offset = sizeof(DataFileHeader) + first * file->header.rowSize;
+#ifdef CRANIUM_USE_POSIX
+    // pread leaves the file position alone, so readers need no lock
+    size_t done = 0;
+    while (done < size){
+        ssize_t got = pread(fileno(file->fp), (char*)buffer + done, size - done, offset + done);
+        if (got <= 0){
+            return -1;
+        }
+        done += got;
+    }
+    return 0;
+#else
+    if (fseek(file->fp, offset, SEEK_SET) != 0){
+        return -1;
+    }
+    return fread(buffer, 1, size, file->fp) == size ? 0 : -1;
+#endif
+}
+
+float* dataRowFeatures(DataFile* file, void* row){
+    return (float*)row;
+}
+
+int dataRowTargets(DataFile* file, void* row, float* targets){
+    float* stored = (float*)row + file->header.numFeatures;
+    if (!file->header.labels){
+        memcpy(targets, stored, sizeof(float) * file->header.numOutputs);
+        return 0;
+    }
+    int32_t label;
+    memcpy(&label, stored, sizeof(label));
+    memset(targets, 0, sizeof(float) * file->header.numOutputs);
+    if (label < 0 || label >= file->header.numOutputs){
+        return -1;
+    }
+    targets[label] = 1;
+    return 0;
+}
+
+void closeDataFile(DataFile* file){
+    fclose(file->fp);
+    free(file);
+}
+
+// rows of the chunks of one window, read together
+typedef struct StreamWindow_ {
+    DataFile* file;
+    size_t* chunks;
+    size_t numChunks;
+    size_t chunkRows;
+    unsigned char* buffer;
+    size_t rows;
+    int status;
+} StreamWindow;
+
+static void* loadStreamWindow(void* arg){
+    StreamWindow* window = (StreamWindow*)arg;
+    size_t rowSize = window->file->header.rowSize, totalRows = window->file->header.rows, i;
+    window->rows = 0;
+    window->status = 0;
+    for (i = 0; i < window->numChunks; i++){
+        size_t first = window->chunks[i] * window->chunkRows;
+        size_t count = MIN(window->chunkRows, totalRows - first);
+        if (readDataRows(window->file, first, count, window->buffer + window->rows * rowSize) != 0){
+            window->status = -1;
+            return NULL;
+        }
+        window->rows += count;
+    }
+    return NULL;
+}
+
+// visits chunks in a fresh random order on every pass
+typedef struct ChunkSchedule_ {
+    size_t* order;
+    size_t numChunks;
+    size_t next;
+    int pass;
+    uint64_t random; // state of the chunk and row shuffles
+} ChunkSchedule;
+
+// fills $window with the next chunks of the current pass, or returns 0 if
+// $numPasses passes have been scheduled
+static int scheduleStreamWindow(ChunkSchedule* schedule, StreamWindow* window, size_t windowChunks, int numPasses){
+    size_t i;
+    if (schedule->next == schedule->numChunks){
+        if (schedule->pass == numPasses){
+            return 0;
+        }
+        for (i = 0; i < schedule->numChunks; i++){
+            schedule->order[i] = i;
+        }
+        for (i = 0; i + 1 < schedule->numChunks; i++){
+            size_t j = i + randomBelow(&schedule->random, schedule->numChunks - i);
+            size_t tmp = schedule->order[j];
+            schedule->order[j] = schedule->order[i];
+            schedule->order[i] = tmp;
+        }
+        schedule->next = 0;
+        schedule->pass++;
+    }
+    window->numChunks = MIN(windowChunks, schedule->numChunks - schedule->next);
+    memcpy(window->chunks, schedule->order + schedule->next, sizeof(size_t) * window->numChunks);
+    schedule->next += window->numChunks;
+    return schedule->pass;
+}
+
+long streamingGradientDescent(Network* network, DataFile* file, LOSS_FUNCTION lossFunction, size_t batchSize, float learningRate, float searchTime, float regularizationStrength, float momentumFactor, int numPasses, size_t memoryBudget, size_t windowChunks, int verbose){
+    DataFileHeader* header = &file->header;
+    assert(network->layers[0]->size == header->numFeatures);
+    assert(network->layers[network->numLayers - 1]->size == header->numOutputs);
+    assert(header->rows > 0 && batchSize >= 1 && numPasses >= 1 && windowChunks >= 1);
+
+    // two windows of raw rows plus a shuffle index per row must fit the budget
+    size_t perRow = 2 * header->rowSize + sizeof(size_t);
+    size_t chunkRows = MIN(memoryBudget / perRow / windowChunks, header->rows);
+    if (chunkRows == 0){
+        return -1;
+    }
+    size_t windowRows = chunkRows * windowChunks;
+    size_t i;
+
+    ChunkSchedule schedule;
+    schedule.numChunks = (header->rows + chunkRows - 1) / chunkRows;
+    schedule.order = (size_t*)malloc(sizeof(size_t) * schedule.numChunks);
+    schedule.next = schedule.numChunks;
+    schedule.pass = 0;
+    schedule.random = ((uint64_t)rand() << 32) ^ rand();
+    StreamWindow windows[2];
+    for (i = 0; i < 2; i++){
+        windows[i].file = file;
+        windows[i].chunks = (size_t*)malloc(sizeof(size_t) * windowChunks);
+        windows[i].chunkRows = chunkRows;
+        windows[i].buffer = (unsigned char*)malloc((size_t)header->rowSize * windowRows);
+    }
+    size_t* rowOrder = (size_t*)malloc(sizeof(size_t) * windowRows);
+
+    // train on standardized inputs, with the stats out of the weights
+    int refold = network->normalizationFolded;
+    if (refold){
+        unfoldNormalization(network);
+    }
+
+    TrainingState* state = createTrainingState(network, lossFunction);
+    Matrix* example = createMatrix(1, header->numFeatures, NULL);
+    Matrix* target = createMatrixZeroes(1, header->numOutputs);
+    size_t inBatch = 0;
+    int step = 1, failed = 0;
+    double passLoss = 0;
+    size_t passRows = 0;
+
+    int current = 0;
+    int pass = scheduleStreamWindow(&schedule, &windows[current], windowChunks, numPasses);
+    loadStreamWindow(&windows[current]);
+    while (pass != 0 && !failed){
+        if (windows[current].status != 0){
+            failed = 1;
+            break;
+        }
+        // start reading the next window while this one is trained on
+        StreamWindow* ahead = &windows[1 - current];
+        int nextPass = scheduleStreamWindow(&schedule, ahead, windowChunks, numPasses);
+#ifdef CRANIUM_USE_POSIX
+        pthread_t reader;
+        int threaded = nextPass != 0 && pthread_create(&reader, NULL, loadStreamWindow, ahead) == 0;
+#endif
+
+        // shuffle rows across the chunks of the window
+        StreamWindow* window = &windows[current];
+        for (i = 0; i < window->rows; i++){
+            rowOrder[i] = i;
+        }
+        for (i = 0; i + 1 < window->rows; i++){
+            size_t j = i + randomBelow(&schedule.random, window->rows - i);
+            size_t tmp = rowOrder[j];
+            rowOrder[j] = rowOrder[i];
+            rowOrder[i] = tmp;
+        }
+
+        for (i = 0; i < window->rows; i++){
+            void* row = window->buffer + rowOrder[i] * header->rowSize;
+            example->data = dataRowFeatures(file, row);
+            if (dataRowTargets(file, row, target->data) != 0){
+                failed = 1;
+                break;
+            }
+            accumulateGradient(state, example, target);
+            if (verbose != 0){
+                Matrix* output = getOuput(network);
+                size_t j;
+                for (j = 0; j < target->cols; j++){
+                    if (lossFunction == CROSS_ENTROPY_LOSS){
+                        passLoss -= target->data[j] * log(MAX(output->data[j], FLT_MIN));
+                    }
+                    else{
+                        passLoss += 0.5 * (output->data[j] - target->data[j]) * (output->data[j] - target->data[j]);
+                    }
+                }
+                passRows++;
+            }
+            if (++inBatch == batchSize){
+                float currentLearningRate = searchTime == 0 ? learningRate : learningRate / (1 + (step / searchTime));
+                applyGradient(state, currentLearningRate, regularizationStrength, momentumFactor, inBatch);
+                inBatch = 0;
+                step++;
+            }
+        }
+
+        // a pass ends with a partial batch rather than mixing passes
+        if (nextPass != pass && !failed){
+            if (inBatch > 0){
+                float currentLearningRate = searchTime == 0 ? learningRate : learningRate / (1 + (step / searchTime));
+                applyGradient(state, currentLearningRate, regularizationStrength, momentumFactor, inBatch);
+                inBatch = 0;
+                step++;
+            }
+            if (verbose != 0){
+                printf("PASS %d: loss is %f\n", pass, passLoss / passRows);
+                passLoss = 0;
+                passRows = 0;
+            }
+        }
+
+#ifdef CRANIUM_USE_POSIX
+        if (threaded){
+            pthread_join(reader, NULL);
+        }
+        else
+#endif
+        if (nextPass != 0 && !failed){
+            loadStreamWindow(ahead);
+        }
+        pass = nextPass;
+        current = 1 - current;
+    }
+
+    free(example);
+    destroyMatrix(target);
+    destroyTrainingState(state);
+    if (refold){
+        foldNormalization(network);
+    }
+    for (i = 0; i < 2; i++){
+        free(windows[i].chunks);
+        free(windows[i].buffer);
+    }
+    free(rowOrder);
+    free(schedule.order);
+    return failed ? -1 : step - 1;
+}
+
+#endif
\ No newline at end of file
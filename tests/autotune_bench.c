@@ -0,0 +1,65 @@
+#include "../src/cranium.h"
+
+#define CACHE "autotune_bench.tune"
+
+static double benchSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// best rows per second of $repeats evaluations of $data
+static double timeEvaluation(Network* network, DataSet* data, DataSet* classes, size_t chunkRows, int numThreads, int repeats){
+    double best = 1e30;
+    int r;
+    for (r = 0; r < repeats; r++){
+        double start = benchSeconds();
+        evaluateNetwork(network, data, classes, chunkRows, numThreads);
+        double seconds = benchSeconds() - start;
+        best = seconds < best ? seconds : best;
+    }
+    return data->rows / best;
+}
+
+// compares evaluation with the default tiles, chunk size and one thread to
+// the tuned settings, and times tuning against loading from the cache
+int main(){
+    srand(1);
+    remove(CACHE);
+    size_t rows = 20000, features = 128, outputs = 10, i, j;
+    DataSet* data = createDataSetContiguous(rows, features);
+    DataSet* classes = createDataSetContiguous(rows, outputs);
+    for (i = 0; i < rows; i++){
+        for (j = 0; j < features; j++){
+            data->data[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        classes->data[i][rand() % outputs] = 1;
+    }
+    size_t hiddenSize[] = {512, 256};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* network = createNetwork(features, 2, hiddenSize, hiddenActivation, outputs, softmax);
+    int maxThreads = 4;
+
+    double baseline = timeEvaluation(network, data, classes, EVALUATION_CHUNK_ROWS, 1, 3);
+
+    double start = benchSeconds();
+    TunedConfig tuned = tuneNetwork(network, CACHE, maxThreads, 1);
+    double tuneTime = benchSeconds() - start;
+    start = benchSeconds();
+    TunedConfig cached = tuneNetwork(network, CACHE, maxThreads, 0);
+    double loadTime = benchSeconds() - start;
+    assert(cached.chunkRows == tuned.chunkRows);
+
+    double fast = timeEvaluation(network, data, classes, tuned.chunkRows, tuned.numThreads, 3);
+    printf("settings                          rows/s\n");
+    printf("default (32x256x256, %3d rows, 1 thread)    %10.0f\n", EVALUATION_CHUNK_ROWS, baseline);
+    printf("tuned (%zux%zux%zu, %3zu rows, %d threads)    %10.0f    (%.2fx)\n", tuned.blocking.rowBlock, tuned.blocking.depthBlock, tuned.blocking.colBlock, tuned.chunkRows, tuned.numThreads, fast, fast / baseline);
+    printf("tuning took %.2f s, loading from the cache %.4f s\n", tuneTime, loadTime);
+
+    remove(CACHE);
+    destroyNetwork(network);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+
+    return 0;
+}
\ No newline at end of file
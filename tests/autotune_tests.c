@@ -0,0 +1,101 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/autotune.h"
+
+#define CACHE "autotune_test.tune"
+
+int main(){
+    srand(time(NULL));
+    remove(CACHE);
+
+    // test tuning picks one of the candidates and leaves it applied
+    size_t hiddenSize[] = {40, 24};
+    Activation hiddenActivation[] = {relu, tanH};
+    Network* network = createNetwork(16, 2, hiddenSize, hiddenActivation, 4, softmax);
+    srand(7);
+    int draw = rand();
+    srand(7);
+    TunedConfig tuned = autotuneNetwork(network, 2, 0);
+    assert(rand() == draw);
+    assert(tuned.blocking.rowBlock == 8 || tuned.blocking.rowBlock == 32 || tuned.blocking.rowBlock == 128);
+    assert(tuned.blocking.depthBlock == 64 || tuned.blocking.depthBlock == 256);
+    assert(tuned.numThreads >= 1 && tuned.numThreads <= 2);
+    assert(tuned.chunkRows >= 16 && tuned.chunkRows <= 512 && (tuned.chunkRows & (tuned.chunkRows - 1)) == 0);
+    assert(tuned.rowsPerSecond > 0);
+    assert(currentGemmBlocking().colBlock == tuned.blocking.colBlock);
+    assert(currentEvaluationDefaults().chunkRows == tuned.chunkRows && currentEvaluationDefaults().numThreads == tuned.numThreads);
+
+    // test nothing is found before anything is saved
+    TunedConfig loaded;
+    assert(loadTunedConfig(CACHE, network, &loaded) == -1);
+
+    // test a saved entry comes back, and one per shape is kept
+    assert(saveTunedConfig(CACHE, network, &tuned) == 0);
+    assert(loadTunedConfig(CACHE, network, &loaded) == 0);
+    assert(loaded.blocking.rowBlock == tuned.blocking.rowBlock && loaded.blocking.depthBlock == tuned.blocking.depthBlock);
+    assert(loaded.numThreads == tuned.numThreads && loaded.chunkRows == tuned.chunkRows);
+    size_t otherSize[] = {40};
+    Network* other = createNetwork(16, 1, otherSize, hiddenActivation, 4, softmax);
+    assert(loadTunedConfig(CACHE, other, &loaded) == -1);
+    TunedConfig handPicked = {{4, 8, 16}, 3, 48, 1000};
+    assert(saveTunedConfig(CACHE, other, &handPicked) == 0);
+    handPicked.chunkRows = 96;
+    assert(saveTunedConfig(CACHE, other, &handPicked) == 0);
+    assert(loadTunedConfig(CACHE, other, &loaded) == 0);
+    assert(loaded.blocking.colBlock == 16 && loaded.numThreads == 3 && loaded.chunkRows == 96);
+    assert(loadTunedConfig(CACHE, network, &loaded) == 0 && loaded.chunkRows == tuned.chunkRows);
+    FILE* fp = fopen(CACHE, "r");
+    char line[2048];
+    int numLines = 0;
+    while (fgets(line, sizeof(line), fp) != NULL){
+        numLines++;
+    }
+    fclose(fp);
+    assert(numLines == 4);
+
+    // test a later process takes the cached settings without tuning
+    setGemmBlocking(tuned.blocking);
+    TunedConfig cached = tuneNetwork(other, CACHE, 2, 0);
+    assert(cached.rowsPerSecond == 1000 && cached.chunkRows == 96);
+    assert(currentGemmBlocking().rowBlock == 4 && currentGemmBlocking().depthBlock == 8);
+    assert(currentEvaluationDefaults().chunkRows == 96 && currentEvaluationDefaults().numThreads == 3);
+
+    // test a cache written on another host, or not a cache at all, is ignored
+    fp = fopen(CACHE, "w");
+    fprintf(fp, "cranium-tuning %d\nhost elsewhere|some_cpu\n16-40-4@built-in 4 8 16 3 96 1000.0\n", TUNING_CACHE_VERSION);
+    fclose(fp);
+    assert(loadTunedConfig(CACHE, other, &loaded) == -1);
+    assert(saveTunedConfig(CACHE, other, &handPicked) == 0);
+    assert(loadTunedConfig(CACHE, other, &loaded) == 0);
+    fp = fopen(CACHE, "w");
+    fprintf(fp, "not a cache\n");
+    fclose(fp);
+    assert(loadTunedConfig(CACHE, other, &loaded) == -1);
+
+    // test tuning when nothing is cached stores the result
+    remove(CACHE);
+    TunedConfig fresh = tuneNetwork(network, CACHE, 1, 0);
+    assert(fresh.numThreads == 1);
+    assert(loadTunedConfig(CACHE, network, &loaded) == 0 && loaded.chunkRows == fresh.chunkRows);
+    remove(CACHE);
+
+    // test the cache path can be given by the environment
+#ifdef CRANIUM_USE_POSIX
+    char path[1024];
+    setenv("CRANIUM_TUNING_CACHE", "/tmp/cranium-given.tune", 1);
+    tuningCachePath(path, sizeof(path));
+    assert(strcmp(path, "/tmp/cranium-given.tune") == 0);
+    unsetenv("CRANIUM_TUNING_CACHE");
+    tuningCachePath(path, sizeof(path));
+    assert(strstr(path, "cranium-") != NULL && strstr(path, ".tune") != NULL);
+#endif
+
+    setGemmBlocking((GemmBlocking){32, 256, 256});
+    destroyNetwork(network);
+    destroyNetwork(other);
+
+    return 0;
+}
\ No newline at end of file
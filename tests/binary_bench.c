@@ -0,0 +1,44 @@
+#include "../src/cranium.h"
+
+// compares load time and file size of the text and binary formats
+static double seconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static long fileSize(const char* path){
+    struct stat info;
+    return stat(path, &info) == 0 ? (long)info.st_size : -1;
+}
+
+int main(){
+    srand(1);
+    size_t hiddenSize[] = {1024, 1024};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* network = createNetwork(2048, 2, hiddenSize, hiddenActivation, 1000, softmax);
+    saveNetwork(network, "bench_network.txt");
+    saveNetworkBinary(network, "bench_network.bin");
+
+    double start = seconds();
+    Network* text = readNetwork("bench_network.txt");
+    double textTime = seconds() - start;
+    start = seconds();
+    Network* binary = readNetworkBinary("bench_network.bin");
+    double binaryTime = seconds() - start;
+    start = seconds();
+    Network* mapped = mapNetwork("bench_network.bin");
+    double mapTime = seconds() - start;
+
+    printf("text:   %10ld bytes, loaded in %f s\n", fileSize("bench_network.txt"), textTime);
+    printf("binary: %10ld bytes, loaded in %f s\n", fileSize("bench_network.bin"), binaryTime);
+    printf("mapped: %10ld bytes, loaded in %f s\n", fileSize("bench_network.bin"), mapTime);
+
+    destroyNetwork(network);
+    destroyNetwork(text);
+    destroyNetwork(binary);
+    destroyNetwork(mapped);
+    remove("bench_network.txt");
+    remove("bench_network.bin");
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stddef.h>
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/binary.h"
+
+// overwrites $size bytes at $offset of a copy of network.bin and fixes the
+// header checksum, so only the validation of the edited field can reject it
+static void writeEditedBinary(size_t offset, uint64_t value, size_t size){
+    FILE* fp = fopen("network.bin", "rb");
+    fseek(fp, 0, SEEK_END);
+    long fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char* file = (unsigned char*)malloc(fileSize);
+    assert(fread(file, 1, fileSize, fp) == fileSize);
+    fclose(fp);
+    memcpy(file + offset, &value, size);
+    BinaryHeader header;
+    memcpy(&header, file, sizeof(header));
+    header.headerChecksum = checksumHeader(&header, file + sizeof(header));
+    memcpy(file, &header, sizeof(header));
+    fp = fopen("edited.bin", "wb");
+    fwrite(file, 1, fileSize, fp);
+    fclose(fp);
+    free(file);
+}
+
+int main(){
+    // test layout of the on-disk records
+    assert(sizeof(BinaryHeader) == 64);
+    assert(sizeof(BinaryLayer) == 32);
+    assert(sizeof(BinaryConnection) == 48);
+
+    // test round trip through the binary format
+    srand(time(NULL));
+    size_t hiddenSize[] = {7, 3};
+    Activation hiddenActivations[] = {relu, tanH};
+    Network* network = createNetwork(5, 2, hiddenSize, hiddenActivations, 4, softmax);
+    setConnectionPrecision(network->connections[2], FLOAT16);
+    assert(saveNetworkBinary(network, "network.bin") == 0);
+    Network* fromFile = readNetworkBinary("network.bin");
+    assert(fromFile != NULL);
+    assert(fromFile->numLayers == 4);
+    assert(fromFile->layers[2]->size == 3 && fromFile->layers[2]->activation == tanH);
+    assert(fromFile->layers[3]->activation == softmax);
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        assert(equals(network->connections[i]->weights, fromFile->connections[i]->weights));
+        assert(equals(network->connections[i]->bias, fromFile->connections[i]->bias));
+    }
+    assert(fromFile->connections[2]->precision == FLOAT16);
+    assert(fromFile->mapping == NULL && isNetworkFlat(fromFile));
+
+    // test mapping points the weights into the file
+    Network* mapped = mapNetwork("network.bin");
+    assert(mapped != NULL);
+    assert(mapped->mapping != NULL && mapped->parameters == NULL);
+    for (i = 0; i < network->numConnections; i++){
+        assert(mapped->connections[i]->external == 1);
+        assert((size_t)mapped->connections[i]->weights->data % BINARY_ALIGNMENT == 0);
+        assert(equals(network->connections[i]->weights, mapped->connections[i]->weights));
+        assert(equals(network->connections[i]->bias, mapped->connections[i]->bias));
+    }
+    Matrix* input = createMatrixZeroes(2, 5);
+    for (i = 0; i < 10; i++){
+        input->data[i] = i / 3.0;
+    }
+    forwardPass(network, input);
+    forwardPass(mapped, input);
+    assert(equals(getOuput(network), getOuput(mapped)));
+
+    // test writing to mapped weights does not change the file
+    mapped->connections[0]->weights->data[0] += 1;
+    Network* again = mapNetwork("network.bin");
+    assert(again->connections[0]->weights->data[0] == network->connections[0]->weights->data[0]);
+
+    // test corrupted files are rejected
+    FILE* fp = fopen("network.bin", "r+b");
+    fseek(fp, 70, SEEK_SET);
+    fputc(0x7f, fp);
+    fclose(fp);
+    assert(readNetworkBinary("network.bin") == NULL);
+    assert(mapNetwork("network.bin") == NULL);
+    assert(readNetworkBinary("missing.bin") == NULL);
+    saveNetworkBinary(network, "network.bin");
+    fp = fopen("network.bin", "r+b");
+    fseek(fp, -2, SEEK_END);
+    fputc(0x7f, fp);
+    fclose(fp);
+    assert(readNetworkBinary("network.bin") == NULL);
+
+    // test out-of-range header and record fields are rejected even with a
+    // valid checksum, including ones whose sizes or offsets overflow
+    saveNetworkBinary(network, "network.bin");
+    size_t records = sizeof(BinaryHeader) + sizeof(BinaryLayer) * 4;
+    struct { size_t offset; uint64_t value; size_t size; } edits[] = {
+        {offsetof(BinaryHeader, numLayers), (uint64_t)1 << 62, 8},
+        {offsetof(BinaryHeader, dataSize), UINT64_MAX, 8},
+        {offsetof(BinaryHeader, dataOffset), UINT64_MAX & ~(uint64_t)(BINARY_ALIGNMENT - 1), 8},
+        {sizeof(BinaryHeader) + sizeof(BinaryLayer), (uint64_t)1 << 62, 8},
+        {sizeof(BinaryHeader) + sizeof(BinaryLayer), 0, 8},
+        {records + offsetof(BinaryConnection, precision), 7, 4},
+        {records + offsetof(BinaryConnection, flags), 8, 4},
+        {records + offsetof(BinaryConnection, flags), BINARY_FACTORIZED, 4},
+        {records + offsetof(BinaryConnection, weightsOffset), UINT64_MAX & ~(uint64_t)(BINARY_ALIGNMENT - 1), 8},
+        {records + offsetof(BinaryConnection, biasOffset), 3 * BINARY_ALIGNMENT / 2, 8}
+    };
+    for (i = 0; i < sizeof(edits) / sizeof(edits[0]); i++){
+        writeEditedBinary(edits[i].offset, edits[i].value, edits[i].size);
+        assert(readNetworkBinary("edited.bin") == NULL);
+        assert(mapNetwork("edited.bin") == NULL);
+    }
+    writeEditedBinary(records + offsetof(BinaryConnection, precision), BFLOAT16, 4);
+    Network* edited = readNetworkBinary("edited.bin");
+    assert(edited != NULL && edited->connections[0]->precision == BFLOAT16);
+
+    // test destroy
+    destroyMatrix(input);
+    destroyNetwork(network);
+    destroyNetwork(fromFile);
+    destroyNetwork(mapped);
+    destroyNetwork(again);
+    destroyNetwork(edited);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "../src/cranium.h"
+
+static double benchSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// best seconds of $repeats products of $A and $B into $into
+static double timeProduct(Matrix* A, Matrix* B, Matrix* into, int repeats){
+    double best = 1e30;
+    int r;
+    for (r = 0; r < repeats; r++){
+        double start = benchSeconds();
+        multiplyInto(A, B, into);
+        double seconds = benchSeconds() - start;
+        best = seconds < best ? seconds : best;
+    }
+    return best;
+}
+
+// times the same products and training run on the built-in kernels and on
+// each BLAS library that loads, one after another in one process
+int main(){
+    srand(1);
+    const char* libraries[] = {NULL, "libopenblas.so.0", "libblis.so.4", "libmkl_rt.so.2", "libmkl_rt.so", "libblas.so.3", "/System/Library/Frameworks/Accelerate.framework/Accelerate"};
+    size_t sizes[] = {64, 256, 512};
+    Matrix* square[3][3];
+    int s, m, l;
+    size_t i;
+    for (s = 0; s < 3; s++){
+        for (m = 0; m < 3; m++){
+            square[s][m] = createMatrixZeroes(sizes[s], sizes[s]);
+            for (i = 0; i < sizes[s] * sizes[s]; i++){
+                square[s][m]->data[i] = (float)rand() / RAND_MAX - .5;
+            }
+        }
+    }
+    Matrix* row = createMatrixZeroes(1, 512);
+    Matrix* rowProduct = createMatrixZeroes(1, 512);
+
+    size_t rows = 2000, features = 64, outputs = 10;
+    DataSet* data = createDataSetContiguous(rows, features);
+    DataSet* classes = createDataSetContiguous(rows, outputs);
+    for (i = 0; i < rows; i++){
+        size_t j;
+        for (j = 0; j < features; j++){
+            data->data[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        classes->data[i][rand() % outputs] = 1;
+    }
+    size_t hiddenSize[] = {256, 256};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* initial = createNetwork(features, 2, hiddenSize, hiddenActivation, outputs, softmax);
+    Network* network = createNetwork(features, 2, hiddenSize, hiddenActivation, outputs, softmax);
+
+    printf("backend                    gemm 64 GFLOP/s    gemm 256 GFLOP/s    gemm 512 GFLOP/s    1x512 row (us)    train batch 100 (s)\n");
+    for (l = 0; l < sizeof(libraries) / sizeof(libraries[0]); l++){
+        if (libraries[l] == NULL){
+            useBuiltinBlas();
+        }
+        else if (loadBlasBackend(libraries[l]) != 0){
+            continue;
+        }
+        double gflops[3];
+        for (s = 0; s < 3; s++){
+            double seconds = timeProduct(square[s][0], square[s][1], square[s][2], sizes[s] >= 512 ? 2 : 5);
+            gflops[s] = 2.0 * sizes[s] * sizes[s] * sizes[s] / seconds * 1e-9;
+        }
+        double rowSeconds = timeProduct(row, square[2][0], rowProduct, 50);
+
+        copyNetworkParameters(initial, network);
+        double start = benchSeconds();
+        batchGradientDescent(network, data, classes, CROSS_ENTROPY_LOSS, 100, .01, 0, 0, .9, 20, 0, 0);
+        double trainSeconds = benchSeconds() - start;
+        printf("%-26.26s %16.2f %19.2f %19.2f %17.1f %22.3f\n", currentBlasBackend()->name, gflops[0], gflops[1], gflops[2], rowSeconds * 1e6, trainSeconds);
+    }
+    useBuiltinBlas();
+
+    for (s = 0; s < 3; s++){
+        for (m = 0; m < 3; m++){
+            destroyMatrix(square[s][m]);
+        }
+    }
+    destroyMatrix(row);
+    destroyMatrix(rowProduct);
+    destroyNetwork(initial);
+    destroyNetwork(network);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+
+static int gemmCalls, gemvCalls, axpyCalls, scalCalls;
+
+// straightforward row-major CBLAS entries, counting their calls
+static void countingSgemm(int order, int transA, int transB, int m, int n, int k, float alpha, const float* A, int lda, const float* B, int ldb, float beta, float* C, int ldc){
+    assert(order == CRANIUM_BLAS_ROW_MAJOR);
+    int i, j, l;
+    for (i = 0; i < m; i++){
+        for (j = 0; j < n; j++){
+            float sum = 0;
+            for (l = 0; l < k; l++){
+                float a = transA == CRANIUM_BLAS_TRANS ? A[l * lda + i] : A[i * lda + l];
+                float b = transB == CRANIUM_BLAS_TRANS ? B[j * ldb + l] : B[l * ldb + j];
+                sum += a * b;
+            }
+            C[i * ldc + j] = alpha * sum + (beta != 0 ? beta * C[i * ldc + j] : 0);
+        }
+    }
+    gemmCalls++;
+}
+
+static void countingSgemv(int order, int trans, int m, int n, float alpha, const float* A, int lda, const float* x, int incx, float beta, float* y, int incy){
+    assert(order == CRANIUM_BLAS_ROW_MAJOR && incx == 1 && incy == 1);
+    int i, j;
+    int outputs = trans == CRANIUM_BLAS_TRANS ? n : m, inputs = trans == CRANIUM_BLAS_TRANS ? m : n;
+    for (i = 0; i < outputs; i++){
+        float sum = 0;
+        for (j = 0; j < inputs; j++){
+            sum += (trans == CRANIUM_BLAS_TRANS ? A[j * lda + i] : A[i * lda + j]) * x[j];
+        }
+        y[i] = alpha * sum + (beta != 0 ? beta * y[i] : 0);
+    }
+    gemvCalls++;
+}
+
+static void countingSaxpy(int n, float alpha, const float* x, int incx, float* y, int incy){
+    int i;
+    for (i = 0; i < n; i++){
+        y[i * incy] += alpha * x[i * incx];
+    }
+    axpyCalls++;
+}
+
+static void countingSscal(int n, float alpha, float* x, int incx){
+    int i;
+    for (i = 0; i < n; i++){
+        x[i * incx] *= alpha;
+    }
+    scalCalls++;
+}
+
+static Matrix* randomMatrix(size_t rows, size_t cols){
+    Matrix* matrix = createMatrixZeroes(rows, cols);
+    size_t i;
+    for (i = 0; i < rows * cols; i++){
+        matrix->data[i] = 2.0 * rand() / RAND_MAX - 1;
+    }
+    return matrix;
+}
+
+static void assertClose(Matrix* A, Matrix* B){
+    assert(A->rows == B->rows && A->cols == B->cols);
+    size_t i;
+    for (i = 0; i < A->rows * A->cols; i++){
+        assert(fabsf(A->data[i] - B->data[i]) < 1e-4);
+    }
+}
+
+// runs every operation that can go to a backend, placing the results in
+// $results
+static void runOperations(Matrix* A, Matrix* B, Matrix* C, Matrix* row, Matrix** results){
+    results[0] = multiply(A, B);
+    results[1] = createMatrixZeroes(1, B->cols);
+    multiplyInto(row, B, results[1]);
+    results[2] = createMatrixZeroes(A->rows, C->rows);
+    multiplyTransposedInto(A, C, results[2]);
+    results[3] = createMatrixZeroes(1, C->rows);
+    multiplyTransposedInto(row, C, results[3]);
+    results[4] = createMatrixZeroes(A->cols, A->cols);
+    addTo(results[0], results[0]);
+    addTransposeMultiply(A, A, results[4]);
+    addTransposeMultiply(A, A, results[4]);
+    scalarMultiply(results[4], -.5);
+}
+
+// checks the current backend gives the $expected results of the built-in
+// kernels
+static void checkAgainst(Matrix** expected, Matrix* A, Matrix* B, Matrix* C, Matrix* row){
+    Matrix* results[5];
+    runOperations(A, B, C, row, results);
+    int i;
+    for (i = 0; i < 5; i++){
+        assertClose(expected[i], results[i]);
+        destroyMatrix(results[i]);
+    }
+}
+
+int main(){
+    srand(time(NULL));
+    int i;
+
+    // test matrices start on the built-in kernels
+    const BlasBackend* backend = currentBlasBackend();
+    assert(strcmp(backend->name, "built-in") == 0 && backend->library == NULL);
+    assert(backend->sgemm == NULL && backend->sgemv == NULL && backend->saxpy == NULL && backend->sscal == NULL);
+
+    Matrix* A = randomMatrix(7, 5);
+    Matrix* B = randomMatrix(5, 9);
+    Matrix* C = randomMatrix(4, 5);
+    Matrix* row = randomMatrix(1, 5);
+    Matrix* expected[5];
+    runOperations(A, B, C, row, expected);
+
+    // test a full backend takes every operation
+    BlasBackend counting = {"counting", NULL, countingSgemm, countingSgemv, countingSaxpy, countingSscal};
+    setBlasBackend(counting);
+    assert(strcmp(currentBlasBackend()->name, "counting") == 0);
+    checkAgainst(expected, A, B, C, row);
+    assert(gemmCalls == 4 && gemvCalls == 2 && axpyCalls == 1 && scalCalls == 1);
+
+    // test missing entries fall back to the built-in kernels
+    BlasBackend gemmOnly = {"gemm only", NULL, countingSgemm, NULL, NULL, NULL};
+    setBlasBackend(gemmOnly);
+    gemmCalls = gemvCalls = axpyCalls = scalCalls = 0;
+    checkAgainst(expected, A, B, C, row);
+    assert(gemmCalls == 6 && gemvCalls == 0 && axpyCalls == 0 && scalCalls == 0);
+
+    // test empty products stay with the built-in kernels
+    Matrix* empty = createMatrixZeroes(1, 5);
+    Matrix* emptyProduct = createMatrixZeroes(1, 9);
+    empty->rows = 0;
+    emptyProduct->rows = 0;
+    Matrix* square = createMatrixZeroes(5, 5);
+    gemmCalls = 0;
+    multiplyInto(empty, B, emptyProduct);
+    addTransposeMultiply(empty, empty, square);
+    assert(gemmCalls == 0);
+    for (i = 0; i < 25; i++){
+        assert(square->data[i] == 0);
+    }
+
+    // test vectors longer than an int stay with the built-in loops
+    assert(blasFitsVector(46340, 46340) && !blasFitsVector(46341, 46341));
+    assert(!blasFitsVector((size_t)1 << 31, 1) && !blasFitsVector(65536, 65536));
+
+    // test a library that is not there leaves the backend alone
+    assert(loadBlasBackend("libcranium-no-such-blas.so") == -1);
+    assert(strcmp(currentBlasBackend()->name, "gemm only") == 0);
+
+#ifdef CRANIUM_USE_POSIX
+    // test whatever BLAS is installed gives the same results, and trains
+    // the same network as the built-in kernels
+    if (loadBlasBackend(NULL) == 0){
+        backend = currentBlasBackend();
+        assert(backend->library != NULL && backend->sgemm != NULL);
+        printf("loaded %s\n", backend->name);
+        checkAgainst(expected, A, B, C, row);
+
+        float** points = (float**)malloc(sizeof(float*) * 100);
+        float** labels = (float**)malloc(sizeof(float*) * 100);
+        for (i = 0; i < 100; i++){
+            points[i] = (float*)malloc(sizeof(float) * 2);
+            labels[i] = (float*)calloc(2, sizeof(float));
+            points[i][0] = 2.0 * rand() / RAND_MAX - 1;
+            points[i][1] = 2.0 * rand() / RAND_MAX - 1;
+            labels[i][points[i][0] * points[i][1] > 0] = 1;
+        }
+        DataSet* data = createDataSet(100, 2, points);
+        DataSet* classes = createDataSet(100, 2, labels);
+        size_t hiddenSize[] = {8};
+        Activation hiddenActivation[] = {tanH};
+        Network* withLibrary = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+        Network* builtin = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+        copyNetworkParameters(withLibrary, builtin);
+        batchGradientDescent(withLibrary, data, classes, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .9, 30, 0, 0);
+        useBuiltinBlas();
+        batchGradientDescent(builtin, data, classes, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .9, 30, 0, 0);
+        for (i = 0; i < builtin->numParameters; i++){
+            assert(fabsf(builtin->parameters[i] - withLibrary->parameters[i]) < 1e-3);
+        }
+        destroyNetwork(withLibrary);
+        destroyNetwork(builtin);
+        destroyDataSet(data);
+        destroyDataSet(classes);
+    }
+    else{
+        printf("no BLAS library found\n");
+    }
+#endif
+
+    // test going back to the built-in kernels
+    useBuiltinBlas();
+    backend = currentBlasBackend();
+    assert(strcmp(backend->name, "built-in") == 0 && backend->library == NULL && backend->sgemm == NULL);
+    checkAgainst(expected, A, B, C, row);
+
+    for (i = 0; i < 5; i++){
+        destroyMatrix(expected[i]);
+    }
+    destroyMatrix(A);
+    destroyMatrix(B);
+    destroyMatrix(C);
+    destroyMatrix(row);
+    destroyMatrix(empty);
+    destroyMatrix(emptyProduct);
+    destroyMatrix(square);
+
+    return 0;
+}
\ No newline at end of file
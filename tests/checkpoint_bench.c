@@ -0,0 +1,42 @@
+#include "../src/cranium.h"
+
+// compares how long training stalls for a text save, a synchronous
+// checkpoint and an asynchronous one
+static double seconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int main(){
+    srand(1);
+    size_t hiddenSize[] = {1024, 1024};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* network = createNetwork(2048, 2, hiddenSize, hiddenActivation, 1000, softmax);
+    TrainingState* state = createTrainingState(network, CROSS_ENTROPY_LOSS);
+
+    double start = seconds();
+    saveNetwork(network, "bench_network.txt");
+    printf("saveNetwork:           %f s\n", seconds() - start);
+    start = seconds();
+    saveCheckpoint(state, "bench.ckpt");
+    printf("saveCheckpoint:        %f s\n", seconds() - start);
+
+    enableCheckpoints(state, "bench.ckpt", 1);
+    double stall = 0;
+    int i;
+    for (i = 0; i < 5; i++){
+        start = seconds();
+        state->stepCallback(state, state->stepContext);
+        stall += seconds() - start;
+        state->epoch++;
+    }
+    printf("asynchronous snapshot: %f s\n", stall / 5);
+    disableCheckpoints(state);
+
+    destroyTrainingState(state);
+    destroyNetwork(network);
+    remove("bench_network.txt");
+    remove("bench.ckpt");
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/binary.h"
+#include "../src/optimizer.h"
+#include "../src/checkpoint.h"
+#include "../src/lowrank.h"
+
+static int sameWeights(Network* A, Network* B){
+    int i;
+    for (i = 0; i < A->numConnections; i++){
+        if (!equals(A->connections[i]->weights, B->connections[i]->weights) || !equals(A->connections[i]->bias, B->connections[i]->bias)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(){
+    srand(time(NULL));
+    assert(sizeof(CheckpointHeader) == 64);
+
+    // test the generator is reproducible and in range
+    uint64_t first = 42, second = 42;
+    int i;
+    for (i = 0; i < 1000; i++){
+        assert(randomBits(&first) == randomBits(&second));
+        assert(randomBelow(&first, 7) < 7);
+        randomBelow(&second, 7);
+    }
+
+    // random regression data
+    size_t rows = 50;
+    float** data = (float**)malloc(sizeof(float*) * rows);
+    float** classes = (float**)malloc(sizeof(float*) * rows);
+    for (i = 0; i < rows; i++){
+        data[i] = (float*)malloc(sizeof(float) * 3);
+        classes[i] = (float*)malloc(sizeof(float) * 2);
+        data[i][0] = box_muller();
+        data[i][1] = box_muller();
+        data[i][2] = box_muller();
+        classes[i][0] = data[i][0] - data[i][1];
+        classes[i][1] = data[i][2] * .5;
+    }
+    DataSet* dataSet = createDataSet(rows, 3, data);
+    DataSet* classSet = createDataSet(rows, 2, classes);
+    size_t hiddenSize[] = {6};
+    Activation hiddenActivation[] = {tanH};
+    Network* initial = createNetwork(3, 1, hiddenSize, hiddenActivation, 2, linear);
+    assert(saveNetworkBinary(initial, "initial.bin") == 0);
+
+    // uninterrupted run
+    Network* straight = readNetworkBinary("initial.bin");
+    TrainingState* state = createTrainingState(straight, MEAN_SQUARED_ERROR);
+    state->random = 12345;
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 30, 1, 0);
+    assert(state->epoch == 31);
+    destroyTrainingState(state);
+
+    // run stopped after 15 steps, with the last checkpoint at step 10
+    Network* stopped = readNetworkBinary("initial.bin");
+    state = createTrainingState(stopped, MEAN_SQUARED_ERROR);
+    state->random = 12345;
+    enableCheckpoints(state, "training.ckpt", 10);
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 15, 1, 0);
+    assert(disableCheckpoints(state) == 0);
+    destroyTrainingState(state);
+
+    // test resuming from the checkpoint reproduces the uninterrupted run
+    Network* resumed = readNetworkBinary("initial.bin");
+    state = createTrainingState(resumed, MEAN_SQUARED_ERROR);
+    assert(loadCheckpoint(state, "training.ckpt") == 0);
+    assert(state->epoch == 11 && state->numRows == rows);
+    assert(!sameWeights(resumed, initial));
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 30, 1, 0);
+    assert(sameWeights(resumed, straight));
+    destroyTrainingState(state);
+
+    // test a factorized connection resumes with its factors and their momentum
+    Network* factorStraight = readNetworkBinary("initial.bin");
+    factorizeConnection(factorStraight->connections[0], 2);
+    state = createTrainingState(factorStraight, MEAN_SQUARED_ERROR);
+    state->random = 12345;
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 30, 1, 0);
+    destroyTrainingState(state);
+    Network* factorResumed = readNetworkBinary("initial.bin");
+    factorizeConnection(factorResumed->connections[0], 2);
+    state = createTrainingState(factorResumed, MEAN_SQUARED_ERROR);
+    state->random = 12345;
+    enableCheckpoints(state, "factorized.ckpt", 10);
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 15, 1, 0);
+    assert(disableCheckpoints(state) == 0);
+    destroyTrainingState(state);
+    state = createTrainingState(factorResumed, MEAN_SQUARED_ERROR);
+    assert(loadCheckpoint(state, "factorized.ckpt") == 0);
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 30, 1, 0);
+    assert(sameWeights(factorResumed, factorStraight));
+    assert(equals(factorResumed->connections[0]->factorU, factorStraight->connections[0]->factorU));
+    destroyTrainingState(state);
+    state = createTrainingState(straight, MEAN_SQUARED_ERROR);
+    assert(loadCheckpoint(state, "factorized.ckpt") != 0);
+    destroyTrainingState(state);
+
+    // test a network with folded input stats resumes exactly, whether the
+    // network it resumes into is folded or not, and ends folded
+    Network* foldStraight = readNetworkBinary("initial.bin");
+    computeNormalization(foldStraight, dataSet);
+    foldNormalization(foldStraight);
+    state = createTrainingState(foldStraight, MEAN_SQUARED_ERROR);
+    state->random = 12345;
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 30, 1, 0);
+    destroyTrainingState(state);
+    assert(foldStraight->normalizationFolded);
+    Network* foldResumed = readNetworkBinary("initial.bin");
+    computeNormalization(foldResumed, dataSet);
+    foldNormalization(foldResumed);
+    state = createTrainingState(foldResumed, MEAN_SQUARED_ERROR);
+    state->random = 12345;
+    enableCheckpoints(state, "folded.ckpt", 10);
+    trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 15, 1, 0);
+    assert(disableCheckpoints(state) == 0);
+    destroyTrainingState(state);
+    assert(foldResumed->normalizationFolded);
+    int folded;
+    for (folded = 0; folded < 2; folded++){
+        Network* target = readNetworkBinary("initial.bin");
+        computeNormalization(target, dataSet);
+        if (folded){
+            foldNormalization(target);
+        }
+        state = createTrainingState(target, MEAN_SQUARED_ERROR);
+        assert(loadCheckpoint(state, "folded.ckpt") == 0);
+        trainGradientDescent(state, dataSet, classSet, 8, .05, 20, .001, .9, 30, 1, 0);
+        destroyTrainingState(state);
+        assert(target->normalizationFolded && sameWeights(target, foldStraight));
+        destroyNetwork(target);
+    }
+
+    // test a checkpoint of a folded network restores it folded, and is
+    // rejected by a network without stats
+    state = createTrainingState(foldStraight, MEAN_SQUARED_ERROR);
+    assert(saveCheckpoint(state, "folded.ckpt") == 0);
+    destroyTrainingState(state);
+    state = createTrainingState(foldResumed, MEAN_SQUARED_ERROR);
+    assert(loadCheckpoint(state, "folded.ckpt") == 0);
+    destroyTrainingState(state);
+    assert(foldResumed->normalizationFolded);
+    for (i = 0; i < 3 * 6; i++){
+        assert(fabsf(foldResumed->connections[0]->weights->data[i] - foldStraight->connections[0]->weights->data[i]) < 1e-4);
+    }
+    state = createTrainingState(straight, MEAN_SQUARED_ERROR);
+    assert(loadCheckpoint(state, "folded.ckpt") == -1);
+    destroyTrainingState(state);
+
+    // test the caller's rows are not reordered
+    for (i = 0; i < rows; i++){
+        assert(dataSet->data[i] == data[i]);
+    }
+
+    // test a rerun of a finished job only restores its result
+    ParameterSet params = {resumed, dataSet, classSet, MEAN_SQUARED_ERROR, 8, .05, 20, .001, .9, 30, 1, 0};
+    assert(optimizeWithCheckpoints(params, "finished.ckpt", 7) == 0);
+    Network* finished = readNetworkBinary("initial.bin");
+    params.network = finished;
+    assert(optimizeWithCheckpoints(params, "finished.ckpt", 7) == 0);
+    assert(sameWeights(finished, resumed));
+
+    // test corrupt checkpoints and other shapes are rejected
+    FILE* fp = fopen("training.ckpt", "r+b");
+    fseek(fp, -3, SEEK_END);
+    int byte = fgetc(fp);
+    fseek(fp, -3, SEEK_END);
+    fputc(byte ^ 1, fp);
+    fclose(fp);
+    state = createTrainingState(initial, MEAN_SQUARED_ERROR);
+    assert(loadCheckpoint(state, "training.ckpt") == -1);
+    assert(loadCheckpoint(state, "missing.ckpt") == 1);
+    destroyTrainingState(state);
+
+    // test a job refuses to start from, or overwrite, an invalid checkpoint
+    fp = fopen("training.ckpt", "rb");
+    fseek(fp, 0, SEEK_END);
+    long corruptSize = ftell(fp);
+    fclose(fp);
+    Network* refused = readNetworkBinary("initial.bin");
+    params.network = refused;
+    assert(optimizeWithCheckpoints(params, "training.ckpt", 7) == -1);
+    assert(sameWeights(refused, initial));
+    fp = fopen("training.ckpt", "rb");
+    fseek(fp, 0, SEEK_END);
+    assert(ftell(fp) == corruptSize);
+    fseek(fp, -3, SEEK_END);
+    assert(fgetc(fp) == (byte ^ 1));
+    fclose(fp);
+    fp = fopen("truncated.ckpt", "wb");
+    fwrite("CRANCKPT", 1, 8, fp);
+    fclose(fp);
+    assert(optimizeWithCheckpoints(params, "truncated.ckpt", 7) == -1);
+    assert(sameWeights(refused, initial));
+    size_t otherSize[] = {5};
+    Network* other = createNetwork(3, 1, otherSize, hiddenActivation, 2, linear);
+    state = createTrainingState(other, MEAN_SQUARED_ERROR);
+    assert(loadCheckpoint(state, "finished.ckpt") == -1);
+    destroyTrainingState(state);
+
+    // test destroy
+    destroyNetwork(initial);
+    destroyNetwork(straight);
+    destroyNetwork(stopped);
+    destroyNetwork(resumed);
+    destroyNetwork(finished);
+    destroyNetwork(other);
+    destroyNetwork(refused);
+    destroyNetwork(foldStraight);
+    destroyNetwork(foldResumed);
+    destroyNetwork(factorStraight);
+    destroyNetwork(factorResumed);
+    destroyDataSet(dataSet);
+    destroyDataSet(classSet);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "../src/cranium.h"
+
+// compares load time and file size of the text and compressed formats
+static double seconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static long fileSize(const char* path){
+    struct stat info;
+    return stat(path, &info) == 0 ? (long)info.st_size : -1;
+}
+
+int main(){
+    srand(1);
+    size_t hiddenSize[] = {1024, 1024};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* network = createNetwork(2048, 2, hiddenSize, hiddenActivation, 1000, softmax);
+    saveNetwork(network, "bench_network.txt");
+    double start = seconds();
+    Network* text = readNetwork("bench_network.txt");
+    printf("text:     %10ld bytes, loaded in %f s\n", fileSize("bench_network.txt"), seconds() - start);
+    destroyNetwork(text);
+
+    WEIGHT_ENCODING encodings[] = {ENCODE_FLOAT32, ENCODE_FLOAT16, ENCODE_BFLOAT16, ENCODE_INT8};
+    const char* names[] = {"float32", "float16", "bfloat16", "int8"};
+    int i;
+    for (i = 0; i < 4; i++){
+        start = seconds();
+        saveNetworkCompressed(network, "bench_network.cz", encodings[i]);
+        double saveTime = seconds() - start;
+        start = seconds();
+        Network* compressed = readNetworkCompressed("bench_network.cz", 4);
+        printf("%-9s %10ld bytes, saved in %f s, loaded in %f s\n", names[i], fileSize("bench_network.cz"), saveTime, seconds() - start);
+        destroyNetwork(compressed);
+    }
+
+    destroyNetwork(network);
+    remove("bench_network.txt");
+    remove("bench_network.cz");
+    return 0;
+}
\ No newline at end of file
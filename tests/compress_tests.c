@@ -0,0 +1,117 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/binary.h"
+#include "../src/compress.h"
+
+int main(){
+    srand(time(NULL));
+    int i;
+    size_t j;
+
+    // test compressor round trip on repetitive and random bytes
+    size_t size = 10000;
+    unsigned char* raw = (unsigned char*)malloc(size);
+    for (j = 0; j < size; j++){
+        raw[j] = j < size / 2 ? j % 7 : rand() % 256;
+    }
+    unsigned char* compressed = (unsigned char*)malloc(lzBound(size));
+    size_t compressedSize = lzCompress(raw, size, compressed);
+    assert(compressedSize < size);
+    unsigned char* restored = (unsigned char*)malloc(size);
+    assert(lzDecompress(compressed, compressedSize, restored, size) == 0);
+    assert(memcmp(raw, restored, size) == 0);
+
+    // test malformed input is rejected
+    assert(lzDecompress(compressed, compressedSize, restored, size - 1) != 0);
+    assert(lzDecompress(compressed, compressedSize - 1, restored, size) != 0);
+
+    // test empty input
+    compressedSize = lzCompress(raw, 0, compressed);
+    assert(lzDecompress(compressed, compressedSize, restored, 0) == 0);
+
+    // test shuffling round trip
+    unsigned char shuffled[12], unshuffled[12];
+    unsigned char bytes[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    shuffleBytes(bytes, 3, 4, shuffled);
+    assert(shuffled[0] == 0 && shuffled[1] == 4 && shuffled[2] == 8 && shuffled[3] == 1);
+    unshuffleBytes(shuffled, 3, 4, unshuffled);
+    assert(memcmp(bytes, unshuffled, 12) == 0);
+
+    // test lossless round trip of a network
+    size_t hiddenSize[] = {30, 10};
+    Activation hiddenActivations[] = {relu, tanH};
+    Network* network = createNetwork(20, 2, hiddenSize, hiddenActivations, 4, softmax);
+    setConnectionPrecision(network->connections[2], BFLOAT16);
+    assert(saveNetworkCompressed(network, "network.cz", ENCODE_FLOAT32) == 0);
+    Network* fromFile = readNetworkCompressed("network.cz", 2);
+    assert(fromFile != NULL);
+    assert(fromFile->numLayers == 4);
+    assert(fromFile->layers[2]->size == 10 && fromFile->layers[2]->activation == tanH);
+    for (i = 0; i < network->numConnections; i++){
+        assert(equals(network->connections[i]->weights, fromFile->connections[i]->weights));
+        assert(equals(network->connections[i]->bias, fromFile->connections[i]->bias));
+    }
+    assert(fromFile->connections[2]->precision == BFLOAT16);
+    destroyNetwork(fromFile);
+
+    // test lossy encodings stay within their step size
+    WEIGHT_ENCODING encodings[] = {ENCODE_FLOAT16, ENCODE_BFLOAT16, ENCODE_INT8};
+    int k;
+    for (k = 0; k < 3; k++){
+        assert(saveNetworkCompressed(network, "network.cz", encodings[k]) == 0);
+        fromFile = readNetworkCompressed("network.cz", 1);
+        assert(fromFile != NULL);
+        for (i = 0; i < network->numConnections; i++){
+            Matrix* weights = network->connections[i]->weights;
+            float maxAbs = 0;
+            for (j = 0; j < weights->rows * weights->cols; j++){
+                maxAbs = MAX(maxAbs, fabsf(weights->data[j]));
+            }
+            for (j = 0; j < weights->rows * weights->cols; j++){
+                float error = fabsf(weights->data[j] - fromFile->connections[i]->weights->data[j]);
+                if (encodings[k] == ENCODE_INT8){
+                    assert(error <= maxAbs / 127 / 2 + 1e-6);
+                }
+                else{
+                    assert(error <= fabsf(weights->data[j]) / (encodings[k] == ENCODE_FLOAT16 ? 1024 : 128) + 1e-6);
+                }
+            }
+            assert(equals(network->connections[i]->bias, fromFile->connections[i]->bias));
+        }
+        destroyNetwork(fromFile);
+    }
+
+    // test a corrupted file is rejected
+    assert(saveNetworkCompressed(network, "network.cz", ENCODE_FLOAT32) == 0);
+    FILE* fp = fopen("network.cz", "r+b");
+    fseek(fp, -20, SEEK_END);
+    int byte = fgetc(fp);
+    fseek(fp, -20, SEEK_END);
+    fputc(byte ^ 0xff, fp);
+    fclose(fp);
+    assert(readNetworkCompressed("network.cz", 2) == NULL);
+    assert(readNetworkCompressed("missing.cz", 2) == NULL);
+
+    // test layer counts and sizes the file is too short to hold are rejected
+    // before being allocated
+    uint64_t edits[][2] = {{16, 1 << 19}, {16, UINT64_MAX}, {24, (uint64_t)1 << 40}, {24 + sizeof(BinaryLayer), (uint64_t)1 << 31}};
+    for (i = 0; i < 4; i++){
+        assert(saveNetworkCompressed(network, "network.cz", ENCODE_FLOAT32) == 0);
+        fp = fopen("network.cz", "r+b");
+        fseek(fp, edits[i][0], SEEK_SET);
+        fwrite(&edits[i][1], sizeof(uint64_t), 1, fp);
+        fclose(fp);
+        assert(readNetworkCompressed("network.cz", 2) == NULL);
+    }
+
+    // test destroy
+    free(raw);
+    free(compressed);
+    free(restored);
+    destroyNetwork(network);
+
+    return 0;
+}
\ No newline at end of file
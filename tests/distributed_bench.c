@@ -0,0 +1,100 @@
+#include "../src/cranium.h"
+#include <sys/wait.h>
+
+#define TOTAL_ROWS 3072
+#define GLOBAL_BATCH 192
+#define STEPS 48
+
+// one rank's share of the run: trains on its shard and, on rank 0, writes
+// the wall time and bytes sent per step to $out
+static void runRank(int rank, int size, int* listeners, int* ports, DataSet* data, DataSet* classes, int out){
+    size_t shardRows = TOTAL_ROWS / size;
+    DataSet* shard = createDataSet(shardRows, data->cols, data->data + rank * shardRows);
+    DataSet* shardClasses = createDataSet(shardRows, classes->cols, classes->data + rank * shardRows);
+    size_t hiddenSize[] = {256, 256};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* network = createNetwork(data->cols, 2, hiddenSize, hiddenActivation, classes->cols, softmax);
+    TrainingState* state = createTrainingState(network, CROSS_ENTROPY_LOSS);
+    int r;
+    for (r = 0; r < size; r++){
+        if (r != rank){
+            close(listeners[r]);
+        }
+    }
+    RingGroup* group = joinRingGroup(rank, size, NULL, ports, listeners[rank], 10);
+    assert(group != NULL);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(distributedGradientDescent(group, state, shard, shardClasses, GLOBAL_BATCH / size, .01, 0, 0, .9, STEPS, 1, 0) == 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double result[2];
+    result[0] = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    result[1] = (double)group->bytesSent / STEPS;
+    if (rank == 0){
+        assert(write(out, result, sizeof(result)) == sizeof(result));
+    }
+    destroyRingGroup(group);
+    _exit(0);
+}
+
+// trains one network with 1 to 4 processes on localhost, each on its
+// shard of a fixed dataset with a fixed global batch, and reports how much
+// of the ideal speedup each process count reaches
+int main(){
+    srand(1);
+    size_t features = 64, outputs = 10;
+    float** rows = (float**)malloc(sizeof(float*) * TOTAL_ROWS);
+    float** labels = (float**)malloc(sizeof(float*) * TOTAL_ROWS);
+    size_t i, j;
+    for (i = 0; i < TOTAL_ROWS; i++){
+        rows[i] = (float*)malloc(sizeof(float) * features);
+        labels[i] = (float*)calloc(outputs, sizeof(float));
+        for (j = 0; j < features; j++){
+            rows[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        labels[i][rand() % outputs] = 1;
+    }
+    DataSet* data = createDataSet(TOTAL_ROWS, features, rows);
+    DataSet* classes = createDataSet(TOTAL_ROWS, outputs, labels);
+
+    double baseline = 0;
+    printf("%d rows, 64-256-256-10, global batch %d, %d steps, %ld cores\n", TOTAL_ROWS, GLOBAL_BATCH, STEPS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("processes    seconds    examples/s    speedup    efficiency    KB sent/step/rank\n");
+    int size, rank;
+    for (size = 1; size <= 4; size++){
+        int channel[2];
+        assert(pipe(channel) == 0);
+        pid_t children[4];
+        int listeners[4], ports[4];
+        for (rank = 0; rank < size; rank++){
+            listeners[rank] = ringListen(0, &ports[rank]);
+            assert(listeners[rank] >= 0);
+        }
+        for (rank = 0; rank < size; rank++){
+            children[rank] = fork();
+            if (children[rank] == 0){
+                runRank(rank, size, listeners, ports, data, classes, channel[1]);
+            }
+        }
+        for (rank = 0; rank < size; rank++){
+            close(listeners[rank]);
+        }
+        close(channel[1]);
+        double result[2];
+        assert(read(channel[0], result, sizeof(result)) == sizeof(result));
+        close(channel[0]);
+        for (rank = 0; rank < size; rank++){
+            waitpid(children[rank], NULL, 0);
+        }
+        if (size == 1){
+            baseline = result[0];
+        }
+        double speedup = baseline / result[0];
+        printf("%9d %10.3f %13.0f %10.2f %12.0f%% %20.1f\n", size, result[0], (double)GLOBAL_BATCH * STEPS / result[0], speedup, 100 * speedup / size, result[1] / 1024);
+    }
+
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/distributed.h"
+#include <sys/wait.h>
+
+#define RANKS 3
+#define SHARD_ROWS 20
+#define LOCAL_BATCH 5
+#define STEPS 30
+
+// binds a listener on a free port for each of $size ranks before they are
+// forked, so no two runs can pick the same ports
+static void listenForRanks(int* listeners, int* ports, int size){
+    int r;
+    for (r = 0; r < size; r++){
+        listeners[r] = ringListen(0, &ports[r]);
+        assert(listeners[r] >= 0);
+    }
+}
+
+// joins the ring as $rank in a forked child, closing the other ranks' listeners
+static RingGroup* joinRing(int rank, int size, int* listeners, int* ports){
+    int r;
+    for (r = 0; r < size; r++){
+        if (r != rank){
+            close(listeners[r]);
+        }
+    }
+    RingGroup* group = joinRingGroup(rank, size, NULL, ports, listeners[rank], 10);
+    assert(group != NULL);
+    return group;
+}
+
+// closes the listeners in the parent once every rank is forked
+static void closeListeners(int* listeners, int size){
+    int r;
+    for (r = 0; r < size; r++){
+        close(listeners[r]);
+    }
+}
+
+// stores the parameters after each completed step
+static void keepParameters(TrainingState* state, void* context){
+    memcpy(context, state->network->parameters, sizeof(float) * state->network->numParameters);
+}
+
+// waits for every child and checks each exited cleanly
+static void waitForRanks(pid_t* children, int size){
+    int r, status;
+    for (r = 0; r < size; r++){
+        assert(waitpid(children[r], &status, 0) == children[r]);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+}
+
+int main(){
+    srand(time(NULL));
+    int r, i, j;
+    pid_t children[4];
+    int listeners[4], ports[4];
+
+    // test all-reduce, broadcast and sum for several ring sizes, including
+    // buffers shorter than the ring
+    int sizes[] = {1, 2, 3, 4};
+    size_t counts[] = {0, 1, 2, 5, 1001};
+    int s;
+    for (s = 0; s < 4; s++){
+        int size = sizes[s];
+        listenForRanks(listeners, ports, size);
+        for (r = 0; r < size; r++){
+            children[r] = fork();
+            if (children[r] == 0){
+                RingGroup* group = joinRing(r, size, listeners, ports);
+                int c;
+                for (c = 0; c < 5; c++){
+                    float* data = (float*)malloc(sizeof(float) * (counts[c] + 1));
+                    for (j = 0; j < counts[c]; j++){
+                        data[j] = r * 1000 + j;
+                    }
+                    assert(ringAllReduce(group, data, counts[c]) == 0);
+                    for (j = 0; j < counts[c]; j++){
+                        assert(data[j] == 1000 * size * (size - 1) / 2 + size * j);
+                    }
+                    for (j = 0; j < counts[c]; j++){
+                        data[j] = r == size - 1 ? j + .5 : -1;
+                    }
+                    assert(ringBroadcast(group, data, counts[c], size - 1) == 0);
+                    for (j = 0; j < counts[c]; j++){
+                        assert(data[j] == j + .5);
+                    }
+                    free(data);
+                }
+                uint64_t value = r + 1;
+                assert(ringSum(group, &value) == 0 && value == size * (size + 1) / 2);
+                assert(group->bytesSent > 0 || size == 1);
+                destroyRingGroup(group);
+                _exit(0);
+            }
+        }
+        closeListeners(listeners, size);
+        waitForRanks(children, size);
+    }
+
+    // test a lost neighbour is reported instead of hanging
+    listenForRanks(listeners, ports, 2);
+    for (r = 0; r < 2; r++){
+        children[r] = fork();
+        if (children[r] == 0){
+            RingGroup* group = joinRing(r, 2, listeners, ports);
+            if (r == 1){
+                destroyRingGroup(group);
+                _exit(0);
+            }
+            float data[100000] = {0};
+            assert(ringAllReduce(group, data, 100000) == -1);
+            destroyRingGroup(group);
+            _exit(0);
+        }
+    }
+    closeListeners(listeners, 2);
+    waitForRanks(children, 2);
+
+    // test a neighbour that stays connected but goes silent times out
+    listenForRanks(listeners, ports, 2);
+    for (r = 0; r < 2; r++){
+        children[r] = fork();
+        if (children[r] == 0){
+            RingGroup* group = joinRing(r, 2, listeners, ports);
+            if (r == 1){
+                sleep(2);
+                destroyRingGroup(group);
+                _exit(0);
+            }
+            group->exchangeTimeout = .2;
+            float data[100000] = {0};
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            assert(ringAllReduce(group, data, 100000) == -1);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            assert(end.tv_sec - start.tv_sec < 2);
+            destroyRingGroup(group);
+            _exit(0);
+        }
+    }
+    closeListeners(listeners, 2);
+    waitForRanks(children, 2);
+
+    // test training on shards matches one process training on their union,
+    // with the union ordered so its batches are the ranks' batches together
+    float** shardData[RANKS];
+    float** shardClasses[RANKS];
+    float** unionData = (float**)malloc(sizeof(float*) * RANKS * SHARD_ROWS);
+    float** unionClasses = (float**)malloc(sizeof(float*) * RANKS * SHARD_ROWS);
+    for (r = 0; r < RANKS; r++){
+        shardData[r] = (float**)malloc(sizeof(float*) * SHARD_ROWS);
+        shardClasses[r] = (float**)malloc(sizeof(float*) * SHARD_ROWS);
+        for (i = 0; i < SHARD_ROWS; i++){
+            shardData[r][i] = (float*)malloc(sizeof(float) * 4);
+            shardClasses[r][i] = (float*)calloc(3, sizeof(float));
+            for (j = 0; j < 4; j++){
+                shardData[r][i][j] = (float)rand() / RAND_MAX - .5;
+            }
+            shardClasses[r][i][rand() % 3] = 1;
+            int row = (i / LOCAL_BATCH) * RANKS * LOCAL_BATCH + r * LOCAL_BATCH + i % LOCAL_BATCH;
+            unionData[row] = (float*)malloc(sizeof(float) * 4);
+            unionClasses[row] = (float*)malloc(sizeof(float) * 3);
+            memcpy(unionData[row], shardData[r][i], sizeof(float) * 4);
+            memcpy(unionClasses[row], shardClasses[r][i], sizeof(float) * 3);
+        }
+    }
+    size_t hiddenSize[] = {6, 5};
+    void (*hiddenActivations[])(Matrix*) = {tanH, relu};
+    Network* initial = createNetwork(4, 2, hiddenSize, hiddenActivations, 3, softmax);
+    Network* reference = createNetwork(4, 2, hiddenSize, hiddenActivations, 3, softmax);
+    copyNetworkParameters(initial, reference);
+    DataSet* allData = createDataSet(RANKS * SHARD_ROWS, 4, unionData);
+    DataSet* allClasses = createDataSet(RANKS * SHARD_ROWS, 3, unionClasses);
+    batchGradientDescent(reference, allData, allClasses, CROSS_ENTROPY_LOSS, RANKS * LOCAL_BATCH, .5, 0, .01, .9, STEPS, 0, 0);
+
+    int pipes[RANKS][2];
+    listenForRanks(listeners, ports, RANKS);
+    for (r = 0; r < RANKS; r++){
+        assert(pipe(pipes[r]) == 0);
+        children[r] = fork();
+        if (children[r] == 0){
+            // only rank 0's starting parameters matter
+            Network* network = createNetwork(4, 2, hiddenSize, hiddenActivations, 3, softmax);
+            if (r == 0){
+                copyNetworkParameters(initial, network);
+            }
+            DataSet* shard = createDataSet(SHARD_ROWS, 4, shardData[r]);
+            DataSet* classes = createDataSet(SHARD_ROWS, 3, shardClasses[r]);
+            RingGroup* group = joinRing(r, RANKS, listeners, ports);
+            TrainingState* state = createTrainingState(network, CROSS_ENTROPY_LOSS);
+            assert(distributedGradientDescent(group, state, shard, classes, LOCAL_BATCH, .5, 0, .01, .9, STEPS, 0, 0) == 0);
+            assert(state->epoch == STEPS + 1 && state->gradientReady == NULL);
+            assert(write(pipes[r][1], network->parameters, sizeof(float) * network->numParameters) == sizeof(float) * network->numParameters);
+            destroyTrainingState(state);
+            destroyRingGroup(group);
+            _exit(0);
+        }
+        close(pipes[r][1]);
+    }
+    closeListeners(listeners, RANKS);
+    float* replicas[RANKS];
+    for (r = 0; r < RANKS; r++){
+        replicas[r] = (float*)malloc(sizeof(float) * reference->numParameters);
+        size_t got = 0;
+        while (got < sizeof(float) * reference->numParameters){
+            ssize_t done = read(pipes[r][0], (char*)replicas[r] + got, sizeof(float) * reference->numParameters - got);
+            assert(done > 0);
+            got += done;
+        }
+        close(pipes[r][0]);
+    }
+    waitForRanks(children, RANKS);
+
+    // replicas agree exactly, and with the single process up to summation order
+    for (r = 1; r < RANKS; r++){
+        assert(memcmp(replicas[r], replicas[0], sizeof(float) * reference->numParameters) == 0);
+    }
+    for (i = 0; i < reference->numParameters; i++){
+        assert(fabsf(replicas[0][i] - reference->parameters[i]) < 1e-4);
+    }
+
+    // test a neighbour lost mid-run drops the step it was lost in, so
+    // momentum and decay do not move the weights on a zero gradient
+    listenForRanks(listeners, ports, 2);
+    for (r = 0; r < 2; r++){
+        children[r] = fork();
+        if (children[r] == 0){
+            Network* network = createNetwork(4, 2, hiddenSize, hiddenActivations, 3, softmax);
+            DataSet* shard = createDataSet(SHARD_ROWS, 4, shardData[r]);
+            DataSet* classes = createDataSet(SHARD_ROWS, 3, shardClasses[r]);
+            RingGroup* group = joinRing(r, 2, listeners, ports);
+            TrainingState* state = createTrainingState(network, CROSS_ENTROPY_LOSS);
+            float* completed = (float*)malloc(sizeof(float) * network->numParameters);
+            state->stepCallback = keepParameters;
+            state->stepContext = completed;
+            if (r == 1){
+                assert(distributedGradientDescent(group, state, shard, classes, LOCAL_BATCH, .5, 0, .01, .9, 3, 0, 0) == 0);
+            }
+            else{
+                assert(distributedGradientDescent(group, state, shard, classes, LOCAL_BATCH, .5, 0, .01, .9, STEPS, 0, 0) == -1);
+                assert(state->epoch == 4);
+                assert(memcmp(completed, network->parameters, sizeof(float) * network->numParameters) == 0);
+            }
+            _exit(0);
+        }
+    }
+    closeListeners(listeners, 2);
+    waitForRanks(children, 2);
+
+    for (r = 0; r < RANKS; r++){
+        free(replicas[r]);
+        for (i = 0; i < SHARD_ROWS; i++){
+            free(shardData[r][i]);
+            free(shardClasses[r][i]);
+        }
+        free(shardData[r]);
+        free(shardClasses[r]);
+    }
+    destroyDataSet(allData);
+    destroyDataSet(allClasses);
+    destroyNetwork(initial);
+    destroyNetwork(reference);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,461 @@
+#include "../src/cranium.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_LIST 16
+
+// settings of a run, each of which can be given on the command line as
+// --name value, lists being comma-separated
+typedef struct BenchConfig_ {
+    size_t rows;
+    size_t features;
+    size_t outputs;
+    size_t hidden[MAX_LIST];
+    int numHidden;
+    size_t examples; // examples trained on per throughput measurement
+    size_t batches[MAX_LIST];
+    int numBatches;
+    int threads[MAX_LIST];
+    int numThreads;
+    float learningRate; // per batch, scaled up since steps divide by all rows
+    size_t targetBatch;
+    float crossEntropyTarget;
+    float squaredErrorTarget;
+    size_t maxTargetExamples;
+    unsigned int seed;
+    const char* json;
+} BenchConfig;
+
+typedef struct TrainResult_ {
+    size_t batchSize;
+    int threads; // pipeline stages, 1 for plain training through optimize
+    double examplesPerSecond;
+} TrainResult;
+
+typedef struct InferenceResult_ {
+    int threads;
+    double examplesPerSecond;
+} InferenceResult;
+
+typedef struct WorkloadResult_ {
+    const char* name;
+    TrainResult train[MAX_LIST * MAX_LIST];
+    int numTrain;
+    double forwardPassPerSecond;
+    double accuracyPerSecond;
+    InferenceResult inference[MAX_LIST];
+    int numInference;
+    float initialLoss;
+    float target;
+    float finalLoss;
+    double secondsToTarget; // negative if the target was not reached
+    size_t examplesToTarget;
+    long peakRssKb;
+} WorkloadResult;
+
+static double benchSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// peak RSS of this process, which is a single workload's once it runs in
+// its own child
+static long peakRssKb(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// parses a comma-separated list of at most MAX_LIST sizes
+static int parseSizes(const char* text, size_t* values){
+    int count = 0;
+    char* end;
+    while (count < MAX_LIST && *text != '\0'){
+        values[count++] = strtoul(text, &end, 10);
+        text = *end == ',' ? end + 1 : end;
+        if (end == text && *end != ','){
+            break;
+        }
+    }
+    return count;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: e2e_bench [--rows N] [--features N] [--outputs N] [--hidden N,N,...] [--examples N]\n");
+    fprintf(stderr, "                 [--batches N,N,...] [--threads N,N,...] [--learning-rate F] [--target-batch N]\n");
+    fprintf(stderr, "                 [--ce-target F] [--mse-target F] [--max-target-examples N] [--seed N] [--json PATH]\n");
+    exit(2);
+}
+
+static BenchConfig parseConfig(int argc, char** argv){
+    BenchConfig config = {20000, 64, 10, {128, 64}, 2, 20000, {1, 32, 256}, 3, {1, 2, 4}, 3, .05, 32, .1, .02, 200000, 1, NULL};
+    int i;
+    for (i = 1; i < argc; i += 2){
+        if (i + 1 >= argc){
+            usage();
+        }
+        const char* name = argv[i];
+        const char* value = argv[i + 1];
+        size_t sizes[MAX_LIST];
+        int count, j;
+        if (strcmp(name, "--rows") == 0) config.rows = strtoul(value, NULL, 10);
+        else if (strcmp(name, "--features") == 0) config.features = strtoul(value, NULL, 10);
+        else if (strcmp(name, "--outputs") == 0) config.outputs = strtoul(value, NULL, 10);
+        else if (strcmp(name, "--hidden") == 0) config.numHidden = parseSizes(value, config.hidden);
+        else if (strcmp(name, "--examples") == 0) config.examples = strtoul(value, NULL, 10);
+        else if (strcmp(name, "--batches") == 0) config.numBatches = parseSizes(value, config.batches);
+        else if (strcmp(name, "--threads") == 0){
+            count = parseSizes(value, sizes);
+            for (j = 0; j < count; j++){
+                config.threads[j] = (int)sizes[j];
+            }
+            config.numThreads = count;
+        }
+        else if (strcmp(name, "--learning-rate") == 0) config.learningRate = atof(value);
+        else if (strcmp(name, "--target-batch") == 0) config.targetBatch = strtoul(value, NULL, 10);
+        else if (strcmp(name, "--ce-target") == 0) config.crossEntropyTarget = atof(value);
+        else if (strcmp(name, "--mse-target") == 0) config.squaredErrorTarget = atof(value);
+        else if (strcmp(name, "--max-target-examples") == 0) config.maxTargetExamples = strtoul(value, NULL, 10);
+        else if (strcmp(name, "--seed") == 0) config.seed = strtoul(value, NULL, 10);
+        else if (strcmp(name, "--json") == 0) config.json = value;
+        else usage();
+    }
+    if (config.rows < 2 || config.features < 1 || config.outputs < 2 || config.numBatches < 1 || config.numThreads < 1){
+        usage();
+    }
+    for (i = 0; i < config.numBatches; i++){
+        if (config.batches[i] < 1 || config.batches[i] > config.rows){
+            usage();
+        }
+    }
+    for (i = 0; i < config.numThreads; i++){
+        if (config.threads[i] < 1){
+            usage();
+        }
+    }
+    if (config.targetBatch < 1 || config.targetBatch > config.rows || config.learningRate <= 0){
+        usage();
+    }
+    return config;
+}
+
+static float uniform(){
+    return 2.0 * rand() / RAND_MAX - 1;
+}
+
+// points scattered around one random center per class, so that a network
+// can separate them but not trivially
+static void makeClassification(BenchConfig* config, DataSet** data, DataSet** classes){
+    *data = createDataSetContiguous(config->rows, config->features);
+    *classes = createDataSetContiguous(config->rows, config->outputs);
+    float* centers = (float*)malloc(sizeof(float) * config->outputs * config->features);
+    size_t i, j;
+    for (i = 0; i < config->outputs * config->features; i++){
+        centers[i] = uniform();
+    }
+    for (i = 0; i < config->rows; i++){
+        size_t label = rand() % config->outputs;
+        for (j = 0; j < config->features; j++){
+            (*data)->data[i][j] = centers[label * config->features + j] + 1.5 * uniform();
+        }
+        (*classes)->data[i][label] = 1;
+    }
+    free(centers);
+}
+
+// targets given by a random one-hidden-layer tanh network of the inputs
+static void makeRegression(BenchConfig* config, DataSet** data, DataSet** targets){
+    size_t width = 16, i, j, k;
+    *data = createDataSetContiguous(config->rows, config->features);
+    *targets = createDataSetContiguous(config->rows, config->outputs);
+    float* first = (float*)malloc(sizeof(float) * config->features * width);
+    float* second = (float*)malloc(sizeof(float) * width * config->outputs);
+    float* hidden = (float*)malloc(sizeof(float) * width);
+    for (i = 0; i < config->features * width; i++){
+        first[i] = uniform() / sqrtf(config->features);
+    }
+    for (i = 0; i < width * config->outputs; i++){
+        second[i] = uniform() / sqrtf(width);
+    }
+    for (i = 0; i < config->rows; i++){
+        for (j = 0; j < config->features; j++){
+            (*data)->data[i][j] = uniform();
+        }
+        for (k = 0; k < width; k++){
+            float sum = 0;
+            for (j = 0; j < config->features; j++){
+                sum += (*data)->data[i][j] * first[j * width + k];
+            }
+            hidden[k] = tanhf(2 * sum);
+        }
+        for (j = 0; j < config->outputs; j++){
+            float sum = 0;
+            for (k = 0; k < width; k++){
+                sum += hidden[k] * second[k * config->outputs + j];
+            }
+            (*targets)->data[i][j] = sum;
+        }
+    }
+    free(first);
+    free(second);
+    free(hidden);
+}
+
+// gradient steps are divided by the number of rows rather than the batch
+// size, so the rate is scaled to keep the step of a batch the same
+static float batchRate(BenchConfig* config, size_t batchSize){
+    return config->learningRate * config->rows / batchSize;
+}
+
+static float datasetLoss(Network* network, DataSet* data, DataSet* classes, LOSS_FUNCTION lossFunction){
+    Evaluation evaluation = evaluateNetwork(network, data, classes, EVALUATION_CHUNK_ROWS, 1);
+    return lossFunction == CROSS_ENTROPY_LOSS ? evaluation.crossEntropy / evaluation.rows : .5 * evaluation.squaredError / evaluation.rows;
+}
+
+// examples per second of $config->examples examples trained from $initial,
+// through optimize with one thread and through a pipeline of $threads stages
+// otherwise
+static double timeTraining(BenchConfig* config, Network* initial, Network* network, DataSet* data, DataSet* classes, LOSS_FUNCTION lossFunction, size_t batchSize, int threads){
+    int steps = config->examples / batchSize > 0 ? config->examples / batchSize : 1;
+    copyNetworkParameters(initial, network);
+    double start, seconds;
+    if (threads == 1){
+        ParameterSet params = {network, data, classes, lossFunction, batchSize, batchRate(config, batchSize), 0, 0, .9, steps, 1, 0};
+        start = benchSeconds();
+        optimize(params);
+        seconds = benchSeconds() - start;
+    }
+    else{
+        TrainingState* state = createTrainingState(network, lossFunction);
+        size_t microBatches = batchSize < 4 ? batchSize : 4;
+        Pipeline* pipeline = createPipeline(state, threads, microBatches, batchSize, PIPELINE_1F1B, NULL);
+        start = benchSeconds();
+        pipelineGradientDescent(pipeline, data, classes, batchSize, batchRate(config, batchSize), 0, 0, .9, steps, 1, 0);
+        seconds = benchSeconds() - start;
+        destroyPipeline(pipeline);
+        destroyTrainingState(state);
+    }
+    return steps * batchSize / seconds;
+}
+
+// trains from $initial in slices of about a pass, checking the loss between
+// slices with the clock stopped, until it reaches $target
+static void timeToTarget(BenchConfig* config, Network* initial, Network* network, DataSet* data, DataSet* classes, LOSS_FUNCTION lossFunction, float target, WorkloadResult* result){
+    copyNetworkParameters(initial, network);
+    TrainingState* state = createTrainingState(network, lossFunction);
+    size_t batchSize = config->targetBatch;
+    int slice = config->rows / batchSize > 0 ? config->rows / batchSize : 1;
+    double seconds = 0;
+    size_t examples = 0;
+    float loss = datasetLoss(network, data, classes, lossFunction);
+    result->initialLoss = loss;
+    result->target = target;
+    while (loss > target && examples < config->maxTargetExamples){
+        double start = benchSeconds();
+        trainGradientDescent(state, data, classes, batchSize, batchRate(config, batchSize), 0, 0, .9, state->epoch - 1 + slice, 1, 0);
+        seconds += benchSeconds() - start;
+        examples += slice * batchSize;
+        loss = datasetLoss(network, data, classes, lossFunction);
+    }
+    result->finalLoss = loss;
+    result->secondsToTarget = loss <= target ? seconds : -1;
+    result->examplesToTarget = examples;
+    destroyTrainingState(state);
+}
+
+// best examples per second over $repeats runs of forwardPass on all of $data
+static double timeForwardPass(Network* network, Matrix* input, int repeats){
+    double best = 1e30;
+    int r;
+    for (r = 0; r < repeats; r++){
+        double start = benchSeconds();
+        forwardPass(network, input);
+        double seconds = benchSeconds() - start;
+        best = seconds < best ? seconds : best;
+    }
+    return input->rows / best;
+}
+
+static void runWorkload(BenchConfig* config, const char* name, DataSet* data, DataSet* classes, Activation outputActivation, LOSS_FUNCTION lossFunction, float target, WorkloadResult* result){
+    Activation hiddenActivation[MAX_LIST];
+    int i, j;
+    for (i = 0; i < config->numHidden; i++){
+        hiddenActivation[i] = relu;
+    }
+    Network* initial = createNetwork(config->features, config->numHidden, config->hidden, hiddenActivation, config->outputs, outputActivation);
+    Network* network = createNetwork(config->features, config->numHidden, config->hidden, hiddenActivation, config->outputs, outputActivation);
+    result->name = name;
+    printf("\n%s: %zu rows, %zu features, %zu outputs, %zu parameters\n", name, config->rows, config->features, config->outputs, network->numParameters);
+
+    // training throughput over batch sizes and pipeline stages
+    result->numTrain = 0;
+    printf("%-8s %-8s %14s\n", "batch", "threads", "train ex/s");
+    for (i = 0; i < config->numBatches; i++){
+        for (j = 0; j < config->numThreads; j++){
+            int threads = config->threads[j];
+            if (threads > network->numConnections){
+                continue;
+            }
+            TrainResult* train = &result->train[result->numTrain++];
+            train->batchSize = config->batches[i];
+            train->threads = threads;
+            train->examplesPerSecond = timeTraining(config, initial, network, data, classes, lossFunction, train->batchSize, threads);
+            printf("%-8zu %-8d %14.0f\n", train->batchSize, threads, train->examplesPerSecond);
+            fflush(stdout);
+        }
+    }
+
+    // inference throughput of a trained network
+    copyNetworkParameters(initial, network);
+    ParameterSet params = {network, data, classes, lossFunction, config->targetBatch, batchRate(config, config->targetBatch), 0, 0, .9, (int)(config->examples / config->targetBatch) + 1, 1, 0};
+    optimize(params);
+    Matrix* input = dataSetToMatrix(data);
+    result->forwardPassPerSecond = timeForwardPass(network, input, 3);
+    double start = benchSeconds();
+    float trainedAccuracy = accuracy(network, data, classes);
+    result->accuracyPerSecond = data->rows / (benchSeconds() - start);
+    printf("forwardPass %.0f ex/s, accuracy %.0f ex/s", result->forwardPassPerSecond, result->accuracyPerSecond);
+    if (lossFunction == CROSS_ENTROPY_LOSS){
+        printf(" (accuracy %.3f)", trainedAccuracy);
+    }
+    printf("\n");
+    result->numInference = config->numThreads;
+    for (j = 0; j < config->numThreads; j++){
+        double best = 1e30;
+        int r;
+        for (r = 0; r < 3; r++){
+            start = benchSeconds();
+            evaluateNetwork(network, data, classes, EVALUATION_CHUNK_ROWS, config->threads[j]);
+            double seconds = benchSeconds() - start;
+            best = seconds < best ? seconds : best;
+        }
+        result->inference[j].threads = config->threads[j];
+        result->inference[j].examplesPerSecond = data->rows / best;
+        printf("evaluateNetwork on %d threads %.0f ex/s\n", config->threads[j], result->inference[j].examplesPerSecond);
+    }
+    destroyMatrix(input);
+
+    timeToTarget(config, initial, network, data, classes, lossFunction, target, result);
+    if (result->secondsToTarget >= 0){
+        printf("loss %.4f -> %.4f in %.3f s (%zu examples, batch %zu)\n", result->initialLoss, result->finalLoss, result->secondsToTarget, result->examplesToTarget, config->targetBatch);
+    }
+    else{
+        printf("loss %.4f -> %.4f, target %.4f not reached in %zu examples\n", result->initialLoss, result->finalLoss, target, result->examplesToTarget);
+    }
+    result->peakRssKb = peakRssKb();
+    printf("peak RSS %ld KB\n", result->peakRssKb);
+
+    destroyNetwork(initial);
+    destroyNetwork(network);
+}
+
+static void writeJson(const char* path, BenchConfig* config, WorkloadResult* results, int numResults){
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL){
+        fprintf(stderr, "could not write %s\n", path);
+        return;
+    }
+    int i, j;
+    fprintf(fp, "{\n  \"version\": 1,\n  \"backend\": \"%s\",\n  \"seed\": %u,\n", currentBlasBackend()->name, config->seed);
+    fprintf(fp, "  \"rows\": %zu,\n  \"features\": %zu,\n  \"outputs\": %zu,\n  \"hidden\": [", config->rows, config->features, config->outputs);
+    for (i = 0; i < config->numHidden; i++){
+        fprintf(fp, "%s%zu", i > 0 ? ", " : "", config->hidden[i]);
+    }
+    fprintf(fp, "],\n  \"workloads\": [\n");
+    for (i = 0; i < numResults; i++){
+        WorkloadResult* result = &results[i];
+        fprintf(fp, "    {\n      \"name\": \"%s\",\n      \"train\": [\n", result->name);
+        for (j = 0; j < result->numTrain; j++){
+            fprintf(fp, "        {\"batch\": %zu, \"threads\": %d, \"examples_per_second\": %.1f}%s\n", result->train[j].batchSize, result->train[j].threads, result->train[j].examplesPerSecond, j + 1 < result->numTrain ? "," : "");
+        }
+        fprintf(fp, "      ],\n      \"inference\": [\n");
+        for (j = 0; j < result->numInference; j++){
+            fprintf(fp, "        {\"threads\": %d, \"examples_per_second\": %.1f}%s\n", result->inference[j].threads, result->inference[j].examplesPerSecond, j + 1 < result->numInference ? "," : "");
+        }
+        fprintf(fp, "      ],\n      \"forward_pass_examples_per_second\": %.1f,\n      \"accuracy_examples_per_second\": %.1f,\n", result->forwardPassPerSecond, result->accuracyPerSecond);
+        fprintf(fp, "      \"initial_loss\": %.6f,\n      \"target_loss\": %.6f,\n      \"final_loss\": %.6f,\n", result->initialLoss, result->target, result->finalLoss);
+        if (result->secondsToTarget >= 0){
+            fprintf(fp, "      \"seconds_to_target\": %.4f,\n", result->secondsToTarget);
+        }
+        else{
+            fprintf(fp, "      \"seconds_to_target\": null,\n");
+        }
+        fprintf(fp, "      \"examples_to_target\": %zu,\n      \"peak_rss_kb\": %ld\n    }%s\n", result->examplesToTarget, result->peakRssKb, i + 1 < numResults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    printf("\nwrote %s\n", path);
+}
+
+// generates the data of one workload and runs it in a child process, so
+// that its peak RSS is not the peak of the workloads before it, and reads
+// its results back
+static void runWorkloadProcess(BenchConfig* config, int regression, WorkloadResult* result){
+    int channel[2];
+    fflush(stdout);
+    if (pipe(channel) != 0){
+        perror("pipe");
+        exit(1);
+    }
+    pid_t child = fork();
+    if (child < 0){
+        perror("fork");
+        exit(1);
+    }
+    if (child == 0){
+        close(channel[0]);
+        DataSet *data, *classes;
+        if (!regression){
+            srand(config->seed);
+            makeClassification(config, &data, &classes);
+            runWorkload(config, "classification", data, classes, softmax, CROSS_ENTROPY_LOSS, config->crossEntropyTarget, result);
+        }
+        else{
+            srand(config->seed + 1);
+            makeRegression(config, &data, &classes);
+            runWorkload(config, "regression", data, classes, linear, MEAN_SQUARED_ERROR, config->squaredErrorTarget, result);
+        }
+        destroyDataSet(data);
+        destroyDataSet(classes);
+        fflush(stdout);
+        _exit(write(channel[1], result, sizeof(*result)) == sizeof(*result) ? 0 : 1);
+    }
+    close(channel[1]);
+    size_t got = 0;
+    ssize_t done = 1;
+    while (got < sizeof(*result) && done > 0){
+        done = read(channel[0], (char*)result + got, sizeof(*result) - got);
+        got += done > 0 ? done : 0;
+    }
+    close(channel[0]);
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || got != sizeof(*result)){
+        fprintf(stderr, "%s workload failed\n", regression ? "regression" : "classification");
+        exit(1);
+    }
+}
+
+// trains and runs networks on a synthetic classification and a synthetic
+// regression problem, reporting training throughput across batch sizes and
+// threads, inference throughput, time to a target loss and peak memory,
+// each workload in its own process
+// the same seed and settings give the same data and starting networks, so
+// runs on different releases or machines can be compared
+int main(int argc, char** argv){
+    BenchConfig config = parseConfig(argc, argv);
+    printf("backend: %s\n", currentBlasBackend()->name);
+    WorkloadResult results[2];
+    runWorkloadProcess(&config, 0, &results[0]);
+    runWorkloadProcess(&config, 1, &results[1]);
+
+    if (config.json != NULL){
+        writeJson(config.json, &config, results, 2);
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "exported_network.h"
+
+// compares the code generated by export_tests against forwardPass
+int main(){
+    srand(time(NULL));
+    Network* network = readNetwork("exported_network.pkl");
+    assert(EXPORTED_NETWORK_INPUTS == 5 && EXPORTED_NETWORK_OUTPUTS == 4);
+    assert(EXPORTED_NETWORK_LAYER2 == 9);
+    Matrix* input = createMatrixZeroes(1, EXPORTED_NETWORK_INPUTS);
+    float output[EXPORTED_NETWORK_OUTPUTS];
+    int trial, i;
+    for (trial = 0; trial < 100; trial++){
+        for (i = 0; i < EXPORTED_NETWORK_INPUTS; i++){
+            input->data[i] = (rand() * (2.0 / RAND_MAX) - 1) * 5;
+        }
+        forwardPass(network, input);
+        exported_network_forward(input->data, output);
+        for (i = 0; i < EXPORTED_NETWORK_OUTPUTS; i++){
+            assert(fabsf(output[i] - getOuput(network)->data[i]) <= 1e-6);
+        }
+    }
+    destroyMatrix(input);
+    destroyNetwork(network);
+    return 0;
+}
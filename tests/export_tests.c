@@ -0,0 +1,26 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/export.h"
+
+int main(){
+    // export a network using every activation, and save it for export_check
+    srand(time(NULL));
+    size_t hiddenSize[] = {7, 9, 6};
+    Activation hiddenActivations[] = {sigmoid, relu, tanH};
+    Network* network = createNetwork(5, 3, hiddenSize, hiddenActivations, 4, softmax);
+    int i;
+    for (i = 0; i < network->numConnections; i++){
+        network->connections[i]->bias->data[0] = .25;
+    }
+    assert(exportNetworkC(network, "exported_network", "exported_network") == 0);
+    saveNetwork(network, "exported_network.pkl");
+
+    // test failure to write is reported
+    assert(exportNetworkC(network, "missing_directory/exported", "exported") == -1);
+
+    destroyNetwork(network);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "../src/cranium.h"
+
+// compares forward pass throughput and agreement of 16 bit weight storage
+// against 32 bit floats on the same network
+static double timeForwardPass(Network* network, Matrix* input, int reps){
+    clock_t start = clock();
+    int i;
+    for (i = 0; i < reps; i++){
+        forwardPass(network, input);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(){
+    srand(1);
+    size_t hiddenSize[] = {1024, 1024};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* network = createNetwork(784, 2, hiddenSize, hiddenActivation, 10, softmax);
+    int rows = 64, reps = 20, i;
+    Matrix* input = createMatrixZeroes(rows, 784);
+    for (i = 0; i < rows * 784; i++){
+        input->data[i] = rand() * (1.0 / RAND_MAX);
+    }
+
+    forwardPass(network, input);
+    Matrix* reference = copy(getOuput(network));
+    int* referencePredictions = predict(network);
+    double referenceTime = timeForwardPass(network, input, reps);
+    printf("%-9s %10.1f examples/sec\n", "float32", rows * reps / referenceTime);
+
+    PRECISION precisions[] = {FLOAT16, BFLOAT16};
+    int p;
+    for (p = 0; p < 2; p++){
+        Network* reduced = createNetwork(784, 2, hiddenSize, hiddenActivation, 10, softmax);
+        for (i = 0; i < network->numConnections; i++){
+            copyValuesInto(network->connections[i]->weights, reduced->connections[i]->weights);
+            copyValuesInto(network->connections[i]->bias, reduced->connections[i]->bias);
+        }
+        setNetworkPrecision(reduced, precisions[p]);
+        double reducedTime = timeForwardPass(reduced, input, reps);
+        int* predictions = predict(reduced);
+        float maxError = 0, agreement = 0;
+        for (i = 0; i < rows * 10; i++){
+            maxError = MAX(maxError, fabsf(getOuput(reduced)->data[i] - reference->data[i]));
+        }
+        for (i = 0; i < rows; i++){
+            agreement += predictions[i] == referencePredictions[i];
+        }
+        printf("%-9s %10.1f examples/sec (%.2fx), max output error %g, prediction agreement %.3f\n", getPrecisionName(precisions[p]), rows * reps / reducedTime, referenceTime / reducedTime, maxError, agreement / rows);
+        free(predictions);
+        destroyNetwork(reduced);
+    }
+
+    free(referencePredictions);
+    destroyMatrix(reference);
+    destroyMatrix(input);
+    destroyNetwork(network);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/half.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+
+int main(){
+    // test exact conversions
+    assert(halfToFloat(floatToHalf(1.0)) == 1.0);
+    assert(halfToFloat(floatToHalf(-2.5)) == -2.5);
+    assert(halfToFloat(floatToHalf(65504)) == 65504);
+    assert(halfToFloat(floatToHalf(0)) == 0);
+    assert(halfToFloat(floatToHalf(5.9604645e-8)) == 5.9604645e-8f);
+    assert(isinf(halfToFloat(floatToHalf(1e6))));
+    assert(floatToHalf(1.0) == 0x3c00);
+    assert(bfloat16ToFloat(floatToBFloat16(1.0)) == 1.0);
+    assert(bfloat16ToFloat(floatToBFloat16(-3.0)) == -3.0);
+    assert(floatToBFloat16(1.0) == 0x3f80);
+
+    // test rounding to nearest even
+    assert(halfToFloat(floatToHalf(1.0 + 1.0 / 2048)) == 1.0);
+    assert(halfToFloat(floatToHalf(1.0 + 3.0 / 2048)) == 1.0 + 4.0 / 2048);
+
+    // test relative error of round trips
+    int i, j;
+    for (i = 0; i < 1000; i++){
+        float val = (rand() * (2.0 / RAND_MAX) - 1) * 100;
+        assert(fabsf(roundToPrecision(val, FLOAT16) - val) <= fabsf(val) / 1024);
+        assert(fabsf(roundToPrecision(val, BFLOAT16) - val) <= fabsf(val) / 128);
+    }
+
+    // test the vector widening paths against the scalar conversions, on
+    // lengths that leave a remainder after every 8-wide step
+    uint16_t halfValues[37], bfloatValues[37];
+    float vectorSum[37], scalarSum[37];
+    for (i = 0; i < 37; i++){
+        float val = (rand() * (2.0 / RAND_MAX) - 1) * 10;
+        halfValues[i] = floatToHalf(val);
+        bfloatValues[i] = floatToBFloat16(val);
+    }
+    halfValues[3] = 0x0001;
+    halfValues[12] = 0x83ff;
+    halfValues[30] = 0x7bff;
+    bfloatValues[12] = 0x8001;
+    size_t lengths[] = {1, 7, 8, 9, 15, 17, 23, 37};
+    int l;
+    for (l = 0; l < 8; l++){
+        PRECISION precision;
+        for (precision = FLOAT16; precision <= BFLOAT16; precision++){
+            const uint16_t* values = precision == FLOAT16 ? halfValues : bfloatValues;
+            for (i = 0; i < 37; i++){
+                vectorSum[i] = scalarSum[i] = i * .25 - 4;
+            }
+            halfAxpy(-1.5, values, vectorSum, lengths[l], precision);
+            for (i = 0; i < lengths[l]; i++){
+                scalarSum[i] += -1.5f * decodeHalf(values[i], precision);
+            }
+            for (i = 0; i < 37; i++){
+                assert(vectorSum[i] == scalarSum[i]);
+            }
+        }
+    }
+
+    // test widening multiplication against float multiplication
+    float* A_data = (float*)malloc(sizeof(float) * 3 * 19);
+    float* B_data = (float*)malloc(sizeof(float) * 19 * 21);
+    for (i = 0; i < 3 * 19; i++){
+        A_data[i] = i % 7 - 3;
+    }
+    for (i = 0; i < 19 * 21; i++){
+        B_data[i] = roundToPrecision((i % 11) * .125 - .5, BFLOAT16);
+    }
+    Matrix* A = createMatrix(3, 19, A_data);
+    Matrix* B = createMatrix(19, 21, B_data);
+    Matrix* expected = multiply(A, B);
+    Matrix* actual = createMatrixZeroes(3, 21);
+    HalfMatrix* halfB = createHalfMatrix(B, FLOAT16);
+    multiplyHalfInto(A, halfB, actual);
+    assert(equals(expected, actual));
+    HalfMatrix* bfloatB = createHalfMatrix(B, BFLOAT16);
+    multiplyHalfInto(A, bfloatB, actual);
+    assert(equals(expected, actual));
+
+    // test network forward pass in reduced precision
+    srand(time(NULL));
+    size_t hiddenSize[] = {8};
+    Activation hiddenActivation[] = {relu};
+    Network* network = createNetwork(5, 1, hiddenSize, hiddenActivation, 3, softmax);
+    Matrix* input = createMatrixZeroes(4, 5);
+    for (i = 0; i < 4 * 5; i++){
+        input->data[i] = i / 10.0;
+    }
+    forwardPass(network, input);
+    Matrix* fullOutput = copy(getOuput(network));
+    setNetworkPrecision(network, BFLOAT16);
+    assert(network->connections[0]->precision == BFLOAT16);
+    forwardPass(network, input);
+    for (i = 0; i < 4; i++){
+        for (j = 0; j < 3; j++){
+            assert(fabsf(getMatrix(fullOutput, i, j) - getMatrix(getOuput(network), i, j)) < .05);
+        }
+    }
+
+    // test training keeps the float weights on the 16 bit grid, so the
+    // paths that read them agree with the 16 bit forward pass
+    size_t trainedSize[] = {8};
+    Network* trained = createNetwork(4, 1, trainedSize, hiddenActivation, 3, softmax);
+    setNetworkPrecision(trained, FLOAT16);
+    float** rows = (float**)malloc(sizeof(float*) * 6);
+    float** labels = (float**)malloc(sizeof(float*) * 6);
+    for (i = 0; i < 6; i++){
+        rows[i] = (float*)malloc(sizeof(float) * 4);
+        labels[i] = (float*)calloc(3, sizeof(float));
+        for (j = 0; j < 4; j++){
+            rows[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        labels[i][i % 3] = 1;
+    }
+    DataSet* trainData = createDataSet(6, 4, rows);
+    DataSet* trainClasses = createDataSet(6, 3, labels);
+    batchGradientDescent(trained, trainData, trainClasses, CROSS_ENTROPY_LOSS, 3, .5, 0, .01, .9, 10, 0, 0);
+    for (i = 0; i < trained->numConnections; i++){
+        Connection* connection = trained->connections[i];
+        for (j = 0; j < connection->weights->rows * connection->weights->cols; j++){
+            assert(roundToPrecision(connection->weights->data[j], FLOAT16) == connection->weights->data[j]);
+            assert(halfToFloat(connection->halfWeights->data[j]) == connection->weights->data[j]);
+        }
+        for (j = 0; j < connection->bias->cols; j++){
+            assert(halfToFloat(connection->halfBias->data[j]) == connection->bias->data[j]);
+        }
+    }
+    Matrix* trainMatrix = dataSetToMatrix(trainData);
+    SparseMatrix* sparseTrain = createSparseMatrix(trainMatrix);
+    forwardPass(trained, trainMatrix);
+    Matrix* halfOutput = copy(getOuput(trained));
+    forwardPassSparse(trained, sparseTrain);
+    for (i = 0; i < 6 * 3; i++){
+        assert(fabsf(halfOutput->data[i] - getOuput(trained)->data[i]) < 1e-6);
+    }
+
+    // test serialization keeps precision
+    saveNetwork(network, "half_network.pkl");
+    Network* fromFile = readNetwork("half_network.pkl");
+    assert(fromFile->connections[0]->precision == BFLOAT16);
+    assert(fromFile->connections[1]->precision == BFLOAT16);
+    assert(equals(network->connections[0]->weights, fromFile->connections[0]->weights));
+    assert(equals(network->connections[1]->bias, fromFile->connections[1]->bias));
+    setConnectionPrecision(network->connections[1], FLOAT32);
+    assert(network->connections[1]->halfWeights == NULL);
+
+    // test destroy
+    destroyMatrix(A);
+    destroyMatrix(B);
+    destroyMatrix(expected);
+    destroyMatrix(actual);
+    destroyHalfMatrix(halfB);
+    destroyHalfMatrix(bfloatB);
+    destroyMatrix(input);
+    destroyMatrix(fullOutput);
+    destroyNetwork(network);
+    destroyNetwork(fromFile);
+    destroyNetwork(trained);
+    destroyDataSet(trainData);
+    destroyDataSet(trainClasses);
+    destroyMatrix(trainMatrix);
+    destroySparseMatrix(sparseTrain);
+    destroyMatrix(halfOutput);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "../src/cranium.h"
+
+// measures CSV ingest throughput against a strtod loop
+static double seconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int main(){
+    srand(1);
+    size_t rows = 200000, cols = 64, i, j;
+    FILE* fp = fopen("bench_data.csv", "w");
+    for (i = 0; i < rows; i++){
+        for (j = 0; j < cols; j++){
+            fprintf(fp, "%.6f,", (float)rand() / RAND_MAX * 200 - 100);
+        }
+        fprintf(fp, "%d\n", (int)(i % 10));
+    }
+    long size = ftell(fp);
+    fclose(fp);
+
+    // the usual hand-written loader
+    double start = seconds();
+    fp = fopen("bench_data.csv", "r");
+    float** data = (float**)malloc(sizeof(float*) * rows);
+    char line[4096];
+    for (i = 0; i < rows && fgets(line, sizeof(line), fp) != NULL; i++){
+        data[i] = (float*)malloc(sizeof(float) * cols);
+        char* cursor = line;
+        for (j = 0; j < cols; j++){
+            data[i][j] = strtod(cursor, &cursor);
+            cursor++;
+        }
+    }
+    fclose(fp);
+    double naiveTime = seconds() - start;
+    printf("strtod loop: %8.1f MB/s\n", size / naiveTime / 1e6);
+    for (i = 0; i < rows; i++){
+        free(data[i]);
+    }
+    free(data);
+
+    int threads[] = {1, 2, 4, 8};
+    for (i = 0; i < 4; i++){
+        DataSet* features,* classes;
+        start = seconds();
+        loadCSV("bench_data.csv", -1, 10, 0, threads[i], &features, &classes);
+        double time = seconds() - start;
+        printf("loadCSV, %d threads: %8.1f MB/s\n", threads[i], size / time / 1e6);
+        destroyDataSet(features);
+        destroyDataSet(classes);
+    }
+
+    remove("bench_data.csv");
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/ingest.h"
+
+// parses all of $text with parseFloat
+static float parseAll(const char* text){
+    const char* cursor = text;
+    float value;
+    assert(parseFloat(&cursor, text + strlen(text), &value) == 0);
+    assert(cursor == text + strlen(text));
+    return value;
+}
+
+static void writeFile(const char* path, const char* contents){
+    FILE* fp = fopen(path, "w");
+    fputs(contents, fp);
+    fclose(fp);
+}
+
+int main(){
+    srand(time(NULL));
+
+    // test the parser agrees with strtof
+    const char* numbers[] = {"0", "-0.5", "+3.25", "1e-3", "2.5E+4", "123456789012345678901234", "0.1", "3.4028235e38", "1e-45", "7.038531e-26", ".75", "5."};
+    int i;
+    for (i = 0; i < 12; i++){
+        float value = parseAll(numbers[i]);
+        assert(value == strtof(numbers[i], NULL));
+    }
+    for (i = 0; i < 100000; i++){
+        char text[64];
+        float expected = (rand() - RAND_MAX / 2) / (float)(rand() % 1000 + 1);
+        sprintf(text, i % 2 == 0 ? "%.9g" : "%.6f", expected);
+        assert(parseAll(text) == strtof(text, NULL));
+    }
+    assert(isinf(parseAll("inf")) && isnan(parseAll("nan")));
+    const char* empty = "x";
+    float value;
+    assert(parseFloat(&empty, empty + 1, &value) != 0);
+
+    // test numbers too long for the slow path are rejected, not cut short
+    char longNumber[INGEST_MAX_TOKEN + 1];
+    memset(longNumber, '1', INGEST_MAX_TOKEN);
+    longNumber[INGEST_MAX_TOKEN - 1] = '\0';
+    assert(parseAll(longNumber) == strtof(longNumber, NULL));
+    longNumber[INGEST_MAX_TOKEN - 1] = '1';
+    longNumber[INGEST_MAX_TOKEN] = '\0';
+    const char* overlong = longNumber;
+    assert(parseFloat(&overlong, longNumber + INGEST_MAX_TOKEN, &value) != 0);
+
+    // test the decimal point stays '.' in a locale that uses ',', where one
+    // is installed
+    const char* commaLocales[] = {"de_DE.UTF-8", "fr_FR.UTF-8", "de_DE", "fr_FR"};
+    for (i = 0; i < 4; i++){
+        if (setlocale(LC_NUMERIC, commaLocales[i]) != NULL && localeconv()->decimal_point[0] == ','){
+            assert(parseAll("1.25e-40") == 1.25e-40f);
+            assert(parseAll("0.1234567890123456789") == 0.1234567890123456789f);
+            break;
+        }
+    }
+    setlocale(LC_NUMERIC, "C");
+
+    // test CSV with a header, a class label column, blank lines and CRLF
+    writeFile("ingest.csv", "a,b,label,c\r\n1.5,2,1,3\r\n\r\n-4, 5.25 ,0,6\r\n7,,2,9");
+    DataSet* data,* classes;
+    assert(loadCSV("ingest.csv", 2, 3, 1, 2, &data, &classes) == 0);
+    assert(data->rows == 3 && data->cols == 3 && classes->cols == 3);
+    assert(data->block != NULL && data->data[1] == data->block + 3);
+    assert(data->data[0][0] == 1.5f && data->data[0][1] == 2 && data->data[0][2] == 3);
+    assert(data->data[1][0] == -4 && data->data[1][1] == 5.25f);
+    assert(isnan(data->data[2][1]) && data->data[2][2] == 9);
+    assert(classes->data[0][1] == 1 && classes->data[0][0] == 0);
+    assert(classes->data[1][0] == 1 && classes->data[2][2] == 1);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+
+    // test regression target counted from the end
+    writeFile("ingest.csv", "1,2,0.5\n3,4,1.5\n");
+    assert(loadCSV("ingest.csv", -1, 0, 0, 1, &data, &classes) == 0);
+    assert(data->cols == 2 && classes->cols == 1 && classes->data[1][0] == 1.5f);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+
+    // test malformed files are rejected
+    writeFile("ingest.csv", "1,2,0\n3,4\n");
+    assert(loadCSV("ingest.csv", -1, 2, 0, 1, &data, &classes) != 0);
+    writeFile("ingest.csv", "1,2,5\n");
+    assert(loadCSV("ingest.csv", -1, 2, 0, 1, &data, &classes) != 0);
+    writeFile("ingest.csv", "1,x,0\n");
+    assert(loadCSV("ingest.csv", -1, 2, 0, 1, &data, &classes) != 0);
+    assert(loadCSV("missing.csv", -1, 2, 0, 1, &data, &classes) != 0);
+
+    // test LIBSVM with -1/+1 labels and sparse indices
+    writeFile("ingest.svm", "+1 1:0.5 4:2\n-1 2:-1 # comment\n1 qid:3 3:7\n");
+    assert(loadLIBSVM("ingest.svm", 0, 2, 2, &data, &classes) == 0);
+    assert(data->rows == 3 && data->cols == 4);
+    assert(data->data[0][0] == .5f && data->data[0][3] == 2 && data->data[0][1] == 0);
+    assert(data->data[1][1] == -1 && data->data[2][2] == 7);
+    assert(classes->data[0][1] == 1 && classes->data[1][0] == 1 && classes->data[2][1] == 1);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+
+    // test a large file splits across threads into the same rows
+    FILE* fp = fopen("ingest.csv", "w");
+    for (i = 0; i < 20000; i++){
+        fprintf(fp, "%d,%.6f,%d\n", i, i * .5, i % 4);
+    }
+    fclose(fp);
+    DataSet* sequentialData,* sequentialClasses;
+    assert(loadCSV("ingest.csv", 2, 4, 0, 1, &sequentialData, &sequentialClasses) == 0);
+    assert(loadCSV("ingest.csv", 2, 4, 0, 4, &data, &classes) == 0);
+    assert(data->rows == 20000);
+    for (i = 0; i < 20000; i++){
+        assert(data->data[i][0] == i && data->data[i][1] == i * .5f);
+        assert(memcmp(data->data[i], sequentialData->data[i], sizeof(float) * 2) == 0);
+        assert(classes->data[i][i % 4] == 1);
+    }
+
+    // test destroy
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    destroyDataSet(sequentialData);
+    destroyDataSet(sequentialClasses);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include "../src/cranium.h"
+
+#define WARMUP_SAMPLES 2
+#define MIN_SAMPLES 5
+#define MAX_SAMPLES 51
+#define MIN_SAMPLE_SECONDS 1e-4
+#define TARGET_SECONDS .4
+
+typedef enum KernelShape_ {
+    PRODUCT,
+    PRODUCT_TRANSPOSED,
+    TRANSPOSE_PRODUCT,
+    TRANSPOSED,
+    ELEMENTWISE
+} KernelShape;
+
+// one kernel under test: $flops and $floatsMoved are per output entry for
+// elementwise kernels (a transcendental function counts as one flop), and
+// are worked out from the dimensions for products
+typedef struct Kernel_ {
+    const char* name;
+    KernelShape shape;
+    void (*run)(Matrix* A, Matrix* B, Matrix* C);
+    double flops;
+    double floatsMoved;
+} Kernel;
+
+typedef struct Result_ {
+    char kernel[64];
+    char shape[32];
+    int samples;
+    double medianNs;
+    double p10Ns;
+    double p90Ns;
+    double minNs;
+    double gflops;
+    double gbps;
+} Result;
+
+static void runMultiply(Matrix* A, Matrix* B, Matrix* C){ multiplyInto(A, B, C); }
+static void runMultiplyTransposed(Matrix* A, Matrix* B, Matrix* C){ multiplyTransposedInto(A, B, C); }
+static void runAddTransposeMultiply(Matrix* A, Matrix* B, Matrix* C){ addTransposeMultiply(A, B, C); }
+static void runTranspose(Matrix* A, Matrix* B, Matrix* C){ transposeInto(A, C); }
+static void runAddTo(Matrix* A, Matrix* B, Matrix* C){ addTo(A, C); }
+static void runHadamard(Matrix* A, Matrix* B, Matrix* C){ hadamardInto(A, B, C); }
+static void runScalarMultiply(Matrix* A, Matrix* B, Matrix* C){ scalarMultiply(C, .999); }
+static void runCopy(Matrix* A, Matrix* B, Matrix* C){ copyValuesInto(A, C); }
+static void runZero(Matrix* A, Matrix* B, Matrix* C){ zeroMatrix(C); }
+static void runSigmoid(Matrix* A, Matrix* B, Matrix* C){ sigmoid(C); }
+static void runRelu(Matrix* A, Matrix* B, Matrix* C){ relu(C); }
+static void runTanH(Matrix* A, Matrix* B, Matrix* C){ tanH(C); }
+static void runSoftmax(Matrix* A, Matrix* B, Matrix* C){ softmax(C); }
+
+static const Kernel kernels[] = {
+    {"multiplyInto", PRODUCT, runMultiply, 0, 0},
+    {"multiplyTransposedInto", PRODUCT_TRANSPOSED, runMultiplyTransposed, 0, 0},
+    {"addTransposeMultiply", TRANSPOSE_PRODUCT, runAddTransposeMultiply, 0, 0},
+    {"transposeInto", TRANSPOSED, runTranspose, 0, 2},
+    {"addTo", ELEMENTWISE, runAddTo, 1, 3},
+    {"hadamardInto", ELEMENTWISE, runHadamard, 1, 3},
+    {"scalarMultiply", ELEMENTWISE, runScalarMultiply, 1, 2},
+    {"copyValuesInto", ELEMENTWISE, runCopy, 0, 2},
+    {"zeroMatrix", ELEMENTWISE, runZero, 0, 1},
+    {"sigmoid", ELEMENTWISE, runSigmoid, 3, 2},
+    {"relu", ELEMENTWISE, runRelu, 1, 2},
+    {"tanH", ELEMENTWISE, runTanH, 1, 2},
+    {"softmax", ELEMENTWISE, runSoftmax, 4, 2}
+};
+
+// m x k times k x n, from a single row through to sizes well past the caches
+static const size_t productShapes[][3] = {{1, 256, 256}, {64, 64, 64}, {128, 784, 128}, {256, 256, 256}, {512, 512, 512}};
+static const size_t elementShapes[][2] = {{64, 64}, {256, 256}, {1024, 1024}};
+
+static double benchSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static Matrix* randomMatrix(size_t rows, size_t cols){
+    Matrix* matrix = createMatrixZeroes(rows, cols);
+    size_t i;
+    for (i = 0; i < rows * cols; i++){
+        matrix->data[i] = (float)rand() / RAND_MAX - .5;
+    }
+    return matrix;
+}
+
+static int compareTimes(const void* a, const void* b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// nearest-rank percentile of sorted $times
+static double percentile(double* times, int numTimes, double p){
+    return times[(int)(p / 100 * (numTimes - 1) + .5)];
+}
+
+// times $kernel on $A, $B and $C after warming up; calls too short for the
+// clock are repeated within each sample, and the number of samples is sized
+// so that each kernel takes about TARGET_SECONDS
+static void measure(const Kernel* kernel, Matrix* A, Matrix* B, Matrix* C, double flops, double bytes, Result* result){
+    double start = benchSeconds();
+    kernel->run(A, B, C);
+    double once = benchSeconds() - start;
+    once = once > 1e-9 ? once : 1e-9;
+    int inner = once >= MIN_SAMPLE_SECONDS ? 1 : (int)(MIN_SAMPLE_SECONDS / once) + 1;
+    int numSamples = (int)(TARGET_SECONDS / (once * inner));
+    numSamples = numSamples < MIN_SAMPLES ? MIN_SAMPLES : numSamples > MAX_SAMPLES ? MAX_SAMPLES : numSamples;
+    double times[MAX_SAMPLES];
+    int s, r;
+    for (s = -WARMUP_SAMPLES; s < numSamples; s++){
+        start = benchSeconds();
+        for (r = 0; r < inner; r++){
+            kernel->run(A, B, C);
+        }
+        if (s >= 0){
+            times[s] = (benchSeconds() - start) / inner;
+        }
+    }
+    qsort(times, numSamples, sizeof(double), compareTimes);
+    result->samples = numSamples;
+    result->medianNs = percentile(times, numSamples, 50) * 1e9;
+    result->p10Ns = percentile(times, numSamples, 10) * 1e9;
+    result->p90Ns = percentile(times, numSamples, 90) * 1e9;
+    result->minNs = times[0] * 1e9;
+    result->gflops = flops / result->medianNs;
+    result->gbps = bytes / result->medianNs;
+}
+
+// runs every kernel over its shapes, filling $results and returning how many
+static int runKernels(Result* results){
+    int numResults = 0;
+    size_t k, s;
+    for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++){
+        const Kernel* kernel = &kernels[k];
+        int product = kernel->shape == PRODUCT || kernel->shape == PRODUCT_TRANSPOSED || kernel->shape == TRANSPOSE_PRODUCT;
+        size_t numShapes = product ? sizeof(productShapes) / sizeof(productShapes[0]) : sizeof(elementShapes) / sizeof(elementShapes[0]);
+        for (s = 0; s < numShapes; s++){
+            Matrix *A, *B, *C;
+            double flops, bytes;
+            Result* result = &results[numResults++];
+            snprintf(result->kernel, sizeof(result->kernel), "%s", kernel->name);
+            if (product){
+                size_t m = productShapes[s][0], depth = productShapes[s][1], n = productShapes[s][2];
+                A = kernel->shape == TRANSPOSE_PRODUCT ? randomMatrix(depth, m) : randomMatrix(m, depth);
+                B = kernel->shape == PRODUCT_TRANSPOSED ? randomMatrix(n, depth) : randomMatrix(depth, n);
+                C = createMatrixZeroes(m, n);
+                flops = 2.0 * m * depth * n;
+                bytes = sizeof(float) * (m * depth + depth * n + (kernel->shape == TRANSPOSE_PRODUCT ? 2 : 1) * m * n);
+                snprintf(result->shape, sizeof(result->shape), "%zux%zux%zu", m, depth, n);
+            }
+            else{
+                size_t rows = elementShapes[s][0], cols = elementShapes[s][1];
+                A = randomMatrix(rows, cols);
+                B = randomMatrix(rows, cols);
+                C = kernel->shape == TRANSPOSED ? randomMatrix(cols, rows) : randomMatrix(rows, cols);
+                flops = kernel->flops * rows * cols;
+                bytes = sizeof(float) * kernel->floatsMoved * rows * cols;
+                snprintf(result->shape, sizeof(result->shape), "%zux%zu", rows, cols);
+            }
+            measure(kernel, A, B, C, flops, bytes, result);
+            printf("%-24s %-12s %12.0f %12.0f %12.0f %9.2f %9.2f\n", result->kernel, result->shape, result->medianNs, result->p10Ns, result->p90Ns, result->gflops, result->gbps);
+            fflush(stdout);
+            destroyMatrix(A);
+            destroyMatrix(B);
+            destroyMatrix(C);
+        }
+    }
+    return numResults;
+}
+
+// writes $results as JSON, one result per line so that runs diff cleanly
+static int writeResults(const char* path, Result* results, int numResults){
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL){
+        return -1;
+    }
+    GemmBlocking blocking = currentGemmBlocking();
+    fprintf(fp, "{\n  \"version\": 1,\n  \"backend\": \"%s\",\n", currentBlasBackend()->name);
+    fprintf(fp, "  \"blocking\": [%zu, %zu, %zu],\n  \"results\": [\n", blocking.rowBlock, blocking.depthBlock, blocking.colBlock);
+    int i;
+    for (i = 0; i < numResults; i++){
+        Result* result = &results[i];
+        fprintf(fp, "    {\"kernel\": \"%s\", \"shape\": \"%s\", \"samples\": %d, \"median_ns\": %.1f, \"p10_ns\": %.1f, \"p90_ns\": %.1f, \"min_ns\": %.1f, \"gflops\": %.3f, \"gbps\": %.3f}%s\n", result->kernel, result->shape, result->samples, result->medianNs, result->p10Ns, result->p90Ns, result->minNs, result->gflops, result->gbps, i + 1 < numResults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return 0;
+}
+
+// compares median times with those in the JSON file at $path, returning the
+// number of kernels slower by more than $tolerance (a fraction), or -1 if
+// the baseline cannot be read
+static int compareBaseline(const char* path, Result* results, int numResults, double tolerance){
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL){
+        return -1;
+    }
+    printf("\n%-24s %-12s %12s %12s %8s\n", "kernel", "shape", "baseline ns", "current ns", "change");
+    int regressions = 0, i;
+    char line[1024], kernel[64], shape[32];
+    int samples;
+    double medianNs;
+    while (fgets(line, sizeof(line), fp) != NULL){
+        if (sscanf(line, " {\"kernel\": \"%63[^\"]\", \"shape\": \"%31[^\"]\", \"samples\": %d, \"median_ns\": %lf", kernel, shape, &samples, &medianNs) != 4){
+            continue;
+        }
+        for (i = 0; i < numResults; i++){
+            if (strcmp(results[i].kernel, kernel) == 0 && strcmp(results[i].shape, shape) == 0){
+                break;
+            }
+        }
+        if (i == numResults){
+            printf("%-24s %-12s %12.0f %12s\n", kernel, shape, medianNs, "missing");
+            continue;
+        }
+        double change = results[i].medianNs / medianNs - 1;
+        int slower = change > tolerance;
+        regressions += slower;
+        printf("%-24s %-12s %12.0f %12.0f %+7.1f%%%s\n", kernel, shape, medianNs, results[i].medianNs, change * 100, slower ? "  REGRESSION" : "");
+    }
+    fclose(fp);
+    return regressions;
+}
+
+// usage: kernel_bench [output.json] [baseline.json]
+// times every matrix and activation kernel, writes the results as JSON, and
+// with a baseline exits with 1 if any kernel is slower than it by more than
+// CRANIUM_BENCH_TOLERANCE (default .1, i.e. 10%)
+int main(int argc, char** argv){
+    srand(1);
+    const char* output = argc > 1 ? argv[1] : "kernel_bench.json";
+    const char* baseline = argc > 2 ? argv[2] : NULL;
+    const char* tolerance = getenv("CRANIUM_BENCH_TOLERANCE");
+
+    printf("backend: %s\n", currentBlasBackend()->name);
+    printf("%-24s %-12s %12s %12s %12s %9s %9s\n", "kernel", "shape", "median ns", "p10 ns", "p90 ns", "GFLOP/s", "GB/s");
+    Result results[sizeof(kernels) / sizeof(kernels[0]) * 5];
+    int numResults = runKernels(results);
+    if (writeResults(output, results, numResults) != 0){
+        fprintf(stderr, "could not write %s\n", output);
+        return 2;
+    }
+    printf("wrote %s\n", output);
+
+    if (baseline != NULL){
+        int regressions = compareBaseline(baseline, results, numResults, tolerance != NULL ? atof(tolerance) : .1);
+        if (regressions < 0){
+            fprintf(stderr, "could not read %s\n", baseline);
+            return 2;
+        }
+        printf("%d regressions\n", regressions);
+        return regressions > 0;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "../src/cranium.h"
+
+// factorizes an approximately low-rank wide connection and reports the
+// multiply-add reduction, measured forward pass speedup and accuracy change
+int main(){
+    srand(1);
+    size_t hiddenSize[] = {1024};
+    Activation hiddenActivation[] = {tanH};
+    Network* network = createNetwork(768, 1, hiddenSize, hiddenActivation, 10, softmax);
+
+    // rank 48 structure plus noise
+    Matrix* left = createMatrixZeroes(768, 48);
+    Matrix* right = createMatrixZeroes(48, 1024);
+    int i;
+    for (i = 0; i < 768 * 48; i++){
+        left->data[i] = box_muller() / sqrt(768);
+    }
+    for (i = 0; i < 48 * 1024; i++){
+        right->data[i] = box_muller();
+    }
+    multiplyInto(left, right, network->connections[0]->weights);
+    for (i = 0; i < 768 * 1024; i++){
+        network->connections[0]->weights->data[i] += box_muller() * .001;
+    }
+
+    // label random inputs with the network's own predictions
+    int rows = 256, j;
+    float** data = (float**)malloc(sizeof(float*) * rows);
+    float** classes = (float**)malloc(sizeof(float*) * rows);
+    for (i = 0; i < rows; i++){
+        data[i] = (float*)malloc(sizeof(float) * 768);
+        for (j = 0; j < 768; j++){
+            data[i][j] = box_muller();
+        }
+        classes[i] = (float*)calloc(10, sizeof(float));
+    }
+    DataSet* dataSet = createDataSet(rows, 768, data);
+    DataSet* classSet = createDataSet(rows, 10, classes);
+    forwardPassDataSet(network, dataSet);
+    int* predictions = predict(network);
+    for (i = 0; i < rows; i++){
+        classes[i][predictions[i]] = 1;
+    }
+
+    printFactorizationReport(factorizeNetworkConnection(network, 0, .02, 2, dataSet, classSet));
+
+    free(predictions);
+    destroyMatrix(left);
+    destroyMatrix(right);
+    destroyDataSet(dataSet);
+    destroyDataSet(classSet);
+    destroyNetwork(network);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/lowrank.h"
+#include "../src/binary.h"
+#include "../src/compress.h"
+
+int main(){
+    srand(time(NULL));
+
+    // build an exactly rank 3 matrix
+    Matrix* left = createMatrixZeroes(40, 3);
+    Matrix* right = createMatrixZeroes(3, 30);
+    int i, j;
+    for (i = 0; i < 40 * 3; i++){
+        left->data[i] = box_muller();
+    }
+    for (i = 0; i < 3 * 30; i++){
+        right->data[i] = box_muller();
+    }
+    Matrix* A = multiply(left, right);
+
+    // test truncated SVD reconstructs it
+    Matrix* U,* V;
+    lowRankFactorize(A, 3, &U, &V);
+    assert(U->rows == 40 && U->cols == 3 && V->rows == 3 && V->cols == 30);
+    Matrix* reconstructed = multiply(U, V);
+    for (i = 0; i < 40 * 30; i++){
+        assert(fabsf(reconstructed->data[i] - A->data[i]) < 1e-3);
+    }
+
+    // test singular values are decreasing and right vectors orthonormal
+    Matrix* leftVectors,* rightVectors;
+    float singular[5];
+    randomizedSVD(A, 5, &leftVectors, singular, &rightVectors);
+    assert(singular[0] >= singular[1] && singular[1] >= singular[2]);
+    assert(singular[3] < 1e-3 * singular[0]);
+    for (i = 0; i < 3; i++){
+        float norm = 0;
+        for (j = 0; j < 30; j++){
+            norm += getMatrix(rightVectors, i, j) * getMatrix(rightVectors, i, j);
+        }
+        assert(fabsf(norm - 1) < 1e-4);
+    }
+
+    // test rank selection
+    assert(maxUsefulRank(40, 30, 1) == 17);
+    assert(chooseRank(A, 1e-3, 1) == 3);
+    assert(chooseRank(A, 1e-3, 100) == 0);
+
+    // test factorized multiplication
+    Matrix* X = createMatrixZeroes(4, 40);
+    for (i = 0; i < 4 * 40; i++){
+        X->data[i] = i % 5 - 2;
+    }
+    Matrix* expected = multiply(X, A);
+    Matrix* scratch = createMatrixZeroes(4, 3);
+    Matrix* actual = createMatrixZeroes(4, 30);
+    multiplyFactorizedInto(X, U, V, scratch, actual);
+    for (i = 0; i < 4 * 30; i++){
+        assert(fabsf(expected->data[i] - actual->data[i]) < 1e-2);
+    }
+
+    // test factorizing a network connection keeps its outputs
+    size_t hiddenSize[] = {30};
+    Activation hiddenActivation[] = {tanH};
+    Network* network = createNetwork(40, 1, hiddenSize, hiddenActivation, 3, softmax);
+    copyValuesInto(A, network->connections[0]->weights);
+    float** data = (float**)malloc(sizeof(float*) * 4);
+    float** classes = (float**)malloc(sizeof(float*) * 4);
+    for (i = 0; i < 4; i++){
+        data[i] = (float*)malloc(sizeof(float) * 40);
+        memcpy(data[i], X->data + i * 40, sizeof(float) * 40);
+        classes[i] = (float*)calloc(3, sizeof(float));
+        classes[i][i % 3] = 1;
+    }
+    DataSet* dataSet = createDataSet(4, 40, data);
+    DataSet* classSet = createDataSet(4, 3, classes);
+    forwardPass(network, X);
+    Matrix* before = copy(getOuput(network));
+    FactorizationReport report = factorizeNetworkConnection(network, 0, 1e-3, 1, dataSet, classSet);
+    assert(report.rank == 3);
+    assert(report.flopsAfter == 3 * (40 + 30));
+    assert(report.accuracyBefore == report.accuracyAfter);
+    assert(network->connections[0]->factorU != NULL);
+    forwardPass(network, X);
+    for (i = 0; i < 4 * 3; i++){
+        assert(fabsf(before->data[i] - getOuput(network)->data[i]) < 1e-3);
+    }
+
+    // test workspace passes keep input * U in the workspace's scratch, sized
+    // when it is created
+    Workspace* workspace = createWorkspace(network, 4);
+    float* workspaceScratch = workspace->scratch;
+    assert(workspace->scratchSize == 4 * 3);
+    Matrix* served = forwardPassWorkspace(network, workspace, X);
+    for (i = 0; i < 4 * 3; i++){
+        assert(fabsf(before->data[i] - served->data[i]) < 1e-3);
+    }
+    assert(workspace->scratch == workspaceScratch);
+    destroyWorkspace(workspace);
+
+    // test serialization keeps the rank
+    saveNetwork(network, "lowrank_network.pkl");
+    Network* fromFile = readNetwork("lowrank_network.pkl");
+    assert(fromFile->connections[0]->factorU != NULL && fromFile->connections[0]->factorU->cols == 3);
+    forwardPass(fromFile, X);
+    for (i = 0; i < 4 * 3; i++){
+        assert(fabsf(before->data[i] - getOuput(fromFile)->data[i]) < 1e-3);
+    }
+
+    // test factorizing is reproducible and leaves rand() alone
+    Network* twice = readNetwork("lowrank_network.pkl");
+    unfactorizeConnection(twice->connections[0]);
+    copyValuesInto(A, twice->connections[0]->weights);
+    srand(7);
+    int draw = rand();
+    srand(7);
+    factorizeConnection(twice->connections[0], 3);
+    assert(rand() == draw);
+    assert(equals(twice->connections[0]->factorU, network->connections[0]->factorU));
+    assert(equals(twice->connections[0]->factorV, network->connections[0]->factorV));
+
+    // test a step moves the factors along the weights' gradient, G V^T for U
+    // and U^T G for V, measured as the step of the same weights unfactorized
+    unfactorizeConnection(twice->connections[0]);
+    copyNetworkParameters(network, twice);
+    unfactorizeConnection(twice->connections[0]);
+    Matrix* U0 = copy(network->connections[0]->factorU);
+    Matrix* V0 = copy(network->connections[0]->factorV);
+    Matrix* W0 = copy(network->connections[0]->weights);
+    batchGradientDescent(network, dataSet, classSet, CROSS_ENTROPY_LOSS, 4, .5, 0, 0, 0, 1, 0, 0);
+    batchGradientDescent(twice, dataSet, classSet, CROSS_ENTROPY_LOSS, 4, .5, 0, 0, 0, 1, 0, 0);
+    Matrix* step = createMatrixZeroes(40, 30);
+    for (i = 0; i < 40 * 30; i++){
+        step->data[i] = W0->data[i] - twice->connections[0]->weights->data[i];
+    }
+    Matrix* stepU = createMatrixZeroes(40, 3);
+    Matrix* stepV = createMatrixZeroes(3, 30);
+    multiplyTransposedInto(step, V0, stepU);
+    addTransposeMultiply(U0, step, stepV);
+    for (i = 0; i < 40 * 3; i++){
+        assert(fabsf(U0->data[i] - stepU->data[i] - network->connections[0]->factorU->data[i]) < 1e-4);
+    }
+    for (i = 0; i < 3 * 30; i++){
+        assert(fabsf(V0->data[i] - stepV->data[i] - network->connections[0]->factorV->data[i]) < 1e-4);
+    }
+    Matrix* product = multiply(network->connections[0]->factorU, network->connections[0]->factorV);
+    assert(equals(product, network->connections[0]->weights));
+
+    // test training keeps the rank
+    ParameterSet params = {network, dataSet, classSet, CROSS_ENTROPY_LOSS, 2, .1, 0, 0, .9, 4, 0, 0};
+    optimize(params);
+    assert(network->connections[0]->factorU->cols == 3);
+    multiplyInto(network->connections[0]->factorU, network->connections[0]->factorV, product);
+    assert(equals(product, network->connections[0]->weights));
+
+    // test every format stores the trained factors rather than refactorizing
+    saveNetwork(network, "lowrank_network.pkl");
+    assert(saveNetworkBinary(network, "lowrank_network.bin") == 0);
+    assert(saveNetworkCompressed(network, "lowrank_network.lz", ENCODE_FLOAT32) == 0);
+    Network* loaded[] = {readNetwork("lowrank_network.pkl"), readNetworkBinary("lowrank_network.bin"), mapNetwork("lowrank_network.bin"), readNetworkCompressed("lowrank_network.lz", 2)};
+    for (i = 0; i < 4; i++){
+        assert(loaded[i] != NULL);
+        assert(equals(loaded[i]->connections[0]->factorU, network->connections[0]->factorU));
+        assert(equals(loaded[i]->connections[0]->factorV, network->connections[0]->factorV));
+        assert(equals(loaded[i]->connections[0]->weights, network->connections[0]->weights));
+        assert(loaded[i]->connections[1]->factorU == NULL);
+        destroyNetwork(loaded[i]);
+    }
+
+    // test lossy compression leaves out the weights of a factorized
+    // connection, which come back as exactly U * V
+    assert(saveNetworkCompressed(network, "lowrank_network.lz", ENCODE_INT8) == 0);
+    Network* lossy = readNetworkCompressed("lowrank_network.lz", 1);
+    assert(lossy != NULL);
+    assert(equals(lossy->connections[0]->factorU, network->connections[0]->factorU));
+    assert(equals(lossy->connections[0]->weights, network->connections[0]->weights));
+    destroyNetwork(lossy);
+
+    // test destroy
+    destroyMatrix(left);
+    destroyMatrix(right);
+    destroyMatrix(A);
+    destroyMatrix(U);
+    destroyMatrix(V);
+    destroyMatrix(reconstructed);
+    destroyMatrix(leftVectors);
+    destroyMatrix(rightVectors);
+    destroyMatrix(X);
+    destroyMatrix(expected);
+    destroyMatrix(scratch);
+    destroyMatrix(actual);
+    destroyMatrix(before);
+    destroyDataSet(dataSet);
+    destroyDataSet(classSet);
+    destroyNetwork(network);
+    destroyNetwork(fromFile);
+    destroyNetwork(twice);
+    destroyMatrix(U0);
+    destroyMatrix(V0);
+    destroyMatrix(W0);
+    destroyMatrix(step);
+    destroyMatrix(stepU);
+    destroyMatrix(stepV);
+    destroyMatrix(product);
+
+    return 0;
+}
\ No newline at end of file
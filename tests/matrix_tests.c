@@ -35,6 +35,14 @@ int main(){
         assert(batches[i]->rows == 3 + (i < 2 ? 1 : 0));
     }
 
+    // test views share the rows they pick
+    size_t picked[] = {19, 0, 7};
+    DataSet* view = createDataSetView(C, picked, 3);
+    assert(view->rows == 3 && view->cols == 2);
+    for (i = 0; i < 3; i++){
+        assert(view->data[i] == C->data[picked[i]]);
+    }
+
     // test transpose
     Matrix* transposed = transpose(B);
     assert(transposed->rows == 4 && transposed->cols == 3);
@@ -56,6 +64,50 @@ int main(){
     assert(getMatrix(product, 0, 0) == 5);
     assert(getMatrix(product, 2, 3) == 38);
 
+    // test transposed products against the plain one (A is symmetric)
+    Matrix* viaTranspose = createMatrixZeroes(3, 4);
+    multiplyTransposedInto(A, transposed, viaTranspose);
+    assert(equals(viaTranspose, product));
+    zeroMatrix(viaTranspose);
+    addTransposeMultiply(A, B, viaTranspose);
+    addTransposeMultiply(A, B, viaTranspose);
+    for (i = 0; i < 3 * 4; i++){
+        assert(viaTranspose->data[i] == 2 * product->data[i]);
+    }
+    destroyMatrix(viaTranspose);
+
+    // test every tiling gives the bits of a plain dot product per entry
+    Matrix* left = createMatrixZeroes(37, 53);
+    Matrix* right = createMatrixZeroes(53, 29);
+    Matrix* tiled = createMatrixZeroes(37, 29);
+    for (i = 0; i < 37 * 53; i++){
+        left->data[i] = (float)rand() / RAND_MAX - .5;
+    }
+    for (i = 0; i < 53 * 29; i++){
+        right->data[i] = (float)rand() / RAND_MAX - .5;
+    }
+    GemmBlocking defaultBlocking = currentGemmBlocking();
+    GemmBlocking blockings[] = {{1, 1, 1}, {5, 7, 3}, {32, 256, 256}, {64, 16, 8}, {1000, 1000, 1000}};
+    int b, r, c, k;
+    for (b = 0; b < 5; b++){
+        setGemmBlocking(blockings[b]);
+        assert(currentGemmBlocking().depthBlock == blockings[b].depthBlock);
+        multiplyInto(left, right, tiled);
+        for (r = 0; r < 37; r++){
+            for (c = 0; c < 29; c++){
+                float dot = 0;
+                for (k = 0; k < 53; k++){
+                    dot += left->data[r * 53 + k] * right->data[k * 29 + c];
+                }
+                assert(tiled->data[r * 29 + c] == dot);
+            }
+        }
+    }
+    setGemmBlocking(defaultBlocking);
+    destroyMatrix(left);
+    destroyMatrix(right);
+    destroyMatrix(tiled);
+
     // test hadamard
     Matrix* hadamardProduct = hadamard(A, A);
     assert(getMatrix(hadamardProduct, 1, 2) == getMatrix(A, 1, 2) * getMatrix(A, 1, 2));
@@ -70,9 +122,9 @@ int main(){
 
     // test conversion
     float** datasetData = (float**)malloc(sizeof(float*) * 3);
-    datasetData[0] = (float*)malloc(sizeof(float) * 3);
-    datasetData[1] = (float*)malloc(sizeof(float) * 3);
-    datasetData[2] = (float*)malloc(sizeof(float) * 3);
+    datasetData[0] = (float*)calloc(3, sizeof(float));
+    datasetData[1] = (float*)calloc(3, sizeof(float));
+    datasetData[2] = (float*)calloc(3, sizeof(float));
     datasetData[0][0] = 1;
     datasetData[1][1] = 1;
     datasetData[2][2] = 1;
@@ -87,6 +139,7 @@ int main(){
     // test destroy
     destroyMatrix(A);
     destroyMatrix(B);
+    destroyDataSetView(view);
     destroyDataSet(C);
     destroyDataSet(ds);
     destroyMatrix(mds);
@@ -82,6 +82,163 @@ int main(){
     assert(equals(networkNoHidden->connections[0]->weights, fromFile2->connections[0]->weights) == 1);
     assert(equals(networkNoHidden->connections[0]->bias, fromFile2->connections[0]->bias) == 1);
 
+    // test chunked evaluation against a full forward pass
+    int numRows = 50;
+    float** eval_data = (float**)malloc(sizeof(float*) * numRows);
+    float** eval_classes = (float**)malloc(sizeof(float*) * numRows);
+    for (i = 0; i < numRows; i++){
+        eval_data[i] = (float*)malloc(sizeof(float) * 5);
+        eval_classes[i] = (float*)calloc(4, sizeof(float));
+        for (j = 0; j < 5; j++){
+            eval_data[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        eval_classes[i][rand() % 4] = 1;
+    }
+    DataSet* evalData = createDataSet(numRows, 5, eval_data);
+    DataSet* evalClasses = createDataSet(numRows, 4, eval_classes);
+    forwardPassDataSet(network, evalData);
+    int* evalPredictions = predict(network);
+    size_t expectedCorrect = 0;
+    for (i = 0; i < numRows; i++){
+        expectedCorrect += evalClasses->data[i][evalPredictions[i]] == 1;
+    }
+    free(evalPredictions);
+    float expectedCrossEntropy = crossEntropyLoss(network, getOuput(network), evalClasses, .01);
+    float expectedSquaredError = meanSquaredError(network, getOuput(network), evalClasses, .01);
+    assert(accuracy(network, evalData, evalClasses) == (float)expectedCorrect / numRows);
+    assert(fabs(crossEntropyLossDataSet(network, evalData, evalClasses, .01) - expectedCrossEntropy) < 1e-4);
+    assert(fabs(meanSquaredErrorDataSet(network, evalData, evalClasses, .01) - expectedSquaredError) < 1e-4);
+
+    // totals do not depend on chunk size or thread count
+    Evaluation baseline = evaluateNetwork(network, evalData, evalClasses, 7, 1);
+    size_t chunkSizes[] = {1, 7, 1000};
+    int threadCounts[] = {1, 3};
+    int c, t;
+    for (c = 0; c < 3; c++){
+        for (t = 0; t < 2; t++){
+            Evaluation evaluation = evaluateNetwork(network, evalData, evalClasses, chunkSizes[c], threadCounts[t]);
+            assert(evaluation.rows == numRows && evaluation.numCorrect == expectedCorrect);
+            assert(fabs(evaluation.crossEntropy - baseline.crossEntropy) < 1e-3);
+            assert(fabs(evaluation.squaredError - baseline.squaredError) < 1e-3);
+            if (chunkSizes[c] == 7){
+                assert(evaluation.crossEntropy == baseline.crossEntropy);
+                assert(evaluation.squaredError == baseline.squaredError);
+            }
+        }
+    }
+
+    // test normalization stats
+    for (i = 0; i < numRows; i++){
+        for (j = 0; j < 5; j++){
+            evalData->data[i][j] = evalData->data[i][j] * (j + 1) * 10 + j * 100;
+        }
+    }
+    computeNormalization(network, evalData);
+    for (j = 0; j < 5; j++){
+        double mean = 0, variance = 0;
+        for (i = 0; i < numRows; i++){
+            mean += evalData->data[i][j];
+        }
+        mean /= numRows;
+        for (i = 0; i < numRows; i++){
+            variance += (evalData->data[i][j] - mean) * (evalData->data[i][j] - mean);
+        }
+        assert(fabs(network->featureMean[j] - mean) < 1e-3);
+        assert(fabs(1 / network->featureScale[j] - sqrt(variance / numRows)) < 1e-3);
+    }
+
+    // test forward passes standardize their input until the stats are folded
+    Matrix* raw = dataSetToMatrix(evalData);
+    Matrix* standardized = copy(raw);
+    normalizeInput(network, standardized);
+    // reference: standardized input with the stats switched off
+    float* savedMean = network->featureMean;
+    network->featureMean = NULL;
+    forwardPass(network, standardized);
+    Matrix* reference = copy(getOuput(network));
+    network->featureMean = savedMean;
+    forwardPass(network, raw);
+    for (i = 0; i < numRows * 4; i++){
+        assert(fabsf(getOuput(network)->data[i] - reference->data[i]) < 1e-5);
+    }
+    Workspace* normWorkspace = createWorkspace(network, 8);
+    Matrix* workspaceOut = forwardPassWorkspace(network, normWorkspace, raw);
+    for (i = 0; i < numRows * 4; i++){
+        assert(fabsf(workspaceOut->data[i] - reference->data[i]) < 1e-5);
+    }
+    Matrix* unfoldedWeights = copy(network->connections[0]->weights);
+    foldNormalization(network);
+    assert(network->normalizationFolded);
+    forwardPass(network, raw);
+    for (i = 0; i < numRows * 4; i++){
+        assert(fabsf(getOuput(network)->data[i] - reference->data[i]) < 1e-4);
+    }
+    workspaceOut = forwardPassWorkspace(network, normWorkspace, raw);
+    for (i = 0; i < numRows * 4; i++){
+        assert(fabsf(workspaceOut->data[i] - reference->data[i]) < 1e-4);
+    }
+
+    // test stats survive serialization, folded or not
+    saveNetwork(network, "network.pkl");
+    Network* normalizedFromFile = readNetwork("network.pkl");
+    assert(normalizedFromFile->normalizationFolded == 1);
+    for (j = 0; j < 5; j++){
+        assert(normalizedFromFile->featureMean[j] == network->featureMean[j]);
+        assert(normalizedFromFile->featureScale[j] == network->featureScale[j]);
+    }
+    destroyNetwork(normalizedFromFile);
+    unfoldNormalization(network);
+    assert(!network->normalizationFolded);
+    for (i = 0; i < unfoldedWeights->rows * unfoldedWeights->cols; i++){
+        assert(fabsf(network->connections[0]->weights->data[i] - unfoldedWeights->data[i]) < 1e-4);
+    }
+    saveNetwork(network, "network.pkl");
+    normalizedFromFile = readNetwork("network.pkl");
+    assert(normalizedFromFile->normalizationFolded == 0 && normalizedFromFile->featureScale[4] == network->featureScale[4]);
+    forwardPass(normalizedFromFile, raw);
+    for (i = 0; i < numRows * 4; i++){
+        assert(fabsf(getOuput(normalizedFromFile)->data[i] - reference->data[i]) < 1e-4);
+    }
+    destroyNetwork(normalizedFromFile);
+    destroyWorkspace(normWorkspace);
+    destroyMatrix(unfoldedWeights);
+    destroyMatrix(reference);
+    destroyMatrix(standardized);
+    destroyMatrix(raw);
+    destroyDataSet(evalData);
+    destroyDataSet(evalClasses);
+
+    // test parameters live in one aligned arena, weights before biases
+    assert(isNetworkFlat(network));
+    assert((uintptr_t)network->parameters % (sizeof(float) * PARAMETER_ALIGNMENT) == 0);
+    size_t weightsOffset[3], biasOffset[3];
+    assert(parameterLayout(network, weightsOffset, biasOffset) == network->numParameters);
+    for (i = 0; i < 3; i++){
+        assert(network->connections[i]->weights->data == network->parameters + weightsOffset[i]);
+        assert(network->connections[i]->bias->data == network->parameters + biasOffset[i]);
+        assert(weightsOffset[i] % PARAMETER_ALIGNMENT == 0 && biasOffset[i] % PARAMETER_ALIGNMENT == 0);
+        assert(weightsOffset[i] < biasOffset[0]);
+    }
+    double squares = 0;
+    for (i = 0; i < 3; i++){
+        Matrix* weights = network->connections[i]->weights;
+        for (j = 0; j < weights->rows * weights->cols; j++){
+            squares += weights->data[j] * weights->data[j];
+        }
+    }
+    assert(fabs(weightSquaredSum(network) - squares) < 1e-6 * squares);
+
+    // test copying parameters and reflattening after matrices are replaced
+    Network* twin = createNetwork(5, 2, hiddenSize, hiddenActivations, 4, softmax);
+    copyNetworkParameters(network, twin);
+    assert(memcmp(twin->parameters, network->parameters, sizeof(float) * network->numParameters) == 0);
+    setConnectionMatrices(twin->connections[1], copy(twin->connections[1]->weights), copy(twin->connections[1]->bias));
+    assert(!isNetworkFlat(twin));
+    flattenNetwork(twin);
+    assert(isNetworkFlat(twin));
+    assert(memcmp(twin->parameters, network->parameters, sizeof(float) * network->numParameters) == 0);
+    destroyNetwork(twin);
+
     // test destroy
     destroyMatrix(predictM);
     destroyDataSet(actual);
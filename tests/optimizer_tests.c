@@ -105,6 +105,16 @@ int main(){
     batchGradientDescent(networkF, trainingDataF, trainingClassesF, CROSS_ENTROPY_LOSS, 20, .01, 0, .01, .5, 1000, 1, 1);
     printf("Final accuracy of %f\n", accuracy(networkF, trainingDataF, trainingClassesF));
 
+    // test the same data with input standardization folded into the network
+    Network* networkN = createNetwork(2, 1, hiddenSizeF, hiddenActivationsF, 2, softmax);
+    computeNormalization(networkN, trainingDataF);
+    foldNormalization(networkN);
+    printf("\nTESTING ON PARABOLA WITH STANDARDIZED INPUTS:\n");
+    printf("Starting accuracy of %f\n", accuracy(networkN, trainingDataF, trainingClassesF));
+    batchGradientDescent(networkN, trainingDataF, trainingClassesF, CROSS_ENTROPY_LOSS, 20, .01, 0, .01, .5, 1000, 1, 1);
+    printf("Final accuracy of %f\n", accuracy(networkN, trainingDataF, trainingClassesF));
+    assert(networkN->normalizationFolded);
+
     // test on regression on y=x^2 + 15
     float** dataReg = (float**)malloc(sizeof(float*) * 1000);
     for (i = 0; i < 1000; i++){
@@ -138,6 +148,11 @@ int main(){
     ParameterSet params = {networkReg, trainingDataReg, trainingClassesReg, MEAN_SQUARED_ERROR, 20, .01, 0, .001, .9, 200, 1, 1};
     printf("\n");
     optimize(params);
+
+    // test a decaying velocity is flushed to zero rather than left denormal
+    float values[] = {1, 1}, gradient[] = {0, 0}, velocity[] = {FLT_MIN, 1};
+    stepValues(values, gradient, velocity, 2, 1, 0, .5);
+    assert(velocity[0] == 0 && velocity[1] == .5 && values[1] == .5);
     
     destroyDataSet(trainingData);
     destroyDataSet(trainingClasses);
@@ -145,6 +160,7 @@ int main(){
     destroyDataSet(trainingDataF);
     destroyDataSet(trainingClassesF);
     destroyNetwork(networkF);
+    destroyNetwork(networkN);
     destroyDataSet(oneExData);
     destroyDataSet(trainingDataReg);
     destroyDataSet(trainingClassesReg);
@@ -0,0 +1,84 @@
+#include "../src/cranium.h"
+
+#define ROWS 2048
+#define BATCH 64
+#define STEPS 64
+#define DEPTH 12
+#define WIDTH 128
+
+static double benchSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// trains a 12-layer network one example at a time and through pipelines of
+// 1, 2 and 4 stages, and compares the measured bubble with (S - 1) / (M + S - 1)
+int main(){
+    srand(1);
+    size_t features = 32, outputs = 10;
+    float** rows = (float**)malloc(sizeof(float*) * ROWS);
+    float** labels = (float**)malloc(sizeof(float*) * ROWS);
+    size_t i, j;
+    for (i = 0; i < ROWS; i++){
+        rows[i] = (float*)malloc(sizeof(float) * features);
+        labels[i] = (float*)calloc(outputs, sizeof(float));
+        for (j = 0; j < features; j++){
+            rows[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        labels[i][rand() % outputs] = 1;
+    }
+    DataSet* data = createDataSet(ROWS, features, rows);
+    DataSet* classes = createDataSet(ROWS, outputs, labels);
+
+    size_t hiddenSize[DEPTH - 1];
+    Activation hiddenActivation[DEPTH - 1];
+    for (i = 0; i < DEPTH - 1; i++){
+        hiddenSize[i] = WIDTH;
+        hiddenActivation[i] = relu;
+    }
+    Network* initial = createNetwork(features, DEPTH - 1, hiddenSize, hiddenActivation, outputs, softmax);
+    Network* network = createNetwork(features, DEPTH - 1, hiddenSize, hiddenActivation, outputs, softmax);
+
+    printf("%d rows, %d layers of %d, batch %d, %d steps, %ld cores\n", ROWS, DEPTH, WIDTH, BATCH, STEPS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("schedule    stages    micro-batches    seconds    speedup    bubble    ideal bubble    min utilization\n");
+    copyNetworkParameters(initial, network);
+    TrainingState* state = createTrainingState(network, CROSS_ENTROPY_LOSS);
+    double start = benchSeconds();
+    trainGradientDescent(state, data, classes, BATCH, .01, 0, 0, .9, STEPS, 1, 0);
+    double baseline = benchSeconds() - start;
+    destroyTrainingState(state);
+    printf("%8s %9d %16d %10.3f %10.2f %9s %15s %18s\n", "serial", 1, 1, baseline, 1.0, "-", "-", "-");
+
+    int stageCounts[] = {1, 2, 4};
+    PIPELINE_SCHEDULE schedules[] = {PIPELINE_GPIPE, PIPELINE_1F1B};
+    size_t numMicroBatches = 8;
+    int s, c;
+    for (c = 0; c < 2; c++){
+        for (s = 0; s < 3; s++){
+            int numStages = stageCounts[s];
+            copyNetworkParameters(initial, network);
+            state = createTrainingState(network, CROSS_ENTROPY_LOSS);
+            Pipeline* pipeline = createPipeline(state, numStages, numMicroBatches, BATCH, schedules[c], NULL);
+            start = benchSeconds();
+            pipelineGradientDescent(pipeline, data, classes, BATCH, .01, 0, 0, .9, STEPS, 1, 0);
+            double seconds = benchSeconds() - start;
+            float least = 1;
+            int stage;
+            for (stage = 0; stage < numStages; stage++){
+                float utilization = stageUtilization(pipeline, stage);
+                least = utilization < least ? utilization : least;
+            }
+            float ideal = (float)(numStages - 1) / (numMicroBatches + numStages - 1);
+            printf("%8s %9d %16zu %10.3f %10.2f %8.1f%% %14.1f%% %17.1f%%\n", c == 0 ? "gpipe" : "1f1b", numStages, numMicroBatches, seconds, baseline / seconds, 100 * bubbleFraction(pipeline), 100 * ideal, 100 * least);
+            destroyPipeline(pipeline);
+            destroyTrainingState(state);
+        }
+    }
+
+    destroyNetwork(initial);
+    destroyNetwork(network);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    return 0;
+}
\ No newline at end of file
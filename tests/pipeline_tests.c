@@ -0,0 +1,119 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/placement.h"
+#include "../src/pipeline.h"
+
+#define ROWS 64
+#define STEPS 20
+
+// trains a copy of $initial one example at a time and through a pipeline of
+// $numStages stages and $numMicroBatches micro-batches, and checks the two
+// end up with the same parameters
+static void compareWithSerial(Network* initial, DataSet* data, DataSet* classes, LOSS_FUNCTION lossFunction, size_t batchSize, int numStages, size_t numMicroBatches, PIPELINE_SCHEDULE schedule, CpuTopology* topology){
+    size_t sizes[initial->numLayers];
+    Activation activations[initial->numLayers];
+    int i;
+    for (i = 0; i < initial->numLayers; i++){
+        sizes[i] = initial->layers[i]->size;
+        activations[i] = i + 1 < initial->numLayers ? initial->layers[i + 1]->activation : NULL;
+    }
+    Network* serial = allocateNetwork(initial->numLayers, sizes, activations);
+    Network* piped = allocateNetwork(initial->numLayers, sizes, activations);
+    copyNetworkParameters(initial, serial);
+    copyNetworkParameters(initial, piped);
+    computeNormalization(serial, data);
+    computeNormalization(piped, data);
+
+    TrainingState* serialState = createTrainingState(serial, lossFunction);
+    TrainingState* pipedState = createTrainingState(piped, lossFunction);
+    pipedState->random = serialState->random;
+    trainGradientDescent(serialState, data, classes, batchSize, .1, 0, .001, .9, STEPS, 1, 0);
+
+    Pipeline* pipeline = createPipeline(pipedState, numStages, numMicroBatches, batchSize, schedule, topology);
+    for (i = 0; i < numStages; i++){
+        assert(pipeline->firstConnection[i] < pipeline->firstConnection[i + 1]);
+    }
+    assert(pipeline->firstConnection[0] == 0 && pipeline->firstConnection[numStages] == piped->numConnections);
+    pipelineGradientDescent(pipeline, data, classes, batchSize, .1, 0, .001, .9, STEPS, 1, 0);
+    assert(pipedState->epoch == STEPS + 1 && pipedState->batchGradient == NULL);
+    for (i = 0; i < piped->numParameters; i++){
+        assert(fabsf(piped->parameters[i] - serial->parameters[i]) < 1e-4);
+    }
+
+    // stage times fit inside the step times
+    assert(pipeline->steps == STEPS);
+    float bubble = bubbleFraction(pipeline);
+    assert(bubble >= 0 && bubble <= 1);
+    for (i = 0; i < numStages; i++){
+        assert(stageUtilization(pipeline, i) >= 0 && stageUtilization(pipeline, i) <= 1.01);
+    }
+    resetPipelineStats(pipeline);
+    assert(pipeline->steps == 0 && bubbleFraction(pipeline) == 0);
+
+    destroyPipeline(pipeline);
+    destroyTrainingState(serialState);
+    destroyTrainingState(pipedState);
+    destroyNetwork(serial);
+    destroyNetwork(piped);
+}
+
+int main(){
+    srand(time(NULL));
+    int i, j;
+    float** points = (float**)malloc(sizeof(float*) * ROWS);
+    float** labels = (float**)malloc(sizeof(float*) * ROWS);
+    float** values = (float**)malloc(sizeof(float*) * ROWS);
+    for (i = 0; i < ROWS; i++){
+        points[i] = (float*)malloc(sizeof(float) * 4);
+        labels[i] = (float*)calloc(3, sizeof(float));
+        values[i] = (float*)malloc(sizeof(float) * 3);
+        for (j = 0; j < 4; j++){
+            points[i][j] = 10.0 * rand() / RAND_MAX + j;
+        }
+        labels[i][rand() % 3] = 1;
+        for (j = 0; j < 3; j++){
+            values[i][j] = points[i][j] - points[i][j + 1];
+        }
+    }
+    DataSet* data = createDataSet(ROWS, 4, points);
+    DataSet* classes = createDataSet(ROWS, 3, labels);
+    DataSet* targets = createDataSet(ROWS, 3, values);
+
+    // test a deep network under both schedules, with stages and micro-batches
+    // that divide it evenly, unevenly, and leave micro-batches empty
+    size_t hiddenSize[] = {8, 6, 8, 6, 5};
+    Activation hiddenActivation[] = {relu, tanH, sigmoid, relu, tanH};
+    Network* classifier = createNetwork(4, 5, hiddenSize, hiddenActivation, 3, softmax);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 1, 1, PIPELINE_GPIPE, NULL);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 3, 4, PIPELINE_GPIPE, NULL);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 3, 4, PIPELINE_1F1B, NULL);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 6, 5, PIPELINE_1F1B, NULL);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 2, 32, PIPELINE_1F1B, NULL);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 24, 4, 3, PIPELINE_GPIPE, NULL);
+
+    // test stages pinned to a machine and to two nodes sharing its first CPU
+    CpuTopology* machine = detectTopology();
+    int cpus[] = {machine->cpus[0], machine->cpus[0]}, nodes[] = {0, 1};
+    CpuTopology* twoNodes = createTopology(2, cpus, nodes);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 3, 4, PIPELINE_1F1B, machine);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 4, 2, PIPELINE_GPIPE, twoNodes);
+    compareWithSerial(classifier, data, classes, CROSS_ENTROPY_LOSS, 16, 1, 4, PIPELINE_GPIPE, twoNodes);
+    destroyTopology(machine);
+    destroyTopology(twoNodes);
+
+    // test regression
+    Network* regressor = createNetwork(4, 5, hiddenSize, hiddenActivation, 3, linear);
+    compareWithSerial(regressor, data, targets, MEAN_SQUARED_ERROR, 8, 2, 4, PIPELINE_1F1B, NULL);
+
+    destroyNetwork(classifier);
+    destroyNetwork(regressor);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    destroyDataSet(targets);
+
+    return 0;
+}
\ No newline at end of file
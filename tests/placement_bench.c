@@ -0,0 +1,106 @@
+#include "../src/cranium.h"
+
+#define ROWS 4000
+#define REPEATS 3
+
+static double benchSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// runs the threaded evaluator, the pipeline and cross-validation with one
+// thread per CPU, unpinned and pinned to the detected nodes, and reports
+// the best time of a few runs of each
+int main(){
+    srand(1);
+    size_t features = 128, outputs = 10;
+    float** rows = (float**)malloc(sizeof(float*) * ROWS);
+    float** labels = (float**)malloc(sizeof(float*) * ROWS);
+    size_t i, j;
+    for (i = 0; i < ROWS; i++){
+        rows[i] = (float*)malloc(sizeof(float) * features);
+        labels[i] = (float*)calloc(outputs, sizeof(float));
+        for (j = 0; j < features; j++){
+            rows[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        labels[i][rand() % outputs] = 1;
+    }
+    DataSet* data = createDataSet(ROWS, features, rows);
+    DataSet* classes = createDataSet(ROWS, outputs, labels);
+    size_t hiddenSize[] = {512, 512, 256};
+    Activation hiddenActivation[] = {relu, relu, relu};
+    Network* network = createNetwork(features, 3, hiddenSize, hiddenActivation, outputs, softmax);
+
+    CpuTopology* topology = detectTopology();
+    int numThreads = topology->numCpus;
+    NodeReplicas* replicas = createNodeReplicas(network, topology);
+    printf("%d nodes, %d CPUs, %d threads\n", topology->numNodes, topology->numCpus, numThreads);
+    printf("workload                        unpinned (s)    pinned (s)    pinned + replicas (s)\n");
+
+    double best[3] = {1e30, 1e30, 1e30};
+    int r, mode;
+    for (r = 0; r < REPEATS; r++){
+        for (mode = 0; mode < 3; mode++){
+            double start = benchSeconds();
+            if (mode == 0){
+                evaluateNetwork(network, data, classes, EVALUATION_CHUNK_ROWS, numThreads);
+            }
+            else{
+                evaluateNetworkPinned(network, mode == 2 ? replicas : NULL, topology, data, classes, EVALUATION_CHUNK_ROWS, numThreads);
+            }
+            double seconds = benchSeconds() - start;
+            best[mode] = seconds < best[mode] ? seconds : best[mode];
+        }
+    }
+    printf("%-30s %14.3f %13.3f %24.3f\n", "evaluation, 4000 rows", best[0], best[1], best[2]);
+
+    // four stages keep a pipeline busy even on a small machine
+    Network* deep = createNetwork(features, 3, hiddenSize, hiddenActivation, outputs, softmax);
+    best[0] = best[1] = 1e30;
+    for (r = 0; r < REPEATS; r++){
+        for (mode = 0; mode < 2; mode++){
+            copyNetworkParameters(network, deep);
+            TrainingState* state = createTrainingState(deep, CROSS_ENTROPY_LOSS);
+            Pipeline* pipeline = createPipeline(state, 4, 8, 128, PIPELINE_1F1B, mode == 1 ? topology : NULL);
+            double start = benchSeconds();
+            pipelineGradientDescent(pipeline, data, classes, 128, .01, 0, 0, .9, 20, 0, 0);
+            double seconds = benchSeconds() - start;
+            best[mode] = seconds < best[mode] ? seconds : best[mode];
+            destroyPipeline(pipeline);
+            destroyTrainingState(state);
+        }
+    }
+    printf("%-30s %14.3f %13.3f %24s\n", "pipeline, 4 stages, 20 steps", best[0], best[1], "-");
+
+    size_t first[2000];
+    for (i = 0; i < 2000; i++){
+        first[i] = i;
+    }
+    DataSet* small = createDataSetView(data, first, 2000);
+    DataSet* smallClasses = createDataSetView(classes, first, 2000);
+    size_t narrow[] = {64};
+    Network* template = createNetwork(features, 1, narrow, hiddenActivation, outputs, softmax);
+    ParameterSet params = {template, small, smallClasses, CROSS_ENTROPY_LOSS, 50, .05, 0, 0, .9, 100, 0, 0};
+    best[0] = best[1] = 1e30;
+    for (r = 0; r < REPEATS; r++){
+        for (mode = 0; mode < 2; mode++){
+            double start = benchSeconds();
+            destroyCrossValidation(crossValidate(params, 8, numThreads, mode == 1 ? topology : NULL));
+            double seconds = benchSeconds() - start;
+            best[mode] = seconds < best[mode] ? seconds : best[mode];
+        }
+    }
+    printf("%-30s %14.3f %13.3f %24s\n", "8-fold cross-validation", best[0], best[1], "-");
+
+    destroyNodeReplicas(replicas);
+    destroyTopology(topology);
+    destroyNetwork(network);
+    destroyNetwork(deep);
+    destroyNetwork(template);
+    destroyDataSetView(small);
+    destroyDataSetView(smallClasses);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    return 0;
+}
\ No newline at end of file
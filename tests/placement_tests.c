@@ -0,0 +1,180 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/prune.h"
+#include "../src/placement.h"
+
+typedef struct PinCheck_ {
+    CpuTopology* topology;
+    int worker;
+    int numWorkers;
+    int pinned;
+    int cpu;
+} PinCheck;
+
+#ifdef CRANIUM_USE_POSIX
+static void* checkPin(void* argument){
+    PinCheck* check = (PinCheck*)argument;
+    check->pinned = pinThread(check->topology, check->worker, check->numWorkers);
+#ifdef __linux__
+    check->cpu = sched_getcpu();
+#endif
+    return NULL;
+}
+#endif
+
+int main(){
+    srand(time(NULL));
+    int i, j;
+
+    // test the detected topology lists each allowed CPU once, node by node
+    CpuTopology* machine = detectTopology();
+    assert(machine->numNodes >= 1 && machine->numCpus >= machine->numNodes);
+    assert(machine->firstCpu[0] == 0 && machine->firstCpu[machine->numNodes] == machine->numCpus);
+    for (i = 0; i < machine->numNodes; i++){
+        assert(machine->firstCpu[i] < machine->firstCpu[i + 1]);
+    }
+    for (i = 0; i < machine->numCpus; i++){
+        for (j = 0; j < i; j++){
+            assert(machine->cpus[i] != machine->cpus[j]);
+        }
+    }
+    printf("%d nodes, %d CPUs\n", machine->numNodes, machine->numCpus);
+
+    // test a given topology is grouped by node, keeping the order within one
+    int cpus[] = {4, 0, 5, 1, 6, 2, 7, 3};
+    int nodes[] = {1, 0, 1, 0, 1, 0, 1, 0};
+    CpuTopology* dual = createTopology(8, cpus, nodes);
+    assert(dual->numNodes == 2 && dual->numCpus == 8);
+    assert(dual->firstCpu[1] == 4 && dual->firstCpu[2] == 8);
+    for (i = 0; i < 8; i++){
+        assert(dual->cpus[i] == i);
+    }
+
+    // test workers form one group per node, spread over its CPUs
+    for (i = 0; i < 8; i++){
+        assert(workerCpu(dual, i, 8) == i && workerNode(dual, i, 8) == i / 4);
+    }
+    assert(workerNode(dual, 0, 2) == 0 && workerNode(dual, 1, 2) == 1);
+    assert(workerCpu(dual, 0, 4) == 0 && workerCpu(dual, 1, 4) == 2 && workerCpu(dual, 2, 4) == 4 && workerCpu(dual, 3, 4) == 6);
+    for (i = 0; i < 16; i++){
+        assert(workerCpu(dual, i, 16) == i / 2 && workerNode(dual, i, 16) == i / 8);
+    }
+    assert(workerNode(dual, 0, 1) == 0 && workerNode(dual, 2, 3) == 1);
+
+#ifdef CRANIUM_USE_POSIX
+    // test a pinned thread runs where it was put, and a missing CPU is refused
+    PinCheck check = {machine, machine->numCpus - 1, machine->numCpus, -1, -1};
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, checkPin, &check) == 0);
+    pthread_join(thread, NULL);
+#ifdef __linux__
+    assert(check.pinned == 0 && check.cpu == workerCpu(machine, machine->numCpus - 1, machine->numCpus));
+    int missing[] = {CPU_SETSIZE + 1}, zero[] = {0};
+    CpuTopology* nowhere = createTopology(1, missing, zero);
+    check.topology = nowhere;
+    check.worker = 0;
+    check.numWorkers = 1;
+    assert(pthread_create(&thread, NULL, checkPin, &check) == 0);
+    pthread_join(thread, NULL);
+    assert(check.pinned == -1);
+    destroyTopology(nowhere);
+#endif
+#endif
+
+    // test replicas on two nodes that share the first CPU
+    int shared[] = {machine->cpus[0], machine->cpus[0]}, twoNodes[] = {0, 1};
+    CpuTopology* simulated = createTopology(2, shared, twoNodes);
+    float** rows = (float**)malloc(sizeof(float*) * 1000);
+    float** labels = (float**)malloc(sizeof(float*) * 1000);
+    for (i = 0; i < 1000; i++){
+        rows[i] = (float*)malloc(sizeof(float) * 6);
+        labels[i] = (float*)calloc(3, sizeof(float));
+        for (j = 0; j < 6; j++){
+            rows[i][j] = 4.0 * rand() / RAND_MAX + j;
+        }
+        labels[i][rand() % 3] = 1;
+    }
+    DataSet* data = createDataSet(1000, 6, rows);
+    DataSet* classes = createDataSet(1000, 3, labels);
+    size_t hiddenSize[] = {10, 7};
+    Activation hiddenActivation[] = {relu, tanH};
+    Network* network = createNetwork(6, 2, hiddenSize, hiddenActivation, 3, softmax);
+    computeNormalization(network, data);
+    NodeReplicas* replicas = createNodeReplicas(network, simulated);
+    for (i = 0; i < 2; i++){
+        Network* replica = replicas->networks[i];
+        assert(replica != network && replica->parameters != network->parameters);
+        assert(memcmp(replica->parameters, network->parameters, sizeof(float) * network->numParameters) == 0);
+        assert(memcmp(replica->featureScale, network->featureScale, sizeof(float) * 6) == 0);
+        assert(replica->layers[2]->activation == tanH && replica->layers[3]->activation == softmax);
+    }
+
+    // test pinned evaluation matches the shared-network evaluator exactly
+    Evaluation expected = evaluateNetwork(network, data, classes, 64, 1);
+    int threadCounts[] = {1, 3, 16, 100};
+    for (i = 0; i < 4; i++){
+        Evaluation pinned = evaluateNetworkPinned(network, NULL, machine, data, classes, 64, threadCounts[i]);
+        Evaluation replicated = evaluateNetworkPinned(network, replicas, simulated, data, classes, 64, threadCounts[i]);
+        assert(pinned.numCorrect == expected.numCorrect && pinned.crossEntropy == expected.crossEntropy);
+        assert(replicated.numCorrect == expected.numCorrect && replicated.crossEntropy == expected.crossEntropy);
+        assert(replicated.squaredError == expected.squaredError && replicated.l2 == expected.l2);
+    }
+
+    // test updated parameters reach every replica
+    for (i = 0; i < network->numParameters; i++){
+        network->parameters[i] *= .5;
+    }
+    for (i = 0; i < network->numConnections; i++){
+        refreshConnection(network->connections[i]);
+    }
+    updateNodeReplicas(replicas, network);
+    expected = evaluateNetwork(network, data, classes, 64, 1);
+    Evaluation replicated = evaluateNetworkPinned(network, replicas, simulated, data, classes, 64, 4);
+    assert(replicated.numCorrect == expected.numCorrect && replicated.crossEntropy == expected.crossEntropy);
+
+    // test replicas of a half precision, pruned network keep its precision and pattern
+    setNetworkPrecision(network, FLOAT16);
+    pruneNetwork(network, .5);
+    NodeReplicas* pruned = createNodeReplicas(network, simulated);
+    updateNodeReplicas(replicas, network);
+    Matrix* input = createMatrixZeroes(5, 6);
+    for (i = 0; i < 5 * 6; i++){
+        input->data[i] = rows[i / 6][i % 6];
+    }
+    forwardPass(network, input);
+    Matrix* output = copy(getOuput(network));
+    for (i = 0; i < 4; i++){
+        Network* replica = (i < 2 ? pruned : replicas)->networks[i % 2];
+        for (j = 0; j < network->numConnections; j++){
+            Connection* source = network->connections[j];
+            Connection* target = replica->connections[j];
+            assert(target->precision == FLOAT16 && target->halfWeights != NULL);
+            assert(target->sparseWeights != NULL && target->sparseWeights->nonZero == source->sparseWeights->nonZero);
+            assert(memcmp(target->sparseWeights->colIndex, source->sparseWeights->colIndex, sizeof(size_t) * source->sparseWeights->nonZero) == 0);
+            assert(memcmp(target->sparseWeights->values, source->sparseWeights->values, sizeof(float) * source->sparseWeights->nonZero) == 0);
+            assert(memcmp(target->halfWeights->data, source->halfWeights->data, sizeof(uint16_t) * source->weights->rows * source->weights->cols) == 0);
+        }
+        forwardPass(replica, input);
+        assert(memcmp(getOuput(replica)->data, output->data, sizeof(float) * 5 * 3) == 0);
+    }
+    expected = evaluateNetwork(network, data, classes, 64, 1);
+    replicated = evaluateNetworkPinned(network, pruned, simulated, data, classes, 64, 4);
+    assert(replicated.numCorrect == expected.numCorrect && replicated.crossEntropy == expected.crossEntropy);
+    destroyNodeReplicas(pruned);
+    destroyMatrix(output);
+    destroyMatrix(input);
+
+    destroyNodeReplicas(replicas);
+    destroyNetwork(network);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    destroyTopology(simulated);
+    destroyTopology(dual);
+    destroyTopology(machine);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "../src/cranium.h"
+
+#define ROWS 4000
+#define STEPS 300
+#define BATCH 32
+
+static double benchSeconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// trains the same network three times: once before profiling starts, once
+// while profiling, and once after it stops; built without CRANIUM_PROFILE
+// the three take the same time, and built with it the summary is printed
+// and the trace written to profile_bench.json
+int main(){
+    srand(1);
+    size_t features = 64, outputs = 10, i, j;
+    DataSet* data = createDataSetContiguous(ROWS, features);
+    DataSet* classes = createDataSetContiguous(ROWS, outputs);
+    for (i = 0; i < ROWS; i++){
+        for (j = 0; j < features; j++){
+            data->data[i][j] = (float)rand() / RAND_MAX - .5;
+        }
+        classes->data[i][rand() % outputs] = 1;
+    }
+    size_t hiddenSize[] = {128, 64};
+    Activation hiddenActivation[] = {relu, relu};
+    Network* initial = createNetwork(features, 2, hiddenSize, hiddenActivation, outputs, softmax);
+    Network* network = createNetwork(features, 2, hiddenSize, hiddenActivation, outputs, softmax);
+    const char* runs[] = {"not started", "profiling", "stopped"};
+    int r;
+    for (r = 0; r < 3; r++){
+        copyNetworkParameters(initial, network);
+        if (r == 1){
+            startProfiling(200000);
+        }
+        double start = benchSeconds();
+        batchGradientDescent(network, data, classes, CROSS_ENTROPY_LOSS, BATCH, .05 * ROWS / BATCH, 0, 0, .9, STEPS, 1, 0);
+        double seconds = benchSeconds() - start;
+        if (r == 1){
+            stopProfiling();
+        }
+#ifdef CRANIUM_PROFILE
+        printf("profiler on, %-12s %.3f s\n", runs[r], seconds);
+#else
+        printf("profiler off, %-11s %.3f s\n", runs[r], seconds);
+#endif
+    }
+#ifdef CRANIUM_PROFILE
+    printf("\n");
+    printProfile(stdout, 0);
+    if (writeProfileTrace("profile_bench.json") == 0){
+        printf("\nwrote profile_bench.json\n");
+    }
+#endif
+
+    destroyNetwork(initial);
+    destroyNetwork(network);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "../src/std_includes.h"
+#include "../src/profile.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+
+#define TRACE "profile_test_trace.json"
+
+// sums what every thread recorded for $name at $index
+static ProfileOp findOp(const char* name, int index){
+    ProfileOp total = {name, index, 0, 0, 0, 0};
+    int i, j;
+    for (i = 0; i < profileNumThreads; i++){
+        ProfileThread* thread = profileThreads[i];
+        for (j = 0; j < thread->numOps; j++){
+            ProfileOp* op = &thread->ops[j];
+            if (op->index == index && strcmp(op->name, name) == 0){
+                total.calls += op->calls;
+                total.nanoseconds += op->nanoseconds;
+                total.flops += op->flops;
+                total.bytes += op->bytes;
+            }
+        }
+    }
+    return total;
+}
+
+static size_t countOccurrences(const char* path, const char* text){
+    FILE* fp = fopen(path, "r");
+    assert(fp != NULL);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* contents = (char*)malloc(size + 1);
+    assert(fread(contents, 1, size, fp) == (size_t)size);
+    contents[size] = '\0';
+    fclose(fp);
+    size_t count = 0;
+    const char* at = contents;
+    while ((at = strstr(at, text)) != NULL){
+        count++;
+        at += strlen(text);
+    }
+    free(contents);
+    return count;
+}
+
+int main(){
+    srand(time(NULL));
+    int i, j;
+
+    // test nothing is recorded until profiling starts
+    Matrix* A = createMatrixZeroes(3, 4);
+    Matrix* B = createMatrixZeroes(4, 5);
+    Matrix* C = createMatrixZeroes(3, 5);
+    multiplyInto(A, B, C);
+    assert(findOp("multiplyInto", -1).calls == 0);
+
+    // test operations are counted with their work, and only while profiling
+    startProfiling(1000);
+    multiplyInto(A, B, C);
+    multiplyInto(A, B, C);
+    relu(C);
+    stopProfiling();
+    multiplyInto(A, B, C);
+    ProfileOp multiply = findOp("multiplyInto", -1);
+    assert(multiply.calls == 2 && multiply.flops == 2 * 2 * 3 * 4 * 5);
+    assert(multiply.bytes == 2 * 4 * (12 + 20 + 15));
+    assert(findOp("relu", -1).calls == 1 && findOp("relu", -1).flops == 15);
+    assert(profileThreads[0]->numEvents == 3);
+
+    // test training records every layer pass and phase
+    size_t rows = 60, batchSize = 6;
+    int steps = 20;
+    DataSet* data = createDataSetContiguous(rows, 4);
+    DataSet* classes = createDataSetContiguous(rows, 3);
+    for (i = 0; i < rows; i++){
+        for (j = 0; j < 4; j++){
+            data->data[i][j] = (float)rand() / RAND_MAX;
+        }
+        classes->data[i][rand() % 3] = 1;
+    }
+    size_t hiddenSize[] = {8, 6};
+    Activation hiddenActivation[] = {relu, tanH};
+    Network* network = createNetwork(4, 2, hiddenSize, hiddenActivation, 3, softmax);
+    startProfiling(100);
+    assert(findOp("multiplyInto", -1).calls == 0);
+    batchGradientDescent(network, data, classes, CROSS_ENTROPY_LOSS, batchSize, .1, 0, 0, .9, steps, 1, 0);
+    stopProfiling();
+    assert(findOp("trainBatch", -1).calls == steps);
+    assert(findOp("applyGradient", -1).calls == steps);
+    assert(findOp("applyGradient", -1).flops == 6.0 * network->numParameters * steps);
+    assert(findOp("shuffle", -1).calls == steps * batchSize / rows);
+    for (i = 0; i < network->numConnections; i++){
+        Connection* connection = network->connections[i];
+        ProfileOp forward = findOp("layerForward", i);
+        assert(forward.calls == steps * batchSize);
+        assert(forward.flops == steps * batchSize * 2.0 * connection->weights->rows * connection->weights->cols);
+        assert(findOp("layerBackward", i).calls == steps * batchSize);
+    }
+    assert(findOp("softmax", -1).calls == steps * batchSize && findOp("tanH", -1).calls == steps * batchSize);
+    ProfileOp batch = findOp("trainBatch", -1), forward = findOp("layerForward", 0);
+    assert(batch.nanoseconds > 0 && batch.nanoseconds >= forward.nanoseconds);
+
+    // test only the first calls are kept for the trace
+    assert(profileThreads[0]->numEvents == 100 && profileThreads[0]->droppedEvents > 0);
+    assert(writeProfileTrace(TRACE) == 0);
+    assert(countOccurrences(TRACE, "\"ph\": \"X\"") == 100);
+    assert(countOccurrences(TRACE, "\"thread_name\"") == profileNumThreads);
+    FILE* summary = tmpfile();
+    printProfile(summary, 1);
+    rewind(summary);
+    char line[256];
+    int sawForward = 0;
+    while (fgets(line, sizeof(line), summary) != NULL){
+        sawForward |= strncmp(line, "layerForward[0] ", 16) == 0;
+    }
+    fclose(summary);
+    assert(sawForward);
+
+#ifdef CRANIUM_USE_POSIX
+    // test evaluation threads record on their own slots, and their calls
+    // add up to the chunks evaluated
+    startProfiling(10000);
+    evaluateNetwork(network, data, classes, 7, 3);
+    stopProfiling();
+    assert(findOp("layerForward", 2).calls == (rows + 6) / 7);
+    int recording = 0;
+    for (i = 0; i < profileNumThreads; i++){
+        recording += profileThreads[i]->numOps > 0;
+    }
+    assert(recording >= 2);
+    assert(writeProfileTrace(TRACE) == 0);
+    assert(countOccurrences(TRACE, "\"name\": \"layerForward[") == (rows + 6) / 7 * 3);
+#endif
+
+    remove(TRACE);
+    destroyNetwork(network);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    destroyMatrix(A);
+    destroyMatrix(B);
+    destroyMatrix(C);
+
+    return 0;
+}
\ No newline at end of file
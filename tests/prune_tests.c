@@ -0,0 +1,139 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/sparse.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/prune.h"
+
+int main(){
+    // test sparse matrix creation
+    float* A_data = (float*)calloc(4 * 5, sizeof(float));
+    A_data[1] = 2;
+    A_data[7] = -1;
+    A_data[19] = 3;
+    Matrix* A = createMatrix(4, 5, A_data);
+    SparseMatrix* sparseA = createSparseMatrix(A);
+    assert(sparseA->nonZero == 3);
+    assert(sparseA->rowStart[0] == 0 && sparseA->rowStart[1] == 1 && sparseA->rowStart[4] == 3);
+    assert(sparseA->colIndex[1] == 2 && sparseA->values[1] == -1);
+    assert(fabsf(sparseDensity(sparseA) - .15) < 1e-6);
+    Matrix* denseA = sparseToMatrix(sparseA);
+    assert(equals(A, denseA));
+
+    // test dense x sparse multiplication
+    float* B_data = (float*)malloc(sizeof(float) * 3 * 4);
+    int i, j;
+    for (i = 0; i < 12; i++){
+        B_data[i] = i - 4;
+    }
+    Matrix* B = createMatrix(3, 4, B_data);
+    Matrix* expected = multiply(B, A);
+    Matrix* actual = createMatrixZeroes(3, 5);
+    multiplyDenseSparseInto(B, sparseA, actual);
+    assert(equals(expected, actual));
+
+    // test refreshing zeroes entries outside the pattern
+    A->data[0] = 5;
+    A->data[1] = 4;
+    refreshSparseFrom(A, sparseA);
+    assert(A->data[0] == 0 && sparseA->values[0] == 4);
+
+    // test pruning to a sparsity
+    srand(time(NULL));
+    size_t hiddenSize[] = {40};
+    Activation hiddenActivation[] = {relu};
+    Network* network = createNetwork(20, 1, hiddenSize, hiddenActivation, 3, softmax);
+    Matrix* input = createMatrixZeroes(6, 20);
+    for (i = 0; i < 6 * 20; i++){
+        input->data[i] = (i % 9) / 4.0 - 1;
+    }
+    pruneNetwork(network, .8);
+    assert(fabsf(networkSparsity(network) - .8) < .01);
+    assert(network->connections[0]->sparseWeights->nonZero == 20 * 40 / 5);
+
+    // test sparse forward pass against dense forward pass
+    forwardPass(network, input);
+    Matrix* sparseOutput = copy(getOuput(network));
+    densifyConnection(network->connections[0]);
+    densifyConnection(network->connections[1]);
+    forwardPass(network, input);
+    for (i = 0; i < 6; i++){
+        for (j = 0; j < 3; j++){
+            assert(fabsf(getMatrix(sparseOutput, i, j) - getMatrix(getOuput(network), i, j)) < 1e-5);
+        }
+    }
+
+    // test fine-tuning keeps pruned weights at zero
+    float** data = (float**)malloc(sizeof(float*) * 6);
+    float** classes = (float**)malloc(sizeof(float*) * 6);
+    for (i = 0; i < 6; i++){
+        data[i] = (float*)malloc(sizeof(float) * 20);
+        memcpy(data[i], input->data + i * 20, sizeof(float) * 20);
+        classes[i] = (float*)calloc(3, sizeof(float));
+        classes[i][i % 3] = 1;
+    }
+    DataSet* trainingData = createDataSet(6, 20, data);
+    DataSet* trainingClasses = createDataSet(6, 3, classes);
+    ParameterSet params = {network, trainingData, trainingClasses, CROSS_ENTROPY_LOSS, 3, .1, 0, .001, .9, 20, 1, 0};
+    pruneAndFineTune(params, .5, 2);
+    assert(networkSparsity(network) >= .5);
+    size_t nonZero = network->connections[0]->sparseWeights->nonZero;
+    optimize(params);
+    size_t count = 0;
+    for (i = 0; i < 20 * 40; i++){
+        count += network->connections[0]->weights->data[i] != 0;
+    }
+    assert(count <= nonZero);
+
+    // test serialization keeps the pattern
+    saveNetwork(network, "pruned_network.pkl");
+    Network* fromFile = readNetwork("pruned_network.pkl");
+    assert(fromFile->connections[0]->sparseWeights != NULL);
+    assert(fromFile->connections[0]->sparseWeights->nonZero == network->connections[0]->sparseWeights->nonZero);
+
+    // test structured pruning of dead neurons leaves outputs unchanged
+    size_t hiddenSizes[] = {6, 5};
+    Activation hiddenActivations[] = {relu, relu};
+    Network* wide = createNetwork(20, 2, hiddenSizes, hiddenActivations, 3, softmax);
+    for (i = 0; i < 20; i++){
+        setMatrix(wide->connections[0]->weights, i, 1, 0);
+        setMatrix(wide->connections[0]->weights, i, 4, 0);
+    }
+    setMatrix(wide->connections[0]->bias, 0, 1, -1);
+    setMatrix(wide->connections[0]->bias, 0, 4, -1);
+    forwardPass(wide, input);
+    Matrix* wideOutput = copy(getOuput(wide));
+    assert(pruneNeurons(wide, trainingData, 0, 0) >= 2);
+    assert(wide->layers[1]->size <= 4);
+    assert(wide->connections[0]->weights->cols == wide->layers[1]->size);
+    assert(wide->connections[0]->bias->cols == wide->layers[1]->size);
+    assert(wide->connections[1]->weights->rows == wide->layers[1]->size);
+    forwardPass(wide, input);
+    for (i = 0; i < 6; i++){
+        for (j = 0; j < 3; j++){
+            assert(fabsf(getMatrix(wideOutput, i, j) - getMatrix(getOuput(wide), i, j)) < 1e-5);
+        }
+    }
+    params.network = wide;
+    optimize(params);
+
+    // test destroy
+    destroyMatrix(wideOutput);
+    destroyNetwork(wide);
+    destroyMatrix(A);
+    destroyMatrix(denseA);
+    destroySparseMatrix(sparseA);
+    destroyMatrix(B);
+    destroyMatrix(expected);
+    destroyMatrix(actual);
+    destroyMatrix(input);
+    destroyMatrix(sparseOutput);
+    destroyDataSet(trainingData);
+    destroyDataSet(trainingClasses);
+    destroyNetwork(network);
+    destroyNetwork(fromFile);
+
+    return 0;
+}
\ No newline at end of file
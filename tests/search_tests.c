@@ -0,0 +1,188 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/placement.h"
+#include "../src/search.h"
+
+static void square(void* item){
+    int* value = (int*)item;
+    *value = *value * *value;
+}
+
+// builds $rows points labelled by whether they lie above y = x^2
+static void parabolaData(size_t rows, DataSet** data, DataSet** classes){
+    float** points = (float**)malloc(sizeof(float*) * rows);
+    float** labels = (float**)malloc(sizeof(float*) * rows);
+    size_t i;
+    for (i = 0; i < rows; i++){
+        points[i] = (float*)malloc(sizeof(float) * 2);
+        labels[i] = (float*)calloc(2, sizeof(float));
+        points[i][0] = 2.0 * rand() / RAND_MAX - 1;
+        points[i][1] = 1.0 * rand() / RAND_MAX;
+        labels[i][points[i][0] * points[i][0] <= points[i][1] ? 0 : 1] = 1;
+    }
+    *data = createDataSet(rows, 2, points);
+    *classes = createDataSet(rows, 2, labels);
+}
+
+int main(){
+    srand(time(NULL));
+    int i;
+    size_t t;
+
+    // test the pool visits every item exactly once
+    int items[100];
+    for (i = 0; i < 100; i++){
+        items[i] = i;
+    }
+    parallelForEach(items, 100, sizeof(int), square, 3, NULL);
+    for (i = 0; i < 100; i++){
+        assert(items[i] == i * i);
+    }
+
+    // and so does a pinned pool, down to a single pinned thread
+    CpuTopology* topology = detectTopology();
+    parallelForEach(items, 10, sizeof(int), square, 3, topology);
+    parallelForEach(items + 10, 1, sizeof(int), square, 4, topology);
+    for (i = 0; i < 100; i++){
+        assert(items[i] == (i <= 10 ? i * i * i * i : i * i));
+    }
+
+    DataSet* data, *classes, *validationData, *validationClasses;
+    parabolaData(200, &data, &classes);
+    parabolaData(100, &validationData, &validationClasses);
+    float* before = (float*)malloc(sizeof(float) * 200 * 2);
+    for (t = 0; t < 200; t++){
+        memcpy(before + t * 2, data->data[t], sizeof(float) * 2);
+    }
+
+    // test a grid of 12 trials halved down to the best
+    size_t hiddenSize[] = {4};
+    Activation hiddenActivation[] = {tanH};
+    Network* templateNetwork = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    ParameterSet params = {templateNetwork, data, classes, CROSS_ENTROPY_LOSS, 20, .1, 0, 0, 0, 80, 1, 0};
+    float learningRates[] = {.5, .05, .0001};
+    float momentumFactors[] = {0, .9};
+    size_t small[] = {4}, deep[] = {8, 4};
+    size_t* architectures[] = {small, deep};
+    size_t numHiddenLayers[] = {1, 2};
+    SearchSpace space;
+    memset(&space, 0, sizeof(space));
+    space.learningRates = learningRates;
+    space.numLearningRates = 3;
+    space.momentumFactors = momentumFactors;
+    space.numMomentumFactors = 2;
+    space.hiddenSizes = architectures;
+    space.numHiddenLayers = numHiddenLayers;
+    space.numArchitectures = 2;
+    SearchResult* result = searchHyperparameters(params, &space, validationData, validationClasses, 2, 4, NULL);
+    assert(result->numTrials == 12 && result->numRounds == 4);
+
+    // rounds run 10, 20, 40 and 80 steps on 12, 6, 3 and 2 trials
+    int stepCounts[81] = {0};
+    int slowest = 0, deepTrials = 0;
+    for (t = 0; t < result->numTrials; t++){
+        SearchTrial* trial = &result->trials[t];
+        stepCounts[trial->steps]++;
+        slowest += trial->learningRate == .0001f;
+        deepTrials += trial->numHiddenLayers == 2 && trial->hiddenSizes == deep;
+        assert(trial->batchSize == 20 && trial->regularizationStrength == 0);
+        assert(trial->seconds > 0 && trial->state == NULL);
+        assert((trial->network != NULL) == (t == 0));
+        if (t > 0){
+            SearchTrial* previous = &result->trials[t - 1];
+            assert(previous->steps > trial->steps || (previous->steps == trial->steps && previous->loss <= trial->loss));
+        }
+    }
+    assert(stepCounts[10] == 6 && stepCounts[20] == 3 && stepCounts[40] == 1 && stepCounts[80] == 2);
+    assert(slowest == 4 && deepTrials == 6);
+
+    // the reported score is the returned network's
+    Network* best = result->trials[0].network;
+    Evaluation evaluation = evaluateNetwork(best, validationData, validationClasses, EVALUATION_CHUNK_ROWS, 1);
+    assert((float)(evaluation.crossEntropy / evaluation.rows) == result->trials[0].loss);
+    assert((float)evaluation.numCorrect / evaluation.rows == result->trials[0].accuracy);
+    printf("best of %zu trials: rate %g, momentum %g, %zu hidden layers, loss %f, accuracy %f in %.3fs\n", result->numTrials, result->trials[0].learningRate, result->trials[0].momentumFactor, result->trials[0].numHiddenLayers, result->trials[0].loss, result->trials[0].accuracy, result->seconds);
+    destroySearchResult(result);
+
+    // test k-fold cross-validation against one fold trained by hand
+    params.maxIters = 50;
+    params.shuffle = 0;
+    Network* untouched = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    copyNetworkParameters(templateNetwork, untouched);
+    CrossValidation* validation = crossValidate(params, 5, 3, topology);
+    assert(validation->numFolds == 5);
+    assert(memcmp(untouched->parameters, templateNetwork->parameters, sizeof(float) * templateNetwork->numParameters) == 0);
+    size_t heldOut[40], kept[160];
+    for (t = 0; t < 200; t++){
+        if (t < 40){
+            heldOut[t] = t;
+        }
+        else{
+            kept[t - 40] = t;
+        }
+    }
+    DataSet* keptData = createDataSetView(data, kept, 160);
+    DataSet* keptClasses = createDataSetView(classes, kept, 160);
+    DataSet* heldOutData = createDataSetView(data, heldOut, 40);
+    DataSet* heldOutClasses = createDataSetView(classes, heldOut, 40);
+    batchGradientDescent(untouched, keptData, keptClasses, CROSS_ENTROPY_LOSS, 20, .1, 0, 0, 0, 50, 0, 0);
+    evaluation = evaluateNetwork(untouched, heldOutData, heldOutClasses, EVALUATION_CHUNK_ROWS, 1);
+    assert((float)(evaluation.crossEntropy / evaluation.rows) == validation->loss[0]);
+    assert((float)evaluation.numCorrect / evaluation.rows == validation->accuracy[0]);
+    float meanLoss = 0, meanAccuracy = 0, squares = 0;
+    for (i = 0; i < 5; i++){
+        meanLoss += validation->loss[i] / 5;
+        meanAccuracy += validation->accuracy[i] / 5;
+    }
+    for (i = 0; i < 5; i++){
+        squares += (validation->loss[i] - meanLoss) * (validation->loss[i] - meanLoss);
+    }
+    assert(fabsf(validation->meanLoss - meanLoss) < 1e-5 && fabsf(validation->meanAccuracy - meanAccuracy) < 1e-5);
+    assert(fabsf(validation->deviationLoss - sqrtf(squares / 5)) < 1e-5);
+    printf("5-fold loss %f +- %f, accuracy %f +- %f\n", validation->meanLoss, validation->deviationLoss, validation->meanAccuracy, validation->deviationAccuracy);
+    destroyCrossValidation(validation);
+    destroyDataSetView(keptData);
+    destroyDataSetView(keptClasses);
+    destroyDataSetView(heldOutData);
+    destroyDataSetView(heldOutClasses);
+    destroyNetwork(untouched);
+
+    // shuffled folds still cover every row once
+    params.shuffle = 1;
+    validation = crossValidate(params, 7, 2, NULL);
+    for (i = 0; i < 7; i++){
+        assert(validation->accuracy[i] >= 0 && validation->accuracy[i] <= 1);
+    }
+    destroyCrossValidation(validation);
+
+    // the shared data is read only
+    for (t = 0; t < 200; t++){
+        assert(memcmp(before + t * 2, data->data[t], sizeof(float) * 2) == 0);
+    }
+
+    // test an empty space keeps the template, and no halving trains to the end
+    SearchSpace empty;
+    memset(&empty, 0, sizeof(empty));
+    params.batchSize = 1000;
+    params.maxIters = 80;
+    result = searchHyperparameters(params, &empty, NULL, NULL, 1, 2, topology);
+    assert(result->numTrials == 1 && result->numRounds == 1);
+    assert(result->trials[0].steps == 80 && result->trials[0].batchSize == 200);
+    assert(result->trials[0].numHiddenLayers == 1 && result->trials[0].hiddenSizes[0] == 4);
+    assert(result->trials[0].network->layers[1]->activation == tanH);
+    destroySearchResult(result);
+
+    free(before);
+    destroyTopology(topology);
+    destroyNetwork(templateNetwork);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+    destroyDataSet(validationData);
+    destroyDataSet(validationClasses);
+
+    return 0;
+}
\ No newline at end of file
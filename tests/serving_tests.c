@@ -0,0 +1,139 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/binary.h"
+#include "../src/serving.h"
+
+// a network whose every output is $value, whatever the input
+static Network* constantNetwork(float value){
+    size_t hiddenSize[] = {4};
+    Activation hiddenActivation[] = {relu};
+    Network* network = createNetwork(3, 1, hiddenSize, hiddenActivation, 2, linear);
+    zeroMatrix(network->connections[0]->weights);
+    zeroMatrix(network->connections[1]->weights);
+    int i;
+    for (i = 0; i < 2; i++){
+        network->connections[1]->bias->data[i] = value;
+    }
+    return network;
+}
+
+typedef struct ReaderArgs_ {
+    ModelServer* server;
+    int stop;
+    int passes;
+    int failures;
+} ReaderArgs;
+
+static void* runReader(void* arg){
+    ReaderArgs* args = (ReaderArgs*)arg;
+    int reader = registerReader(args->server);
+    assert(reader >= 0);
+    float inputData[2 * 3] = {1, 2, 3, 4, 5, 6};
+    Matrix input = {2, 3, inputData};
+    Workspace* workspace = createWorkspace(acquireNetwork(args->server, reader), 2);
+    releaseNetwork(args->server, reader);
+    while (!__atomic_load_n(&args->stop, __ATOMIC_ACQUIRE)){
+        Matrix* output = serveForwardPass(args->server, reader, workspace, &input);
+
+        // every output of one pass comes from the same network
+        int i;
+        for (i = 1; i < 4; i++){
+            args->failures += output->data[i] != output->data[0];
+        }
+        args->passes++;
+    }
+    destroyWorkspace(workspace);
+    return NULL;
+}
+
+int main(){
+    srand(time(NULL));
+
+    // test workspace passes match forwardPass and leave the network alone
+    size_t hiddenSize[] = {5, 4};
+    Activation hiddenActivation[] = {relu, tanH};
+    Network* network = createNetwork(3, 2, hiddenSize, hiddenActivation, 2, softmax);
+    Matrix* input = createMatrixZeroes(3, 3);
+    int i;
+    for (i = 0; i < 9; i++){
+        input->data[i] = i - 4;
+    }
+    forwardPass(network, input);
+    Matrix* expected = copy(getOuput(network));
+    Workspace* workspace = createWorkspace(network, 1);
+    Matrix* output = forwardPassWorkspace(network, workspace, input);
+    assert(equals(output, expected) && workspace->maxRows == 3);
+    assert(equals(getOuput(network), expected));
+
+    // test a workspace follows a network of another shape
+    Network* constant = constantNetwork(7);
+    output = forwardPassWorkspace(constant, workspace, input);
+    assert(output->rows == 3 && output->cols == 2 && output->data[5] == 7);
+    destroyWorkspace(workspace);
+    destroyNetwork(constant);
+
+    // test a held network is not freed until released
+    ModelServer* server = createModelServer(constantNetwork(0), 8);
+    int reader = registerReader(server);
+    Network* held = acquireNetwork(server, reader);
+    publishNetwork(server, constantNetwork(1));
+    assert(reclaimNetworks(server) == 1);
+    assert(held->connections[1]->bias->data[0] == 0);
+    releaseNetwork(server, reader);
+    assert(reclaimNetworks(server) == 0);
+    assert(acquireNetwork(server, reader)->connections[1]->bias->data[0] == 1);
+    releaseNetwork(server, reader);
+
+    // test serving workspaces hold one evaluation chunk, as tuning sets it
+    EvaluationDefaults defaults = {48, 2};
+    setEvaluationDefaults(defaults);
+    Workspace* serving = createServingWorkspace(server, reader);
+    assert(serving->maxRows == 48 && serving->activations[2]->cols == 2);
+    destroyWorkspace(serving);
+    defaults.chunkRows = EVALUATION_CHUNK_ROWS;
+    defaults.numThreads = 1;
+    setEvaluationDefaults(defaults);
+
+    // test reloading from a file
+    saveNetworkBinary(network, "serving.bin");
+    reloadNetworkAsync(server, "serving.bin", readNetworkBinary);
+    assert(waitForReload(server) == 0);
+    assert(equals(server->current->connections[0]->weights, network->connections[0]->weights));
+    reloadNetworkAsync(server, "missing.bin", readNetworkBinary);
+    assert(waitForReload(server) != 0);
+    destroyModelServer(server);
+
+#ifdef CRANIUM_USE_POSIX
+    // test readers under continuous publishing see whole networks only
+    server = createModelServer(constantNetwork(0), 8);
+    ReaderArgs args[4];
+    pthread_t threads[4];
+    for (i = 0; i < 4; i++){
+        args[i].server = server;
+        args[i].stop = 0;
+        args[i].passes = 0;
+        args[i].failures = 0;
+        pthread_create(&threads[i], NULL, runReader, &args[i]);
+    }
+    for (i = 1; i <= 200; i++){
+        publishNetwork(server, constantNetwork(i));
+    }
+    for (i = 0; i < 4; i++){
+        __atomic_store_n(&args[i].stop, 1, __ATOMIC_RELEASE);
+        pthread_join(threads[i], NULL);
+        assert(args[i].failures == 0);
+    }
+    assert(reclaimNetworks(server) == 0);
+    destroyModelServer(server);
+#endif
+
+    // test destroy
+    destroyMatrix(input);
+    destroyMatrix(expected);
+    destroyNetwork(network);
+
+    return 0;
+}
\ No newline at end of file
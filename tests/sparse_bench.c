@@ -0,0 +1,61 @@
+#include "../src/cranium.h"
+
+// compares the cost of a training step on wide inputs with few non-zero
+// features when they are given densely and sparsely
+int main(){
+    srand(1);
+    size_t numFeatures = 100000, nonZero = 30, rows = 64;
+    size_t hiddenSize[] = {64};
+    Activation hiddenActivation[] = {relu};
+    Network* network = createNetwork(numFeatures, 1, hiddenSize, hiddenActivation, 10, softmax);
+    size_t* rowStart = (size_t*)malloc(sizeof(size_t) * (rows + 1));
+    size_t* colIndex = (size_t*)malloc(sizeof(size_t) * rows * nonZero);
+    float* values = (float*)malloc(sizeof(float) * rows * nonZero);
+    size_t i, j;
+    for (i = 0; i < rows; i++){
+        rowStart[i] = i * nonZero;
+        for (j = 0; j < nonZero; j++){
+            colIndex[i * nonZero + j] = j * (numFeatures / nonZero) + rand() % (numFeatures / nonZero);
+            values[i * nonZero + j] = 1;
+        }
+    }
+    rowStart[rows] = rows * nonZero;
+    SparseMatrix* sparse = createSparseMatrixFrom(rows, numFeatures, rowStart, colIndex, values);
+    Matrix* dense = sparseToMatrix(sparse);
+    Matrix* target = createMatrixZeroes(1, 10);
+    target->data[0] = 1;
+
+    TrainingState* state = createTrainingState(network, CROSS_ENTROPY_LOSS);
+    Matrix* example = createMatrix(1, numFeatures, NULL);
+    int denseSteps = 4, sparseSteps = 200, step;
+    clock_t start = clock();
+    for (step = 0; step < denseSteps; step++){
+        for (i = 0; i < rows; i++){
+            example->data = dense->data + i * numFeatures;
+            accumulateGradient(state, example, target);
+        }
+        applyGradient(state, .01, 0, 0, rows);
+    }
+    double denseTime = (double)(clock() - start) / CLOCKS_PER_SEC / (denseSteps * rows);
+
+    start = clock();
+    for (step = 0; step < sparseSteps; step++){
+        for (i = 0; i < rows; i++){
+            SparseMatrix row = sparseRows(sparse, i, 1);
+            accumulateGradientSparse(state, &row, target);
+        }
+        applyGradient(state, .01, 0, 0, rows);
+    }
+    double sparseTime = (double)(clock() - start) / CLOCKS_PER_SEC / (sparseSteps * rows);
+    printf("%zu features, %zu non-zero per example, 64 hidden\n", numFeatures, nonZero);
+    printf("dense  %10.1f us/example\n", denseTime * 1e6);
+    printf("sparse %10.1f us/example (%.0fx)\n", sparseTime * 1e6, denseTime / sparseTime);
+
+    free(example);
+    destroyMatrix(target);
+    destroyMatrix(dense);
+    destroySparseMatrix(sparse);
+    destroyTrainingState(state);
+    destroyNetwork(network);
+    return 0;
+}
\ No newline at end of file
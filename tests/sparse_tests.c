@@ -0,0 +1,172 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/sparse.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/lowrank.h"
+
+// copies the weights and biases of $from into $to
+static void copyParameters(Network* from, Network* to){
+    int i;
+    for (i = 0; i < from->numConnections; i++){
+        copyValuesInto(from->connections[i]->weights, to->connections[i]->weights);
+        copyValuesInto(from->connections[i]->bias, to->connections[i]->bias);
+    }
+}
+
+// largest difference between the weights and biases of two networks
+static float maxParameterDifference(Network* A, Network* B){
+    float diff = 0;
+    int i;
+    size_t j;
+    for (i = 0; i < A->numConnections; i++){
+        Matrix* wa = A->connections[i]->weights;
+        Matrix* wb = B->connections[i]->weights;
+        for (j = 0; j < wa->rows * wa->cols; j++){
+            diff = MAX(diff, fabsf(wa->data[j] - wb->data[j]));
+        }
+        for (j = 0; j < wa->cols; j++){
+            diff = MAX(diff, fabsf(A->connections[i]->bias->data[j] - B->connections[i]->bias->data[j]));
+        }
+    }
+    return diff;
+}
+
+int main(){
+    srand(time(NULL));
+    int numRows = 40, numFeatures = 60, numClasses = 3;
+    int i, j;
+
+    // build a dataset with a few non-zero features per row, whose class
+    // depends on which features are set
+    float** rows = (float**)malloc(sizeof(float*) * numRows);
+    float** labels = (float**)malloc(sizeof(float*) * numRows);
+    for (i = 0; i < numRows; i++){
+        rows[i] = (float*)calloc(numFeatures, sizeof(float));
+        labels[i] = (float*)calloc(numClasses, sizeof(float));
+        int label = i % numClasses;
+        labels[i][label] = 1;
+        for (j = 0; j < 4; j++){
+            rows[i][(label * 20 + rand() % 20)] = 1 + (rand() % 4) / 4.0;
+        }
+    }
+    DataSet* data = createDataSet(numRows, numFeatures, rows);
+    DataSet* classes = createDataSet(numRows, numClasses, labels);
+
+    // test conversion and row views
+    SparseMatrix* sparse = createSparseDataSet(data);
+    size_t count = 0;
+    for (i = 0; i < numRows; i++){
+        for (j = 0; j < numFeatures; j++){
+            count += data->data[i][j] != 0;
+        }
+    }
+    assert(sparse->rows == numRows && sparse->cols == numFeatures && sparse->nonZero == count);
+    Matrix* dense = dataSetToMatrix(data);
+    Matrix* roundTrip = sparseToMatrix(sparse);
+    assert(equals(dense, roundTrip));
+    SparseMatrix view = sparseRows(sparse, 5, 3);
+    assert(view.rows == 3 && view.nonZero == sparse->rowStart[8] - sparse->rowStart[5]);
+    assert(view.colIndex[view.rowStart[0]] == sparse->colIndex[sparse->rowStart[5]]);
+
+    // test sparse x dense multiplication
+    Matrix* B = createMatrixZeroes(numFeatures, 7);
+    for (i = 0; i < numFeatures * 7; i++){
+        B->data[i] = (i % 11) / 5.0 - 1;
+    }
+    Matrix* expected = multiply(dense, B);
+    Matrix* actual = createMatrixZeroes(numRows, 7);
+    multiplySparseDenseInto(sparse, B, actual);
+    assert(equals(expected, actual));
+
+    // test sparse transpose x dense only writes the touched rows
+    Matrix* C = createMatrixZeroes(3, 7);
+    for (i = 0; i < 3 * 7; i++){
+        C->data[i] = i / 7.0;
+    }
+    Matrix* viewDense = sparseToMatrix(&view);
+    Matrix* viewT = transpose(viewDense);
+    Matrix* expectedT = multiply(viewT, C);
+    Matrix* actualT = createMatrixZeroes(numFeatures, 7);
+    addSparseTransposeMultiply(&view, C, actualT);
+    for (i = 0; i < numFeatures * 7; i++){
+        assert(fabsf(expectedT->data[i] - actualT->data[i]) < 1e-5);
+    }
+
+    // test sparse forward pass against dense forward pass
+    size_t hiddenSize[] = {8};
+    Activation hiddenActivation[] = {relu};
+    Network* network = createNetwork(numFeatures, 1, hiddenSize, hiddenActivation, numClasses, softmax);
+    forwardPass(network, dense);
+    Matrix* denseOutput = copy(getOuput(network));
+    forwardPassSparse(network, sparse);
+    for (i = 0; i < numRows * numClasses; i++){
+        assert(fabsf(denseOutput->data[i] - getOuput(network)->data[i]) < 1e-6);
+    }
+    Workspace* workspace = createWorkspace(network, 4);
+    Matrix* workspaceOutput = forwardPassWorkspaceSparse(network, workspace, sparse);
+    for (i = 0; i < numRows * numClasses; i++){
+        assert(fabsf(denseOutput->data[i] - workspaceOutput->data[i]) < 1e-6);
+    }
+
+    // test factorized first connections multiply through the factors
+    factorizeConnection(network->connections[0], 4);
+    forwardPass(network, dense);
+    copyValuesInto(getOuput(network), denseOutput);
+    forwardPassSparse(network, sparse);
+    for (i = 0; i < numRows * numClasses; i++){
+        assert(fabsf(denseOutput->data[i] - getOuput(network)->data[i]) < 1e-5);
+    }
+    unfactorizeConnection(network->connections[0]);
+
+    // test sparse evaluation against dense evaluation
+    Evaluation denseEvaluation = evaluateNetwork(network, data, classes, 7, 1);
+    Evaluation sparseEvaluation = evaluateNetworkSparse(network, sparse, classes, 7, 2);
+    assert(denseEvaluation.numCorrect == sparseEvaluation.numCorrect);
+    assert(fabs(denseEvaluation.crossEntropy - sparseEvaluation.crossEntropy) < 1e-4);
+    assert(accuracy(network, data, classes) == accuracySparse(network, sparse, classes));
+
+    // test sparse training matches dense training without regularization
+    // or momentum, with and without hidden layers
+    int h;
+    for (h = 0; h < 2; h++){
+        Network* denseNet = createNetwork(numFeatures, h, hiddenSize, hiddenActivation, numClasses, softmax);
+        Network* sparseNet = createNetwork(numFeatures, h, hiddenSize, hiddenActivation, numClasses, softmax);
+        copyParameters(denseNet, sparseNet);
+        srand(7);
+        batchGradientDescent(denseNet, data, classes, CROSS_ENTROPY_LOSS, 8, .5, 0, 0, 0, 30, 1, 0);
+        srand(7);
+        batchGradientDescentSparse(sparseNet, sparse, classes, CROSS_ENTROPY_LOSS, 8, .5, 0, 0, 0, 30, 1, 0);
+        assert(maxParameterDifference(denseNet, sparseNet) < 1e-5);
+        destroyNetwork(denseNet);
+        destroyNetwork(sparseNet);
+    }
+
+    // test sparse training with regularization and momentum learns
+    Network* learner = createNetwork(numFeatures, 1, hiddenSize, hiddenActivation, numClasses, softmax);
+    batchGradientDescentSparse(learner, sparse, classes, CROSS_ENTROPY_LOSS, 4, .5, 0, .0001, .5, 300, 1, 0);
+    assert(accuracySparse(learner, sparse, classes) > .9);
+
+    // test destroy
+    destroyNetwork(learner);
+    destroyNetwork(network);
+    destroyWorkspace(workspace);
+    destroyMatrix(denseOutput);
+    destroyMatrix(expected);
+    destroyMatrix(actual);
+    destroyMatrix(expectedT);
+    destroyMatrix(actualT);
+    destroyMatrix(viewDense);
+    destroyMatrix(viewT);
+    destroyMatrix(B);
+    destroyMatrix(C);
+    destroyMatrix(dense);
+    destroyMatrix(roundTrip);
+    destroySparseMatrix(sparse);
+    destroyDataSet(data);
+    destroyDataSet(classes);
+
+    return 0;
+}
\ No newline at end of file
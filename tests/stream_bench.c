@@ -0,0 +1,46 @@
+#include "../src/cranium.h"
+#include <sys/resource.h>
+
+// trains from a dataset file larger than the memory budget and reports
+// the peak resident size
+static double seconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static long peakKilobytes(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(){
+    srand(1);
+    size_t rows = 200000, features = 256, i, j;
+    DataWriter* writer = createDataWriter("bench_data.bin", features, 10, 1);
+    float row[256];
+    for (i = 0; i < rows; i++){
+        for (j = 0; j < features; j++){
+            row[j] = (float)rand() / RAND_MAX;
+        }
+        writeDataLabel(writer, row, i % 10);
+    }
+    closeDataWriter(writer);
+    long before = peakKilobytes();
+
+    size_t hiddenSize[] = {64};
+    Activation hiddenActivation[] = {relu};
+    Network* network = createNetwork(features, 1, hiddenSize, hiddenActivation, 10, softmax);
+    DataFile* file = openDataFile("bench_data.bin");
+    size_t budget = 16 << 20;
+    double start = seconds();
+    streamingGradientDescent(network, file, CROSS_ENTROPY_LOSS, 32, .01, 0, 0, .9, 1, budget, 8, 0);
+    printf("dataset: %zu MB, budget: %zu MB\n", rows * file->header.rowSize >> 20, budget >> 20);
+    printf("trained one pass in %f s, peak resident %ld MB (%ld MB before training)\n", seconds() - start, peakKilobytes() >> 10, before >> 10);
+
+    closeDataFile(file);
+    destroyNetwork(network);
+    remove("bench_data.bin");
+    return 0;
+}
\ No newline at end of file
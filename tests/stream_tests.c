@@ -0,0 +1,124 @@
+#include "../src/std_includes.h"
+#include "../src/matrix.h"
+#include "../src/function.h"
+#include "../src/layer.h"
+#include "../src/network.h"
+#include "../src/optimizer.h"
+#include "../src/stream.h"
+
+int main(){
+    srand(time(NULL));
+    assert(sizeof(DataFileHeader) == 64);
+
+    // two linearly separable classes
+    size_t rows = 1000;
+    float** data = (float**)malloc(sizeof(float*) * rows);
+    float** classes = (float**)malloc(sizeof(float*) * rows);
+    size_t i;
+    for (i = 0; i < rows; i++){
+        data[i] = (float*)malloc(sizeof(float) * 2);
+        classes[i] = (float*)calloc(2, sizeof(float));
+        data[i][0] = (float)rand() / RAND_MAX * 2 - 1;
+        data[i][1] = (float)rand() / RAND_MAX * 2 - 1;
+        classes[i][data[i][0] + data[i][1] > 0 ? 1 : 0] = 1;
+    }
+    DataSet* dataSet = createDataSet(rows, 2, data);
+    DataSet* classSet = createDataSet(rows, 2, classes);
+
+    // test round trip of target and label files
+    assert(saveDataSetBinary(dataSet, classSet, "targets.bin", 0) == 0);
+    assert(saveDataSetBinary(dataSet, classSet, "labels.bin", 1) == 0);
+    DataFile* targetFile = openDataFile("targets.bin");
+    DataFile* labelFile = openDataFile("labels.bin");
+    assert(targetFile != NULL && labelFile != NULL);
+    assert(targetFile->header.rows == rows && labelFile->header.rows == rows);
+    assert(targetFile->header.rowSize == 16 && labelFile->header.rowSize == 12);
+    unsigned char buffer[16 * 10];
+    float targets[2];
+    assert(readDataRows(labelFile, 500, 10, buffer) == 0);
+    for (i = 0; i < 10; i++){
+        void* row = buffer + i * labelFile->header.rowSize;
+        assert(memcmp(dataRowFeatures(labelFile, row), data[500 + i], sizeof(float) * 2) == 0);
+        dataRowTargets(labelFile, row, targets);
+        assert(memcmp(targets, classes[500 + i], sizeof(float) * 2) == 0);
+    }
+    assert(readDataRows(targetFile, rows - 5, 5, buffer) == 0);
+    dataRowTargets(targetFile, buffer + 4 * 16, targets);
+    assert(memcmp(targets, classes[rows - 1], sizeof(float) * 2) == 0);
+    assert(readDataRows(targetFile, rows - 5, 6, buffer) != 0);
+
+    // test truncated and missing files are rejected
+    FILE* fp = fopen("truncated.bin", "wb");
+    fwrite(&targetFile->header, sizeof(DataFileHeader), 1, fp);
+    fclose(fp);
+    assert(openDataFile("truncated.bin") == NULL);
+    assert(openDataFile("missing.bin") == NULL);
+
+    // test streaming training learns with a budget far below the dataset
+    size_t hiddenSize[] = {8};
+    Activation hiddenActivation[] = {relu};
+    Network* network = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    StreamParameterSet params = {network, labelFile, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .5, 10, 2000, 4, 0};
+    assert(optimizeStream(params) == 10 * rows / 10);
+    assert(accuracy(network, dataSet, classSet) > .9);
+    destroyNetwork(network);
+
+    // test training on float targets
+    network = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    assert(streamingGradientDescent(network, targetFile, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .5, 10, 100000, 1, 0) == 10 * rows / 10);
+    assert(accuracy(network, dataSet, classSet) > .9);
+    destroyNetwork(network);
+
+    // test seeding rand() reproduces a run, whose shuffles draw from their
+    // own generator once seeded
+    network = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    Network* again = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    copyNetworkParameters(network, again);
+    srand(11);
+    assert(streamingGradientDescent(network, labelFile, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .5, 2, 2000, 4, 0) == 2 * rows / 10);
+    srand(11);
+    assert(streamingGradientDescent(again, labelFile, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .5, 2, 2000, 4, 0) == 2 * rows / 10);
+    assert(memcmp(network->parameters, again->parameters, sizeof(float) * network->numParameters) == 0);
+    destroyNetwork(again);
+
+    // test a budget too small for a row per chunk is refused, untrained
+    again = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    copyNetworkParameters(network, again);
+    assert(streamingGradientDescent(network, labelFile, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .5, 2, 4 * (2 * 12 + sizeof(size_t)) - 1, 4, 0) == -1);
+    assert(memcmp(network->parameters, again->parameters, sizeof(float) * network->numParameters) == 0);
+    destroyNetwork(again);
+    destroyNetwork(network);
+
+    // test an invalid label and a file cut short mid-stream stop training
+    // with an error rather than ending it quietly
+    assert(saveDataSetBinary(dataSet, classSet, "broken.bin", 1) == 0);
+    fp = fopen("broken.bin", "r+b");
+    int32_t badLabel = 7;
+    fseek(fp, sizeof(DataFileHeader) + (rows / 2) * labelFile->header.rowSize + 2 * sizeof(float), SEEK_SET);
+    fwrite(&badLabel, sizeof(badLabel), 1, fp);
+    fclose(fp);
+    DataFile* brokenFile = openDataFile("broken.bin");
+    assert(brokenFile != NULL);
+    assert(readDataRows(brokenFile, rows / 2, 1, buffer) == 0);
+    assert(dataRowTargets(brokenFile, buffer, targets) == -1);
+    network = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    assert(streamingGradientDescent(network, brokenFile, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .5, 2, 2000, 4, 0) == -1);
+    closeDataFile(brokenFile);
+    destroyNetwork(network);
+    assert(saveDataSetBinary(dataSet, classSet, "broken.bin", 1) == 0);
+    brokenFile = openDataFile("broken.bin");
+    assert(brokenFile != NULL);
+    assert(truncate("broken.bin", sizeof(DataFileHeader) + (rows / 2) * labelFile->header.rowSize) == 0);
+    network = createNetwork(2, 1, hiddenSize, hiddenActivation, 2, softmax);
+    assert(streamingGradientDescent(network, brokenFile, CROSS_ENTROPY_LOSS, 10, .1, 0, 0, .5, 2, 2000, 4, 0) == -1);
+    closeDataFile(brokenFile);
+
+    // test destroy
+    destroyNetwork(network);
+    closeDataFile(targetFile);
+    closeDataFile(labelFile);
+    destroyDataSet(dataSet);
+    destroyDataSet(classSet);
+
+    return 0;
+}
\ No newline at end of file